@@ -0,0 +1,130 @@
+#!/bin/bash
+
+# =============================================================================
+# TRAFFIC ACCOUNTING (tc-BPF)
+# =============================================================================
+#
+# Counts packets and bytes per 5-tuple on the VM tap ports with the tc-BPF
+# program in tools/bpf, and groups MPTCP subflows by connection token:
+#
+#   vm:
+#     accounting: true        # attach on every --network/--vm
+#
+# The program is attached at priority 1 of the tap clsact hooks, before the
+# IFB redirect of the link emulation (priority 10):
+#
+#   ingress  VM -> bridge ("up"), counted before the "up" shaping
+#   egress   bridge -> VM ("down"), counted before the root qdisc, i.e. the
+#            offered traffic, including what netem later drops
+#
+# All ports share one pinned map (tools/bpf/vkacct.h: VKACCT_MAP_PATH); the
+# vkacct reader turns it into a CSV time series at any resolution.
+
+ACCT_DIR="${MAIN_DIR}/tools/bpf"
+ACCT_PRIO=1
+VKACCT_MAP="/sys/fs/bpf/tc/globals/vk_flows"
+
+accounting_enabled() {
+    [[ "$(parse_yaml "$CONFIG_FILE" "vm.accounting")" == "true" ]]
+}
+
+_accounting_build() {
+    if [ ! -x "$ACCT_DIR/vkacct" ] || [ "$ACCT_DIR/vkacct.c" -nt "$ACCT_DIR/vkacct" ] || \
+       [ "$MAIN_DIR/tools/common/mptcp_token.c" -nt "$ACCT_DIR/vkacct" ] || \
+       [ ! -f "$ACCT_DIR/vkacct.bpf.o" ] || [ "$ACCT_DIR/vkacct.bpf.c" -nt "$ACCT_DIR/vkacct.bpf.o" ]; then
+        log_info "Building vkacct..."
+        make -s -C "$ACCT_DIR" || { log_error "Failed to build vkacct (needs clang)"; return 1; }
+    fi
+}
+
+# tc pins the map under the bpf filesystem
+_accounting_bpffs() {
+    if ! mountpoint -q /sys/fs/bpf; then
+        sudo mount -t bpf bpf /sys/fs/bpf || return 1
+    fi
+}
+
+accounting_attach() {
+    local bridge_id="$1"
+    local tap
+    tap=$(tap_name "$bridge_id")
+
+    if [ ! -d "/sys/class/net/$tap" ]; then
+        log_warning "Tap port $tap not present, no accounting on $bridge_id"
+        return 0
+    fi
+
+    tc_clsact_ensure "$tap" || return 1
+    sudo tc filter replace dev "$tap" ingress prio $ACCT_PRIO handle 1 \
+        bpf da obj "$ACCT_DIR/vkacct.bpf.o" sec tc_ingress || return 1
+    sudo tc filter replace dev "$tap" egress prio $ACCT_PRIO handle 1 \
+        bpf da obj "$ACCT_DIR/vkacct.bpf.o" sec tc_egress || return 1
+    log_info "Accounting attached to $tap"
+}
+
+accounting_detach() {
+    local bridge_id="$1"
+    local tap
+    tap=$(tap_name "$bridge_id")
+
+    [ -d "/sys/class/net/$tap" ] || return 0
+    sudo tc filter del dev "$tap" ingress prio $ACCT_PRIO 2>/dev/null || true
+    sudo tc filter del dev "$tap" egress prio $ACCT_PRIO 2>/dev/null || true
+    tc_clsact_release "$tap"
+}
+
+accounting_setup() {
+    local name_bridges bridge status=0
+    name_bridges=$(get_yaml_subkeys "$CONFIG_FILE" vm.bridges) || return 1
+
+    _accounting_build || return 1
+    _accounting_bpffs || { log_error "Cannot mount the bpf filesystem"; return 1; }
+
+    for bridge in $name_bridges; do
+        accounting_attach "$bridge" || { log_error "Failed to attach accounting to $bridge"; status=1; }
+    done
+    return $status
+}
+
+accounting_teardown() {
+    local name_bridges bridge
+    name_bridges=$(get_yaml_subkeys "$CONFIG_FILE" vm.bridges) || return 1
+
+    for bridge in $name_bridges; do
+        accounting_detach "$bridge"
+    done
+    log_info "Accounting detached (counters kept in $VKACCT_MAP, use --acct clear)"
+}
+
+# Time series of the counters: accounting_export [INTERVAL_MS] [SECONDS]
+# writes $VM_DIR/accounting-<date>.csv until SECONDS elapse (or Ctrl-C)
+accounting_export() {
+    local interval_ms="${1:-100}"
+    local duration="${2:-}"
+    local out args
+
+    _accounting_build || return 1
+    out="$VM_DIR/accounting-$(date +%Y%m%d-%H%M%S).csv"
+    args=(-m "$VKACCT_MAP" -i "$interval_ms" -o "$out")
+    [ -n "$duration" ] && args+=(-d "$duration")
+
+    log_info "Exporting accounting every ${interval_ms}ms to $out"
+    sudo "$ACCT_DIR/vkacct" "${args[@]}" || return 1
+    log_success "Accounting written to $out"
+}
+
+accounting_clear() {
+    _accounting_build || return 1
+    sudo "$ACCT_DIR/vkacct" -m "$VKACCT_MAP" -c
+}
+
+accounting_status() {
+    log_info "Traffic accounting:"
+    if ! sudo test -e "$VKACCT_MAP"; then
+        log_info "  not attached"
+        return 0
+    fi
+    sudo "$ACCT_DIR/vkacct" -m "$VKACCT_MAP" -t -a | column -t -s, | while read -r line; do
+        log_info "  $line"
+    done
+}
@@ -0,0 +1,208 @@
+#!/bin/bash
+
+# =============================================================================
+# HOST PACKET CAPTURE
+# =============================================================================
+#
+# Captures the VM tap ports from the host, headers only, so the guest does
+# not spend CPU and 9p I/O on tshark while it is being measured:
+#
+#   vm:
+#     capture:
+#       snaplen: 160        # bytes per packet (Ethernet + IP + TCP with options)
+#       buffer_mb: 64       # kernel ring buffer per port
+#       rotate_mb: 100      # start a new file every N MB (0: never)
+#       files: 0            # keep only the last N files per port (0: all)
+#       compress: true      # gzip every file once it is closed
+#       bridges: "br0 br1"  # default: every bridge without "external"
+#
+#   ./script.sh client.yaml --capture start [RUN]   # captures/<RUN>/<bridge>.pcap*
+#   ./script.sh client.yaml --capture stop
+#   ./script.sh client.yaml --capture analyze [RUN] [BIN_MS]
+#
+# tcpdump/libpcap read the port through a TPACKET_V3 ring (-B sets its size).
+# "analyze" runs tools/vkpcap over the files of each port: per-subflow MPTCP
+# throughput, RTT, retransmission and reordering time series.
+
+CAPTURE_DIR_NAME="captures"
+VKPCAP_DIR="${MAIN_DIR}/tools/vkpcap"
+
+capture_param() {
+    local key="$1"
+    local default="$2"
+    local value
+    value=$(parse_yaml "$CONFIG_FILE" "vm.capture.$key")
+    echo "${value:-$default}"
+}
+
+capture_bridges() {
+    local bridges bridge
+    bridges=$(capture_param bridges "")
+    if [ -n "$bridges" ]; then
+        echo "$bridges"
+        return 0
+    fi
+
+    for bridge in $(get_yaml_subkeys "$CONFIG_FILE" vm.bridges); do
+        [ -n "$(parse_yaml "$CONFIG_FILE" "vm.bridges.$bridge.external")" ] && continue
+        echo "$bridge"
+    done
+}
+
+_capture_pid_file() {
+    local bridge_id="$1"
+    echo "$VM_DIR/$CAPTURE_DIR_NAME/.tcpdump-$bridge_id.pid"
+}
+
+_capture_running() {
+    local pid_file="$1"
+    [ -f "$pid_file" ] && sudo kill -0 "$(cat "$pid_file")" 2>/dev/null
+}
+
+_capture_stopped() {
+    ! _capture_running "$1"
+}
+
+capture_start() {
+    local run="${1:-$(date +%Y%m%d-%H%M%S)}"
+    local run_dir="$VM_DIR/$CAPTURE_DIR_NAME/$run"
+    local snaplen buffer_mb rotate_mb files compress bridge tap pid_file args
+
+    check_command tcpdump || return 1
+    snaplen=$(capture_param snaplen 160)
+    buffer_mb=$(capture_param buffer_mb 64)
+    rotate_mb=$(capture_param rotate_mb 100)
+    files=$(capture_param files 0)
+    compress=$(capture_param compress true)
+
+    capture_stop > /dev/null
+    mkdir -p "$run_dir"
+    echo "$run_dir" > "$VM_DIR/$CAPTURE_DIR_NAME/.current"
+
+    for bridge in $(capture_bridges); do
+        tap=$(tap_name "$bridge")
+        if [ ! -d "/sys/class/net/$tap" ]; then
+            log_warning "Tap port $tap not present, not capturing $bridge"
+            continue
+        fi
+
+        # -Z root: the rotated files are written (and gzipped) in a directory
+        # owned by the user, not by the tcpdump user
+        args=(-i "$tap" -n -s "$snaplen" -B $((buffer_mb * 1024)) -Z root
+              -w "$run_dir/$bridge.pcap")
+        if [ "$rotate_mb" -gt 0 ]; then
+            args+=(-C "$rotate_mb")
+            [ "$files" -gt 0 ] && args+=(-W "$files")
+            [ "$compress" = "true" ] && args+=(-z gzip)
+        fi
+
+        pid_file=$(_capture_pid_file "$bridge")
+        sudo tcpdump "${args[@]}" > "$run_dir/$bridge.log" 2>&1 &
+        echo $! > "$pid_file"
+
+        if ! wait_for 2 grep -q "listening on" "$run_dir/$bridge.log"; then
+            log_error "tcpdump failed to start on $tap:"
+            cat "$run_dir/$bridge.log"
+            rm -f "$pid_file"
+            return 1
+        fi
+        log_info "Capturing $tap (snaplen $snaplen) to $run_dir/$bridge.pcap"
+    done
+    log_success "Capture $run started"
+}
+
+capture_stop() {
+    local run_dir bridge pid_file file
+
+    for pid_file in "$VM_DIR/$CAPTURE_DIR_NAME"/.tcpdump-*.pid; do
+        [ -f "$pid_file" ] || continue
+        if _capture_running "$pid_file"; then
+            sudo kill -INT "$(cat "$pid_file")" 2>/dev/null
+            wait_for 5 _capture_stopped "$pid_file" || sudo kill -9 "$(cat "$pid_file")" 2>/dev/null
+        fi
+        rm -f "$pid_file"
+    done
+
+    run_dir=$(cat "$VM_DIR/$CAPTURE_DIR_NAME/.current" 2>/dev/null)
+    [ -n "$run_dir" ] && [ -d "$run_dir" ] || return 0
+    rm -f "$VM_DIR/$CAPTURE_DIR_NAME/.current"
+
+    for bridge in $(capture_bridges); do
+        [ -f "$run_dir/$bridge.log" ] || continue
+        # "N packets dropped by kernel" tells whether the buffer was enough
+        grep -E "captured|dropped" "$run_dir/$bridge.log" | while read -r line; do
+            log_info "  $bridge: $line"
+        done
+    done
+
+    # The file open at stop time was not rotated, so not compressed yet
+    if [ "$(capture_param compress true)" = "true" ]; then
+        for file in "$run_dir"/*.pcap*; do
+            [ -f "$file" ] || continue
+            [[ "$file" == *.gz ]] && continue
+            sudo gzip -f "$file"
+        done
+    fi
+    sudo chown -R "$(id -u):$(id -g)" "$run_dir"
+    log_success "Capture stopped: $run_dir"
+}
+
+capture_status() {
+    local pid_file bridge
+
+    log_info "Host capture:"
+    for bridge in $(capture_bridges); do
+        pid_file=$(_capture_pid_file "$bridge")
+        if _capture_running "$pid_file"; then
+            log_info "  $bridge ($(tap_name "$bridge")): capturing to $(cat "$VM_DIR/$CAPTURE_DIR_NAME/.current")"
+        else
+            log_info "  $bridge ($(tap_name "$bridge")): not capturing"
+        fi
+    done
+}
+
+_vkpcap_build() {
+    if [ ! -x "$VKPCAP_DIR/vkpcap" ] || [ "$VKPCAP_DIR/vkpcap.c" -nt "$VKPCAP_DIR/vkpcap" ] || \
+       [ "$MAIN_DIR/tools/common/mptcp_token.c" -nt "$VKPCAP_DIR/vkpcap" ]; then
+        log_info "Building vkpcap..."
+        make -s -C "$VKPCAP_DIR" || { log_error "Failed to build vkpcap"; return 1; }
+    fi
+}
+
+# capture_analyze [RUN] [BIN_MS]: <bridge>-subflows.csv (time series) and
+# <bridge>-summary.csv in the run directory, default the latest run
+capture_analyze() {
+    local run="$1"
+    local bin_ms="${2:-100}"
+    local run_dir bridge files
+
+    _vkpcap_build || return 1
+    if [ -n "$run" ]; then
+        run_dir="$VM_DIR/$CAPTURE_DIR_NAME/$run"
+    else
+        run_dir=$(ls -td "$VM_DIR/$CAPTURE_DIR_NAME"/*/ 2>/dev/null | head -1)
+        run_dir="${run_dir%/}"
+    fi
+    if [ -z "$run_dir" ] || [ ! -d "$run_dir" ]; then
+        log_error "No capture found${run:+ for $run}"
+        return 1
+    fi
+    if [ -f "$VM_DIR/$CAPTURE_DIR_NAME/.current" ] && [ "$(cat "$VM_DIR/$CAPTURE_DIR_NAME/.current")" = "$run_dir" ]; then
+        log_warning "Capture $run_dir still running, the last file may be partial"
+    fi
+
+    for bridge in $(capture_bridges); do
+        # <bridge>.pcap, <bridge>.pcap1, ... (.gz once closed); vkpcap puts
+        # them in the order of their first packet, as a -W ring reuses names
+        files=("$run_dir/$bridge".pcap*)
+        [ -f "${files[0]}" ] || continue
+
+        log_info "Analysing $bridge (${#files[@]} file(s))..."
+        "$VKPCAP_DIR/vkpcap" -b "$bin_ms" -o "$run_dir/$bridge-subflows.csv" \
+            -S "$run_dir/$bridge-summary.csv" "${files[@]}" || return 1
+        column -t -s, "$run_dir/$bridge-summary.csv" | while read -r line; do
+            log_info "  $line"
+        done
+    done
+    log_success "Analysis written to $run_dir"
+}
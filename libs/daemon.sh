@@ -0,0 +1,437 @@
+#!/bin/bash
+
+# =============================================================================
+# CONTROL DAEMON (virtkd)
+# =============================================================================
+#
+# A long-running process that owns the VMs, bridges and dnsmasq of this
+# tree. It sources the modules and compiles the configs once, remembers the
+# VMs it was asked about and answers on a Unix socket:
+#
+#   ./script.sh client.yaml --daemon start | stop | status | jobs | run
+#
+# While it runs, script.sh is a thin client for these options (set
+# VIRTK_DAEMON=0 to run them locally):
+#
+#   --all [force]   create (the setup steps), then start
+#   --vm            start: the bridges, then the VM detached, its serial
+#                   console on VM_DIR/console.sock
+#   --stop          stop the VM
+#   --matrix F [O]  run-experiment
+#
+# --status stays local; --daemon status is the daemon's view (VMs, bridges,
+# dnsmasq and jobs, read from /proc and /sys).
+#
+# A request is one line of fields separated by DAEMON_FS (command, config,
+# prompt policy, arguments); the reply is text lines, then "exit N". socat
+# accepts the connections and relays each request (--daemon relay) through
+# the .virtkd/requests FIFO, with a FIFO of its own for the reply. create,
+# start, stop and run-experiment are queued as jobs for a single worker, so
+# concurrent clients are serialized in order; a job logs into
+# .virtkd/jobs/ID.log and leaves its exit status in ID.status, and the client
+# follows the log until the status appears. A flock on .virtkd/lock keeps
+# one daemon per tree.
+#
+# The jobs run without a terminal: start the daemon from the terminal whose
+# sudo credentials it should keep fresh, and set a prompt policy (--policy,
+# VIRTK_POLICY or vm.prompt_policy) for the prompts.
+
+DAEMON_DIR="${MAIN_DIR}/.virtkd"
+DAEMON_SOCKET="$DAEMON_DIR/virtkd.sock"
+DAEMON_FS=$'\x1f'
+
+# =============================================================================
+# CLIENT
+# =============================================================================
+
+# Send one request, print the reply and return its status (255: no daemon)
+daemon_request() {
+    local IFS="$DAEMON_FS"
+    local line status=""
+
+    while IFS= read -r line; do
+        if [[ "$line" == "exit "* ]]; then
+            status="${line#exit }"
+        else
+            printf '%s\n' "$line"
+        fi
+    done < <(printf '%s\n' "$*" | socat -t 30 - UNIX-CONNECT:"$DAEMON_SOCKET" 2>/dev/null)
+    [ -n "$status" ] || return 255
+    return "$status"
+}
+
+daemon_alive() {
+    [ -S "$DAEMON_SOCKET" ] && command -v socat > /dev/null && daemon_request ping > /dev/null
+}
+
+# script.sh options the daemon serves
+daemon_serves() {
+    case "${1:-}" in
+        -a|--all|-v|--vm|--stop) return 0 ;;
+        --matrix) [ -n "${2:-}" ] ;;
+        *) return 1 ;;
+    esac
+}
+
+# Follow the log of a job until its status is written, return it; fails
+# when the daemon goes away first (its lock is free)
+_daemon_follow() {
+    local id="$1"
+    local log="$DAEMON_DIR/jobs/$id.log"
+    local status_file="$DAEMON_DIR/jobs/$id.status"
+    local tail_pid status=1 polls=0 gone=false
+
+    tail -n +1 -F -s 0.2 "$log" 2>/dev/null &
+    tail_pid=$!
+    trap 'kill $tail_pid 2>/dev/null; log_warning "Job $id keeps running in the daemon (--daemon jobs)"; exit 130' INT
+    until [ -f "$status_file" ]; do
+        sleep 0.2
+        polls=$((polls + 1))
+        if (( polls % 25 == 0 )) && { [ ! -e "$DAEMON_DIR/lock" ] || flock -n "$DAEMON_DIR/lock" true 2>/dev/null; }; then
+            [ -f "$status_file" ] || gone=true
+            break
+        fi
+    done
+    sleep 0.3
+    kill "$tail_pid" 2>/dev/null
+    wait "$tail_pid" 2>/dev/null
+    trap - INT
+
+    if $gone; then
+        log_error "virtkd exited before job $id finished"
+        return 1
+    fi
+    read -r status < "$status_file"
+    return "$status"
+}
+
+# Queue a job and wait for it
+_daemon_job() {
+    local reply status=0
+    reply=$(daemon_request "$@") || status=$?
+    if [ "$status" -ne 0 ] || [[ "$reply" != "job "* ]]; then
+        [ -n "$reply" ] && log_error "$reply"
+        return $(( status ? status : 1 ))
+    fi
+    log_info "virtkd: $1 queued as job ${reply#job }"
+    _daemon_follow "${reply#job }"
+}
+
+daemon_client() {
+    local policy="${PROMPT_POLICY:-${VIRTK_POLICY:-}}"
+
+    case "$1" in
+        -a|--all)
+            _daemon_job create "$CONFIG_FILE" "$policy" "${2:-}" && \
+                _daemon_job start "$CONFIG_FILE" "$policy"
+            ;;
+        -v|--vm)
+            _daemon_job start "$CONFIG_FILE" "$policy"
+            ;;
+        --stop)
+            _daemon_job stop "$CONFIG_FILE" "$policy"
+            ;;
+        --matrix)
+            _daemon_job run-experiment "$CONFIG_FILE" "$policy" "$(realpath "$2")" \
+                "${3:+$(realpath -m "$3")}"
+            ;;
+    esac
+}
+
+# Per connection, run by socat: hand the request to the daemon, relay the
+# reply up to its "exit" line. Both ends open the reply FIFO read-write, so
+# neither blocks on a peer that went away.
+daemon_relay() {
+    local request reply line fd
+
+    IFS= read -r request || return 1
+    reply=$(mktemp -u "$DAEMON_DIR/reply.XXXXXX")
+    mkfifo -m 600 "$reply" || return 1
+    exec {fd}<> "$reply"
+    printf '%s%s%s\n' "$reply" "$DAEMON_FS" "$request" > "$DAEMON_DIR/requests"
+    while IFS= read -r line <&"$fd"; do
+        printf '%s\n' "$line"
+        [[ "$line" == "exit "* ]] && break
+    done
+    exec {fd}<&-
+    rm -f "$reply"
+}
+
+# socat splits its addresses on these: the listener and its relay command
+# need paths without them
+_daemon_paths_ok() {
+    local path
+    for path in "$MAIN_DIR" "$CONFIG_FILE"; do
+        if [[ "$path" =~ [[:space:],:!\"\'\\] ]]; then
+            log_error "virtkd needs paths without spaces, quotes, backslashes, \",\", \":\" or \"!\": $path"
+            return 1
+        fi
+    done
+}
+
+daemon_start() {
+    if daemon_alive; then
+        log_info "virtkd already running"
+        return 0
+    fi
+    check_command socat || return 1
+    _daemon_paths_ok || return 1
+    sudo -v || return 1
+
+    mkdir -p "$DAEMON_DIR"
+    nohup "$MAIN_DIR/script.sh" "$CONFIG_FILE" --daemon run \
+        > "$DAEMON_DIR/virtkd.log" 2>&1 < /dev/null &
+    if ! wait_for 10 daemon_alive; then
+        log_error "virtkd did not start, see $DAEMON_DIR/virtkd.log"
+        return 1
+    fi
+    log_success "virtkd running: $DAEMON_SOCKET (log: $DAEMON_DIR/virtkd.log)"
+}
+
+daemon_stop() {
+    if ! daemon_alive; then
+        log_info "virtkd not running"
+        return 0
+    fi
+    daemon_request shutdown
+    log_info "Waiting for the queued jobs..."
+    until flock -n "$DAEMON_DIR/lock" true; do
+        sleep 0.2
+    done
+    log_success "virtkd stopped"
+}
+
+# =============================================================================
+# DAEMON
+# =============================================================================
+
+declare -A DAEMON_VMS       # VM name -> config
+declare -A DAEMON_JOBS      # job id -> "command VM"
+DAEMON_JOB_ID=0
+
+_daemon_context() {
+    CONFIG_FILE="$1"
+    local stamp
+
+    # another shell may have rebuilt the cache since: reload on a new stamp
+    stamp=$(stat -L -c '%y %s' "$CONFIG_FILE" 2>/dev/null)
+    [ "$stamp" = "${_YAML_STAMP[$CONFIG_FILE]:-}" ] || unset "_YAML_CACHE[$CONFIG_FILE]"
+    yaml_load "$CONFIG_FILE" || return 1
+    VM_NAME=$(parse_yaml "$CONFIG_FILE" "vm.name" 2>/dev/null)
+    VM_NAME="${VM_NAME:-$(basename "$CONFIG_FILE" .yaml)}"
+    VM_DIR="${MAIN_DIR}/VirtK_Machines/${VM_NAME}"
+}
+
+# Load a config and remember its VM, across restarts too
+_daemon_register() {
+    local config="$1"
+    local name
+
+    [ -f "$config" ] || { echo "No such config: $config"; return 1; }
+    _daemon_context "$config" || { echo "Cannot load $config"; return 1; }
+    [ "${DAEMON_VMS[$VM_NAME]:-}" = "$config" ] && return 0
+
+    DAEMON_VMS[$VM_NAME]="$config"
+    for name in "${!DAEMON_VMS[@]}"; do
+        printf '%s\t%s\n' "$name" "${DAEMON_VMS[$name]}"
+    done > "$DAEMON_DIR/vms"
+}
+
+_daemon_jobs() {
+    local id status state
+
+    for (( id = 1; id <= DAEMON_JOB_ID; id++ )); do
+        if [ -f "$DAEMON_DIR/jobs/$id.status" ]; then
+            read -r status < "$DAEMON_DIR/jobs/$id.status"
+            state="done, exit $status"
+        elif [ -f "$DAEMON_DIR/jobs/$id.log" ]; then
+            state="running"
+        else
+            state="queued"
+        fi
+        echo "job $id ${DAEMON_JOBS[$id]}: $state ($DAEMON_DIR/jobs/$id.log)"
+    done
+}
+
+# Only builtins and reads of /proc and /sys, from the compiled configs
+_daemon_status() {
+    local name pid state bridge flags dhcp
+
+    [ -n "${1:-}" ] && _daemon_register "$1"
+    for name in "${!DAEMON_VMS[@]}"; do
+        _daemon_context "${DAEMON_VMS[$name]}" || continue
+        if pid=$(vm_pid); then
+            state="running, PID $pid, ssh port $(parse_yaml "$CONFIG_FILE" "vm.ssh_port")"
+        elif [ -f "$VM_DIR/rootfs.img" ] && [ -f "$VM_DIR/$(kernel_image_path)" ]; then
+            state="stopped"
+        else
+            state="not created"
+        fi
+        echo "VM $VM_NAME: $state ($CONFIG_FILE)"
+
+        for bridge in $(get_yaml_subkeys "$CONFIG_FILE" vm.bridges); do
+            if [ ! -r "/sys/class/net/$bridge/flags" ]; then
+                echo "  bridge $bridge: missing"
+                continue
+            fi
+            read -r flags < "/sys/class/net/$bridge/flags"
+            state="down"
+            (( flags & 1 )) && state="up"
+            if dhcp=$(dnsmasq_pid "$bridge"); then
+                state+=", dnsmasq PID $dhcp"
+            fi
+            echo "  bridge $bridge: $state"
+        done
+    done
+    _daemon_jobs
+}
+
+_daemon_submit() {
+    local command="$1"
+    local config="$2"
+
+    _daemon_register "$config" || return 1
+    if [ "$command" = "run-experiment" ] && [ ! -f "${4:-}" ]; then
+        echo "No such matrix: ${4:-}"
+        return 1
+    fi
+
+    DAEMON_JOB_ID=$((DAEMON_JOB_ID + 1))
+    DAEMON_JOBS[$DAEMON_JOB_ID]="$command $VM_NAME"
+    local IFS="$DAEMON_FS"
+    printf '%s\n' "$DAEMON_JOB_ID$IFS$*" >&"$DAEMON_QUEUE"
+    echo "job $DAEMON_JOB_ID"
+}
+
+_daemon_handle() {
+    local -a request
+    IFS="$DAEMON_FS" read -r -a request <<< "$1"
+
+    case "${request[0]:-}" in
+        ping)
+            echo "virtkd $$"
+            ;;
+        status)
+            _daemon_status "${request[1]:-}"
+            ;;
+        jobs)
+            _daemon_jobs
+            ;;
+        create|start|stop|run-experiment)
+            _daemon_submit "${request[@]}"
+            ;;
+        shutdown)
+            DAEMON_STOP=1
+            echo "virtkd stopping"
+            ;;
+        *)
+            echo "Unknown request: ${request[0]:-}"
+            return 1
+            ;;
+    esac
+}
+
+_daemon_exec() {
+    local command="$1"
+    shift
+
+    case "$command" in
+        create)
+            pipeline_build "${1:-}"
+            ;;
+        start)
+            if vm_pid > /dev/null; then
+                log_info "VM $VM_NAME already running"
+                return 0
+            fi
+            bridges_setup && VM_DETACHED=1 vm_start
+            ;;
+        stop)
+            vm_stop
+            ;;
+        run-experiment)
+            matrix_run "$1" "${2:-}"
+            ;;
+    esac
+}
+
+# Run the queued jobs in order, each in a subshell of the loaded modules
+_daemon_worker() {
+    local -a job
+    local id status
+
+    export VIRTK_DAEMON=0
+    while IFS="$DAEMON_FS" read -r -a job; do
+        id="${job[0]}"
+        (
+            _daemon_context "${job[2]}" || exit 1
+            PROMPT_POLICY="${job[3]:-}"
+            VIRTK_POLICY=""
+            log_info "=== ${job[1]} $VM_NAME (job $id) ==="
+            _daemon_exec "${job[1]}" "${job[@]:4}"
+        ) > "$DAEMON_DIR/jobs/$id.log" 2>&1 < /dev/null {DAEMON_LOCK}>&-
+        status=$?
+        echo "$status" > "$DAEMON_DIR/jobs/$id.status.tmp"
+        mv -f "$DAEMON_DIR/jobs/$id.status.tmp" "$DAEMON_DIR/jobs/$id.status"
+    done
+}
+
+daemon_serve() {
+    local line reply requests worker listener keepalive name config
+
+    set +e
+    check_command socat || return 1
+    _daemon_paths_ok || return 1
+    mkdir -p "$DAEMON_DIR"
+    exec {DAEMON_LOCK}> "$DAEMON_DIR/lock"
+    if ! flock -n "$DAEMON_LOCK"; then
+        log_error "virtkd already running"
+        return 1
+    fi
+
+    rm -rf "$DAEMON_DIR/jobs.prev" "$DAEMON_DIR"/reply.*
+    [ -d "$DAEMON_DIR/jobs" ] && mv "$DAEMON_DIR/jobs" "$DAEMON_DIR/jobs.prev"
+    mkdir -p "$DAEMON_DIR/jobs"
+    if [ -f "$DAEMON_DIR/vms" ]; then
+        while IFS=$'\t' read -r name config; do
+            [ -f "$config" ] && DAEMON_VMS[$name]="$config"
+        done < "$DAEMON_DIR/vms"
+    fi
+
+    rm -f "$DAEMON_DIR/queue" "$DAEMON_DIR/requests"
+    mkfifo -m 600 "$DAEMON_DIR/queue" "$DAEMON_DIR/requests" || return 1
+    _daemon_worker < "$DAEMON_DIR/queue" &
+    worker=$!
+    exec {DAEMON_QUEUE}> "$DAEMON_DIR/queue"
+    exec {requests}<> "$DAEMON_DIR/requests"
+
+    sudo_keepalive {DAEMON_LOCK}>&- {DAEMON_QUEUE}>&- {requests}<&-
+    keepalive=$!
+    socat UNIX-LISTEN:"$DAEMON_SOCKET",fork,unlink-early,umask=077 \
+        EXEC:"$MAIN_DIR/script.sh $CONFIG_FILE --daemon relay" \
+        {DAEMON_LOCK}>&- {DAEMON_QUEUE}>&- {requests}<&- &
+    listener=$!
+
+    DAEMON_STOP=0
+    trap 'DAEMON_STOP=1' TERM INT
+    log_success "virtkd listening on $DAEMON_SOCKET (PID $$)"
+
+    # read -t: a trapped signal only stops the loop between reads
+    while [ "$DAEMON_STOP" = "0" ]; do
+        IFS= read -r -t 1 line <&"$requests" || continue
+        reply="${line%%"$DAEMON_FS"*}"
+        [[ "$reply" == "$DAEMON_DIR"/reply.* && -p "$reply" ]] || continue
+        { _daemon_handle "${line#*"$DAEMON_FS"}"; echo "exit $?"; } 1<> "$reply"
+    done
+
+    log_info "virtkd stopping"
+    kill "$listener" "$keepalive" 2>/dev/null
+    wait "$listener" 2>/dev/null
+    rm -f "$DAEMON_SOCKET"
+    # the worker finishes the queued jobs, then reads the end of the queue
+    exec {DAEMON_QUEUE}>&-
+    wait "$worker"
+    exec {requests}<&-
+    rm -f "$DAEMON_DIR/queue" "$DAEMON_DIR/requests"
+    log_success "virtkd stopped"
+}
@@ -0,0 +1,285 @@
+#!/bin/bash
+
+# =============================================================================
+# PATH EVENTS (FAILURE AND HANDOVER INJECTION)
+# =============================================================================
+#
+# A timeline changes the paths of a running client VM at given offsets (in
+# seconds, from the start of the run), separated by ";":
+#
+#   "10 br1 down; 20 br1 up; 30 br0 blackhole; 35 br0 restore; 40 br1 rate 5mbit"
+#
+#   down | up        the VM tap port on the bridge; the guest keeps its
+#                    carrier, as for a failure further along the path
+#   blackhole        drop every packet of the port, both directions (tc
+#                    matchall ahead of the IFB redirect of libs/link.sh)
+#   restore          undo blackhole
+#   rate RATE        change the HTB rate of both directions, keeping the
+#                    delay/loss of the profile
+#   reset            back to the configured profile (up, no blackhole)
+#
+#   ./script.sh client.yaml --event br1 down          # one event, now
+#   ./script.sh client.yaml --timeline "5 br1 down; 15 br1 up"
+#
+# The matrix runner plays experiment.timeline during every cell and adds the
+# goodput gap, recovery time and MPTCP reinjections per event (see
+# path_events_analyze). Every event is logged with the host time at which
+# it took effect, converted to the time base of the throughput samples with
+# the measured guest clock offset.
+
+PATH_EVENT_PRIO=5
+
+# Apply one event to this VM's tap port on a bridge
+path_event() {
+    local bridge_id="$1"
+    local action="$2"
+    local arg="$3"
+    local tap
+    tap=$(tap_name "$bridge_id")
+
+    if [ ! -d "/sys/class/net/$tap" ]; then
+        log_error "Tap port $tap not found"
+        return 1
+    fi
+
+    case "$action" in
+        down|up)
+            sudo ip link set dev "$tap" "$action"
+            ;;
+        blackhole)
+            tc_clsact_ensure "$tap" || return 1
+            sudo tc filter replace dev "$tap" ingress protocol all prio $PATH_EVENT_PRIO handle 1 \
+                matchall action drop && \
+            sudo tc filter replace dev "$tap" egress protocol all prio $PATH_EVENT_PRIO handle 1 \
+                matchall action drop
+            ;;
+        restore)
+            sudo tc filter del dev "$tap" ingress prio $PATH_EVENT_PRIO 2>/dev/null || true
+            sudo tc filter del dev "$tap" egress prio $PATH_EVENT_PRIO 2>/dev/null || true
+            tc_clsact_release "$tap"
+            ;;
+        rate)
+            if [ -z "$arg" ]; then
+                log_error "rate needs a value (e.g. 10mbit)"
+                return 1
+            fi
+            if link_uses_linkem "$bridge_id"; then
+                log_error "rate events are not supported with linkem ($bridge_id)"
+                return 1
+            fi
+            local ifb direction
+            ifb=$(_link_ifb_setup "$tap") || return 1
+            for direction in down up; do
+                link_shape_dev "$([ "$direction" = down ] && echo "$tap" || echo "$ifb")" "$arg" \
+                    "$(link_param "$bridge_id" "$direction" delay)" \
+                    "$(link_param "$bridge_id" "$direction" jitter)" \
+                    "$(link_param "$bridge_id" "$direction" loss)" \
+                    "$(link_param "$bridge_id" "$direction" limit)" || return 1
+            done
+            # no longer the profile link_setup applied
+            rm -f "$VM_DIR/.link-$bridge_id"
+            ;;
+        reset)
+            path_event "$bridge_id" restore
+            sudo ip link set dev "$tap" up
+            rm -f "$VM_DIR/.link-$bridge_id"
+            link_setup "$bridge_id" > /dev/null
+            ;;
+        *)
+            log_error "Unknown path event: $action (down, up, blackhole, restore, rate RATE, reset)"
+            return 1
+            ;;
+    esac
+}
+
+# One "OFFSET BRIDGE ACTION [ARG]" line per event, sorted by offset
+_path_events_lines() {
+    tr ';' '\n' <<< "$1" | awk 'NF { $1 = $1; print }' | sort -n -k1,1
+}
+
+# Validate a timeline against the bridges of this VM
+path_events_check() {
+    local timeline="$1"
+    local bridges offset bridge action arg status=0
+    bridges=" $(get_yaml_subkeys "$CONFIG_FILE" vm.bridges | tr '\n' ' ') "
+
+    while read -r offset bridge action arg; do
+        if ! [[ "$offset" =~ ^[0-9]+([.][0-9]+)?$ ]]; then
+            log_error "Bad event offset: $offset $bridge $action $arg"
+            status=1
+        elif [[ "$bridges" != *" $bridge "* ]]; then
+            log_error "Bridge $bridge not in $CONFIG_FILE"
+            status=1
+        elif [[ ! " down up blackhole restore rate reset " == *" $action "* ]]; then
+            log_error "Unknown path event: $action"
+            status=1
+        elif [ "$action" = "rate" ] && [ -z "$arg" ]; then
+            log_error "Event at $offset s: rate needs a value"
+            status=1
+        fi
+    done < <(_path_events_lines "$timeline")
+    return $status
+}
+
+# Play a timeline from now into a CSV; epoch_ns is the host time at which
+# the change was in place, apply_ms how long applying it took
+path_events_run() {
+    local timeline="$1"
+    local out="$2"
+    local start due now t1 t2 offset bridge action arg status
+
+    start=$(date +%s%N)
+    echo "epoch_ns,offset_s,bridge,action,arg,status,apply_ms" > "$out"
+    while read -r offset bridge action arg; do
+        due=$(awk -v s="$start" -v o="$offset" 'BEGIN { printf "%.0f", s + o * 1e9 }')
+        now=$(date +%s%N)
+        if (( due > now )); then
+            sleep "$(awk -v d=$(( due - now )) 'BEGIN { printf "%.6f", d / 1e9 }')"
+        fi
+        t1=$(date +%s%N)
+        if path_event "$bridge" "$action" "$arg" > /dev/null 2>&1; then
+            status=ok
+        else
+            status=failed
+        fi
+        t2=$(date +%s%N)
+        echo "$t2,$offset,$bridge,$action,$arg,$status,$(( (t2 - t1) / 1000000 ))" >> "$out"
+    done < <(_path_events_lines "$timeline")
+}
+
+# Wire bytes of the tap ports every PERIOD seconds until killed (to_vm:
+# tap egress, from_vm: tap ingress)
+path_samples_run() {
+    local out="$1"
+    local period="${2:-0.1}"
+    local bridges bridge tap t tx rx
+    bridges=$(get_yaml_subkeys "$CONFIG_FILE" vm.bridges)
+
+    echo "epoch_ns,bridge,to_vm_bytes,from_vm_bytes" > "$out"
+    while :; do
+        t=$(date +%s%N)
+        for bridge in $bridges; do
+            tap=$(tap_name "$bridge")
+            [ -r "/sys/class/net/$tap/statistics/tx_bytes" ] || continue
+            read -r tx < "/sys/class/net/$tap/statistics/tx_bytes"
+            read -r rx < "/sys/class/net/$tap/statistics/rx_bytes"
+            echo "$t,$bridge,$tx,$rx"
+        done >> "$out"
+        sleep "$period"
+    done
+}
+
+# Guest clock minus host clock (ns), from the fastest of a few round trips
+# over one ssh session
+path_events_clock_offset() {
+    local config="$1"
+    local i t1 t2 tg rtt best="" offset=0
+
+    coproc GUEST_CLOCK { vm_ssh "$config" 'while read -r _; do date +%s%N; done' 2>/dev/null; }
+    for i in $(seq 10); do
+        t1=$(date +%s%N)
+        echo >&"${GUEST_CLOCK[1]}" || break
+        read -r -t 5 tg <&"${GUEST_CLOCK[0]}" || break
+        t2=$(date +%s%N)
+        rtt=$(( t2 - t1 ))
+        if [ -z "$best" ] || (( rtt < best )); then
+            best=$rtt
+            offset=$(( tg - (t1 + t2) / 2 ))
+        fi
+    done
+    exec {GUEST_CLOCK[1]}>&-
+    wait "$GUEST_CLOCK_PID" 2>/dev/null
+    [ -n "$best" ] || return 1
+    echo "$offset"
+}
+
+# MPTCP-level retransmissions (reinjections included) and duplicate data
+# received, absolute counters of a VM: "RETRANS DUPLICATE"
+path_events_mib() {
+    local config="$1"
+    vm_ssh "$config" "nstat -asz MPTcpExtMPTCPRetrans MPTcpExtDuplicateData" 2>/dev/null | \
+        awk '$1 == "MPTcpExtMPTCPRetrans" { r = $2 } $1 == "MPTcpExtDuplicateData" { d = $2 }
+             END { print r + 0, d + 0 }'
+}
+
+# path_events_analyze EVENTS_CSV T0_NS OFFSET_NS < "start seconds bps" samples
+#
+# One CSV line per event, times in seconds from the start of the samples:
+#   pre_bps     mean goodput over the 2 s before the event
+#   post_bps    median goodput over the second half of the time to the next
+#               event (or the end): the level the connection settles at
+#   gap_s       from the event to the start of the first sample that is
+#               back above 10% of pre_bps (0: never dropped)
+#   recovery_s  from the event to the start of the first sample at 90% of
+#               post_bps or more, after the gap
+# The resolution is one sample (matrix sample_interval).
+path_events_analyze() {
+    local events="$1"
+    local t0="$2"
+    local offset="$3"
+
+    awk -F'[ ,]' -v t0="$t0" -v off="$offset" '
+        FNR == NR {
+            if (NF < 3) next
+            n++; st[n] = $1; mid[n] = $1 + $2 / 2; end[n] = $1 + $2; bps[n] = $3
+            next
+        }
+        FNR == 1 { next }
+        $6 == "ok" {
+            k++; te[k] = ($1 + off - t0) / 1e9; what[k] = $3 "," $4 "," $5
+        }
+        END {
+            print "t_s,bridge,action,arg,pre_bps,post_bps,gap_s,recovery_s"
+            for (e = 1; e <= k; e++) {
+                tn = e < k ? te[e + 1] : end[n]
+                pre = 0; c = 0
+                for (i = 1; i <= n; i++)
+                    if (mid[i] >= te[e] - 2 && mid[i] < te[e]) { pre += bps[i]; c++ }
+                pre = c ? pre / c : 0
+
+                m = 0
+                for (i = 1; i <= n; i++)
+                    if (mid[i] >= te[e] + (tn - te[e]) / 2 && mid[i] <= tn) v[++m] = bps[i]
+                for (i = 2; i <= m; i++)
+                    for (j = i; j > 1 && v[j - 1] > v[j]; j--) { x = v[j]; v[j] = v[j - 1]; v[j - 1] = x }
+                post = m ? (m % 2 ? v[(m + 1) / 2] : (v[m / 2] + v[m / 2 + 1]) / 2) : 0
+
+                gap = ""; rec = ""; low = 0
+                for (i = 1; i <= n; i++) {
+                    if (mid[i] < te[e] || mid[i] > tn) continue
+                    if (gap == "") {
+                        if (bps[i] < 0.1 * pre) { low = 1; continue }
+                        gap = low ? st[i] - te[e] : 0
+                    }
+                    if (bps[i] >= 0.9 * post) { rec = st[i] > te[e] ? st[i] - te[e] : 0; break }
+                }
+                if (gap == "" && !low) gap = 0
+                printf "%.3f,%s,%.0f,%.0f,%s,%s\n", te[e], what[e], pre, post,
+                       gap == "" ? "" : sprintf("%.3f", gap), rec == "" ? "" : sprintf("%.3f", rec)
+            }
+        }' - "$events"
+}
+
+# failover_* key=value summary of an analysis CSV: the first event that
+# takes a path away (down/blackhole)
+path_events_summary() {
+    awk -F, 'NR > 1 && ($3 == "down" || $3 == "blackhole") {
+                 print "failover_at_s=" $1; print "failover_gap_s=" $7; print "failover_recovery_s=" $8
+                 exit
+             }' "$1"
+}
+
+# Standalone: play a timeline on this VM now, logged under results/
+path_events_play() {
+    local timeline="$1"
+    local out
+
+    path_events_check "$timeline" || return 1
+    sudo -v || return 1
+    out="$MAIN_DIR/results/events-$VM_NAME-$(date +%Y%m%d-%H%M%S).csv"
+    mkdir -p "$(dirname "$out")"
+    log_info "Playing: $timeline"
+    path_events_run "$timeline" "$out"
+    column -s, -t < "$out" 2>/dev/null || cat "$out"
+    log_success "Events logged to $out (./script.sh $(basename "$CONFIG_FILE") --event BRIDGE reset to undo)"
+}
@@ -0,0 +1,205 @@
+#!/bin/bash
+
+# =============================================================================
+# FIREWALL FUNCTIONS
+# =============================================================================
+#
+# The forwarding/NAT rules of all bridges of a VM live in one nftables table
+# (inet virtk_<vm>) that is generated from the YAML and loaded atomically
+# with "nft -f". Bridges are matched through sets, so the packet path costs
+# a few set lookups no matter how many bridges there are.
+#
+# vm.firewall selects the backend: "nftables" (default when nft is
+# installed) or "iptables" (the per-rule backend in libs/network.sh).
+#
+# An nft accept does not override a drop in another table: when the iptables
+# FORWARD chain has a DROP policy (Docker hosts), the NAT bridges are also
+# accepted there.
+
+firewall_backend() {
+    local backend
+    backend=$(parse_yaml "$CONFIG_FILE" "vm.firewall")
+
+    case "$backend" in
+        iptables|nftables) echo "$backend" ;;
+        *)
+            if command -v nft &> /dev/null || [ -x /usr/sbin/nft ]; then
+                echo "nftables"
+            else
+                echo "iptables"
+            fi
+            ;;
+    esac
+}
+
+firewall_table_name() {
+    local name="${VM_NAME//[^a-zA-Z0-9_]/_}"
+    echo "virtk_$name"
+}
+
+# Join quoted names for an nft "elements = { ... }" line
+_nft_elements() {
+    local elements=""
+    local item
+    for item in "$@"; do
+        elements+="${elements:+, }$item"
+    done
+    echo "$elements"
+}
+
+_nft_set() {
+    local name="$1"
+    local type="$2"
+    local flags="$3"
+    shift 3
+
+    echo "    set $name {"
+    echo "        type $type"
+    [ -n "$flags" ] && echo "        flags $flags"
+    [ $# -gt 0 ] && echo "        elements = { $(_nft_elements "$@") }"
+    echo "    }"
+}
+
+# Print the complete nftables ruleset of this VM's bridges
+firewall_ruleset() {
+    local table name_bridges bridge
+    table=$(firewall_table_name)
+    name_bridges=$(get_yaml_subkeys "$CONFIG_FILE" vm.bridges) || return 1
+
+    local isolated=() nat_pairs=() nat_sources=()
+    for bridge in $name_bridges; do
+        local ip_address netmask external mask_bits network_base
+        ip_address=$(parse_yaml "$CONFIG_FILE" "vm.bridges.$bridge.ip")
+        netmask=$(parse_yaml "$CONFIG_FILE" "vm.bridges.$bridge.netmask")
+        external=$(parse_yaml "$CONFIG_FILE" "vm.bridges.$bridge.external")
+        calculate_network_parameters "$ip_address" "$netmask"
+
+        if [[ -n "$external" ]] && ip link show "$external" &>/dev/null; then
+            nat_pairs+=("\"$bridge\" . \"$external\"")
+            nat_sources+=("$network_base/$mask_bits . \"$external\"")
+        else
+            isolated+=("\"$bridge\"")
+        fi
+    done
+
+    # "table + delete table" makes the load replace any previous version
+    # in the same transaction
+    echo "table inet $table"
+    echo "delete table inet $table"
+    echo "table inet $table {"
+    echo "    # Bridges without internet access"
+    _nft_set isolated "ifname" "" "${isolated[@]}"
+    echo "    # NAT bridge . external interface"
+    _nft_set nat_pairs "ifname . ifname" "" "${nat_pairs[@]}"
+    _nft_set nat_sources "ipv4_addr . ifname" "interval" "${nat_sources[@]}"
+    cat << EOF
+    chain forward {
+        type filter hook forward priority filter; policy accept;
+        iifname . oifname @nat_pairs accept
+        oifname . iifname @nat_pairs ct state established,related accept
+        iifname @isolated drop
+    }
+    chain postrouting {
+        type nat hook postrouting priority srcnat; policy accept;
+        ip saddr . oifname @nat_sources masquerade
+    }
+}
+EOF
+}
+
+_firewall_setup_nftables() {
+    local table ruleset_file="$VM_DIR/firewall.nft"
+    table=$(firewall_table_name)
+
+    local ruleset
+    ruleset=$(firewall_ruleset) || return 1
+
+    # Nothing to do when the loaded table was generated from the same config
+    if [ "$(cat "$ruleset_file" 2>/dev/null)" = "$ruleset" ] && sudo nft list table inet "$table" &>/dev/null; then
+        log_info "nftables table $table is up to date"
+        return 0
+    fi
+
+    echo "$ruleset" > "$ruleset_file"
+    if ! sudo nft -f "$ruleset_file"; then
+        rm -f "$ruleset_file"
+        log_error "Failed to load nftables table $table"
+        return 1
+    fi
+    log_success "nftables table $table loaded"
+}
+
+_firewall_iptables_foreach() {
+    local action="$1"
+    local name_bridges bridge
+    name_bridges=$(get_yaml_subkeys "$CONFIG_FILE" vm.bridges) || return 1
+
+    for bridge in $name_bridges; do
+        local ip_address netmask external mask_bits network_base internet_access=false
+        ip_address=$(parse_yaml "$CONFIG_FILE" "vm.bridges.$bridge.ip")
+        netmask=$(parse_yaml "$CONFIG_FILE" "vm.bridges.$bridge.netmask")
+        external=$(parse_yaml "$CONFIG_FILE" "vm.bridges.$bridge.external")
+        calculate_network_parameters "$ip_address" "$netmask"
+        if [[ -n "$external" ]] && ip link show "$external" &>/dev/null; then
+            internet_access=true
+        fi
+        "$action" "$bridge" "$ip_address" "$mask_bits" "$external" "$internet_access"
+    done
+}
+
+# FORWARD ACCEPT rules of a NAT bridge, without the NAT itself
+_firewall_iptables_forward() {
+    local bridge_id="$1"
+    local external="$4"
+    local internet_access="$5"
+
+    [ "$internet_access" = "true" ] || return 0
+    _iptables_ensure FORWARD -i "$bridge_id" -o "$external" -j ACCEPT
+    _iptables_ensure FORWARD -i "$external" -o "$bridge_id" -m state --state RELATED,ESTABLISHED -j ACCEPT
+}
+
+_firewall_forward_policy() {
+    command -v iptables &> /dev/null || [ -x /usr/sbin/iptables ] || return 0
+    sudo iptables -w -S FORWARD 2>/dev/null | grep -qx -- "-P FORWARD DROP" || return 0
+
+    log_warning "iptables FORWARD policy is DROP, accepting the NAT bridges there too"
+    _firewall_iptables_foreach _firewall_iptables_forward
+}
+
+firewall_setup() {
+    case "$(firewall_backend)" in
+        nftables) _firewall_setup_nftables && _firewall_forward_policy ;;
+        iptables) _firewall_iptables_foreach setup_iptables_rules ;;
+    esac
+}
+
+firewall_teardown() {
+    local table
+    table=$(firewall_table_name)
+
+    # Remove whatever either backend may have left behind
+    if command -v nft &> /dev/null || [ -x /usr/sbin/nft ]; then
+        if sudo nft list table inet "$table" &>/dev/null; then
+            log_info "Removing nftables table: $table"
+            sudo nft delete table inet "$table"
+        fi
+    fi
+    rm -f "$VM_DIR/firewall.nft"
+
+    if command -v iptables &> /dev/null || [ -x /usr/sbin/iptables ]; then
+        _firewall_iptables_foreach remove_iptables_rules
+    fi
+}
+
+firewall_status() {
+    local table
+    table=$(firewall_table_name)
+
+    log_info "Firewall backend: $(firewall_backend)"
+    if sudo nft list table inet "$table" &>/dev/null; then
+        log_info "  nftables table $table:"
+        sudo nft list table inet "$table" | grep -E "elements|@" | while read -r line; do
+            log_info "    $line"
+        done
+    fi
+}
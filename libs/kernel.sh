@@ -3,6 +3,10 @@
 
 # KERNEL MANAGEMENT FUNCTIONS
 # =============================================================================
+
+# Scheduler sources copied into net/mptcp of the client kernel
+KERNEL_PATCH_DIR="/home/tiago/xlayer-scheduler/scheduler"
+
 choose_arch_defconfig() {
     local machine=$1
     case "$machine" in
@@ -18,21 +22,45 @@ choose_arch_defconfig() {
     esac
 }
 
+# 0: build, 4: the compiled kernel is reused, otherwise stop with that status
 handle_existing_kernel() {
     local kernel_version=$1
-    if [ -d "linux-$kernel_version" ]; then
-        log_warning "Kernel $kernel_version já existe. O que pretende fazer?"
-        echo "0) Sair sem alterações"
-        echo "1) Recompilar kernel existente"
-        echo "2) Remover e voltar a descarregar"
-        read -rp "Opção (0..2): " option
-        case $option in
-            0) log_info "A sair."; return 1 ;;
-            1) log_info "A recompilar kernel existente" ;;
-            2) log_info "A remover kernel existente"; rm -rf "linux-$kernel_version" ;;
-            *) log_error "Opção inválida."; return 2 ;;
-        esac
-    fi
+    local option policy
+    [ -d "linux-$kernel_version" ] || return 0
+
+    policy=$(prompt_policy)
+    case "$policy" in
+        reuse)   option=3 ;;
+        update)  option=1 ;;
+        rebuild) option=2 ;;
+        abort)
+            log_warning "Kernel $kernel_version já existe, sem alterações (política: abort)"
+            return $PROMPT_ABORTED
+            ;;
+        *)
+            log_warning "Kernel $kernel_version já existe. O que pretende fazer?"
+            echo "0) Sair sem alterações"
+            echo "1) Recompilar kernel existente"
+            echo "2) Remover e voltar a descarregar"
+            echo "3) Reutilizar kernel compilado"
+            read -rp "Opção (0..3): " option
+            ;;
+    esac
+    [ "$policy" != "ask" ] && log_info "Kernel $kernel_version já existe (política: $policy)"
+
+    case $option in
+        0) log_info "A sair."; return 1 ;;
+        1) log_info "A recompilar kernel existente" ;;
+        2) log_info "A remover kernel existente"; rm -rf "linux-$kernel_version" ;;
+        3)
+            if [ -f "$(kernel_image_path)" ]; then
+                log_info "A reutilizar $(kernel_image_path)"
+                return 4
+            fi
+            log_warning "Kernel ainda não compilado, a recompilar"
+            ;;
+        *) log_error "Opção inválida."; return 2 ;;
+    esac
     return 0
 }
 
@@ -92,7 +120,7 @@ apply_patches_if_needed() {
     local kernel_version=$1
     if [ "$VM_NAME" = "client" ]; then
         log_info "A copiar patches..."
-        cp -r "/home/tiago/xlayer-scheduler/scheduler/." "linux-$kernel_version/net/mptcp/" \
+        cp -r "$KERNEL_PATCH_DIR/." "linux-$kernel_version/net/mptcp/" \
             && log_success "Patches aplicados"
 
         # check if xlayer.c is present
@@ -110,9 +138,9 @@ configure_kernel() {
     log_info "Criar configuração padrão (arch=$arch, defconfig=$defconfig)"
 
     if [ "$arch" = "x86_64" ]; then
-        make defconfig
+        make defconfig || { log_error "defconfig falhou"; return 1; }
     elif [ "$arch" = "arm64" ]; then
-        make ARCH=$arch CROSS_COMPILE=$cross_compile $defconfig
+        make ARCH=$arch CROSS_COMPILE=$cross_compile $defconfig || { log_error "defconfig falhou"; return 1; }
     fi
 
     # Activate additional config options from YAML Config
@@ -121,6 +149,33 @@ configure_kernel() {
         [ -n "$config_option" ] && scripts/config --enable "$config_option"
     done < <(get_config_array "$CONFIG_FILE" "config_options")
 
+    # Options required by the memory density features (libs/memory.sh)
+    while IFS= read -r config_option; do
+        log_info "Applying memory config option: $config_option"
+        [ -n "$config_option" ] && scripts/config --enable "$config_option"
+    done < <(memory_kernel_options)
+
+    # Options required by the scheduler tracing (libs/schedtrace.sh)
+    while IFS= read -r config_option; do
+        log_info "Applying schedtrace config option: $config_option"
+        [ -n "$config_option" ] && scripts/config --enable "$config_option"
+    done < <(schedtrace_kernel_options)
+    if schedtrace_enabled && ! command -v pahole &> /dev/null; then
+        log_warning "pahole (dwarves) not found, the kernel will be built without BTF and virtk-sched will not work"
+    fi
+
+    # Options required by the scheduler benchmark (libs/schedbench.sh)
+    while IFS= read -r config_option; do
+        log_info "Applying schedbench config option: $config_option"
+        [ -n "$config_option" ] && scripts/config --enable "$config_option"
+    done < <(schedbench_kernel_options)
+
+    # Options required by the namespace endpoints in the guest (libs/netns.sh)
+    while IFS= read -r config_option; do
+        log_info "Applying netns config option: $config_option"
+        [ -n "$config_option" ] && scripts/config --enable "$config_option"
+    done < <(netns_kernel_options)
+
     # Enable virtio configs for Raspberry Pi 4B
     if [ "$defconfig" = "bcm2711_defconfig" ]; then
         log_info "Enabling virtio block configs for rpi4b..."
@@ -180,6 +235,19 @@ compile_kernel() {
     fi
 }
 
+# Kernel image of this VM, relative to $VM_DIR
+kernel_image_path() {
+    local kernel_version arch defconfig cross_compile
+    kernel_version=$(parse_yaml "$CONFIG_FILE" "kernel.version")
+    choose_arch_defconfig "$(parse_yaml "$CONFIG_FILE" "kernel.machine")"
+
+    if [ "$arch" = "arm64" ]; then
+        echo "linux-$kernel_version/arch/arm64/boot/Image"
+    else
+        echo "linux-$kernel_version/arch/x86/boot/bzImage"
+    fi
+}
+
 # === Função principal ===
 
 kernel_setup() {
@@ -195,7 +263,13 @@ kernel_setup() {
     cd "$VM_DIR" || { log_error "Failed to change to VM directory"; return 1; }
     log_info "Setting up kernel in: $VM_DIR"
 
-    handle_existing_kernel "$kernel_version" || return $?
+    local existing=0
+    handle_existing_kernel "$kernel_version" || existing=$?
+    case $existing in
+        0) ;;
+        4) return 0 ;;
+        *) return $existing ;;
+    esac
 
     if [ "$arch" = "arm64" ]; then
         fetch_rpi_kernel "$kernel_version" "$kernel_cache_dir" || return 1
@@ -203,12 +277,17 @@ kernel_setup() {
         fetch_generic_kernel "$kernel_version" "$kernel_cache_dir" || return 1
     fi
 
-    apply_patches_if_needed "$kernel_version"
+    apply_patches_if_needed "$kernel_version" || return 1
+    schedbench_install_source "linux-$kernel_version" || return 1
+
+    # a failed build must not leave the previous image behind, that the
+    # setup pipeline would take for this one
+    rm -f "$(kernel_image_path)"
 
     cd "linux-$kernel_version" || { log_error "Failed to enter kernel source"; return 1; }
 
-    configure_kernel "$arch" "$defconfig" "$cross_compile"
-    compile_kernel "$arch" "$cross_compile"
+    configure_kernel "$arch" "$defconfig" "$cross_compile" || return 1
+    compile_kernel "$arch" "$cross_compile" || return 1
 
     log_success "Compilação concluída!"
     return 0
@@ -0,0 +1,603 @@
+#!/bin/bash
+
+# =============================================================================
+# LINK EMULATION FUNCTIONS
+# =============================================================================
+#
+# Each bridge may declare the impairment of the VM port attached to it:
+#
+#   vm:
+#     bridges:
+#       br0:
+#         link:
+#           rate: "100mbit"   # HTB rate (omit for no rate limit)
+#           delay: "10ms"     # netem delay
+#           jitter: "2ms"     # netem delay variation (needs delay)
+#           loss: "0.5%"      # netem random loss
+#           limit: 1000       # queue limit in packets
+#           up:               # overrides for VM -> bridge
+#             rate: "20mbit"
+#           down:             # overrides for bridge -> VM
+#             delay: "20ms"
+#
+# "down" is shaped on the egress of the VM tap port, "up" on the egress of
+# an IFB device that receives the tap ingress traffic.
+#
+# With "emulator: linkem" the same profile is applied by the userspace
+# emulator in tools/linkem instead of tc/netem (see the section below).
+
+LINK_KEYS=(rate delay jitter loss limit)
+
+# Tap port of this VM on a bridge (interface names are limited to 15 chars):
+# names longer than 6 chars keep 2 of them and a hash of the whole name, so
+# "client" and "client2" get different ports
+tap_name() {
+    local bridge_id="$1"
+    local name="$VM_NAME"
+    local crc
+
+    if [ ${#name} -gt 6 ]; then
+        crc=$(printf '%s' "$name" | cksum)
+        printf -v name '%s%04x' "${name:0:2}" $(( ${crc%% *} & 0xffff ))
+    fi
+    echo "$name-${bridge_id:0:8}"
+}
+
+ifb_name() {
+    local dev="$1"
+    echo "i${dev:0:14}"
+}
+
+link_param() {
+    local bridge_id="$1"
+    local direction="$2"
+    local key="$3"
+    local value
+
+    # A named profile of an experiment matrix (libs/matrix.sh) replaces the
+    # link sections of the VM config: bridges it does not list are unshaped
+    if [ -n "$LINK_PROFILE" ]; then
+        value=$(parse_yaml "$LINK_PROFILE_FILE" "profiles.$LINK_PROFILE.$bridge_id.$direction.$key")
+        if [ -z "$value" ]; then
+            value=$(parse_yaml "$LINK_PROFILE_FILE" "profiles.$LINK_PROFILE.$bridge_id.$key")
+        fi
+        echo "$value"
+        return 0
+    fi
+
+    value=$(parse_yaml "$CONFIG_FILE" "vm.bridges.$bridge_id.link.$direction.$key")
+    if [ -z "$value" ]; then
+        value=$(parse_yaml "$CONFIG_FILE" "vm.bridges.$bridge_id.link.$key")
+    fi
+    echo "$value"
+}
+
+# Build the netem argument list from rate/delay/jitter/loss/limit values
+_netem_args() {
+    local delay="$1"
+    local jitter="$2"
+    local loss="$3"
+    local limit="$4"
+    local args=""
+
+    if [ -n "$delay" ]; then
+        args+="delay $delay "
+        [ -n "$jitter" ] && args+="$jitter "
+    fi
+    [ -n "$loss" ] && args+="loss $loss "
+    [ -n "$limit" ] && args+="limit $limit "
+    echo "$args"
+}
+
+_root_qdisc_kind() {
+    local dev="$1"
+    tc qdisc show dev "$dev" root 2>/dev/null | awk 'NR == 1 { print $2 }'
+}
+
+# Apply a rate/delay/jitter/loss/limit profile to the egress of a device.
+# Uses "replace" so it can be re-applied at runtime without touching the VM.
+link_shape_dev() {
+    local dev="$1"
+    local rate="$2"
+    local delay="$3"
+    local jitter="$4"
+    local loss="$5"
+    local limit="$6"
+    local netem_args current
+
+    netem_args=$(_netem_args "$delay" "$jitter" "$loss" "$limit")
+    current=$(_root_qdisc_kind "$dev")
+
+    if [ -z "$rate" ] && [ -z "$netem_args" ]; then
+        if [ "$current" = "htb" ] || [ "$current" = "netem" ]; then
+            sudo tc qdisc del dev "$dev" root 2>/dev/null || true
+        fi
+        return 0
+    fi
+
+    if [ -n "$rate" ]; then
+        if [ "$current" != "htb" ]; then
+            sudo tc qdisc del dev "$dev" root 2>/dev/null || true
+            sudo tc qdisc add dev "$dev" root handle 1: htb default 1 || return 1
+        fi
+        sudo tc class replace dev "$dev" parent 1: classid 1:1 htb rate "$rate" ceil "$rate" || return 1
+        if [ -n "$netem_args" ]; then
+            sudo tc qdisc replace dev "$dev" parent 1:1 handle 10: netem $netem_args || return 1
+        else
+            sudo tc qdisc replace dev "$dev" parent 1:1 handle 10: pfifo limit 1000 || return 1
+        fi
+    else
+        if [ "$current" = "htb" ]; then
+            sudo tc qdisc del dev "$dev" root 2>/dev/null || true
+        fi
+        sudo tc qdisc replace dev "$dev" root handle 1: netem $netem_args || return 1
+    fi
+    return 0
+}
+
+# clsact gives a device ingress/egress filter hooks that several users
+# share by priority (IFB redirect here, accounting in libs/accounting.sh)
+tc_clsact_ensure() {
+    local dev="$1"
+    local kind
+    kind=$(tc qdisc show dev "$dev" ingress 2>/dev/null | awk 'NR == 1 { print $2 }')
+
+    case "$kind" in
+        clsact) return 0 ;;
+        ingress) sudo tc qdisc del dev "$dev" ingress ;;
+    esac
+    sudo tc qdisc add dev "$dev" clsact
+}
+
+# Remove clsact once no filter is left on it
+tc_clsact_release() {
+    local dev="$1"
+
+    if [ -z "$(tc filter show dev "$dev" ingress 2>/dev/null)" ] && \
+       [ -z "$(tc filter show dev "$dev" egress 2>/dev/null)" ]; then
+        sudo tc qdisc del dev "$dev" clsact 2>/dev/null || true
+    fi
+}
+
+# Redirect the ingress of a tap port to its IFB device so it can be shaped
+_link_ifb_setup() {
+    local tap="$1"
+    local ifb
+    ifb=$(ifb_name "$tap")
+
+    if ! ip link show "$ifb" &>/dev/null; then
+        sudo modprobe ifb numifbs=0 2>/dev/null || true
+        sudo ip link add name "$ifb" type ifb || return 1
+    fi
+    sudo ip link set dev "$ifb" up
+
+    tc_clsact_ensure "$tap" || return 1
+    sudo tc filter replace dev "$tap" ingress protocol all prio 10 handle 1 \
+        matchall action mirred egress redirect dev "$ifb" || return 1
+    echo "$ifb"
+}
+
+_link_ifb_teardown() {
+    local tap="$1"
+    local ifb
+    ifb=$(ifb_name "$tap")
+
+    sudo tc filter del dev "$tap" ingress prio 10 2>/dev/null || true
+    tc_clsact_release "$tap"
+    if ip link show "$ifb" &>/dev/null; then
+        sudo ip link delete "$ifb"
+    fi
+}
+
+_link_direction_configured() {
+    local bridge_id="$1"
+    local direction="$2"
+    local key
+
+    for key in "${LINK_KEYS[@]}"; do
+        if [ -n "$(link_param "$bridge_id" "$direction" "$key")" ]; then
+            return 0
+        fi
+    done
+    return 1
+}
+
+link_describe() {
+    local bridge_id="$1"
+    local direction="$2"
+    local key value description=""
+
+    for key in "${LINK_KEYS[@]}"; do
+        value=$(link_param "$bridge_id" "$direction" "$key")
+        [ -n "$value" ] && description+="$key=$value "
+    done
+    echo "${description:-unshaped}"
+}
+
+# True when the qdiscs of a tap port still reflect an applied profile
+_link_state_present() {
+    local bridge_id="$1"
+    local tap="$2"
+
+    if _link_direction_configured "$bridge_id" down; then
+        case "$(_root_qdisc_kind "$tap")" in
+            htb|netem) ;;
+            *) return 1 ;;
+        esac
+    fi
+    if _link_direction_configured "$bridge_id" up; then
+        [ -d "/sys/class/net/$(ifb_name "$tap")" ] || return 1
+    fi
+    return 0
+}
+
+# Apply the YAML link profile of a bridge to this VM's tap port
+link_setup() {
+    local bridge_id="$1"
+    local tap
+    tap=$(tap_name "$bridge_id")
+
+    if [ ! -d "/sys/class/net/$tap" ]; then
+        log_warning "Tap port $tap not found, skipping link emulation for $bridge_id"
+        return 1
+    fi
+
+    if link_uses_linkem "$bridge_id"; then
+        linkem_setup "$bridge_id"
+        return $?
+    fi
+    linkem_stop "$bridge_id"
+
+    # Skip the tc calls when the applied profile is unchanged
+    local profile state_file="$VM_DIR/.link-$bridge_id"
+    profile="down [$(link_describe "$bridge_id" down)] up [$(link_describe "$bridge_id" up)]"
+    if [ "$(cat "$state_file" 2>/dev/null)" = "$profile" ] && _link_state_present "$bridge_id" "$tap"; then
+        log_info "Link emulation on $tap unchanged"
+        return 0
+    fi
+    rm -f "$state_file"
+
+    # bridge -> VM: egress of the tap port
+    link_shape_dev "$tap" \
+        "$(link_param "$bridge_id" down rate)" \
+        "$(link_param "$bridge_id" down delay)" \
+        "$(link_param "$bridge_id" down jitter)" \
+        "$(link_param "$bridge_id" down loss)" \
+        "$(link_param "$bridge_id" down limit)" \
+        || { log_error "Failed to shape $tap (down)"; return 1; }
+
+    # VM -> bridge: egress of the IFB fed by the tap ingress
+    if _link_direction_configured "$bridge_id" up; then
+        local ifb
+        ifb=$(_link_ifb_setup "$tap") || { log_error "Failed to set up IFB for $tap"; return 1; }
+        link_shape_dev "$ifb" \
+            "$(link_param "$bridge_id" up rate)" \
+            "$(link_param "$bridge_id" up delay)" \
+            "$(link_param "$bridge_id" up jitter)" \
+            "$(link_param "$bridge_id" up loss)" \
+            "$(link_param "$bridge_id" up limit)" \
+            || { log_error "Failed to shape $ifb (up)"; return 1; }
+    else
+        _link_ifb_teardown "$tap"
+    fi
+
+    echo "$profile" > "$state_file"
+    if _link_direction_configured "$bridge_id" down || _link_direction_configured "$bridge_id" up; then
+        log_success "Link emulation on $tap: $profile"
+    fi
+    return 0
+}
+
+link_teardown() {
+    local bridge_id="$1"
+    local tap
+    tap=$(tap_name "$bridge_id")
+
+    linkem_stop "$bridge_id"
+    _link_ifb_teardown "$tap"
+    sudo tc qdisc del dev "$tap" root 2>/dev/null || true
+    rm -f "$VM_DIR/.link-$bridge_id"
+}
+
+# Re-apply the link profiles of all bridges (running VMs are not restarted)
+links_setup() {
+    log_info "Applying link emulation..."
+
+    local name_bridges
+    name_bridges=$(get_yaml_subkeys "$CONFIG_FILE" vm.bridges)
+    if [ $? -ne 0 ]; then
+        log_error "Section 'vm.bridges' not found or empty"
+        return 1
+    fi
+
+    local bridge status=0
+    for bridge in $name_bridges; do
+        link_setup "$bridge" || status=1
+    done
+    return $status
+}
+
+links_status() {
+    log_info "Link emulation status:"
+
+    local name_bridges
+    name_bridges=$(get_yaml_subkeys "$CONFIG_FILE" vm.bridges) || return 1
+
+    local bridge tap
+    for bridge in $name_bridges; do
+        tap=$(tap_name "$bridge")
+        if ! ip link show "$tap" &>/dev/null; then
+            log_warning "  $bridge: tap port $tap not present"
+            continue
+        fi
+        log_info "  $bridge ($tap): down [$(link_describe "$bridge" down)] up [$(link_describe "$bridge" up)]"
+        if link_uses_linkem "$bridge"; then
+            linkem_status "$bridge"
+            continue
+        fi
+        tc -s qdisc show dev "$tap" | while read -r line; do
+            log_info "    $line"
+        done
+    done
+}
+
+# =============================================================================
+# USERSPACE EMULATOR
+# =============================================================================
+#
+# netem loses timing precision (and costs a lot of CPU) at multi-gigabit
+# rates with jitter. A bridge may use tools/linkem instead:
+#
+#   link:
+#     emulator: "linkem"
+#     rate: "2gbit"
+#     delay: "10ms"
+#     jitter: "100us"
+#     ge: "1%:30%"         # Gilbert-Elliott loss p:r[:loss_bad[:loss_good]]
+#     reorder: "0.5%"      # fraction of packets that skip the delay line
+#
+# The VM tap port is then kept off the bridge; linkem reads it with
+# AF_PACKET and attaches a port of its own (linkem_port_name) to the bridge.
+# Counters are appended to $VM_DIR/linkem-<bridge>.json every second.
+
+LINKEM_DIR="${MAIN_DIR}/tools/linkem"
+LINKEM_KEYS=(rate delay jitter loss ge reorder limit)
+
+link_uses_linkem() {
+    local bridge_id="$1"
+    [ "$(parse_yaml "$CONFIG_FILE" "vm.bridges.$bridge_id.link.emulator")" = "linkem" ]
+}
+
+linkem_port_name() {
+    local bridge_id="$1"
+    local tap
+    tap=$(tap_name "$bridge_id")
+    echo "l${tap:0:14}"
+}
+
+_linkem_build() {
+    if [ ! -x "$LINKEM_DIR/linkem" ] || [ "$LINKEM_DIR/linkem.c" -nt "$LINKEM_DIR/linkem" ]; then
+        log_info "Building linkem..."
+        make -s -C "$LINKEM_DIR" || { log_error "Failed to build linkem"; return 1; }
+    fi
+}
+
+# "rate=...,delay=...," profile of one direction
+_linkem_spec() {
+    local bridge_id="$1"
+    local direction="$2"
+    local key value spec=""
+
+    for key in "${LINKEM_KEYS[@]}"; do
+        value=$(link_param "$bridge_id" "$direction" "$key")
+        [ -n "$value" ] && spec+="${spec:+,}$key=$value"
+    done
+    echo "$spec"
+}
+
+_linkem_running() {
+    local pid_file="$1"
+    [ -f "$pid_file" ] && sudo kill -0 "$(cat "$pid_file")" 2>/dev/null
+}
+
+linkem_setup() {
+    local bridge_id="$1"
+    local tap port pid_file="$VM_DIR/linkem-$bridge_id.pid"
+    tap=$(tap_name "$bridge_id")
+    port=$(linkem_port_name "$bridge_id")
+
+    local args=(-i "$tap" -p "$port" -b "$bridge_id" -N "$bridge_id" -o "$VM_DIR/linkem-$bridge_id.json")
+    local up down seed
+    up=$(_linkem_spec "$bridge_id" up)
+    down=$(_linkem_spec "$bridge_id" down)
+    seed=$(parse_yaml "$CONFIG_FILE" "vm.trace_seed")
+    [ -n "$up" ] && args+=(-u "$up")
+    [ -n "$down" ] && args+=(-d "$down")
+    [ -n "$seed" ] && args+=(-S "$seed")
+
+    local profile state_file="$VM_DIR/.link-$bridge_id"
+    profile="linkem ${args[*]}"
+    if [ "$(cat "$state_file" 2>/dev/null)" = "$profile" ] && _linkem_running "$pid_file"; then
+        log_info "linkem on $tap unchanged"
+        return 0
+    fi
+    rm -f "$state_file"
+
+    _linkem_build || return 1
+    linkem_stop "$bridge_id"
+
+    # No tc shaping on the tap, and the tap must not be switched directly
+    _link_ifb_teardown "$tap"
+    sudo tc qdisc del dev "$tap" root 2>/dev/null || true
+    if [ -e "/sys/class/net/$tap/master" ]; then
+        sudo ip link set dev "$tap" nomaster
+    fi
+
+    sudo "$LINKEM_DIR/linkem" "${args[@]}" > "$VM_DIR/linkem-$bridge_id.log" 2>&1 &
+    echo $! > "$pid_file"
+
+    if ! wait_for 2 test -d "/sys/class/net/$port"; then
+        log_error "linkem failed to start for $bridge_id:"
+        cat "$VM_DIR/linkem-$bridge_id.log"
+        linkem_stop "$bridge_id"
+        return 1
+    fi
+    echo "$profile" > "$state_file"
+    log_success "linkem on $tap <-> $port: up [$up] down [$down]"
+}
+
+linkem_stop() {
+    local bridge_id="$1"
+    local pid_file="$VM_DIR/linkem-$bridge_id.pid"
+    local port
+    port=$(linkem_port_name "$bridge_id")
+
+    if [ -f "$pid_file" ]; then
+        sudo pkill -P "$(cat "$pid_file")" linkem 2>/dev/null || true
+        sudo kill "$(cat "$pid_file")" 2>/dev/null || true
+        rm -f "$pid_file"
+        # The port is removed when linkem closes it
+        wait_for 2 test ! -d "/sys/class/net/$port" || true
+    fi
+    return 0
+}
+
+linkem_status() {
+    local bridge_id="$1"
+    local counters="$VM_DIR/linkem-$bridge_id.json"
+
+    if ! _linkem_running "$VM_DIR/linkem-$bridge_id.pid"; then
+        log_warning "    linkem not running"
+        return 0
+    fi
+    log_info "    linkem port: $(linkem_port_name "$bridge_id")"
+    [ -f "$counters" ] && log_info "    $(tail -n 1 "$counters")"
+}
+
+# =============================================================================
+# TRACE REPLAY
+# =============================================================================
+#
+# A bridge (or one of its directions) may replay a time-varying trace
+# instead of the static values above:
+#
+#   link:
+#     trace: "tools/traceplay/examples/wifi.trace"
+#     trace_format: "mahimahi"    # optional, default is the text format
+#
+# The player waits on a FIFO so the start can be aligned with the iperf run:
+#   ./script.sh client.yaml --trace start    # arm the player
+#   ./script.sh client.yaml --trace sync     # start now (right before iperf)
+
+TRACEPLAY_DIR="${MAIN_DIR}/tools/traceplay"
+
+_traceplay_build() {
+    if [ ! -x "$TRACEPLAY_DIR/traceplay" ] || [ "$TRACEPLAY_DIR/traceplay.c" -nt "$TRACEPLAY_DIR/traceplay" ]; then
+        log_info "Building traceplay..."
+        make -s -C "$TRACEPLAY_DIR" || { log_error "Failed to build traceplay"; return 1; }
+    fi
+}
+
+# Build the "-p DEV=TRACE,..." arguments for every bridge/direction with a trace
+_link_trace_specs() {
+    local name_bridges bridge direction trace format limit dev spec
+    name_bridges=$(get_yaml_subkeys "$CONFIG_FILE" vm.bridges) || return 1
+
+    for bridge in $name_bridges; do
+        for direction in down up; do
+            trace=$(link_param "$bridge" "$direction" trace)
+            [ -z "$trace" ] && continue
+            if link_uses_linkem "$bridge"; then
+                log_error "Trace replay is not supported with linkem ($bridge)" >&2
+                return 1
+            fi
+            [[ "$trace" != /* ]] && trace="$MAIN_DIR/$trace"
+            if [ ! -f "$trace" ]; then
+                log_error "Trace file not found for $bridge ($direction): $trace" >&2
+                return 1
+            fi
+
+            dev=$(tap_name "$bridge")
+            if [ "$direction" = "up" ]; then
+                dev=$(_link_ifb_setup "$dev") || return 1
+            fi
+
+            spec="$dev=$trace"
+            format=$(link_param "$bridge" "$direction" trace_format)
+            [ "$format" = "mahimahi" ] && spec+=",mahimahi"
+            limit=$(link_param "$bridge" "$direction" limit)
+            [ -n "$limit" ] && spec+=",limit=$limit"
+            echo "-p $spec"
+        done
+    done
+}
+
+link_trace_start() {
+    local start="${1:-sync}"
+    local pid_file="$VM_DIR/traceplay.pid"
+    local fifo="$VM_DIR/traceplay.sync"
+
+    _traceplay_build || return 1
+    link_trace_stop quiet
+    rm -f "$VM_DIR"/.link-*
+
+    local specs
+    specs=$(_link_trace_specs) || return 1
+    if [ -z "$specs" ]; then
+        log_warning "No link traces configured for $VM_NAME"
+        return 0
+    fi
+
+    local args=(-L "$VM_DIR/traceplay.log")
+    local seed loop
+    seed=$(parse_yaml "$CONFIG_FILE" "vm.trace_seed")
+    loop=$(parse_yaml "$CONFIG_FILE" "vm.trace_loop")
+    [ -n "$seed" ] && args+=(-S "$seed")
+    [ "$loop" = "true" ] && args+=(-l)
+
+    if [ "$start" = "sync" ]; then
+        rm -f "$fifo"
+        mkfifo "$fifo"
+        args+=(-f "$fifo")
+    else
+        args+=(-s "$start")
+    fi
+
+    # shellcheck disable=SC2086
+    sudo "$TRACEPLAY_DIR/traceplay" "${args[@]}" $specs > "$VM_DIR/traceplay.out" 2>&1 &
+    echo $! > "$pid_file"
+
+    if [ "$start" = "sync" ]; then
+        log_success "Trace player armed (PID: $(cat "$pid_file")), start it with: --trace sync"
+    else
+        log_success "Trace player started (PID: $(cat "$pid_file")), start at: $start"
+    fi
+}
+
+# Release an armed player; all paths start at the same epoch millisecond
+link_trace_sync() {
+    local fifo="$VM_DIR/traceplay.sync"
+    local start_ms="${1:-$(date +%s%3N)}"
+
+    if [ ! -p "$fifo" ]; then
+        log_error "No armed trace player for $VM_NAME"
+        return 1
+    fi
+    echo "$start_ms" > "$fifo"
+    rm -f "$fifo"
+    log_info "Trace replay started at $start_ms ms"
+}
+
+link_trace_stop() {
+    local quiet="$1"
+    local pid_file="$VM_DIR/traceplay.pid"
+
+    if [ -f "$pid_file" ]; then
+        sudo pkill -P "$(cat "$pid_file")" traceplay 2>/dev/null || true
+        sudo kill "$(cat "$pid_file")" 2>/dev/null || true
+        rm -f "$pid_file" "$VM_DIR/traceplay.sync"
+        [ -z "$quiet" ] && log_info "Trace player stopped, restoring static link profiles"
+        [ -z "$quiet" ] && links_setup
+    fi
+    return 0
+}
@@ -0,0 +1,572 @@
+#!/bin/bash
+
+# =============================================================================
+# EXPERIMENT MATRIX RUNNER
+# =============================================================================
+#
+# Runs every scheduler x link profile x workload x repetition cell of a
+# matrix file against running VM pairs, non-interactively (vm_ssh):
+#
+#   experiment:
+#     name: "schedulers"
+#     schedulers: "default minrtt blest"
+#     profiles: "symmetric lossy"     # names under "profiles" below ("none": unshaped)
+#     workloads: "bulk reverse"       # names under "workloads" below
+#     repetitions: 5
+#     duration: 30                    # iperf3 -t
+#     omit: 3                         # warm-up seconds left out of the results (-O)
+#     retries: 2                      # extra attempts of a failed cell
+#     shuffle: true                   # run the cells in random order
+#     telemetry_us: 5000              # per-subflow sock_diag polling (tools/vkdiag), 0: off
+#     schedtrace: true                # scheduler latency/path choices (virtk-sched)
+#     pairs:                          # one worker per pair, all in parallel
+#       pair1:
+#         client: "client.yaml"
+#         server: "server.yaml"
+#         server_ip: "10.0.0.20"
+#   profiles:
+#     lossy:
+#       br0:
+#         rate: "50mbit"
+#         loss: "1%"
+#   workloads:
+#     bulk: ""                        # extra iperf3 client arguments
+#     reverse: "-R"
+#     web: "vkload -m fct -B 10"      # or a vkload client command line
+#
+# Profiles use the keys of the bridge "link" sections (including up/down)
+# and are applied to the tap ports of each pair's client VM. Pairs must not
+# share bridges, otherwise their cells are not independent.
+#
+# Every cell gets results/<name>-<date>/<scheduler>/<profile>/<workload>/rep<N>/
+# with the iperf3 JSON and a meta.env; results.csv indexes all cells. Running
+# again into the same directory only runs the cells that did not succeed.
+# The successful runs are also ingested into results.vks (tools/vkstore):
+#
+#   tools/vkstore/vkstore query results.vks -g scheduler,profile -w workload=bulk
+#
+# With telemetry_us, the client VM polls the cwnd, RTT and bytes of every
+# subflow during the run (vkdiag, in the rootfs) into an in-memory ring,
+# saved as diag.bin and decoded into diag.csv in the cell directory.
+# With schedtrace, the client runs iperf3 under virtk-sched: sched.jsonl,
+# sched.csv and sched-paths.csv per cell, the sched_* summary in meta.env
+# and results.csv (libs/schedtrace.sh, clients built with vm.schedtrace).
+#
+# A workload starting with "vkload" runs tools/vkload (in the rootfs) with
+# those arguments instead of iperf3, into vkload.json (no warm-up: omit is
+# ignored). Short-flow workloads (-m fct) also record the flow completion
+# time percentiles (fct_*_ms, pct_p99_ms for pages) in meta.env and
+# results.csv, and need at least one completed flow to succeed; query them
+# with -m fct_p99 etc.
+#
+# experiment.timeline plays path events on the client VM during every run
+# (libs/events.sh), at offsets from the client launch:
+#
+#     timeline: "10 br1 down; 20 br1 up"
+#     sample_interval: 0.1            # throughput samples (-i) the events are aligned with
+#
+# Each cell then also has events.csv (when every event took effect), the
+# tap byte counters in paths.csv and failover.csv: goodput before/after,
+# gap and recovery time per event. meta.env and results.csv get the
+# failover_* times of the first down/blackhole event and the MPTCP
+# reinjections (reinject_segs, dup_data_segs) of the run. The links are
+# reset to the profile after every run.
+
+MATRIX_PORT=5201
+VKSTORE_DIR="${MAIN_DIR}/tools/vkstore"
+VKDIAG_DIR="${MAIN_DIR}/tools/vkdiag"
+
+_vkstore_build() {
+    if [ ! -x "$VKSTORE_DIR/vkstore" ] || [ "$VKSTORE_DIR/vkstore.c" -nt "$VKSTORE_DIR/vkstore" ]; then
+        log_info "Building vkstore..."
+        make -s -C "$VKSTORE_DIR" || { log_error "Failed to build vkstore"; return 1; }
+    fi
+}
+
+# Host build of vkdiag, only used to decode (the guests run the static one)
+_vkdiag_build() {
+    if [ ! -x "$VKDIAG_DIR/vkdiag" ] || [ "$VKDIAG_DIR/vkdiag.c" -nt "$VKDIAG_DIR/vkdiag" ]; then
+        log_info "Building vkdiag..."
+        make -s -C "$VKDIAG_DIR" vkdiag || { log_error "Failed to build vkdiag"; return 1; }
+    fi
+}
+
+matrix_param() {
+    local key="$1"
+    local default="$2"
+    local value
+    value=$(parse_yaml "$MATRIX_FILE" "experiment.$key")
+    echo "${value:-$default}"
+}
+
+# One "scheduler profile workload rep" line per cell
+matrix_cells() {
+    local scheduler profile workload rep repetitions
+    repetitions=$(matrix_param repetitions 1)
+
+    for scheduler in $(matrix_param schedulers default); do
+        for profile in $(matrix_param profiles none); do
+            for workload in $(matrix_param workloads bulk); do
+                for (( rep = 1; rep <= repetitions; rep++ )); do
+                    echo "$scheduler $profile $workload $rep"
+                done
+            done
+        done
+    done
+}
+
+_matrix_config_path() {
+    local config="$1"
+    [[ "$config" != /* ]] && config="$MAIN_DIR/$config"
+    echo "$config"
+}
+
+# Pop the first cell of the shared queue
+_matrix_next_cell() {
+    local queue="$1"
+    (
+        flock 9
+        head -n 1 "$queue"
+        sed -i 1d "$queue"
+    ) 9> "$queue.lock"
+}
+
+_matrix_is_vkload() {
+    [[ "$1" == vkload || "$1" == "vkload "* ]]
+}
+
+# File the client writes in a cell, the rest of its name is kept for the
+# failed attempts (vkstore ingests *.json)
+_matrix_output() {
+    _matrix_is_vkload "$1" && echo "vkload" || echo "iperf"
+}
+
+# key=value summary of a vkload JSON (meta.env)
+_matrix_vkload_summary() {
+    awk 'function num(key) {
+             if (!match($0, "\"" key "\": [0-9.e+-]+"))
+                 return ""
+             return substr($0, RSTART + length(key) + 4, RLENGTH - length(key) - 4)
+         }
+         /^  "duration_s"/ { print "duration=" num("duration_s") }
+         /^  "receiver"/   { print "bits_per_second=" num("bits_per_second") }
+         /^    "completed"/ { print "fct_completed=" num("completed") }
+         /^    "failed"/   { print "fct_failed=" num("failed") }
+         /^    "fct_ms"/   { print "fct_p50_ms=" num("p50"); print "fct_p99_ms=" num("p99"); print "fct_p999_ms=" num("p999") }
+         /^    "pages"/    { print "pct_p99_ms=" num("p99") }' "$1"
+}
+
+# Receiver throughput and duration of an iperf3 JSON, empty if the run failed
+_matrix_iperf_summary() {
+    local json="$1"
+    grep -q '"error"' "$json" && return 1
+    awk '/"sum_received"/ { f = 1 }
+         f && /"seconds"/ { gsub(/[^0-9.e+-]/, "", $2); seconds = $2 }
+         f && /"bits_per_second"/ { gsub(/[^0-9.e+-]/, "", $2); print $2, seconds; exit }' "$json"
+}
+
+# Apply a profile to the tap ports of a client VM
+_matrix_link_setup() {
+    _matrix_client_env "$1" "$2" links_setup
+}
+
+# Run a link or path event command for the tap ports of a client VM, with
+# the links of a profile
+_matrix_client_env() {
+    local client="$1"
+    local profile="$2"
+    local name
+    shift 2
+    name=$(parse_yaml "$client" "vm.name")
+
+    [ "$profile" = "none" ] && profile="__none__"
+    CONFIG_FILE="$client" VM_NAME="$name" VM_DIR="$MAIN_DIR/VirtK_Machines/$name" \
+        LINK_PROFILE_FILE="$MATRIX_FILE" LINK_PROFILE="$profile" "$@"
+}
+
+# Back to the profile on every bridge of the timeline
+_matrix_events_reset() {
+    local client="$1"
+    local profile="$2"
+    local bridge
+
+    for bridge in $(_path_events_lines "$(matrix_param timeline "")" | awk '{ print $2 }' | sort -u); do
+        _matrix_client_env "$client" "$profile" path_event "$bridge" reset
+    done
+}
+
+# failover.csv of a run and its key=value summary (failover.env)
+_matrix_events_report() {
+    local client="$1"
+    local server="$2"
+    local cell_dir="$3"
+    local out="$4"
+    local args="$5"
+    local clock_offset="$6"
+    local mib_before="$7"
+    local t0 mib_after store="$cell_dir/.samples.vks"
+
+    # Guest time of the first sample's start
+    if _matrix_is_vkload "$args"; then
+        t0=$(awk -F'[:,]' '/^  "start_epoch_ns"/ { gsub(/ /, "", $2); print $2 }' "$out")
+    else
+        t0=$(vm_ssh "$client" "cat /tmp/vkrun.t0") && \
+            t0=$(( t0 + $(matrix_param omit 0) * 1000000000 ))
+    fi
+    [ -n "$t0" ] || return 1
+
+    rm -f "$store"
+    "$VKSTORE_DIR/vkstore" ingest "$store" "$out" > /dev/null || return 1
+    "$VKSTORE_DIR/vkstore" dump "$store" | awk -F, '$3 == "sum" && $11 == 0 { print $4, $5, $6 }' | \
+        path_events_analyze "$cell_dir/events.csv" "$t0" "$clock_offset" > "$cell_dir/failover.csv"
+    rm -f "$store"
+    path_events_summary "$cell_dir/failover.csv"
+
+    # MPTCP retransmissions of the sender and duplicates at the receiver,
+    # whichever side each one is
+    mib_after="$(path_events_mib "$client") $(path_events_mib "$server")"
+    awk -v b="$mib_before" -v a="$mib_after" 'BEGIN {
+        split(b, x, " "); split(a, y, " ")
+        print "reinject_segs=" y[1] - x[1] + y[3] - x[3]
+        print "dup_data_segs=" y[2] - x[2] + y[4] - x[4]
+    }'
+}
+
+_matrix_link_describe() {
+    local client="$1"
+    local profile="$2"
+    local bridge
+
+    [ "$profile" = "none" ] && profile="__none__"
+    for bridge in $(get_yaml_subkeys "$client" vm.bridges); do
+        echo "link_$bridge=down [$(LINK_PROFILE_FILE="$MATRIX_FILE" LINK_PROFILE="$profile" link_describe "$bridge" down)]" \
+             "up [$(LINK_PROFILE_FILE="$MATRIX_FILE" LINK_PROFILE="$profile" link_describe "$bridge" up)]"
+    done
+}
+
+_matrix_attempt() {
+    local client="$1"
+    local server="$2"
+    local server_ip="$3"
+    local scheduler="$4"
+    local cell_dir="$5"
+    local args="$6"
+    local profile="$7"
+    local duration omit telemetry_us telemetry="" tracer="" server_cmd client_cmd out
+    local timeline stamp="" clock_offset=0 mib_before="" events_pid samples_pid
+    duration=$(matrix_param duration 10)
+    omit=$(matrix_param omit 0)
+    telemetry_us=$(matrix_param telemetry_us 0)
+    out="$cell_dir/$(_matrix_output "$args").json"
+
+    if _matrix_is_vkload "$args"; then
+        server_cmd="setsid vkload -s -p $MATRIX_PORT > /dev/null 2>&1 < /dev/null &"
+        client_cmd="vkload -c $server_ip -p $MATRIX_PORT -t $duration -J ${args#vkload}"
+    else
+        server_cmd="mptcpize run iperf3 -s -1 -D -p $MATRIX_PORT || exit 1"
+        client_cmd="mptcpize run iperf3 -c $server_ip -p $MATRIX_PORT -t $duration -O $omit -J $args"
+    fi
+
+    # One-off server per attempt, so a stuck server never outlives a cell
+    vm_ssh "$server" "sysctl -qw net.mptcp.scheduler=$scheduler && pkill -x iperf3; pkill -x vkload;
+        for i in \$(seq 50); do
+            pgrep -x 'iperf3|vkload' > /dev/null || break
+            sleep 0.1
+        done
+        $server_cmd
+        for i in \$(seq 50); do
+            ss -Hltn 'sport = :$MATRIX_PORT' | grep -q . && exit 0
+            sleep 0.1
+        done
+        exit 1" > "$cell_dir/server.log" 2>&1 || return 1
+
+    # Samples for the events to be aligned with, and the guest start time
+    timeline=$(matrix_param timeline "")
+    if [ -n "$timeline" ]; then
+        client_cmd="$client_cmd -i $(matrix_param sample_interval 0.1)"
+        stamp="date +%s%N > /tmp/vkrun.t0;"
+        clock_offset=$(path_events_clock_offset "$client") || \
+            { log_warning "No guest clock offset for $cell_dir, assuming 0"; clock_offset=0; }
+        mib_before="$(path_events_mib "$client") $(path_events_mib "$server")"
+    fi
+
+    # The collector only writes its ring to the guest tmpfs after the run
+    if [ "$(matrix_param schedtrace false)" = "true" ]; then
+        tracer="virtk-sched -o /tmp/vksched.jsonl --"
+    fi
+    if [ "$telemetry_us" -gt 0 ]; then
+        telemetry="vkdiag -i $telemetry_us -p $MATRIX_PORT -o /tmp/vkdiag.bin & diag=\$!;"
+    fi
+
+    if [ -n "$timeline" ]; then
+        _matrix_client_env "$client" "$profile" path_samples_run "$cell_dir/paths.csv" &
+        samples_pid=$!
+        _matrix_client_env "$client" "$profile" path_events_run "$timeline" "$cell_dir/events.csv" &
+        events_pid=$!
+    fi
+    vm_ssh "$client" \
+        "sysctl -qw net.mptcp.scheduler=$scheduler || exit 1; $telemetry
+         $stamp $tracer timeout $((duration + omit + 30)) $client_cmd
+         status=\$?
+         [ -n \"\$diag\" ] && kill -INT \$diag && wait \$diag
+         exit \$status" \
+        > "$out" 2> "$cell_dir/client.log"
+    _matrix_is_vkload "$args" && vm_ssh "$server" "pkill -x vkload" > /dev/null 2>&1
+
+    if [ -n "$timeline" ]; then
+        # events past the end of the run are not played
+        kill "$events_pid" "$samples_pid" 2>/dev/null
+        wait "$events_pid" "$samples_pid" 2>/dev/null
+        _matrix_events_reset "$client" "$profile" >> "$cell_dir/link.log" 2>&1
+        rm -f "$cell_dir/failover.env"
+        _matrix_events_report "$client" "$server" "$cell_dir" "$out" "$args" "$clock_offset" "$mib_before" \
+            > "$cell_dir/failover.env" 2>> "$cell_dir/client.log" || \
+            log_warning "No failover analysis for $cell_dir"
+    fi
+
+    if [ "$telemetry_us" -gt 0 ]; then
+        vm_ssh "$client" "cat /tmp/vkdiag.bin && rm -f /tmp/vkdiag.bin" > "$cell_dir/diag.bin" 2>> "$cell_dir/client.log" && \
+            "$VKDIAG_DIR/vkdiag" -r "$cell_dir/diag.bin" > "$cell_dir/diag.csv" 2>> "$cell_dir/client.log" || \
+            log_warning "No telemetry for $cell_dir"
+    fi
+    if [ -n "$tracer" ]; then
+        rm -f "$cell_dir/sched.env"
+        vm_ssh "$client" "cat /tmp/vksched.jsonl && rm -f /tmp/vksched.jsonl" > "$cell_dir/sched.jsonl" 2>> "$cell_dir/client.log" && \
+            schedtrace_report "$cell_dir/sched.jsonl" "$cell_dir/sched" > "$cell_dir/sched.env" 2>> "$cell_dir/client.log" || \
+            log_warning "No scheduler trace for $cell_dir"
+    fi
+
+    # Interrupted runs still produce a JSON: require the full duration
+    local summary seconds
+    if _matrix_is_vkload "$args"; then
+        summary=$(_matrix_vkload_summary "$out")
+        seconds=$(echo "$summary" | sed -n 's/^duration=//p')
+        [ -n "$seconds" ] || return 1
+        # Short flows must have completed at least one
+        grep -qx 'fct_completed=0' <<< "$summary" && return 1
+        awk -v s="$seconds" -v d="$duration" 'BEGIN { exit !(s >= d - 0.5) }'
+        return
+    fi
+    summary=$(_matrix_iperf_summary "$out") || return 1
+    seconds=${summary#* }
+    [ -n "$summary" ] && awk -v s="$seconds" -v d="$duration" 'BEGIN { exit !(s >= d - 0.5) }'
+}
+
+_matrix_cell_run() {
+    local pair="$1"
+    local scheduler="$2"
+    local profile="$3"
+    local workload="$4"
+    local rep="$5"
+    local cell_dir="$MATRIX_OUT/$scheduler/$profile/$workload/rep$rep"
+    local client server server_ip args retries attempt status=failed start output
+
+    if grep -qx "status=ok" "$cell_dir/meta.env" 2>/dev/null; then
+        log_info "[$pair] $scheduler/$profile/$workload/rep$rep already done"
+        return 0
+    fi
+    rm -rf "$cell_dir"
+    mkdir -p "$cell_dir"
+
+    client=$(_matrix_config_path "$(parse_yaml "$MATRIX_FILE" "experiment.pairs.$pair.client")")
+    server=$(_matrix_config_path "$(parse_yaml "$MATRIX_FILE" "experiment.pairs.$pair.server")")
+    server_ip=$(parse_yaml "$MATRIX_FILE" "experiment.pairs.$pair.server_ip")
+    args=$(parse_yaml "$MATRIX_FILE" "workloads.$workload")
+    retries=$(matrix_param retries 2)
+    output=$(_matrix_output "$args")
+
+    start=$(date +%s)
+    if ! _matrix_link_setup "$client" "$profile" > "$cell_dir/link.log" 2>&1; then
+        log_error "[$pair] Failed to apply profile $profile"
+        attempt=0
+    else
+        for (( attempt = 1; attempt <= retries + 1; attempt++ )); do
+            if _matrix_attempt "$client" "$server" "$server_ip" "$scheduler" "$cell_dir" "$args" "$profile"; then
+                status=ok
+                break
+            fi
+            log_warning "[$pair] $scheduler/$profile/$workload/rep$rep attempt $attempt failed"
+            # kept out of vkstore ingest: a failed run has no "error" key to
+            # be skipped by
+            mv "$cell_dir/$output.json" "$cell_dir/$output-failed-$attempt.json.txt" 2>/dev/null || true
+            sleep $(( attempt * 2 ))
+        done
+        (( attempt > retries + 1 )) && attempt=$(( retries + 1 ))
+    fi
+
+    local summary bits_per_second="" fct_summary=""
+    if [ "$status" = "ok" ] && _matrix_is_vkload "$args"; then
+        summary=$(_matrix_vkload_summary "$cell_dir/$output.json")
+        bits_per_second=$(echo "$summary" | sed -n 's/^bits_per_second=//p')
+        fct_summary=$(echo "$summary" | grep -E '^(fct|pct)_')
+    elif [ "$status" = "ok" ]; then
+        summary=$(_matrix_iperf_summary "$cell_dir/$output.json")
+        bits_per_second=${summary%% *}
+    fi
+
+    {
+        echo "status=$status"
+        echo "scheduler=$scheduler"
+        echo "profile=$profile"
+        echo "workload=$workload"
+        echo "rep=$rep"
+        echo "pair=$pair"
+        echo "attempts=$attempt"
+        echo "bits_per_second=$bits_per_second"
+        if _matrix_is_vkload "$args"; then
+            echo "vkload_args=-t $(matrix_param duration 10)${args#vkload}"
+        else
+            echo "iperf_args=-t $(matrix_param duration 10) -O $(matrix_param omit 0) $args"
+        fi
+        [ -n "$fct_summary" ] && echo "$fct_summary"
+        echo "server_ip=$server_ip"
+        echo "start=$start"
+        echo "end=$(date +%s)"
+        echo "client_kernel=$(vm_ssh "$client" uname -r 2>/dev/null)"
+        echo "server_kernel=$(vm_ssh "$server" uname -r 2>/dev/null)"
+        _matrix_link_describe "$client" "$profile"
+        if [ "$status" = "ok" ] && [ -f "$cell_dir/sched.env" ]; then
+            cat "$cell_dir/sched.env"
+        fi
+        if [ "$status" = "ok" ] && [ -f "$cell_dir/failover.env" ]; then
+            echo "timeline=$(matrix_param timeline "")"
+            cat "$cell_dir/failover.env"
+        fi
+    } > "$cell_dir/meta.env"
+
+    if [ "$status" = "ok" ]; then
+        log_success "[$pair] $scheduler/$profile/$workload/rep$rep: $bits_per_second bit/s"
+    else
+        log_error "[$pair] $scheduler/$profile/$workload/rep$rep failed after $attempt attempt(s)"
+    fi
+}
+
+_matrix_worker() {
+    local pair="$1"
+    local queue="$2"
+    local cell
+
+    while cell=$(_matrix_next_cell "$queue") && [ -n "$cell" ]; do
+        # shellcheck disable=SC2086
+        _matrix_cell_run "$pair" $cell
+    done
+}
+
+_matrix_index() {
+    local meta
+    echo "scheduler,profile,workload,rep,pair,status,attempts,bits_per_second,start,sched_send_calls_per_s,sched_send_mean_ns,sched_send_p99_ns,fct_p50_ms,fct_p99_ms,fct_p999_ms,failover_gap_s,failover_recovery_s,reinject_segs"
+    for meta in "$MATRIX_OUT"/*/*/*/rep*/meta.env; do
+        [ -f "$meta" ] || continue
+        awk -F= '{ v[$1] = substr($0, length($1) + 2) }
+            END { print v["scheduler"] "," v["profile"] "," v["workload"] "," v["rep"] "," \
+                        v["pair"] "," v["status"] "," v["attempts"] "," v["bits_per_second"] "," v["start"] "," \
+                        v["sched_send_calls_per_s"] "," v["sched_send_mean_ns"] "," v["sched_send_p99_ns"] "," \
+                        v["fct_p50_ms"] "," v["fct_p99_ms"] "," v["fct_p999_ms"] "," \
+                        v["failover_gap_s"] "," v["failover_recovery_s"] "," v["reinject_segs"] }' "$meta"
+    done
+}
+
+# Usage: matrix_run <matrix.yaml> [OUT_DIR]
+matrix_run() {
+    MATRIX_FILE=$(realpath "$1")
+    local pairs pair name queue profile
+    if [ ! -f "$MATRIX_FILE" ]; then
+        log_error "Matrix file not found: $1"
+        return 1
+    fi
+
+    # loaded in this shell, so the workers inherit the parsed files
+    yaml_load "$MATRIX_FILE"
+    name=$(matrix_param name matrix)
+    MATRIX_OUT="${2:-$MAIN_DIR/results/$name-$(date +%Y%m%d-%H%M%S)}"
+    pairs=$(get_yaml_subkeys "$MATRIX_FILE" experiment.pairs) || { log_error "No experiment.pairs in $MATRIX_FILE"; return 1; }
+
+    for profile in $(matrix_param profiles none); do
+        if [ "$profile" != "none" ] && ! get_yaml_subkeys "$MATRIX_FILE" "profiles.$profile" > /dev/null; then
+            log_error "Profile $profile not defined under profiles"
+            return 1
+        fi
+    done
+
+    sudo -v || return 1
+    vm_ssh_key || return 1
+    for pair in $pairs; do
+        local role config client
+        for role in client server; do
+            config=$(_matrix_config_path "$(parse_yaml "$MATRIX_FILE" "experiment.pairs.$pair.$role")")
+            yaml_load "$config"
+            if ! vm_ssh "$config" true; then
+                log_error "Cannot reach the $role VM of $pair ($config), is it running?"
+                return 1
+            fi
+        done
+        client=$(_matrix_config_path "$(parse_yaml "$MATRIX_FILE" "experiment.pairs.$pair.client")")
+        if [ "$(matrix_param telemetry_us 0)" -gt 0 ] && ! vm_ssh "$client" "command -v vkdiag" > /dev/null; then
+            log_error "vkdiag not installed in the client VM of $pair, rebuild its rootfs"
+            return 1
+        fi
+        if [ "$(matrix_param schedtrace false)" = "true" ] && ! vm_ssh "$client" "command -v virtk-sched" > /dev/null; then
+            log_error "virtk-sched not installed in the client VM of $pair (vm.schedtrace: true, rebuild)"
+            return 1
+        fi
+        local workload
+        for workload in $(matrix_param workloads bulk); do
+            _matrix_is_vkload "$(parse_yaml "$MATRIX_FILE" "workloads.$workload")" || continue
+            for role in client server; do
+                config=$(_matrix_config_path "$(parse_yaml "$MATRIX_FILE" "experiment.pairs.$pair.$role")")
+                if ! vm_ssh "$config" "command -v vkload" > /dev/null; then
+                    log_error "vkload not installed in the $role VM of $pair ($workload), rebuild its rootfs"
+                    return 1
+                fi
+            done
+            break
+        done
+    done
+    if [ "$(matrix_param telemetry_us 0)" -gt 0 ]; then
+        _vkdiag_build || return 1
+    fi
+    if [ -n "$(matrix_param timeline "")" ]; then
+        _vkstore_build || return 1
+        for pair in $pairs; do
+            _matrix_client_env "$(_matrix_config_path "$(parse_yaml "$MATRIX_FILE" "experiment.pairs.$pair.client")")" \
+                none path_events_check "$(matrix_param timeline "")" || return 1
+        done
+    fi
+
+    mkdir -p "$MATRIX_OUT"
+    cp "$MATRIX_FILE" "$MATRIX_OUT/matrix.yaml"
+    git -C "$MAIN_DIR" rev-parse HEAD > "$MATRIX_OUT/virtk.commit" 2>/dev/null
+
+    queue="$MATRIX_OUT/.queue"
+    if [ "$(matrix_param shuffle false)" = "true" ]; then
+        matrix_cells | shuf > "$queue"
+    else
+        matrix_cells > "$queue"
+    fi
+    log_info "Running $(wc -l < "$queue") cells on: $(echo $pairs) -> $MATRIX_OUT"
+
+    local -A pids
+    for pair in $pairs; do
+        _matrix_worker "$pair" "$queue" &
+        pids[$pair]=$!
+    done
+    for pair in $pairs; do
+        wait "${pids[$pair]}" || true
+    done
+    rm -f "$queue" "$queue.lock"
+
+    _matrix_index > "$MATRIX_OUT/results.csv"
+    if _vkstore_build; then
+        "$VKSTORE_DIR/vkstore" ingest "$MATRIX_OUT/results.vks" "$MATRIX_OUT" && \
+            "$VKSTORE_DIR/vkstore" query "$MATRIX_OUT/results.vks" -g scheduler,profile,workload || \
+            log_warning "Failed to ingest the results into $MATRIX_OUT/results.vks"
+    fi
+    local failed
+    failed=$(grep -c ',failed,' "$MATRIX_OUT/results.csv" || true)
+    if [ "$failed" -gt 0 ]; then
+        log_warning "$failed cell(s) failed, run again with the same directory to retry them:"
+        log_warning "  ./script.sh $(basename "$CONFIG_FILE") --matrix $1 $MATRIX_OUT"
+        return 1
+    fi
+    log_success "Matrix done: $MATRIX_OUT/results.csv"
+}
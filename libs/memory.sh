@@ -0,0 +1,147 @@
+#!/bin/bash
+
+# =============================================================================
+# MEMORY DENSITY FUNCTIONS
+# =============================================================================
+#
+# Options read from the YAML (all optional):
+#
+#   vm:
+#     memory_options:
+#       ksm: true           # let the host KSM daemon merge identical guest pages
+#       balloon: true       # virtio-balloon with free page reporting
+#       guest_swap: "zram"  # zram | none | default
+#
+
+KSM_SYSFS="/sys/kernel/mm/ksm"
+
+memory_option_enabled() {
+    local option="$1"
+    local value
+    value=$(parse_yaml "$CONFIG_FILE" "vm.memory_options.$option")
+    [[ "$value" == "true" || "$value" == "yes" || "$value" == "on" ]]
+}
+
+memory_guest_swap_profile() {
+    local profile
+    profile=$(parse_yaml "$CONFIG_FILE" "vm.memory_options.guest_swap")
+    case "$profile" in
+        zram|none) echo "$profile" ;;
+        *) echo "default" ;;
+    esac
+}
+
+# Kernel options needed by the enabled memory features (one per line)
+memory_kernel_options() {
+    if memory_option_enabled "balloon"; then
+        echo "CONFIG_VIRTIO_BALLOON"
+        echo "CONFIG_PAGE_REPORTING"
+        echo "CONFIG_BALLOON_COMPACTION"
+    fi
+    if [ "$(memory_guest_swap_profile)" = "zram" ]; then
+        echo "CONFIG_SWAP"
+        echo "CONFIG_ZSMALLOC"
+        echo "CONFIG_ZRAM"
+        echo "CONFIG_CRYPTO_LZ4"
+        echo "CONFIG_CRYPTO_ZSTD"
+    fi
+}
+
+memory_host_setup() {
+    if ! memory_option_enabled "ksm"; then
+        return 0
+    fi
+
+    if [ ! -d "$KSM_SYSFS" ]; then
+        log_warning "KSM not supported by the host kernel ($KSM_SYSFS missing)"
+        return 0
+    fi
+
+    if [ "$(cat "$KSM_SYSFS/run")" != "1" ]; then
+        log_info "Enabling host KSM page merging"
+        echo 1 | sudo tee "$KSM_SYSFS/run" > /dev/null
+    fi
+
+    local pages_to_scan
+    pages_to_scan=$(parse_yaml "$CONFIG_FILE" "vm.memory_options.ksm_pages_to_scan")
+    if [ -n "$pages_to_scan" ]; then
+        echo "$pages_to_scan" | sudo tee "$KSM_SYSFS/pages_to_scan" > /dev/null
+    fi
+}
+
+# QEMU arguments for the memory options
+_get_memory_args() {
+    local memory_args=""
+
+    if memory_option_enabled "ksm"; then
+        memory_args+="-machine mem-merge=on "
+    fi
+
+    if memory_option_enabled "balloon"; then
+        memory_args+="-device virtio-balloon-pci,id=balloon0,free-page-reporting=on,deflate-on-oom=on "
+    fi
+
+    echo "$memory_args"
+}
+
+# Kernel command line parameters read by memory-setup.sh inside the guest
+_get_memory_kernel_params() {
+    echo "virtk.swap=$(memory_guest_swap_profile)"
+}
+
+_rollup_kb() {
+    local rollup="$1"
+    local field="$2"
+    awk -v field="$field:" '$1 == field { print $2; exit }' <<< "$rollup"
+}
+
+memory_report() {
+    local page_kb=$(( $(getconf PAGESIZE) / 1024 ))
+    local machines_dir="${MAIN_DIR}/VirtK_Machines"
+
+    log_info "Resident memory per VM:"
+    printf "  %-16s %8s %10s %10s %10s %10s\n" "VM" "PID" "RSS(MB)" "PSS(MB)" "SWAP(MB)" "KSM(MB)"
+
+    local total_rss=0 total_pss=0 running=0
+    local pid_file
+    for pid_file in "$machines_dir"/*/qemu.pid; do
+        [ -f "$pid_file" ] || continue
+
+        local vm pid rollup rss pss swap ksm_pages
+        vm=$(basename "$(dirname "$pid_file")")
+        pid=$(sudo cat "$pid_file" 2>/dev/null)
+        if [ -z "$pid" ] || [ ! -d "/proc/$pid" ]; then
+            continue
+        fi
+
+        rollup=$(sudo cat "/proc/$pid/smaps_rollup" 2>/dev/null)
+        rss=$(_rollup_kb "$rollup" "Rss")
+        pss=$(_rollup_kb "$rollup" "Pss")
+        swap=$(_rollup_kb "$rollup" "Swap")
+        ksm_pages=$(sudo cat "/proc/$pid/ksm_merging_pages" 2>/dev/null || echo 0)
+
+        printf "  %-16s %8s %10d %10d %10d %10d\n" "$vm" "$pid" \
+            $(( ${rss:-0} / 1024 )) $(( ${pss:-0} / 1024 )) $(( ${swap:-0} / 1024 )) \
+            $(( ${ksm_pages:-0} * page_kb / 1024 ))
+
+        total_rss=$(( total_rss + ${rss:-0} ))
+        total_pss=$(( total_pss + ${pss:-0} ))
+        running=$(( running + 1 ))
+    done
+
+    if [ "$running" -eq 0 ]; then
+        log_warning "  No running VMs found"
+        return 0
+    fi
+
+    log_info "  Running VMs: $running"
+    log_info "  Total RSS: $(( total_rss / 1024 )) MB, total PSS: $(( total_pss / 1024 )) MB"
+
+    if [ -d "$KSM_SYSFS" ]; then
+        local shared sharing
+        shared=$(cat "$KSM_SYSFS/pages_shared")
+        sharing=$(cat "$KSM_SYSFS/pages_sharing")
+        log_info "  KSM: run=$(cat "$KSM_SYSFS/run"), pages_shared=$shared, pages_sharing=$sharing"
+        log_info "  KSM saving: $(( sharing * page_kb / 1024 )) MB"
+    fi
+}
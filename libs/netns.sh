@@ -0,0 +1,290 @@
+#!/bin/bash
+
+# =============================================================================
+# NETWORK NAMESPACE BACKEND
+# =============================================================================
+#
+# Lightweight MPTCP endpoints: every endpoint is a network namespace with one
+# veth per bridge instead of a QEMU VM, so dozens of clients fit in one host
+# (or in one big VirtK VM, to run them against the custom kernel). The
+# bridges and their link profiles use the same YAML model as the VMs:
+#
+#   vm:
+#     name: "netns"
+#     bridges:
+#       br0:
+#         ip: "10.1.0.1"
+#         netmask: "255.255.255.0"
+#         link:
+#           rate: "100mbit"
+#   netns:
+#     clients: 16             # namespaces vk-c1 .. vk-c16
+#     servers: 1              # namespaces vk-s1 .. vk-s1
+#     client_host_id: 100     # cN gets network base + client_host_id + N
+#     server_host_id: 10      # sN gets network base + server_host_id + N
+#     shape: "servers"        # ports that get the link profile: servers|clients
+#     scheduler: "default"    # net.mptcp.scheduler of every namespace
+#
+# With "shape: servers" the link profile is applied to the server ports only,
+# so all clients compete for the same shaped path. Bridges with an
+# "external" interface are skipped, the endpoints have no internet access.
+
+NETNS_PREFIX="vk-"
+
+# Kernel options the in-guest namespace endpoints need, when the VM gets a
+# netns config (vm.netns_config, one per line)
+netns_kernel_options() {
+    [ -n "$(parse_yaml "$CONFIG_FILE" "vm.netns_config")" ] || return 0
+    echo "CONFIG_NET_NS"
+    echo "CONFIG_VETH"
+    echo "CONFIG_BRIDGE"
+    echo "CONFIG_NET_SCH_HTB"
+    echo "CONFIG_NET_SCH_NETEM"
+    echo "CONFIG_NET_SCH_INGRESS"
+    echo "CONFIG_NET_CLS_ACT"
+    echo "CONFIG_NET_CLS_MATCHALL"
+    echo "CONFIG_NET_ACT_MIRRED"
+    echo "CONFIG_IFB"
+}
+
+# Endpoint names: c1..cN followed by s1..sM
+netns_endpoints() {
+    local clients servers i
+    clients=$(parse_yaml "$CONFIG_FILE" "netns.clients")
+    servers=$(parse_yaml "$CONFIG_FILE" "netns.servers")
+
+    for (( i = 1; i <= ${clients:-0}; i++ )); do
+        echo "c$i"
+    done
+    for (( i = 1; i <= ${servers:-0}; i++ )); do
+        echo "s$i"
+    done
+}
+
+netns_bridges() {
+    local name_bridges bridge
+    name_bridges=$(get_yaml_subkeys "$CONFIG_FILE" vm.bridges) || return 1
+
+    for bridge in $name_bridges; do
+        [ -n "$(parse_yaml "$CONFIG_FILE" "vm.bridges.$bridge.external")" ] && continue
+        echo "$bridge"
+    done
+}
+
+# Host side veth of an endpoint on a bridge (the "tap port" of a namespace)
+netns_port_name() {
+    local endpoint="$1"
+    local bridge_id="$2"
+    VM_NAME="$endpoint" tap_name "$bridge_id"
+}
+
+netns_address() {
+    local endpoint="$1"
+    local bridge_id="$2"
+    local role_id ip_address netmask
+
+    case "$endpoint" in
+        c*) role_id=$(parse_yaml "$CONFIG_FILE" "netns.client_host_id") ;;
+        s*) role_id=$(parse_yaml "$CONFIG_FILE" "netns.server_host_id") ;;
+    esac
+    ip_address=$(parse_yaml "$CONFIG_FILE" "vm.bridges.$bridge_id.ip")
+    netmask=$(parse_yaml "$CONFIG_FILE" "vm.bridges.$bridge_id.netmask")
+
+    local ip_int mask_int host_id
+    ip_int=$(ip_to_int "$ip_address")
+    mask_int=$(ip_to_int "$netmask")
+    host_id=$(( ${role_id:-0} + ${endpoint:1} ))
+
+    if (( host_id >= (~mask_int & 0xffffffff) )); then
+        log_error "Endpoint $endpoint does not fit in $ip_address/$netmask" >&2
+        return 1
+    fi
+    if (( (ip_int & mask_int) + host_id == ip_int )); then
+        log_error "Endpoint $endpoint collides with the bridge address $ip_address" >&2
+        return 1
+    fi
+    int_to_ip $(( (ip_int & mask_int) + host_id ))
+}
+
+_netns_shaped() {
+    local endpoint="$1"
+    local shape
+    shape=$(parse_yaml "$CONFIG_FILE" "netns.shape")
+
+    case "${shape:-servers}" in
+        clients) [[ "$endpoint" == c* ]] ;;
+        servers) [[ "$endpoint" == s* ]] ;;
+        *) return 1 ;;
+    esac
+}
+
+_netns_bridge_setup() {
+    local bridge_id="$1"
+    local ip_address netmask mask_bits network_base network_end dhcp_range_start dhcp_range_end
+
+    ip_address=$(parse_yaml "$CONFIG_FILE" "vm.bridges.$bridge_id.ip")
+    netmask=$(parse_yaml "$CONFIG_FILE" "vm.bridges.$bridge_id.netmask")
+    calculate_network_parameters "$ip_address" "$netmask"
+
+    if [ ! -d "/sys/class/net/$bridge_id" ]; then
+        log_info "Creating bridge $bridge_id ($ip_address/$mask_bits)"
+        sudo ip link add name "$bridge_id" type bridge || return 1
+        update_bridge_ip "$bridge_id" "$ip_address" "$mask_bits"
+    elif ! ip -4 addr show dev "$bridge_id" | grep -q "inet $ip_address/$mask_bits "; then
+        update_bridge_ip "$bridge_id" "$ip_address" "$mask_bits"
+    fi
+}
+
+# Attach one endpoint to one bridge and apply the link profile to its port
+_netns_port_setup() {
+    local endpoint="$1"
+    local bridge_id="$2"
+    local ifname="$3"
+    local ns="$NETNS_PREFIX$endpoint"
+    local port address netmask mask_bits network_base network_end dhcp_range_start dhcp_range_end
+    port=$(netns_port_name "$endpoint" "$bridge_id")
+    address=$(netns_address "$endpoint" "$bridge_id") || return 1
+    netmask=$(parse_yaml "$CONFIG_FILE" "vm.bridges.$bridge_id.netmask")
+    calculate_network_parameters "$address" "$netmask"
+
+    if [ ! -d "/sys/class/net/$port" ]; then
+        sudo ip link add "$port" type veth peer name "$ifname" netns "$ns" || return 1
+    fi
+    sudo ip link set dev "$port" master "$bridge_id" up || return 1
+    sudo ip -n "$ns" addr replace "$address/$mask_bits" dev "$ifname" || return 1
+    sudo ip -n "$ns" link set dev "$ifname" up
+
+    if _netns_shaped "$endpoint"; then
+        # link_setup shapes "tap_name <bridge>", which is this port here
+        mkdir -p "$VM_DIR/netns/$endpoint"
+        VM_NAME="$endpoint" VM_DIR="$VM_DIR/netns/$endpoint" link_setup "$bridge_id" || return 1
+    fi
+}
+
+# MPTCP setup of one namespace: every address after the first is an endpoint
+_netns_mptcp_setup() {
+    local endpoint="$1"
+    shift
+    local ns="$NETNS_PREFIX$endpoint"
+    local scheduler flags address
+
+    sudo ip netns exec "$ns" sysctl -q -w net.mptcp.enabled=1
+    scheduler=$(parse_yaml "$CONFIG_FILE" "netns.scheduler")
+    if [ -n "$scheduler" ]; then
+        sudo ip netns exec "$ns" sysctl -q -w "net.mptcp.scheduler=$scheduler" || return 1
+    fi
+
+    sudo ip -n "$ns" mptcp limits set add_addr_accepted 8 subflows 8
+    sudo ip -n "$ns" mptcp endpoint flush
+    [[ "$endpoint" == s* ]] && flags="signal" || flags="subflow"
+    for address in "${@:2}"; do
+        sudo ip -n "$ns" mptcp endpoint add "${address%%@*}" dev "${address##*@}" $flags || return 1
+    done
+}
+
+netns_endpoint_setup() {
+    local endpoint="$1"
+    local ns="$NETNS_PREFIX$endpoint"
+    local bridge index=0 addresses=()
+
+    if ! ip netns list | grep -qw "^$ns"; then
+        sudo ip netns add "$ns" || return 1
+    fi
+    sudo ip -n "$ns" link set dev lo up
+
+    for bridge in $(netns_bridges); do
+        _netns_port_setup "$endpoint" "$bridge" "eth$index" || return 1
+        addresses+=("$(netns_address "$endpoint" "$bridge")@eth$index")
+        index=$((index + 1))
+    done
+
+    _netns_mptcp_setup "$endpoint" "${addresses[@]}"
+}
+
+netns_setup() {
+    local endpoints bridge endpoint
+    endpoints=$(netns_endpoints)
+    if [ -z "$endpoints" ]; then
+        log_error "No endpoints declared (netns.clients / netns.servers)"
+        return 1
+    fi
+
+    sudo -v || return 1
+    mkdir -p "$VM_DIR"
+
+    for bridge in $(netns_bridges); do
+        _netns_bridge_setup "$bridge" || { log_error "Failed to set up bridge $bridge"; return 1; }
+    done
+
+    # Endpoints are independent of each other
+    local status=0
+    local -A pids
+    for endpoint in $endpoints; do
+        netns_endpoint_setup "$endpoint" > "$VM_DIR/.netns-$endpoint.log" 2>&1 &
+        pids[$endpoint]=$!
+    done
+    for endpoint in $endpoints; do
+        if ! wait "${pids[$endpoint]}"; then
+            log_error "Failed to set up endpoint $endpoint:"
+            cat "$VM_DIR/.netns-$endpoint.log"
+            status=1
+        fi
+        rm -f "$VM_DIR/.netns-$endpoint.log"
+    done
+
+    [ $status -eq 0 ] && log_success "Namespaces ready: $(echo $endpoints)"
+    return $status
+}
+
+netns_teardown() {
+    local endpoint bridge ns
+
+    for endpoint in $(netns_endpoints); do
+        ns="$NETNS_PREFIX$endpoint"
+        for bridge in $(netns_bridges); do
+            if [ -d "/sys/class/net/$(netns_port_name "$endpoint" "$bridge")" ]; then
+                VM_NAME="$endpoint" VM_DIR="$VM_DIR/netns/$endpoint" link_teardown "$bridge"
+            fi
+        done
+        # Deleting the namespace also removes its veth pairs
+        if ip netns list | grep -qw "^$ns"; then
+            sudo ip netns delete "$ns"
+        fi
+        rm -rf "$VM_DIR/netns/$endpoint"
+    done
+
+    for bridge in $(netns_bridges); do
+        if [ -d "/sys/class/net/$bridge" ]; then
+            log_info "Removing bridge: $bridge"
+            sudo ip link delete "$bridge"
+        fi
+    done
+    log_success "Namespaces removed"
+}
+
+netns_status() {
+    local endpoint ns bridge addresses
+
+    log_info "Network namespace endpoints:"
+    for endpoint in $(netns_endpoints); do
+        ns="$NETNS_PREFIX$endpoint"
+        if ! ip netns list | grep -qw "^$ns"; then
+            log_warning "  $ns: not present"
+            continue
+        fi
+        addresses=$(sudo ip -n "$ns" -4 -o addr show scope global | awk '{ printf "%s ", $4 }')
+        log_info "  $ns: $addresses"
+    done
+    local shape
+    shape=$(parse_yaml "$CONFIG_FILE" "netns.shape")
+    for bridge in $(netns_bridges); do
+        log_info "  $bridge: [$(link_describe "$bridge" down)] on the ${shape:-servers} ports"
+    done
+}
+
+# Run a command inside an endpoint, e.g. netns_exec c1 iperf3 -c 10.1.0.11
+netns_exec() {
+    local endpoint="$1"
+    shift
+    sudo ip netns exec "$NETNS_PREFIX$endpoint" "$@"
+}
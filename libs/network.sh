@@ -12,11 +12,14 @@ calculate_network_parameters() {
     
     # Calculate mask bits
     mask_bits=0
-    for octet in $(echo "$netmask" | sed 's/\./ /g'); do
-        binbits=$(echo "obase=2; ibase=10; ${octet}" | bc | sed 's/0//g')
-        mask_bits=$(expr $mask_bits + ${#binbits})
+    local octet
+    for octet in ${netmask//./ }; do
+        while (( octet > 0 )); do
+            mask_bits=$(( mask_bits + (octet & 1) ))
+            octet=$(( octet >> 1 ))
+        done
     done
-    
+
     # Parse IP components
     IFS=. read -r i1 i2 i3 i4 <<< "$ip_address"
     IFS=. read -r m1 m2 m3 m4 <<< "$netmask"
@@ -30,6 +33,75 @@ calculate_network_parameters() {
     network_end="$((i1 | (255 - m1))).$((i2 | (255 - m2))).$((i3 | (255 - m3))).$((i4 | (255 - m4)))"
 }
 
+ip_to_int() {
+    local i1 i2 i3 i4
+    IFS=. read -r i1 i2 i3 i4 <<< "$1"
+    echo $(( (i1 << 24) | (i2 << 16) | (i3 << 8) | i4 ))
+}
+
+int_to_ip() {
+    local n="$1"
+    echo "$(( (n >> 24) & 255 )).$(( (n >> 16) & 255 )).$(( (n >> 8) & 255 )).$(( n & 255 ))"
+}
+
+# Addressing mode of a bridge: "static" or "dhcp" (vm.addressing, per-bridge
+# "dhcp: true|false" overrides it)
+bridge_addressing() {
+    local bridge_id="$1"
+    local dhcp addressing
+
+    dhcp=$(parse_yaml "$CONFIG_FILE" "vm.bridges.$bridge_id.dhcp")
+    case "$dhcp" in
+        true) echo "dhcp"; return 0 ;;
+        false) echo "static"; return 0 ;;
+    esac
+
+    addressing=$(parse_yaml "$CONFIG_FILE" "vm.addressing")
+    if [ "$addressing" = "static" ]; then
+        echo "static"
+    else
+        echo "dhcp"
+    fi
+}
+
+# Deterministic guest address on a bridge: vm.bridges.<br>.address if set,
+# otherwise the bridge network base plus vm.host_id
+bridge_static_address() {
+    local bridge_id="$1"
+    local address ip_address netmask host_id
+
+    address=$(parse_yaml "$CONFIG_FILE" "vm.bridges.$bridge_id.address")
+    if [ -n "$address" ]; then
+        echo "$address"
+        return 0
+    fi
+
+    host_id=$(parse_yaml "$CONFIG_FILE" "vm.host_id")
+    if [ -z "$host_id" ]; then
+        log_error "vm.host_id is required for static addressing on $bridge_id" >&2
+        return 1
+    fi
+
+    ip_address=$(parse_yaml "$CONFIG_FILE" "vm.bridges.$bridge_id.ip")
+    netmask=$(parse_yaml "$CONFIG_FILE" "vm.bridges.$bridge_id.netmask")
+
+    local ip_int mask_int base_int
+    ip_int=$(ip_to_int "$ip_address")
+    mask_int=$(ip_to_int "$netmask")
+    base_int=$(( ip_int & mask_int ))
+
+    if (( host_id <= 0 || host_id >= (~mask_int & 0xffffffff) )); then
+        log_error "vm.host_id $host_id does not fit in $ip_address/$netmask" >&2
+        return 1
+    fi
+    if (( base_int + host_id == ip_int )); then
+        log_error "vm.host_id $host_id collides with the bridge address $ip_address" >&2
+        return 1
+    fi
+
+    int_to_ip $(( base_int + host_id ))
+}
+
 check_external_interface() {
     local external="$1"
     local bridge_id="$2"
@@ -49,14 +121,11 @@ check_external_interface() {
 
 setup_qemu_bridge_conf() {
     local bridge_id="$1"
-    
-    sudo touch /etc/qemu/bridge.conf
-    
+
     if ! grep -q "^allow $bridge_id$" /etc/qemu/bridge.conf 2>/dev/null; then
         log_info "Adding $bridge_id to /etc/qemu/bridge.conf"
+        sudo mkdir -p /etc/qemu
         echo "allow $bridge_id" | sudo tee -a /etc/qemu/bridge.conf >/dev/null
-    else
-        log_info "$bridge_id already allowed in /etc/qemu/bridge.conf"
     fi
 }
 
@@ -70,22 +139,43 @@ update_bridge_ip() {
     sudo ip link set dev "$bridge_id" up
 }
 
+dnsmasq_pid() {
+    local bridge_id="$1"
+    local pid_file="/var/run/dnsmasq-$bridge_id.pid"
+    local pid
+
+    pid=$(cat "$pid_file" 2>/dev/null)
+    if [[ -n "$pid" && -d "/proc/$pid" ]]; then
+        echo "$pid"
+        return 0
+    fi
+    return 1
+}
+
+_dnsmasq_stopped() {
+    local bridge_id="$1"
+    ! pgrep -f "dnsmasq.*dnsmasq-$bridge_id.conf" > /dev/null
+}
+
 cleanup_existing_dnsmasq() {
     local bridge_id="$1"
     local pid_file="/var/run/dnsmasq-$bridge_id.pid"
     local lease_file="/var/lib/misc/dnsmasq-$bridge_id.leases"
-    
+
     # Kill existing dnsmasq processes
     if [[ -f "$pid_file" ]]; then
         sudo kill "$(cat "$pid_file")" 2>/dev/null || true
         sudo rm -f "$pid_file"
     fi
-    
-    sudo pkill -f "dnsmasq.*$bridge_id" 2>/dev/null || true
+
+    sudo pkill -f "dnsmasq.*dnsmasq-$bridge_id.conf" 2>/dev/null || true
+    # Wait until the old server has released the DHCP socket
+    wait_for 5 _dnsmasq_stopped "$bridge_id" \
+        || log_warning "dnsmasq for $bridge_id did not exit in time"
+
     sudo rm -f "/tmp/dnsmasq-$bridge_id.conf"
     sudo rm -f "/var/log/dnsmasq-$bridge_id.log"
     sudo rm -f "$lease_file"
-    sleep 3
 }
 
 get_files(){
@@ -101,23 +191,21 @@ get_files(){
     echo "Log file: $log_file"
 }
 
-create_dnsmasq_config() {
+# Print the dnsmasq configuration of a bridge (used to create it and to
+# detect whether a running server is still up to date)
+dnsmasq_config_content() {
     local bridge_id="$1"
     local dhcp_range_start="$2"
     local dhcp_range_end="$3"
     local ip_address="$4"
     local netmask="$5"
     local internet_access="$6"
-    local config_file="/tmp/dnsmasq-$bridge_id.conf"
     local pid_file="/var/run/dnsmasq-$bridge_id.pid"
     local lease_file="/var/lib/misc/dnsmasq-$bridge_id.leases"
     local log_file="/var/log/dnsmasq-$bridge_id.log"
 
-    # Create the files if they don't exist
-    sudo touch "$config_file" "$pid_file" "$lease_file" "$log_file"
-
     # Base configuration
-    sudo tee "$config_file" > /dev/null << EOF
+    cat << EOF
 # Interface configuration
 interface=$bridge_id
 bind-interfaces
@@ -144,11 +232,23 @@ EOF
 
     # DNS configuration based on internet access
     if [[ "$internet_access" == "true" ]]; then
-        echo "dhcp-option=6,8.8.8.8,8.8.4.4" | sudo tee -a "$config_file" > /dev/null
+        echo "dhcp-option=6,8.8.8.8,8.8.4.4"
     else
-        echo "dhcp-option=6,$ip_address" | sudo tee -a "$config_file" > /dev/null
+        echo "dhcp-option=6,$ip_address"
     fi
-    
+}
+
+create_dnsmasq_config() {
+    local bridge_id="$1"
+    local config_file="/tmp/dnsmasq-$bridge_id.conf"
+    local lease_file="/var/lib/misc/dnsmasq-$bridge_id.leases"
+    local log_file="/var/log/dnsmasq-$bridge_id.log"
+
+    # Create the files if they don't exist
+    sudo touch "$lease_file" "$log_file"
+
+    dnsmasq_config_content "$@" | sudo tee "$config_file" > /dev/null
+
     echo "$config_file"
 }
 
@@ -166,43 +266,30 @@ start_dnsmasq_server() {
         return 1
     fi
     
-    # Start dnsmasq
-    sudo dnsmasq --conf-file="$config_file" 2>/dev/null &
-    sleep 3
-    
-    # Verify startup - check both process and log file
-    local actual_pid log_file="/var/log/dnsmasq-$bridge_id.log"
-    actual_pid=$(pgrep -f "dnsmasq.*$bridge_id" | head -1)
-    
-    # Check if process is running OR if log shows successful start
-    if [[ -n "$actual_pid" ]] && kill -0 "$actual_pid" 2>/dev/null; then
-        log_success "DHCP server started successfully for $bridge_id (PID: $actual_pid)"
-        echo "$actual_pid" | sudo tee "$pid_file" > /dev/null
-        return 0
-    elif [[ -f "$log_file" ]] && grep -q "sockets bound exclusively to interface $bridge_id" "$log_file"; then
-        # Process might have forked, try to find it by interface
-        actual_pid=$(pgrep -f "interface.*$bridge_id" | head -1)
-        if [[ -n "$actual_pid" ]]; then
-            log_success "DHCP server started successfully for $bridge_id (PID: $actual_pid)"
-            echo "$actual_pid" | sudo tee "$pid_file" > /dev/null
-            return 0
-        else
-            # Log shows success but can't find PID - that's okay
-            log_success "DHCP server started successfully for $bridge_id"
-            return 0
-        fi
-    else
+    # Start dnsmasq. The parent only exits once the daemon is initialised
+    # (or failed), so its exit code tells whether the server is up.
+    if ! sudo dnsmasq --conf-file="$config_file" 2>/dev/null; then
         log_error "Failed to start DHCP server for $bridge_id"
         return 1
     fi
+
+    # The daemon writes its pid file right after forking
+    local actual_pid
+    if wait_for 2 dnsmasq_pid "$bridge_id" > /dev/null; then
+        actual_pid=$(dnsmasq_pid "$bridge_id")
+        log_success "DHCP server started successfully for $bridge_id (PID: $actual_pid)"
+        return 0
+    fi
+
+    log_error "Failed to start DHCP server for $bridge_id"
+    return 1
 }
 
 verify_dnsmasq_status() {
     local bridge_id="$1"
     local dhcp_range_start="$2"
     local dhcp_range_end="$3"
-    
-    sleep 1
+
     local log_file="/var/log/dnsmasq-$bridge_id.log"
     local pid_file="/var/run/dnsmasq-$bridge_id.pid"
     local lease_file="/var/lib/misc/dnsmasq-$bridge_id.leases"
@@ -256,50 +343,185 @@ setup_iptables_rules() {
     local internet_access="$5"
     
     if [[ "$internet_access" == "true" && -n "$external" ]]; then
-        # Remove existing rules to avoid duplicates
-        sudo iptables -t nat -D POSTROUTING -s "$ip_address"/"$mask_bits" -o "$external" -j MASQUERADE 2>/dev/null || true
-        sudo iptables -D FORWARD -i "$bridge_id" -o "$external" -j ACCEPT 2>/dev/null || true
-        sudo iptables -D FORWARD -i "$external" -o "$bridge_id" -m state --state RELATED,ESTABLISHED -j ACCEPT 2>/dev/null || true
-        
-        # Add new rules
-        sudo iptables -t nat -A POSTROUTING -s "$ip_address"/"$mask_bits" -o "$external" -j MASQUERADE
-        sudo iptables -A FORWARD -i "$bridge_id" -o "$external" -j ACCEPT
-        sudo iptables -A FORWARD -i "$external" -o "$bridge_id" -m state --state RELATED,ESTABLISHED -j ACCEPT
-        
+        # Only add the rules that are missing (-C checks for an existing rule)
+        _iptables_ensure -t nat POSTROUTING -s "$ip_address"/"$mask_bits" -o "$external" -j MASQUERADE
+        _iptables_ensure FORWARD -i "$bridge_id" -o "$external" -j ACCEPT
+        _iptables_ensure FORWARD -i "$external" -o "$bridge_id" -m state --state RELATED,ESTABLISHED -j ACCEPT
+
         log_success "NAT setup complete for $bridge_id -> $external (Internet access enabled)"
     else
         # Block internet access for isolated bridges
-        sudo iptables -D FORWARD -i "$bridge_id" -j DROP 2>/dev/null || true
-        sudo iptables -A FORWARD -i "$bridge_id" -j DROP
+        _iptables_ensure FORWARD -i "$bridge_id" -j DROP
         log_info "$bridge_id configured as isolated network (no internet access)"
     fi
 }
 
-check_bridge_configuration() {
+remove_iptables_rules() {
     local bridge_id="$1"
     local ip_address="$2"
     local mask_bits="$3"
-    
-    local result_ip current_ip current_mask
-    result_ip=$(ip addr show dev "$bridge_id" | grep "inet " | awk '{print $2}')
-    current_ip=$(echo "$result_ip" | cut -d'/' -f1)
-    current_mask=$(echo "$result_ip" | cut -d'/' -f2)
-    
-    if [[ "$current_ip" != "$ip_address" || "$current_mask" != "$mask_bits" ]]; then
-        log_warning "Current bridge configuration does not match desired configuration."
-        log_warning "Current IP: $current_ip/$current_mask"
-        log_warning "Desired IP: $ip_address/$mask_bits"
-        
-        read -p "Do you want to update the bridge configuration? (y/n) " answer
-        if [[ "$answer" == "y" ]]; then
-            return 0  # Need to update
-        else
-            return 1  # Don't update
+    local external="$4"
+
+    if [[ -n "$external" ]]; then
+        sudo iptables -w -t nat -D POSTROUTING -s "$ip_address"/"$mask_bits" -o "$external" -j MASQUERADE 2>/dev/null || true
+        sudo iptables -w -D FORWARD -i "$bridge_id" -o "$external" -j ACCEPT 2>/dev/null || true
+        sudo iptables -w -D FORWARD -i "$external" -o "$bridge_id" -m state --state RELATED,ESTABLISHED -j ACCEPT 2>/dev/null || true
+    fi
+    sudo iptables -w -D FORWARD -i "$bridge_id" -j DROP 2>/dev/null || true
+}
+
+# Append a rule unless it is already present: _iptables_ensure [-t table] CHAIN RULE...
+_iptables_ensure() {
+    local table_args=()
+    if [[ "$1" == "-t" ]]; then
+        table_args=(-t "$2")
+        shift 2
+    fi
+    local chain="$1"
+    shift
+
+    if ! sudo iptables -w "${table_args[@]}" -C "$chain" "$@" 2>/dev/null; then
+        sudo iptables -w "${table_args[@]}" -A "$chain" "$@"
+    fi
+}
+
+setup_vm_tap() {
+    local bridge_id="$1"
+    local tap
+    tap=$(tap_name "$bridge_id")
+
+    if [ ! -d "/sys/class/net/$tap" ]; then
+        log_info "Creating tap port $tap on $bridge_id"
+        sudo ip tuntap add dev "$tap" mode tap user "$(whoami)" || return 1
+    fi
+    # With linkem the tap stays off the bridge (linkem attaches its own port)
+    if link_uses_linkem "$bridge_id"; then
+        echo 1 | sudo tee "/proc/sys/net/ipv6/conf/$tap/disable_ipv6" > /dev/null
+    elif [ "$(basename "$(readlink "/sys/class/net/$tap/master" 2>/dev/null)")" != "$bridge_id" ]; then
+        sudo ip link set dev "$tap" master "$bridge_id" || return 1
+    fi
+    if (( ($(cat "/sys/class/net/$tap/flags") & 0x1) == 0 )); then
+        sudo ip link set dev "$tap" up
+    fi
+}
+
+remove_vm_tap() {
+    local bridge_id="$1"
+    local tap
+    tap=$(tap_name "$bridge_id")
+
+    if ip link show "$tap" &>/dev/null; then
+        link_teardown "$bridge_id"
+        log_info "Removing tap port: $tap"
+        sudo ip link delete "$tap"
+    fi
+}
+
+# =============================================================================
+# BRIDGE FAST PATH (br_netfilter bypass)
+# =============================================================================
+#
+# With br_netfilter loaded, frames switched inside a bridge are also passed
+# through iptables when net.bridge.bridge-nf-call-* is 1. A bridge with
+# "fast_path: true" is kept out of netfilter. The per-bridge nf_call_*
+# options can only opt a bridge *in*, so when a fast path bridge exists the
+# global sysctls are turned off and every other bridge is opted back in
+# (br-ext and any bridge of the host keep being filtered as before).
+
+BRNF_SYSCTLS=(bridge-nf-call-iptables bridge-nf-call-ip6tables bridge-nf-call-arptables)
+BRNF_SAVED="/run/virtk-brnf.saved"
+
+bridge_fast_path_enabled() {
+    local bridge_id="$1"
+    [[ "$(parse_yaml "$CONFIG_FILE" "vm.bridges.$bridge_id.fast_path")" == "true" ]]
+}
+
+_bridge_set_nf_call() {
+    local bridge_id="$1"
+    local value="$2"
+    local current
+    current=$(cat "/sys/class/net/$bridge_id/bridge/nf_call_iptables" 2>/dev/null)
+    [ "$current" = "$value" ] && return 0
+
+    sudo ip link set dev "$bridge_id" type bridge \
+        nf_call_iptables "$value" nf_call_ip6tables "$value" nf_call_arptables "$value"
+}
+
+bridges_fast_path_setup() {
+    local name_bridges="$1"
+    local bridge fast_bridges=()
+
+    for bridge in $name_bridges; do
+        bridge_fast_path_enabled "$bridge" && fast_bridges+=("$bridge")
+    done
+    [ ${#fast_bridges[@]} -eq 0 ] && return 0
+
+    # Without br_netfilter bridged frames never reach netfilter
+    if [ ! -d /proc/sys/net/bridge ]; then
+        log_info "br_netfilter not loaded, fast path is the default for: ${fast_bridges[*]}"
+        return 0
+    fi
+
+    local sysctl
+    if [ "$(cat /proc/sys/net/bridge/bridge-nf-call-iptables)" = "1" ] && [ ! -f "$BRNF_SAVED" ]; then
+        for sysctl in "${BRNF_SYSCTLS[@]}"; do
+            echo "$sysctl=$(cat "/proc/sys/net/bridge/$sysctl")"
+        done | sudo tee "$BRNF_SAVED" > /dev/null
+    fi
+
+    # Keep every other bridge on the host filtered through its own option
+    local dev
+    for dev in /sys/class/net/*/bridge; do
+        bridge=$(basename "$(dirname "$dev")")
+        if [[ " ${fast_bridges[*]} " == *" $bridge "* ]]; then
+            _bridge_set_nf_call "$bridge" 0
+        elif [ -f "$BRNF_SAVED" ]; then
+            _bridge_set_nf_call "$bridge" 1
         fi
-    else
-        log_success "Bridge $bridge_id configuration matches desired configuration."
-        return 2  # Configuration matches
+    done
+
+    for sysctl in "${BRNF_SYSCTLS[@]}"; do
+        if [ "$(cat "/proc/sys/net/bridge/$sysctl")" != "0" ]; then
+            sudo sysctl -q -w "net.bridge.$sysctl=0"
+        fi
+    done
+    log_success "Fast path (no br_netfilter) on: ${fast_bridges[*]}"
+}
+
+# Restore the global br_netfilter sysctls once no fast path bridge is left
+bridges_fast_path_restore() {
+    [ -f "$BRNF_SAVED" ] || return 0
+
+    local dev bridge
+    for dev in /sys/class/net/*/bridge; do
+        [ -e "$dev" ] || continue
+        bridge=$(basename "$(dirname "$dev")")
+        if [ "$(cat "$dev/nf_call_iptables")" = "0" ]; then
+            return 0
+        fi
+    done
+
+    local line
+    while IFS= read -r line; do
+        sudo sysctl -q -w "net.bridge.$line"
+    done < "$BRNF_SAVED"
+    sudo rm -f "$BRNF_SAVED"
+    log_info "Restored global br_netfilter settings"
+}
+
+check_bridge_configuration() {
+    local bridge_id="$1"
+    local ip_address="$2"
+    local mask_bits="$3"
+
+    local result_ip
+    result_ip=$(ip -o -4 addr show dev "$bridge_id" | awk '{print $4}')
+
+    if [[ "$result_ip" != "$ip_address/$mask_bits" ]]; then
+        log_warning "Bridge $bridge_id has ${result_ip:-no address}, desired $ip_address/$mask_bits"
+        return 0  # Need to update
     fi
+    return 2  # Configuration matches
 }
 
 # =============================================================================
@@ -363,34 +585,42 @@ bridge_setup() {
     # Setup QEMU bridge configuration
     setup_qemu_bridge_conf "$bridge_id"
 
-    # Create or check bridge
+    # Create the bridge or bring its address to the desired state
     local start_dhcp_server=false
-    if ! ip link show "$bridge_id" &>/dev/null; then
+    if [ ! -d "/sys/class/net/$bridge_id" ]; then
         sudo ip link add name "$bridge_id" type bridge
         update_bridge_ip "$bridge_id" "$ip_address" "$mask_bits"
         start_dhcp_server=true
     else
-        log_warning "Bridge $bridge_id already exists. Checking configuration..."
-        
-        case $(check_bridge_configuration "$bridge_id" "$ip_address" "$mask_bits") in
-            0) # Need to update
-                log_info "Updating bridge configuration..."
-                update_bridge_ip "$bridge_id" "$ip_address" "$mask_bits"
+        local config_state=0
+        check_bridge_configuration "$bridge_id" "$ip_address" "$mask_bits" || config_state=$?
+        if [ $config_state -eq 0 ]; then
+            log_info "Updating bridge configuration..."
+            update_bridge_ip "$bridge_id" "$ip_address" "$mask_bits"
+            start_dhcp_server=true
+        else
+            log_success "Bridge $bridge_id configuration matches desired configuration."
+            if ! dnsmasq_pid "$bridge_id" > /dev/null; then
                 start_dhcp_server=true
-                ;;
-            1) # Don't update
-                start_dhcp_server=false
-                ;;
-            2) # Configuration matches
-                if ! pgrep -f "dnsmasq.*interface=$bridge_id" > /dev/null; then
-                    log_info "DHCP server not running for $bridge_id, will start it"
-                    start_dhcp_server=true
-                else
-                    log_info "DHCP server already running for $bridge_id"
-                    start_dhcp_server=false
-                fi
-                ;;
-        esac
+            elif ! dnsmasq_config_content "$bridge_id" "$dhcp_range_start" "$dhcp_range_end" \
+                    "$ip_address" "$netmask" "$internet_access" | cmp -s - "/tmp/dnsmasq-$bridge_id.conf"; then
+                log_info "DHCP configuration changed for $bridge_id, will restart it"
+                start_dhcp_server=true
+            else
+                log_info "DHCP server already running for $bridge_id"
+            fi
+        fi
+    fi
+
+    # Guests with static addresses do not need a DHCP server, stop the one
+    # left from a previous DHCP setup
+    if [[ "$(bridge_addressing "$bridge_id")" == "static" ]]; then
+        log_info "Static addressing on $bridge_id, DHCP server not needed"
+        start_dhcp_server=false
+        if dnsmasq_pid "$bridge_id" > /dev/null; then
+            log_info "Stopping the DHCP server of $bridge_id"
+            cleanup_existing_dnsmasq "$bridge_id"
+        fi
     fi
 
     # Start DHCP server if needed
@@ -399,8 +629,11 @@ bridge_setup() {
                          "$dhcp_range_start" "$dhcp_range_end" "$network_base"
     fi
 
-    # Setup iptables rules
-    setup_iptables_rules "$bridge_id" "$ip_address" "$mask_bits" "$external" "$internet_access"
+    # Forwarding/NAT rules are set for all bridges at once by firewall_setup
+
+    # Attach this VM's tap port and apply the link emulation profile
+    setup_vm_tap "$bridge_id" || { log_error "Failed to create tap port for $bridge_id"; return 1; }
+    link_setup "$bridge_id"
 }
 
 bridges_setup() {
@@ -408,17 +641,49 @@ bridges_setup() {
 
     local name_bridges
     name_bridges=$(get_yaml_subkeys "$CONFIG_FILE" vm.bridges)
-    if [ $? -eq 0 ]; then
-        for bridge in $name_bridges; do
-            bridge_setup "$bridge"
-        done
-    else
+    if [ $? -ne 0 ]; then
         echo "Seção 'vm.bridges' não encontrada ou vazia"
         return 1
     fi
 
-    sudo sysctl -w net.ipv4.ip_forward=1 >/dev/null
-    return 0
+    # Ask for the sudo password once, before the bridges run in parallel
+    sudo -v || return 1
+
+    # Each bridge converges independently; the output of every bridge is
+    # buffered and printed in order so the logs do not interleave
+    local bridge status=0 out_dir
+    local -A pids
+    out_dir=$(mktemp -d)
+    for bridge in $name_bridges; do
+        bridge_setup "$bridge" > "$out_dir/$bridge.log" 2>&1 &
+        pids[$bridge]=$!
+    done
+    for bridge in $name_bridges; do
+        local bridge_status=0
+        wait "${pids[$bridge]}" || bridge_status=$?
+        cat "$out_dir/$bridge.log"
+        if [ $bridge_status -ne 0 ]; then
+            log_error "Failed to set up bridge $bridge"
+            status=1
+        fi
+    done
+    rm -rf "$out_dir"
+
+    # Forwarding and NAT rules for all bridges (libs/firewall.sh)
+    firewall_setup || status=1
+
+    # Keep fast path bridges out of br_netfilter
+    bridges_fast_path_setup "$name_bridges" || status=1
+
+    # Per-flow counters on the tap ports (libs/accounting.sh)
+    if accounting_enabled; then
+        accounting_setup || status=1
+    fi
+
+    if [ "$(cat /proc/sys/net/ipv4/ip_forward)" != "1" ]; then
+        sudo sysctl -w net.ipv4.ip_forward=1 >/dev/null
+    fi
+    return $status
 }
 
 bridges_teardown() {
@@ -432,6 +697,8 @@ bridges_teardown() {
             # remove dnsmasq process and pid file
             cleanup_existing_dnsmasq "$bridge"
 
+            remove_vm_tap "$bridge"
+
 
             log_info "Removing bridge: $bridge"
             sudo ip link set dev "$bridge" down
@@ -442,6 +709,9 @@ bridges_teardown() {
         return 1
     fi
 
+    firewall_teardown
+    bridges_fast_path_restore
+
     sudo sysctl -w net.ipv4.ip_forward=0 >/dev/null
     return 0
 }
@@ -456,6 +726,14 @@ bridges_status() {
             if ip link show "$bridge" >/dev/null 2>&1; then
                 bridge_ip=$(ip addr show dev "$bridge" | grep "inet " | awk '{print $2}')
                 log_info "Bridge $bridge is up - IP: $bridge_ip"
+                if [ -d /proc/sys/net/bridge ]; then
+                    if [ "$(cat /proc/sys/net/bridge/bridge-nf-call-iptables)" = "0" ] && \
+                       [ "$(cat "/sys/class/net/$bridge/bridge/nf_call_iptables")" = "0" ]; then
+                        log_info "  Fast path: bridged traffic bypasses netfilter"
+                    else
+                        log_info "  Filtered: bridged traffic passes through netfilter"
+                    fi
+                fi
                 
                 # Check DHCP server status
                 if pgrep -f "dnsmasq.*$bridge" > /dev/null; then
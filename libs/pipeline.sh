@@ -0,0 +1,255 @@
+#!/bin/bash
+
+# =============================================================================
+# SETUP PIPELINE (--all)
+# =============================================================================
+#
+# --all runs setup steps that declare their inputs, outputs and the steps
+# they depend on:
+#
+#   kernel  kernel.*, kernel options of vm.memory_options/schedtrace/
+#           schedbench/netns_config, the scheduler patches, libs/kernel.sh
+#           -> kernel image
+#   rootfs  debian.*, kernel.machine -> rootfs/ (debootstrap)
+#   image   vm.*, scripts/, tools/vkdiag, tools/vkload, the netns config,
+#           libs/rootfs.sh, rootfs (and kernel on arm64, for the modules)
+#           -> rootfs.img
+#
+# then the network and the VM, as before. The hash of a step's inputs, with
+# the stamps of the steps it depends on, is stamped in $VM_DIR/.steps/ when
+# the step succeeds; a step whose stamp matches and whose outputs exist is
+# skipped. Steps whose dependencies are done run concurrently (debootstrap
+# while the kernel compiles), logged into $VM_DIR/.steps/<step>.log and
+# shown prefixed with their name.
+#
+#   ./script.sh client.yaml --all          # only the steps whose inputs changed
+#   ./script.sh client.yaml --all force    # every step
+#   ./script.sh client.yaml --steps        # which steps are up to date
+
+PIPELINE_STEPS="kernel rootfs image"
+
+_step_arm64() {
+    local arch defconfig cross_compile
+    choose_arch_defconfig "$(parse_yaml "$CONFIG_FILE" "kernel.machine")"
+    [ "$arch" = "arm64" ]
+}
+
+_step_deps() {
+    case "$1" in
+        image) echo "rootfs$(_step_arm64 && echo " kernel")" ;;
+    esac
+}
+
+# Sorted key=value lines and list items of a section of the config
+_step_yaml() {
+    local section="$1"
+    local prefix key
+
+    yaml_load "$CONFIG_FILE" || return 1
+    prefix="${_YAML_PREFIX[$CONFIG_FILE]}"
+    {
+        for key in "${!_YAML_V[@]}"; do
+            [[ "$key" == "$prefix$section" || "$key" == "$prefix$section."* ]] && \
+                printf '%s=%s\n' "${key#"$prefix"}" "${_YAML_V[$key]}"
+        done
+        for key in "${!_YAML_L[@]}"; do
+            [[ "$key" == "$prefix$section."* ]] && \
+                printf '%s[]=%s\n' "${key#"$prefix"}" "${_YAML_L[$key]//$'\n'/,}"
+        done
+    } | LC_ALL=C sort
+}
+
+# Content hashes of files and directory trees (paths relative to MAIN_DIR)
+_step_files() {
+    (
+        cd "$MAIN_DIR" || exit 1
+        find "$@" -type f -print0 2>/dev/null | LC_ALL=C sort -z | xargs -0 -r sha1sum
+    )
+}
+
+_step_inputs() {
+    case "$1" in
+        kernel)
+            _step_yaml kernel
+            memory_kernel_options
+            schedtrace_kernel_options
+            schedbench_kernel_options
+            netns_kernel_options
+            _step_files libs/kernel.sh
+            schedbench_enabled && _step_files "${SCHEDBENCH_DIR#"$MAIN_DIR"/}/$SCHEDBENCH_SRC"
+            [ "$VM_NAME" = "client" ] && _step_files "$KERNEL_PATCH_DIR"
+            ;;
+        rootfs)
+            _step_yaml debian
+            _step_yaml kernel.machine
+            ;;
+        image)
+            local netns_config
+            _step_yaml vm
+            _step_yaml kernel.version
+            _step_files libs/rootfs.sh scripts tools/vkdiag/vkdiag.c tools/vkdiag/Makefile \
+                tools/vkload/vkload.c tools/vkload/Makefile
+            netns_config=$(parse_yaml "$CONFIG_FILE" "vm.netns_config")
+            if [ -n "$netns_config" ]; then
+                [[ "$netns_config" != /* ]] && netns_config="$MAIN_DIR/$netns_config"
+                _step_files "$netns_config" libs/utils.sh libs/network.sh libs/link.sh libs/netns.sh
+            fi
+            ;;
+    esac
+    true
+}
+
+# Outputs, relative to VM_DIR
+_step_outputs() {
+    case "$1" in
+        kernel) kernel_image_path ;;
+        rootfs) echo "rootfs/etc/debian_version" ;;
+        image)  echo "rootfs.img" ;;
+    esac
+}
+
+_step_hash() {
+    local step="$1"
+    local dep hash
+
+    hash=$(
+        {
+            echo "step=$step"
+            _step_inputs "$step"
+            for dep in $(_step_deps "$step"); do
+                echo "$dep=$(cat "$VM_DIR/.steps/$dep" 2>/dev/null)"
+            done
+        } | sha1sum
+    ) || return 1
+    echo "${hash%% *}"
+}
+
+_step_outputs_present() {
+    local output
+    for output in $(_step_outputs "$1"); do
+        [ -e "$VM_DIR/$output" ] || return 1
+    done
+}
+
+_step_up_to_date() {
+    local step="$1"
+    local hash="$2"
+    [ "$(cat "$VM_DIR/.steps/$step" 2>/dev/null)" = "$hash" ] && _step_outputs_present "$step"
+}
+
+_step_function() {
+    case "$1" in
+        kernel) echo kernel_setup ;;
+        rootfs) echo rootfs_setup ;;
+        image)  echo rootfs_config ;;
+    esac
+}
+
+_step_run() {
+    local step="$1"
+    local force="$2"
+    local hash log="$VM_DIR/.steps/$step.log" status policy
+
+    hash=$(_step_hash "$step") || { log_error "[$step] Failed to hash the inputs"; return 1; }
+    if [ "$force" != "force" ] && _step_up_to_date "$step" "$hash"; then
+        log_info "[$step] Up to date, skipped"
+        return 0
+    fi
+
+    # A step only runs again when its inputs changed: update what exists
+    # (recompile the kernel tree), unless a policy was chosen
+    policy="${PROMPT_POLICY:-${VIRTK_POLICY:-$(parse_yaml "$CONFIG_FILE" "vm.prompt_policy")}}"
+    policy="${policy:-update}"
+
+    rm -f "$VM_DIR/.steps/$step"
+    log_info "[$step] Running (log: $log)"
+    # "|| exit": the setup functions were not written for errexit, their
+    # status is kept (PROMPT_ABORTED)
+    {
+        PROMPT_POLICY="$policy" "$(_step_function "$step")" < /dev/null 2>&1 || exit $?
+    } | tee "$log" | sed -u "s/^/[$step] /"
+    status=${PIPESTATUS[0]}
+    if [ "$status" -eq "$PROMPT_ABORTED" ]; then
+        log_warning "[$step] Aborted by the prompt policy, see $log"
+        return "$PROMPT_ABORTED"
+    fi
+    if [ "$status" -ne 0 ] || ! _step_outputs_present "$step"; then
+        log_error "[$step] Failed, see $log"
+        return 1
+    fi
+    echo "$hash" > "$VM_DIR/.steps/$step"
+    log_success "[$step] Done"
+}
+
+# Run the steps whose dependencies are done, concurrently, until all are
+# done or nothing more can run
+pipeline_build() {
+    local force="${1:-}"
+    local step dep ready running=0 done_pid status keepalive
+    local -A state pids
+
+    mkdir -p "$VM_DIR/.steps"
+    # the steps run without a terminal, keep the sudo credentials fresh
+    sudo -v || return 1
+    sudo_keepalive
+    keepalive=$!
+
+    while :; do
+        for step in $PIPELINE_STEPS; do
+            [ -z "${state[$step]:-}" ] || continue
+            ready=true
+            for dep in $(_step_deps "$step"); do
+                [ "${state[$dep]:-}" = "ok" ] || ready=false
+            done
+            $ready || continue
+            _step_run "$step" "$force" &
+            pids[$!]=$step
+            state[$step]=running
+            running=$((running + 1))
+        done
+        (( running > 0 )) || break
+
+        wait -n -p done_pid "${!pids[@]}" && status=0 || status=$?
+        step=${pids[$done_pid]}
+        unset "pids[$done_pid]"
+        running=$((running - 1))
+        if [ "$status" -eq 0 ]; then
+            state[$step]=ok
+        elif [ "$status" -eq "$PROMPT_ABORTED" ]; then
+            state[$step]=aborted
+        else
+            state[$step]=failed
+        fi
+    done
+
+    kill "$keepalive" 2>/dev/null || true
+    status=0
+    for step in $PIPELINE_STEPS; do
+        case "${state[$step]:-}" in
+            ok)      ;;
+            aborted) status=$PROMPT_ABORTED ;;
+            failed)  status=1; break ;;
+            *)       log_error "[$step] Not run, a step it depends on did not complete" ;;
+        esac
+    done
+    return $status
+}
+
+pipeline_run() {
+    pipeline_build "$1" && bridges_setup && vm_start
+}
+
+pipeline_status() {
+    local step hash
+    log_info "Setup steps for $VM_NAME:"
+    for step in $PIPELINE_STEPS; do
+        hash=$(_step_hash "$step")
+        if _step_up_to_date "$step" "$hash"; then
+            log_success "  $step: up to date"
+        elif [ -f "$VM_DIR/.steps/$step" ]; then
+            log_warning "  $step: inputs changed or outputs missing"
+        else
+            log_warning "  $step: never run"
+        fi
+    done
+}
@@ -47,6 +47,18 @@ rootfs_setup(){
     log_info "Configuration: $arch $suite from $mirror"
     
     if [ -d rootfs ]; then
+        case "$(prompt_policy)" in
+            reuse)
+                if [ -f rootfs/etc/debian_version ]; then
+                    log_info "Root filesystem already exists, reused (policy: reuse)"
+                    return 0
+                fi
+                ;;
+            abort)
+                log_warning "Root filesystem already exists, not replaced (policy: abort)"
+                return $PROMPT_ABORTED
+                ;;
+        esac
         log_warning "Root filesystem already exists. Removing..."
         sudo rm -rf rootfs
     fi
@@ -90,6 +102,7 @@ rootfs_config(){
 
     # Adiciona initramfs-tools para garantir suporte ao boot
     packages="$packages initramfs-tools"
+    schedtrace_enabled && packages="$packages bpftrace"
 
     log_info "Installing packages and configuring system..."
     sudo chroot rootfs /bin/bash <<EOF
@@ -102,8 +115,8 @@ DEBIAN_FRONTEND=noninteractive apt install -y $packages
 echo "root:$root_password" | chpasswd
 sed -i 's/#PermitRootLogin prohibit-password/PermitRootLogin yes/' /etc/ssh/sshd_config
 
-# Create user account
-useradd -m -s /bin/bash "$username"
+# Create user account (kept when the image is rebuilt from the same rootfs)
+id "$username" > /dev/null 2>&1 || useradd -m -s /bin/bash "$username"
 echo "$username:$password" | chpasswd
 usermod -aG sudo "$username"
 
@@ -151,7 +164,8 @@ auto lo
 iface lo inet loopback
 
 # Interfaces will be managed by network-setup service
-# They will automatically request DHCP when brought up
+# Static addresses come from virtk.ip= on the kernel cmdline, the
+# remaining interfaces request DHCP when brought up
 EOF
 
     # Create network setup script
@@ -165,6 +179,69 @@ EOF
     # Enable the service
     sudo chroot "$rootfs_dir" systemctl enable network-setup.service
 
+    # Install memory setup service (swap profile from kernel cmdline)
+    log_info "Installing memory setup service..."
+    sudo cp "${MAIN_DIR}/scripts/memory-setup.sh" "$rootfs_dir/usr/local/bin/"
+    sudo chmod +x "$rootfs_dir/usr/local/bin/memory-setup.sh"
+    sudo cp "${MAIN_DIR}/scripts/memory-setup.service" "$rootfs_dir/etc/systemd/system/"
+    sudo chroot "$rootfs_dir" systemctl enable memory-setup.service
+
+    # Host key for non-interactive runs (vm_ssh, libs/matrix.sh)
+    log_info "Installing host SSH key for root..."
+    vm_ssh_key || { log_error "Failed to create $VM_SSH_KEY"; return 1; }
+    sudo mkdir -p -m 700 "$rootfs_dir/root/.ssh"
+    sudo cp "$VM_SSH_KEY.pub" "$rootfs_dir/root/.ssh/authorized_keys"
+    sudo chmod 600 "$rootfs_dir/root/.ssh/authorized_keys"
+
+    # Subflow telemetry collector (tools/vkdiag), static so it does not
+    # depend on the guest libc
+    log_info "Installing vkdiag..."
+    local cross=""
+    case "$(parse_yaml "$CONFIG_FILE" "kernel.machine")" in
+        "raspberrypi4"|"rpi4"|"raspi4"|"raspberrypi4b"|"rpi4b")
+            cross="aarch64-linux-gnu-"
+            ;;
+    esac
+    # optional: a host without a static libc or the cross compiler still
+    # builds the image, without the tool
+    if make -s -C "${MAIN_DIR}/tools/vkdiag" guest CROSS_COMPILE="$cross"; then
+        sudo install -m 755 "${MAIN_DIR}/tools/vkdiag/vkdiag-guest" "$rootfs_dir/usr/local/bin/vkdiag"
+    else
+        log_warning "Failed to build vkdiag (static ${cross}gcc), the image will not have it"
+    fi
+
+    # Native MPTCP load generator (tools/vkload, test_conn/load.sh)
+    log_info "Installing vkload..."
+    if make -s -C "${MAIN_DIR}/tools/vkload" guest CROSS_COMPILE="$cross"; then
+        sudo install -m 755 "${MAIN_DIR}/tools/vkload/vkload-guest" "$rootfs_dir/usr/local/bin/vkload"
+    else
+        log_warning "Failed to build vkload (static ${cross}gcc), the image will not have it"
+    fi
+
+    if schedtrace_enabled; then
+        log_info "Installing scheduler tracing (virtk-sched)..."
+        sudo cp "${MAIN_DIR}/scripts/virtk-sched.sh" "$rootfs_dir/usr/local/bin/virtk-sched"
+        sudo chmod +x "$rootfs_dir/usr/local/bin/virtk-sched"
+    fi
+
+    # Namespace endpoints backend (libs/netns.sh) for running many
+    # endpoints inside this VM
+    local netns_config
+    netns_config=$(parse_yaml "$CONFIG_FILE" "vm.netns_config")
+    if [ -n "$netns_config" ]; then
+        [[ "$netns_config" != /* ]] && netns_config="$MAIN_DIR/$netns_config"
+        if [ ! -f "$netns_config" ]; then
+            log_error "Namespace config not found: $netns_config"
+            return 1
+        fi
+        log_info "Installing namespace endpoints backend (virtk-netns)..."
+        sudo mkdir -p "$rootfs_dir/usr/local/lib/virtk/libs" "$rootfs_dir/etc/virtk"
+        sudo cp "${MAIN_DIR}"/libs/{utils,network,link,netns}.sh "$rootfs_dir/usr/local/lib/virtk/libs/"
+        sudo cp "$netns_config" "$rootfs_dir/etc/virtk/netns.yaml"
+        sudo cp "${MAIN_DIR}/scripts/virtk-netns.sh" "$rootfs_dir/usr/local/bin/virtk-netns"
+        sudo chmod +x "$rootfs_dir/usr/local/bin/virtk-netns"
+    fi
+
 
 ########################### Into the /etc/hostname ###########################
     log_info "Setting hostname to: $VM_NAME"
@@ -0,0 +1,85 @@
+#!/bin/bash
+
+# =============================================================================
+# MPTCP SCHEDULER MICROBENCHMARK
+# =============================================================================
+#
+# Cost of one scheduling decision in isolation from the VM, virtio and the
+# network: tools/schedbench/mptcp_sched_bench.c is built into the guest
+# kernel (net/mptcp) and calls each scheduler's get_send on synthetic MPTCP
+# sockets with growing subflow counts.
+#
+#   vm:
+#     schedbench: true      # add the benchmark to --kernel (needs a rebuild)
+#
+#   ./script.sh client.yaml --schedbench [SUBFLOWS] [ITERS] [SCHEDULERS]
+#
+# e.g. "--schedbench 1,2,4,8,16,32 200000 default,xlayer". Without
+# SCHEDULERS every registered scheduler is measured. The CSV (ns and cache
+# misses per decision, see the source for the subflow states) is printed
+# and saved under results/.
+
+SCHEDBENCH_DIR="${MAIN_DIR}/tools/schedbench"
+SCHEDBENCH_SRC="mptcp_sched_bench.c"
+SCHEDBENCH_DEBUGFS="/sys/kernel/debug/mptcp_sched_bench/run"
+
+schedbench_enabled() {
+    [[ "$(parse_yaml "$CONFIG_FILE" "vm.schedbench")" == "true" ]]
+}
+
+# Kernel options needed by the benchmark (one per line); KALLSYMS_ALL lets
+# it find the registered schedulers, PERF_EVENTS count the cache misses
+schedbench_kernel_options() {
+    schedbench_enabled || return 0
+    echo "CONFIG_DEBUG_FS"
+    echo "CONFIG_PERF_EVENTS"
+    echo "CONFIG_KALLSYMS"
+    echo "CONFIG_KALLSYMS_ALL"
+}
+
+# Copies the benchmark into net/mptcp of the kernel tree and links it into
+# the MPTCP stack (after apply_patches_if_needed, which may replace the
+# Makefile)
+schedbench_install_source() {
+    local kernel_dir="$1"
+    local mptcp_dir="$kernel_dir/net/mptcp"
+
+    schedbench_enabled || return 0
+    log_info "Adding the MPTCP scheduler benchmark to $mptcp_dir"
+    cp "$SCHEDBENCH_DIR/$SCHEDBENCH_SRC" "$mptcp_dir/" || { log_error "Failed to copy $SCHEDBENCH_SRC"; return 1; }
+    if ! grep -q "mptcp_sched_bench.o" "$mptcp_dir/Makefile"; then
+        echo "obj-\$(CONFIG_MPTCP) += mptcp_sched_bench.o" >> "$mptcp_dir/Makefile"
+    fi
+}
+
+# schedbench_run [SUBFLOWS] [ITERS] [SCHEDULERS]
+schedbench_run() {
+    local subflows="${1:-1,2,4,8,16,32}"
+    local iters="${2:-100000}"
+    local scheds="${3:-}"
+    local params out
+
+    vm_ssh_key || return 1
+    if ! vm_ssh "$CONFIG_FILE" true; then
+        log_error "Cannot reach $VM_NAME, is it running?"
+        return 1
+    fi
+
+    params="subflows=$subflows iters=$iters"
+    [ -n "$scheds" ] && params="$params sched=$scheds"
+
+    out="$MAIN_DIR/results/schedbench-$VM_NAME-$(date +%Y%m%d-%H%M%S).csv"
+    mkdir -p "$(dirname "$out")"
+
+    log_info "Running the scheduler benchmark ($params)"
+    if ! vm_ssh "$CONFIG_FILE" "mountpoint -q /sys/kernel/debug || mount -t debugfs none /sys/kernel/debug;
+        [ -e $SCHEDBENCH_DEBUGFS ] || { echo 'Kernel built without vm.schedbench' >&2; exit 1; }
+        echo '$params' > $SCHEDBENCH_DEBUGFS && cat $SCHEDBENCH_DEBUGFS" > "$out"; then
+        log_error "Scheduler benchmark failed (see dmesg in the guest)"
+        rm -f "$out"
+        return 1
+    fi
+
+    cat "$out"
+    log_success "Results saved to $out"
+}
@@ -0,0 +1,153 @@
+#!/bin/bash
+
+# =============================================================================
+# MPTCP SCHEDULER TRACING
+# =============================================================================
+#
+# CPU cost and path choices of the MPTCP scheduler, measured in the guest
+# with kprobes (scripts/virtk-sched.sh, installed as virtk-sched):
+#
+#   vm:
+#     schedtrace: true      # kernel options, bpftrace and virtk-sched in the rootfs
+#
+#   virtk-sched -o sched.jsonl -- iperf3 -c 10.0.0.20     # in the guest
+#
+# The matrix runner traces every cell with experiment.schedtrace: true and
+# joins the summary to the iperf results (meta.env, results.csv).
+#
+# Latencies come from kprobe/kretprobe pairs, so they include the probe
+# overhead (the same for every scheduler, fine for comparisons but not an
+# absolute cost). Percentiles are upper bounds of the log2 histogram bucket.
+
+schedtrace_enabled() {
+    [[ "$(parse_yaml "$CONFIG_FILE" "vm.schedtrace")" == "true" ]]
+}
+
+# Kernel options needed by virtk-sched (one per line); the BTF needs pahole
+# (dwarves) on the build host
+schedtrace_kernel_options() {
+    schedtrace_enabled || return 0
+    echo "CONFIG_BPF_SYSCALL"
+    echo "CONFIG_BPF_JIT"
+    echo "CONFIG_KPROBES"
+    echo "CONFIG_KPROBE_EVENTS"
+    echo "CONFIG_BPF_EVENTS"
+    echo "CONFIG_FTRACE"
+    echo "CONFIG_DEBUG_INFO_DWARF_TOOLCHAIN_DEFAULT"
+    echo "CONFIG_DEBUG_INFO_BTF"
+}
+
+# bpftrace -f json lines -> "hist FN UPPER COUNT", "stats FN COUNT AVG TOTAL",
+# "map NAME KEY VALUE" and "scalar NAME VALUE" records
+_schedtrace_parse() {
+    awk '
+    function num(obj, key,   r) {
+        if (!match(obj, "\"" key "\": *-?[0-9]+"))
+            return ""
+        r = substr(obj, RSTART, RLENGTH)
+        sub(/.*: */, "", r)
+        return r
+    }
+    function first_key(seg) {
+        match(seg, /"[^"]*"/)
+        return substr(seg, RSTART + 1, RLENGTH - 2)
+    }
+    {
+        if (!match($0, /"@[A-Za-z0-9_]+"/))
+            next
+        name = substr($0, RSTART + 2, RLENGTH - 3)
+        rest = substr($0, RSTART + RLENGTH)
+
+        if ($0 ~ /"type": *"hist"/) {
+            while (match(rest, /"[^"]*": *\[[^]]*\]/)) {
+                seg = substr(rest, RSTART, RLENGTH)
+                rest = substr(rest, RSTART + RLENGTH)
+                fn = first_key(seg)
+                while (match(seg, /\{[^}]*\}/)) {
+                    b = substr(seg, RSTART, RLENGTH)
+                    seg = substr(seg, RSTART + RLENGTH)
+                    upper = num(b, "max")
+                    if (upper == "")
+                        upper = num(b, "min")
+                    print "hist", fn, upper, num(b, "count")
+                }
+            }
+        } else if ($0 ~ /"type": *"stats"/) {
+            while (match(rest, /"[^"]*": *\{[^}]*\}/)) {
+                seg = substr(rest, RSTART, RLENGTH)
+                rest = substr(rest, RSTART + RLENGTH)
+                print "stats", first_key(seg), num(seg, "count"), num(seg, "average"), num(seg, "total")
+            }
+        } else if ($0 ~ /"type": *"map"/) {
+            if (rest ~ /^: *-?[0-9]/) {
+                gsub(/[^0-9-]/, "", rest)
+                print "scalar", name, rest
+            } else {
+                while (match(rest, /"[^"]*": *-?[0-9]+/)) {
+                    seg = substr(rest, RSTART, RLENGTH)
+                    rest = substr(rest, RSTART + RLENGTH)
+                    v = seg
+                    sub(/.*: */, "", v)
+                    print "map", name, first_key(seg), v
+                }
+            }
+        }
+    }' "$1"
+}
+
+# schedtrace_report <sched.jsonl> <out_prefix>: <out_prefix>.csv (per traced
+# function) and <out_prefix>-paths.csv (decisions per path); prints the
+# sched_* summary of mptcp_sched_get_send as KEY=VALUE lines for meta.env
+schedtrace_report() {
+    local jsonl="$1"
+    local prefix="$2"
+    local records
+
+    [ -s "$jsonl" ] || { log_error "No scheduler trace in $jsonl"; return 1; }
+    records=$(_schedtrace_parse "$jsonl")
+
+    awk -v out="$prefix.csv" -v paths="$prefix-paths.csv" '
+    $1 == "scalar" && $2 == "elapsed_ns" { elapsed = $3 }
+    $1 == "stats" { calls[$2] = $3; avg[$2] = $4; fns[$2] = 1 }
+    $1 == "hist" { n = ++nb[$2]; upper[$2, n] = $3; count[$2, n] = $4; fns[$2] = 1 }
+    $1 == "map" && $2 == "empty" { empty[$3] = $4 }
+    $1 == "map" && $2 == "path" { path[$3] = $4; decisions += $4 }
+
+    function pct(fn, p,   i, total, acc) {
+        total = 0
+        for (i = 1; i <= nb[fn]; i++)
+            total += count[fn, i]
+        acc = 0
+        for (i = 1; i <= nb[fn]; i++) {
+            acc += count[fn, i]
+            if (acc >= total * p)
+                return upper[fn, i] + 1
+        }
+        return ""
+    }
+    END {
+        secs = elapsed / 1e9
+        print "function,calls,calls_per_s,mean_ns,p50_ns,p90_ns,p99_ns,empty" > out
+        for (fn in fns) {
+            rate = secs > 0 ? sprintf("%.1f", calls[fn] / secs) : ""
+            printf "%s,%d,%s,%d,%s,%s,%s,%d\n", fn, calls[fn], rate, avg[fn],
+                pct(fn, 0.5), pct(fn, 0.9), pct(fn, 0.99), empty[fn] > out
+        }
+
+        print "path,decisions,share" > paths
+        shares = ""
+        for (p in path) {
+            share = decisions ? 100 * path[p] / decisions : 0
+            printf "%s,%d,%.1f\n", p, path[p], share > paths
+            shares = shares (shares ? ";" : "") sprintf("%s:%.1f%%", p, share)
+        }
+
+        fn = "mptcp_sched_get_send"
+        print "sched_send_calls=" calls[fn]
+        print "sched_send_calls_per_s=" (secs > 0 ? sprintf("%.1f", calls[fn] / secs) : "")
+        print "sched_send_mean_ns=" avg[fn]
+        print "sched_send_p99_ns=" pct(fn, 0.99)
+        print "sched_retrans_calls=" calls["mptcp_sched_get_retrans"]
+        print "sched_paths=" shares
+    }' <<< "$records"
+}
@@ -31,253 +31,322 @@ check_command() {
     return 0
 }
 
-parse_yaml_subkeys() {
-    local yaml_file="$1"
-    local first_key="$2"
-    local remaining_keys="$3"
-    local indent_level="$4"
-    
-    # Build indentation pattern
-    local indent_pattern=""
-    for ((i=0; i<indent_level; i++)); do
-        indent_pattern+="  "
-    done
-    
-    # Find the section for the first key
-    local in_section=false
-    local temp_file
-    temp_file=$(mktemp)
-    
-    while IFS= read -r line; do
-        # Check current line indentation
-        local line_indent=""
-        if [[ "$line" =~ ^([[:space:]]*) ]]; then
-            line_indent="${BASH_REMATCH[1]}"
-        fi
-        
-        # Check if we found our key at the correct indentation level
-        if [[ "$line" =~ ^${indent_pattern}${first_key}:[[:space:]]*$ ]] || [[ "$line" =~ ^${indent_pattern}${first_key}:[[:space:]]+.+ ]]; then
-            in_section=true
-            # If this line has a value, extract it (for simple key:value on same line)
-            if [[ "$line" =~ ^${indent_pattern}${first_key}:[[:space:]]+(.+)$ ]] && [[ "$remaining_keys" == "" ]]; then
-                local value="${BASH_REMATCH[1]}"
-                value=$(echo "$value" | sed 's/^[[:space:]]*//; s/[[:space:]]*$//' | tr -d '"'"'"'')
-                echo "$value"
-                rm -f "$temp_file"
-                return 0
-            fi
-            continue
+# Poll a command until it succeeds, instead of sleeping a fixed time.
+# Usage: wait_for <timeout_seconds> <command> [args...]
+wait_for() {
+    local timeout="$1"
+    shift
+    local now="${EPOCHREALTIME/./}"
+    local deadline=$(( now + timeout * 1000000 ))
+
+    until "$@"; do
+        now="${EPOCHREALTIME/./}"
+        if (( now >= deadline )); then
+            return 1
         fi
-        
-        # If we're in the section, collect lines with deeper indentation
-        if [ "$in_section" = true ]; then
-            # If we encounter a line at the same or lesser indentation, we've left the section
-            if [[ ${#line_indent} -le ${#indent_pattern} ]] && [[ "$line" =~ ^[[:space:]]*[^[:space:]] ]]; then
-                break
-            fi
-            
-            # Add lines that belong to this section
-            if [[ ${#line_indent} -gt ${#indent_pattern} ]] || [[ "$line" =~ ^[[:space:]]*$ ]]; then
-                echo "$line" >> "$temp_file"
+        sleep 0.02
+    done
+    return 0
+}
+
+# Keep the sudo credentials fresh for work that runs without a terminal, as
+# long as the calling shell lives (also when it is interrupted or killed):
+#   sudo_keepalive; keepalive=$!
+sudo_keepalive() {
+    local owner=$BASHPID
+    while sleep 60 && kill -0 "$owner" 2>/dev/null; do
+        sudo -n -v
+    done > /dev/null 2>&1 &
+}
+
+# =============================================================================
+# PROMPT POLICY
+# =============================================================================
+#
+# Every question the toolkit asks (existing kernel tree, KVM, cleaning) is
+# answered by a policy instead of blocking on read when one is set, by
+# --policy, VIRTK_POLICY or vm.prompt_policy in that order:
+#
+#   ask      interactive (default); without a terminal, abort
+#   reuse    keep what exists, skip the work
+#   update   keep and update it (recompile the kernel tree, load KVM),
+#            never cleans
+#   rebuild  discard it and redo it from scratch (clean without asking)
+#   abort    change nothing and fail with PROMPT_ABORTED
+#
+# so that unattended runs are deterministic and report the outcome in
+# their exit code.
+
+PROMPT_ABORTED=3
+
+prompt_policy() {
+    local policy="${PROMPT_POLICY:-${VIRTK_POLICY:-}}"
+
+    if [ -z "$policy" ] && [ -n "${CONFIG_FILE:-}" ]; then
+        policy=$(parse_yaml "$CONFIG_FILE" "vm.prompt_policy")
+    fi
+    case "${policy:-ask}" in
+        ask)
+            [ -t 0 ] && echo "ask" || echo "abort"
+            ;;
+        reuse|update|rebuild|abort)
+            echo "$policy"
+            ;;
+        *)
+            log_error "Unknown prompt policy: $policy (ask, reuse, update, rebuild, abort)" >&2
+            echo "abort"
+            ;;
+    esac
+}
+
+# y/N question under the policy: 0 yes (rebuild, and update unless the
+# question is "destructive"), 1 no (reuse or declined), PROMPT_ABORTED
+# (abort). prompt_confirm QUESTION [destructive]
+prompt_confirm() {
+    local question="$1"
+    local destructive="${2:-}"
+    local policy
+    policy=$(prompt_policy)
+
+    case "$policy" in
+        update|rebuild)
+            if [ "$policy" = "update" ] && [ "$destructive" = "destructive" ]; then
+                log_info "$question no (policy: update, which never cleans)" >&2
+                return 1
             fi
-        fi
-    done < "$yaml_file"
-    
-    # Recursively parse the remaining keys with increased indentation
-    if [ -s "$temp_file" ]; then
-        local result
-        result=$(parse_yaml "$temp_file" "$remaining_keys" $((indent_level + 1)))
-        local exit_code=$?
-        rm -f "$temp_file"
-        if [ $exit_code -eq 0 ]; then
-            echo "$result"
+            log_info "$question yes (policy: $policy)" >&2
+            return 0
+            ;;
+        reuse)
+            log_info "$question no (policy: reuse)" >&2
+            return 1
+            ;;
+        abort)
+            log_warning "$question aborted (policy: abort)" >&2
+            return $PROMPT_ABORTED
+            ;;
+    esac
+    read -p "$question (y/N): " -n 1 -r
+    echo >&2
+    [[ $REPLY =~ ^[Yy]$ ]]
+}
+
+# =============================================================================
+# YAML CONFIG CACHE
+# =============================================================================
+#
+# A YAML file is compiled in one awk pass into a bash file that fills three
+# associative arrays (value of every key path, child keys of every mapping,
+# items of every list), cached in .yaml-cache/ and sourced once per shell:
+# parse_yaml, get_yaml_subkeys and get_config_array are then array lookups.
+# The cache header keeps the mtime and size of the YAML it was built from
+# and its sha1sum: when the stamp differs (edited, or restored with an older
+# mtime by cp -p/rsync/tar), the sha1sum decides between refreshing the
+# stamp and compiling again. The cache file takes the mtime of the YAML, so
+# a shell that already loaded it only compares the two mtimes; the stamp it
+# loaded is kept in _YAML_STAMP for long-running shells. Values keep the old
+# parse_yaml conventions (quotes removed, trailing "# comments" dropped),
+# malformed lines are reported when the file is compiled.
+
+declare -gA _YAML_V _YAML_K _YAML_L _YAML_PREFIX _YAML_CACHE _YAML_STAMP
+_YAML_GEN=0
+
+_yaml_compile() {
+    local yaml_file="$1"
+    local hash="$2"
+
+    awk -v file="$yaml_file" -v hash="$hash" '
+        function q(s) { gsub(/\047/, "\047\\\047\047", s); return "\047" s "\047" }
+        function bad(msg) { printf "%s:%d: %s, line ignored\n", file, NR, msg > "/dev/stderr" }
+        function clean(v,   c) {
+            sub(/^[ \t]+/, "", v)
+            if (v ~ /^"/) {
+                c = index(substr(v, 2), "\"")
+                if (c) v = substr(v, 1, c + 1)
+            } else if (v ~ /^\047/) {
+                c = index(substr(v, 2), "\047")
+                if (c) v = substr(v, 1, c + 1)
+            } else if (match(v, /[ \t]#/)) {
+                v = substr(v, 1, RSTART - 1)
+            }
+            sub(/[ \t]+$/, "", v)
+            gsub(/["\047]/, "", v)
+            return v
+        }
+        {
+            sub(/\r$/, "")
+            if ($0 ~ /^[ \t]*(#|$)/ || $0 ~ /^(---|\.\.\.)[ \t]*$/)
+                next
+            if ($0 ~ /^ *\t/) { bad("tab indentation"); next }
+            match($0, /^ */)
+            ind = RLENGTH
+            line = substr($0, ind + 1)
+
+            if (line == "-" || line ~ /^- /) {
+                while (sp > 0 && sind[sp] > ind) sp--
+                if (sp == 0) { bad("list item outside of a key"); next }
+                owner = spath[sp]
+                item = clean(substr(line, 2))
+                if (owner in list) list[owner] = list[owner] "\n" item
+                else { list[owner] = item; lname[++nl] = owner }
+                next
+            }
+
+            c = index(line, ":")
+            if (c < 2 || (c < length(line) && substr(line, c + 1, 1) !~ /[ \t]/)) {
+                bad("not a \"key: value\" line")
+                next
+            }
+            key = substr(line, 1, c - 1)
+            sub(/[ \t]+$/, "", key)
+            gsub(/["\047]/, "", key)
+
+            while (sp > 0 && sind[sp] >= ind) sp--
+            parent = sp ? spath[sp] : ""
+            path = sp ? parent "." key : key
+            sp++; sind[sp] = ind; spath[sp] = path
+
+            # the first definition wins, as with the line scans it replaces
+            if (path in val)
+                next
+            val[path] = clean(substr(line, c + 1))
+            order[++nk] = path
+            if (!(parent in kids)) { korder[++np] = parent; kids[parent] = key }
+            else kids[parent] = kids[parent] " " key
+        }
+        END {
+            print "_yh=" q(hash)
+            for (i = 1; i <= nk; i++)
+                print "_YAML_V[\"$_yk\"" q(order[i]) "]=" q(val[order[i]])
+            for (i = 1; i <= np; i++)
+                print "_YAML_K[\"$_yk\"" q(korder[i]) "]=" q(kids[korder[i]])
+            for (i = 1; i <= nl; i++) {
+                p = lname[i]
+                print "_YAML_L[\"$_yk\"" q(p) "]=" q(list[p])
+                # get_config_array looks lists up by their last key
+                n = split(p, parts, ".")
+                if (!(parts[n] in byname)) {
+                    byname[parts[n]] = 1
+                    print "_YAML_L[\"$_yk\"" q("@" parts[n]) "]=" q(list[p])
+                }
+            }
+        }' "$yaml_file"
+}
+
+# Drop the values a previous load of a YAML file left in this shell
+_yaml_forget() {
+    local prefix="${_YAML_PREFIX[$1]:-}"
+    local key
+
+    [ -n "$prefix" ] || return 0
+    for key in "${!_YAML_V[@]}"; do
+        [[ "$key" == "$prefix"* ]] && unset -v '_YAML_V[$key]'
+    done
+    for key in "${!_YAML_K[@]}"; do
+        [[ "$key" == "$prefix"* ]] && unset -v '_YAML_K[$key]'
+    done
+    for key in "${!_YAML_L[@]}"; do
+        [[ "$key" == "$prefix"* ]] && unset -v '_YAML_L[$key]'
+    done
+    unset -v '_YAML_PREFIX[$1]'
+}
+
+# Load the cached form of a YAML file into this shell, compiling it first
+# if needed; cheap when already loaded (mtimes compared by the shell)
+yaml_load() {
+    local yaml_file="$1"
+    local cache="${_YAML_CACHE[$yaml_file]}"
+    local path hash stamp line stamp_line hash_line _yk _yh _ys
+
+    if [ -n "$cache" ] && [ -f "$cache" ] && \
+       [ ! "$yaml_file" -nt "$cache" ] && [ ! "$yaml_file" -ot "$cache" ]; then
+        return 0
+    fi
+    [ -f "$yaml_file" ] || return 1
+
+    path="$yaml_file"
+    [[ "$path" != /* ]] && path="$PWD/$path"
+    cache="${YAML_CACHE_DIR:-${MAIN_DIR:-$PWD}/.yaml-cache}/${path//\//%}.sh"
+
+    stamp=$(stat -L -c '%y %s' "$yaml_file") || return 1
+    stamp_line="" hash_line=""
+    [ -f "$cache" ] && { read -r stamp_line; read -r hash_line; } < "$cache"
+    if [ "$stamp_line" != "_ys='$stamp'" ]; then
+        hash=$(sha1sum < "$yaml_file") || return 1
+        hash="${hash%% *}"
+        if [ "$hash_line" = "_yh='$hash'" ] && \
+           { echo "_ys='$stamp'"; tail -n +2 "$cache"; } > "$cache.$BASHPID" 2>/dev/null; then
+            mv -f "$cache.$BASHPID" "$cache"
+        elif mkdir -p "$(dirname "$cache")" 2>/dev/null && \
+             { echo "_ys='$stamp'"; _yaml_compile "$yaml_file" "$hash"; } > "$cache.$BASHPID" \
+                 2> >(while IFS= read -r line; do log_warning "$line"; done >&2); then
+            mv -f "$cache.$BASHPID" "$cache"
+        else
+            # read-only tree: compile for this shell only
+            rm -f "$cache.$BASHPID"
+            _yaml_forget "$yaml_file"
+            _YAML_GEN=$((_YAML_GEN + 1))
+            _yk="$_YAML_GEN|"
+            source <(_yaml_compile "$yaml_file" "$hash") || return 1
+            _YAML_PREFIX[$yaml_file]="$_yk"
+            _YAML_STAMP[$yaml_file]="$stamp"
             return 0
         fi
     fi
-    
-    rm -f "$temp_file"
-    echo ""
-    return 0
+
+    if [ "$yaml_file" -nt "$cache" ] || [ "$yaml_file" -ot "$cache" ]; then
+        touch -r "$yaml_file" "$cache" 2>/dev/null || true
+    fi
+
+    _yaml_forget "$yaml_file"
+    _YAML_GEN=$((_YAML_GEN + 1))
+    _yk="$_YAML_GEN|"
+    source "$cache" || return 1
+    _YAML_PREFIX[$yaml_file]="$_yk"
+    _YAML_CACHE[$yaml_file]="$cache"
+    _YAML_STAMP[$yaml_file]="$stamp"
 }
 
+# Value of a dotted key path (e.g. vm.bridges.br0.ip), empty if missing
 parse_yaml() {
     local yaml_file="$1"
     local key="$2"
-    local indent_level="${3:-0}"  # Default indentation level is 0
-    
-    if [ ! -f "$yaml_file" ]; then
+
+    if ! yaml_load "$yaml_file"; then
         log_error "YAML file not found: $yaml_file"
         echo ""
         return 0
     fi
-    
-    # Handle nested keys (e.g., kernel.version.number)
-    if [[ "$key" == *.* ]]; then
-        local first_key="${key%%.*}"
-        local remaining_keys="${key#*.}"
-        
-        # Use yq if available and it's the top level call
-        if [ "$indent_level" -eq 0 ] && command -v yq &> /dev/null; then
-            local result
-            result=$(yq eval ".$key" "$yaml_file" 2>/dev/null)
-            if [ $? -eq 0 ] && [ "$result" != "null" ]; then
-                echo "$result"
-            else
-                echo ""
-            fi
-            return 0
-        fi
-        
-        # Use the dedicated subkey parsing function
-        parse_yaml_subkeys "$yaml_file" "$first_key" "$remaining_keys" "$indent_level"
-        return 0
-    else
-        # Simple key-value pairs at current indentation level
-        local indent_pattern=""
-        for ((i=0; i<indent_level; i++)); do
-            indent_pattern+="  "
-        done
-        
-        local result
-        result=$(grep "^${indent_pattern}${key}:" "$yaml_file" | cut -d':' -f2- | sed 's/^[[:space:]]*//; s/[[:space:]]*$//' | tr -d '"'"'"'')
-        
-        if [ -n "$result" ]; then
-            echo "$result"
-        else
-            echo ""
-        fi
-        return 0
-    fi
+    echo "${_YAML_V[${_YAML_PREFIX[$yaml_file]}$key]}"
 }
 
+# Child keys of a mapping, one per line (no key: the top-level keys);
+# fails if there are none
 get_yaml_subkeys() {
     local yaml_file="$1"
     local parent_key="$2"
-    local indent_level="${3:-0}"
-    
-    if [ ! -f "$yaml_file" ]; then
+    local -a keys
+
+    if ! yaml_load "$yaml_file"; then
         log_error "YAML file not found: $yaml_file"
         return 1
     fi
-    
-    # If parent_key contains dots, we need to navigate to the nested section first
-    if [[ "$parent_key" == *.* ]]; then
-        local first_key="${parent_key%%.*}"
-        local remaining_keys="${parent_key#*.}"
-        
-        # Build indentation pattern for the first key
-        local parent_indent=""
-        for ((i=0; i<indent_level; i++)); do
-            parent_indent+="  "
-        done
-        
-        # Find the section for the first key and create a temp file with its content
-        local in_section=false
-        local temp_file
-        temp_file=$(mktemp)
-        
-        while IFS= read -r line; do
-            # Check current line indentation
-            local line_indent=""
-            if [[ "$line" =~ ^([[:space:]]*) ]]; then
-                line_indent="${BASH_REMATCH[1]}"
-            fi
-            
-            # Check if we found the first key at the correct indentation level
-            if [[ "$line" =~ ^${parent_indent}${first_key}:[[:space:]]*$ ]] || [[ "$line" =~ ^${parent_indent}${first_key}:[[:space:]]+.+ ]]; then
-                in_section=true
-                continue
-            fi
-            
-            # If we're in the section, collect lines with deeper indentation
-            if [ "$in_section" = true ]; then
-                # If we encounter a line at the same or lesser indentation, we've left the section
-                if [[ ${#line_indent} -le ${#parent_indent} ]] && [[ "$line" =~ ^[[:space:]]*[^[:space:]] ]]; then
-                    break
-                fi
-                
-                # Add lines that belong to this section
-                if [[ ${#line_indent} -gt ${#parent_indent} ]] || [[ "$line" =~ ^[[:space:]]*$ ]]; then
-                    echo "$line" >> "$temp_file"
-                fi
-            fi
-        done < "$yaml_file"
-        
-        # Recursively call get_yaml_subkeys with the remaining keys
-        if [ -s "$temp_file" ]; then
-            local result
-            result=$(get_yaml_subkeys "$temp_file" "$remaining_keys" $((indent_level + 1)))
-            local exit_code=$?
-            rm -f "$temp_file"
-            if [ $exit_code -eq 0 ]; then
-                echo "$result"
-                return 0
-            fi
-        fi
-        
-        rm -f "$temp_file"
-        return 1
-    else
-        # Single level key - original logic
-        # Build indentation pattern for the parent key
-        local parent_indent=""
-        for ((i=0; i<indent_level; i++)); do
-            parent_indent+="  "
-        done
-        
-        # Build indentation pattern for the child keys (one level deeper)
-        local child_indent="${parent_indent}  "
-        
-        # If we have a parent key, find its section first
-        if [ -n "$parent_key" ]; then
-            local in_section=false
-            local found_keys=()
-            
-            while IFS= read -r line; do
-                # Check current line indentation
-                local line_indent=""
-                if [[ "$line" =~ ^([[:space:]]*) ]]; then
-                    line_indent="${BASH_REMATCH[1]}"
-                fi
-                
-                # Check if we found the parent key at the correct indentation level
-                if [[ "$line" =~ ^${parent_indent}${parent_key}:[[:space:]]*$ ]] || [[ "$line" =~ ^${parent_indent}${parent_key}:[[:space:]]+.+ ]]; then
-                    in_section=true
-                    continue
-                fi
-                
-                # If we're in the section, look for child keys
-                if [ "$in_section" = true ]; then
-                    # If we encounter a line at the same or lesser indentation, we've left the section
-                    if [[ ${#line_indent} -le ${#parent_indent} ]] && [[ "$line" =~ ^[[:space:]]*[^[:space:]] ]]; then
-                        break
-                    fi
-                    
-                    # Check if this line contains a key at the immediate child level
-                    if [[ "$line" =~ ^${child_indent}([^[:space:]]+):[[:space:]]*.*$ ]]; then
-                        local key_name="${BASH_REMATCH[1]}"
-                        found_keys+=("$key_name")
-                    fi
-                fi
-            done < "$yaml_file"
-            
-            # Print found keys
-            if [ ${#found_keys[@]} -gt 0 ]; then
-                printf '%s\n' "${found_keys[@]}"
-                return 0
-            else
-                return 1
-            fi
-        else
-            # If no parent key specified, list top-level keys
-            grep "^[^[:space:]].*:" "$yaml_file" | sed 's/:.*$//' | sort -u
-        fi
+    read -r -a keys <<< "${_YAML_K[${_YAML_PREFIX[$yaml_file]}$parent_key]}"
+    if [ -z "$parent_key" ]; then
+        [ ${#keys[@]} -gt 0 ] && printf '%s\n' "${keys[@]}" | sort -u
+        return 0
     fi
+    [ ${#keys[@]} -gt 0 ] || return 1
+    printf '%s\n' "${keys[@]}"
 }
 
+# Items of the first list under a key of that name, one per line
 get_config_array() {
     local yaml_file="$1"
     local section="$2"
+    local items
 
-    awk "/$section:/,/^[^ ]/ { if (/^ *- /) print \$2 }" "$yaml_file"
+    yaml_load "$yaml_file" || return 0
+    items="${_YAML_L[${_YAML_PREFIX[$yaml_file]}@$section]}"
+    [ -z "$items" ] || printf '%s\n' "$items"
 }
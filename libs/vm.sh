@@ -64,9 +64,10 @@ vm_start(){
             log_info "KVM acceleration enabled" >&2
         else
             log_warning "KVM not available, using software emulation" >&2
-            log_warning "Do you want to activate KVM? (y/n)" >&2
-            read -r answer
-            if [[ "$answer" == "y" ]]; then
+            local answer=0
+            prompt_confirm "Do you want to activate KVM?" || answer=$?
+            [ "$answer" -eq "$PROMPT_ABORTED" ] && return "$PROMPT_ABORTED"
+            if [ "$answer" -eq 0 ]; then
                 sudo modprobe kvm
                 sudo modprobe kvm_intel || sudo modprobe kvm_amd
                 if lsmod | grep -q kvm; then
@@ -81,6 +82,28 @@ vm_start(){
     mounting=(-virtfs local,path=$MAIN_DIR/test_conn,mount_tag=hostshare,security_model=none,id=hostshare)
     kernel_params+=" 9p.virtio=1"
 
+    # Static addresses are passed on the cmdline and set by network-setup.sh
+    local address_params
+    address_params=$(_get_static_address_params) || return 1
+    [ -n "$address_params" ] && kernel_params+=" $address_params"
+
+    # Memory density options (KSM, balloon, guest swap profile)
+    local memory_args
+    memory_host_setup
+    memory_args=$(_get_memory_args)
+    kernel_params+=" $(_get_memory_kernel_params)"
+
+    # Started by the daemon: no terminal, the serial console and the monitor
+    # are sockets in VM_DIR (socat -,raw,echo=0 UNIX-CONNECT:console.sock)
+    # (QEMU option values escape "," as ",,")
+    local console_args=(-nographic)
+    if [ "${VM_DETACHED:-}" = "1" ]; then
+        rm -f "$VM_DIR/qemu.pid"
+        console_args=(-display none -daemonize
+            -serial "unix:${VM_DIR//,/,,}/console.sock,server=on,wait=off"
+            -monitor "unix:${VM_DIR//,/,,}/monitor.sock,server=on,wait=off")
+    fi
+
     log_info "Starting QEMU VM:"
     log_info "  Memory: $memory"
     log_info "  Cores: $cores"
@@ -88,6 +111,7 @@ vm_start(){
     log_info "  Root FS: $rootfs_img"
     log_info "  Network: $network_args"
     log_info "  KVM: ${kvm_args:-disabled}"
+    log_info "  Memory options: ${memory_args:-none}"
 
     # Start VM
     if [ "$arch" = "arm64" ]; then
@@ -100,8 +124,11 @@ vm_start(){
             -drive file="$rootfs_img",format=raw,if=none,id=hd0 \
             -device virtio-blk-device,drive=hd0 \
             -append "$kernel_params" \
-            -nographic \
+            "${console_args[@]}" \
             "${mounting[@]}" \
+            -name "$VM_NAME" \
+            -pidfile "$VM_DIR/qemu.pid" \
+            $memory_args \
             $network_args
     elif [ "$arch" = "arm" ]; then
         $qemu_bin \
@@ -111,8 +138,11 @@ vm_start(){
             -kernel "$kernel_img" \
             -drive file="$rootfs_img",format=raw,if=virtio \
             -append "$kernel_params" \
-            -nographic \
+            "${console_args[@]}" \
             "${mounting[@]}" \
+            -name "$VM_NAME" \
+            -pidfile "$VM_DIR/qemu.pid" \
+            $memory_args \
             $network_args
     else
         $qemu_bin \
@@ -122,12 +152,43 @@ vm_start(){
             -kernel "$kernel_img" \
             -drive file="$rootfs_img",format=raw \
             -append "$kernel_params" \
-            -nographic \
+            "${console_args[@]}" \
             "${mounting[@]}" \
+            -name "$VM_NAME" \
+            -pidfile "$VM_DIR/qemu.pid" \
+            $memory_args \
             $network_args
     fi
 }
 
+# PID of the running VM, from the QEMU pidfile
+vm_pid() {
+    local pid=""
+    read -r pid 2>/dev/null < "$VM_DIR/qemu.pid"
+    if [[ -n "$pid" && -d "/proc/$pid" ]]; then
+        echo "$pid"
+        return 0
+    fi
+    return 1
+}
+
+vm_stop() {
+    local pid
+    if ! pid=$(vm_pid); then
+        log_info "VM $VM_NAME is not running"
+        return 0
+    fi
+
+    log_info "Stopping VM $VM_NAME (PID: $pid)"
+    kill "$pid" 2>/dev/null || sudo kill "$pid"
+    if ! wait_for 30 test ! -d "/proc/$pid"; then
+        log_warning "VM $VM_NAME did not stop, killing it"
+        kill -9 "$pid" 2>/dev/null || sudo kill -9 "$pid"
+    fi
+    rm -f "$VM_DIR/qemu.pid" "$VM_DIR/console.sock" "$VM_DIR/monitor.sock"
+    log_success "VM $VM_NAME stopped"
+}
+
 _validate_vm_files(){
     local kernel_version="$1"
     local machine arch kernel_img valid=true
@@ -189,7 +250,8 @@ _get_network_config(){
             local mac_address
             mac_address=$(parse_yaml "$CONFIG_FILE" "vm.bridges.${bridge_name}.mac_address")
             if [ -n "$mac_address" ]; then
-                network_args+="-nic bridge,br=$bridge_name,mac=$mac_address "
+                # Tap port created by bridge_setup (see libs/network.sh)
+                network_args+="-nic tap,ifname=$(tap_name "$bridge_name"),script=no,downscript=no,mac=$mac_address "
             else
                 log_warning "No MAC address found for bridge: $bridge_name"
             fi
@@ -200,6 +262,71 @@ _get_network_config(){
     return 0
 }
 
+# Kernel parameters "virtk.ip=<mac>,<address>/<bits>[,<gateway>]", one per
+# bridge with static addressing. The gateway is set for external bridges,
+# the resolvers of vm.dns (if any) go in "virtk.dns=<ip>[,<ip>...]".
+_get_static_address_params(){
+    local bridge_names params="" dns
+
+    mapfile -t bridge_names < <(get_yaml_subkeys "$CONFIG_FILE" "vm.bridges")
+
+    for bridge_name in "${bridge_names[@]}"; do
+        [ -n "$bridge_name" ] || continue
+        [ "$(bridge_addressing "$bridge_name")" = "static" ] || continue
+
+        local mac_address address ip_address netmask external mask_bits network_base
+        mac_address=$(parse_yaml "$CONFIG_FILE" "vm.bridges.${bridge_name}.mac_address")
+        ip_address=$(parse_yaml "$CONFIG_FILE" "vm.bridges.${bridge_name}.ip")
+        netmask=$(parse_yaml "$CONFIG_FILE" "vm.bridges.${bridge_name}.netmask")
+        external=$(parse_yaml "$CONFIG_FILE" "vm.bridges.${bridge_name}.external")
+        address=$(bridge_static_address "$bridge_name") || return 1
+
+        calculate_network_parameters "$ip_address" "$netmask"
+        log_info "Static address on $bridge_name: $address/$mask_bits" >&2
+
+        params+="virtk.ip=$mac_address,$address/$mask_bits"
+        [ -n "$external" ] && params+=",$ip_address"
+        params+=" "
+    done
+
+    dns=$(parse_yaml "$CONFIG_FILE" "vm.dns")
+    if [ -n "$params" ] && [ -n "$dns" ]; then
+        read -r -a dns <<< "$dns"
+        params+="virtk.dns=$(IFS=,; echo "${dns[*]}") "
+    fi
+
+    echo "${params% }"
+}
+
+# Key pair installed for root by rootfs_config, so the VMs can be driven
+# without a password (libs/matrix.sh)
+VM_SSH_KEY="${MAIN_DIR}/.ssh/virtk_ed25519"
+
+vm_ssh_key(){
+    if [ ! -f "$VM_SSH_KEY" ]; then
+        mkdir -p -m 700 "$(dirname "$VM_SSH_KEY")"
+        ssh-keygen -q -t ed25519 -N "" -C "virtk" -f "$VM_SSH_KEY" || return 1
+    fi
+}
+
+# Run a command as root in the running VM of a config (via its ssh_port)
+# Usage: vm_ssh <config.yaml> <command...>
+vm_ssh(){
+    local config="$1"
+    shift
+    local ssh_port
+    ssh_port=$(parse_yaml "$config" "vm.ssh_port")
+    if [ -z "$ssh_port" ]; then
+        log_error "No vm.ssh_port in $config" >&2
+        return 255
+    fi
+
+    ssh -i "$VM_SSH_KEY" -p "$ssh_port" \
+        -o BatchMode=yes -o ConnectTimeout=5 -o ServerAliveInterval=5 -o LogLevel=ERROR \
+        -o StrictHostKeyChecking=no -o UserKnownHostsFile=/dev/null \
+        root@127.0.0.1 "$@"
+}
+
 vm_status(){
     local kernel_version machine arch kernel_img
     kernel_version=$(parse_yaml "$CONFIG_FILE" "kernel.version")
@@ -255,10 +382,10 @@ vm_clean(){
     cd "$VM_DIR" || { log_error "Failed to change to VM directory"; return 1; }
     
     log_warning "This will remove all VM data for $VM_NAME"
-    read -p "Are you sure? (y/N): " -n 1 -r
-    echo
-    
-    if [[ ! $REPLY =~ ^[Yy]$ ]]; then
+    local answer=0
+    prompt_confirm "Are you sure?" destructive || answer=$?
+    [ "$answer" -eq "$PROMPT_ABORTED" ] && return "$PROMPT_ABORTED"
+    if [ "$answer" -ne 0 ]; then
         log_info "Operation cancelled"
         return 0
     fi
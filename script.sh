@@ -8,20 +8,38 @@ set -e
 
 # Check if YAML file is provided
 if [ $# -eq 0 ] || [ ! -f "$1" ]; then
-    echo "Usage: $0 <config.yaml> [OPTIONS]"
+    echo "Usage: $0 <config.yaml> [--policy POLICY] [OPTIONS]"
     echo "Example: $0 server.yaml --all"
     echo ""
     echo "Available commands:"
-    echo "  --all         Complete setup (kernel + rootfs + network + start VM)"
+    echo "  --all [force] Complete setup (kernel + rootfs + network + start VM), only the changed steps"
+    echo "  --steps       Show which setup steps are up to date"
     echo "  --kernel      Setup and compile kernel only"  
     echo "  --rootfs      Setup root filesystem only"
     echo "  --network     Setup bridge network only"
     echo "  --vm          Start VM (setup network if needed)"
+    echo "  --stop        Stop the VM"
     echo "  --status      Show complete system status"
+    echo "  --memory      Show resident memory of running VMs"
     echo "  --clean       Clean VM data (interactive)"
     echo "  --cache       Show kernel cache status"
     echo "  --cache-clean Clean kernel cache (interactive)"
     echo "  --teardown    Remove bridge network"
+    echo "  --link        Re-apply link emulation (rate/delay/loss) at runtime"
+    echo "  --trace CMD   Link trace replay: start [EPOCH_MS] | sync | stop"
+    echo "  --netns CMD   Namespace endpoints: up | down | status"
+    echo "  --acct CMD    Traffic accounting: start | stop | export [MS] [S] | clear | status"
+    echo "  --capture CMD Host packet capture: start [RUN] | stop | status | analyze [RUN] [BIN_MS]"
+    echo "  --event       Path event now: BRIDGE down | up | blackhole | restore | rate RATE | reset"
+    echo "  --timeline    Play path events: \"OFFSET BRIDGE ACTION [ARG]; ...\""
+    echo "  --matrix FILE Run an experiment matrix on running VM pairs: FILE [OUT_DIR]"
+    echo "  --schedbench  In-kernel scheduler microbenchmark: [SUBFLOWS] [ITERS] [SCHEDULERS]"
+    echo "  --daemon CMD  Control daemon: start | stop | status | jobs | run"
+    echo "                (while it runs it serves --all, --vm, --stop, --matrix)"
+    echo ""
+    echo "  --policy P    Answer every prompt: ask | reuse | update | rebuild | abort"
+    echo "                (also VIRTK_POLICY or vm.prompt_policy; ask without a terminal aborts)"
+    echo "Exit status: 0 done, 1 failed, 3 aborted by the prompt policy"
     exit 1
 fi
 
@@ -32,10 +50,46 @@ shift # Remove the YAML file from arguments
 
 # Source all utility modules
 source "${MAIN_DIR}/libs/utils.sh"
+source "${MAIN_DIR}/libs/daemon.sh"
+
+if [ "${1:-}" = "--policy" ]; then
+    PROMPT_POLICY="${2:-}"
+    shift 2 || shift
+    if [[ ! " ask reuse update rebuild abort " == *" $PROMPT_POLICY "* ]]; then
+        log_error "Unknown prompt policy: $PROMPT_POLICY (ask, reuse, update, rebuild, abort)"
+        exit 1
+    fi
+    export PROMPT_POLICY
+fi
+
+# The daemon's socket relay, and the options it serves while it runs: no
+# need to load the other modules
+if [ "${1:-}" = "--daemon" ] && [ "${2:-}" = "relay" ]; then
+    daemon_relay
+    exit 0
+fi
+if [ "${VIRTK_DAEMON:-1}" != "0" ] && daemon_serves "$@" && daemon_alive; then
+    daemon_client "$@" && exit 0 || exit $?
+fi
+
 source "${MAIN_DIR}/libs/network.sh" 
+source "${MAIN_DIR}/libs/link.sh"
+source "${MAIN_DIR}/libs/firewall.sh"
+source "${MAIN_DIR}/libs/accounting.sh"
+source "${MAIN_DIR}/libs/capture.sh"
+source "${MAIN_DIR}/libs/events.sh"
+source "${MAIN_DIR}/libs/matrix.sh"
+source "${MAIN_DIR}/libs/netns.sh"
 source "${MAIN_DIR}/libs/kernel.sh"
 source "${MAIN_DIR}/libs/rootfs.sh"
 source "${MAIN_DIR}/libs/vm.sh"
+source "${MAIN_DIR}/libs/memory.sh"
+source "${MAIN_DIR}/libs/schedtrace.sh"
+source "${MAIN_DIR}/libs/schedbench.sh"
+source "${MAIN_DIR}/libs/pipeline.sh"
+
+# Compile the config once, the modules then read it from memory
+yaml_load "$CONFIG_FILE"
 
 VM_NAME=$(parse_yaml "$CONFIG_FILE" "vm.name" 2>/dev/null || echo "$(basename "$CONFIG_FILE" .yaml)")
 VM_DIR="${MAIN_DIR}/VirtK_Machines/${VM_NAME}"
@@ -157,10 +211,10 @@ kernel_cache_clean(){
         log_warning "  $kernel_file ($size)"
     done
     
-    read -p "Are you sure? (y/N): " -n 1 -r
-    echo
-    
-    if [[ $REPLY =~ ^[Yy]$ ]]; then
+    local answer=0
+    prompt_confirm "Are you sure?" destructive || answer=$?
+    [ "$answer" -eq "$PROMPT_ABORTED" ] && return "$PROMPT_ABORTED"
+    if [ "$answer" -eq 0 ]; then
         rm -rf "$kernel_cache_dir"
         log_success "Kernel cache cleared"
     else
@@ -173,29 +227,51 @@ kernel_cache_clean(){
 # =============================================================================
 
 usage() {
-    echo "Usage: $0 <config.yaml> [OPTION]"
+    echo "Usage: $0 <config.yaml> [--policy POLICY] [OPTION]"
     echo ""
     echo "Available options:"
-    echo "  -a |    --all         Complete setup"
+    echo "  -a |    --all         Complete setup, skips unchanged steps ([force]: all)"
+    echo "          --steps       Show which setup steps are up to date"
     echo "  -k |    --kernel      Kernel setup only"
     echo "  -r |    --rootfs      Root filesystem setup only" 
     echo "  -v |    --vm          Start VM"
+    echo "          --stop        Stop VM"
     echo "  -s |    --status      Show system status"
+    echo "  -m |    --memory      Show VM memory usage"
     echo "  -c |    --clean       Clean VM data"
     echo ""
     echo "Network Options:"
     echo "  -n |    --network     Network setup only"
     echo "  -t |    --teardown    Remove network"
+    echo "  -l |    --link        Re-apply link emulation"
+    echo "          --trace       Trace replay (start [EPOCH_MS] | sync | stop)"
+    echo "          --netns       Namespace endpoints (up | down | status)"
+    echo "          --acct        Traffic accounting (start | stop | export [MS] [S] | clear | status)"
+    echo "          --capture     Host packet capture (start [RUN] | stop | status | analyze [RUN] [BIN_MS])"
+    echo "          --event       Path event now (BRIDGE down | up | blackhole | restore | rate RATE | reset)"
+    echo "          --timeline    Play path events (\"OFFSET BRIDGE ACTION [ARG]; ...\")"
+    echo ""
+    echo "Experiment Options:"
+    echo "          --matrix      Run an experiment matrix (FILE [OUT_DIR])"
+    echo "          --schedbench  Scheduler microbenchmark ([SUBFLOWS] [ITERS] [SCHEDULERS])"
+    echo ""
+    echo "Control daemon (serves --all, --vm, --stop and --matrix while it runs):"
+    echo "          --daemon      start | stop | status | jobs | run (foreground)"
+    echo ""
+    echo "Prompts (existing kernel tree or rootfs, KVM, clean):"
+    echo "          --policy P    ask | reuse | update | rebuild | abort, before the option"
+    echo "                        (also VIRTK_POLICY or vm.prompt_policy; ask needs a terminal)"
+    echo "Exit status: 0 done, 1 failed, 3 aborted by the prompt policy"
 }
 
 case "${1:-}" in
     -a|--all)
         log_info "=== COMPLETE VM SETUP ==="
-        kernel_setup && \
-        rootfs_setup && \
-        rootfs_config && \
-        bridges_setup && \
-        vm_start
+        pipeline_run "${2:-}"
+        ;;
+    --steps)
+        log_info "=== SETUP STEPS ==="
+        pipeline_status
         ;;
     
     -k|--kernel)
@@ -211,6 +287,10 @@ case "${1:-}" in
         log_info "=== STARTING VM ==="
         bridges_setup && vm_start
         ;;
+    --stop)
+        log_info "=== STOPPING VM ==="
+        vm_stop
+        ;;
     
     -s|--status)
         log_info "=== SYSTEM STATUS ==="
@@ -224,6 +304,19 @@ case "${1:-}" in
         vm_status
         echo ""
         bridges_status
+        echo ""
+        firewall_status
+        echo ""
+        links_status
+        echo ""
+        accounting_status
+        echo ""
+        memory_report
+        ;;
+
+    -m|--memory)
+        log_info "=== VM MEMORY REPORT ==="
+        memory_report
         ;;
     
     --clean)
@@ -244,6 +337,87 @@ case "${1:-}" in
         log_info "=== NETWORK STATUS ==="
         bridges_setup
         ;;
+    -l|--link)
+        log_info "=== LINK EMULATION ==="
+        links_setup && links_status
+        ;;
+    --trace)
+        log_info "=== LINK TRACE REPLAY ==="
+        case "${2:-}" in
+            start) link_trace_start "${3:-sync}" ;;
+            sync)  link_trace_sync "${3:-}" ;;
+            stop)  link_trace_stop ;;
+            *)     log_error "Usage: $0 <config.yaml> --trace start [EPOCH_MS] | sync | stop"; exit 1 ;;
+        esac
+        ;;
+    --netns)
+        log_info "=== NAMESPACE ENDPOINTS ==="
+        case "${2:-}" in
+            up)     netns_setup ;;
+            down)   netns_teardown ;;
+            status) netns_status ;;
+            *)      log_error "Usage: $0 <config.yaml> --netns up | down | status"; exit 1 ;;
+        esac
+        ;;
+    --acct)
+        log_info "=== TRAFFIC ACCOUNTING ==="
+        case "${2:-}" in
+            start)  accounting_setup ;;
+            stop)   accounting_teardown ;;
+            export) accounting_export "${3:-}" "${4:-}" ;;
+            clear)  accounting_clear ;;
+            status) accounting_status ;;
+            *)      log_error "Usage: $0 <config.yaml> --acct start | stop | export [MS] [S] | clear | status"; exit 1 ;;
+        esac
+        ;;
+    --capture)
+        log_info "=== HOST PACKET CAPTURE ==="
+        case "${2:-}" in
+            start)  capture_start "${3:-}" ;;
+            stop)   capture_stop ;;
+            status) capture_status ;;
+            analyze) capture_analyze "${3:-}" "${4:-}" ;;
+            *)      log_error "Usage: $0 <config.yaml> --capture start [RUN] | stop | status | analyze [RUN] [BIN_MS]"; exit 1 ;;
+        esac
+        ;;
+    --event)
+        log_info "=== PATH EVENT ==="
+        if [ -z "${2:-}" ] || [ -z "${3:-}" ]; then
+            log_error "Usage: $0 <config.yaml> --event BRIDGE down | up | blackhole | restore | rate RATE | reset"
+            exit 1
+        fi
+        path_events_check "0 $2 $3 ${4:-}" && path_event "$2" "$3" "${4:-}" && links_status
+        ;;
+    --timeline)
+        log_info "=== PATH EVENT TIMELINE ==="
+        if [ -z "${2:-}" ]; then
+            log_error "Usage: $0 <config.yaml> --timeline \"OFFSET BRIDGE ACTION [ARG]; ...\""
+            exit 1
+        fi
+        path_events_play "$2"
+        ;;
+    --matrix)
+        log_info "=== EXPERIMENT MATRIX ==="
+        if [ -z "${2:-}" ]; then
+            log_error "Usage: $0 <config.yaml> --matrix <matrix.yaml> [OUT_DIR]"
+            exit 1
+        fi
+        matrix_run "$2" "${3:-}"
+        ;;
+    --schedbench)
+        log_info "=== MPTCP SCHEDULER BENCHMARK ==="
+        schedbench_run "${2:-}" "${3:-}" "${4:-}"
+        ;;
+    --daemon)
+        case "${2:-}" in
+            start)  daemon_start ;;
+            stop)   daemon_stop ;;
+            status) daemon_alive && daemon_request status "$CONFIG_FILE" || log_info "virtkd not running" ;;
+            jobs)   daemon_alive && daemon_request jobs || log_info "virtkd not running" ;;
+            run)    daemon_serve ;;
+            *)      log_error "Usage: $0 <config.yaml> --daemon start | stop | status | jobs | run"; exit 1 ;;
+        esac
+        ;;
     -t|--teardown)
         log_info "=== NETWORK TEARDOWN ==="
         bridges_teardown
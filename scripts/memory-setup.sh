@@ -0,0 +1,53 @@
+#!/bin/bash
+
+# Memory setup script for VM guests
+# Applies the swap profile passed by the host on the kernel command line
+# (virtk.swap=zram|none|default)
+
+LOG_FILE="/var/log/memory-setup.log"
+
+log_message() {
+    echo "$(date): $1" >> "$LOG_FILE"
+    echo "$(date): $1"  # Also output to console for debugging
+}
+
+profile="default"
+for param in $(cat /proc/cmdline); do
+    case "$param" in
+        virtk.swap=*) profile="${param#virtk.swap=}" ;;
+    esac
+done
+
+log_message "Applying memory profile: $profile"
+
+case "$profile" in
+    zram)
+        # Compressed swap in RAM sized to half of the guest memory
+        mem_kb=$(awk '/^MemTotal:/ {print $2}' /proc/meminfo)
+        modprobe zram num_devices=1 2>/dev/null || true
+
+        if [ -e /sys/block/zram0 ]; then
+            swapoff /dev/zram0 2>/dev/null || true
+            echo 1 > /sys/block/zram0/reset
+            echo zstd > /sys/block/zram0/comp_algorithm 2>/dev/null || true
+            echo "$(( mem_kb / 2 ))K" > /sys/block/zram0/disksize
+            mkswap /dev/zram0 > /dev/null
+            swapon -p 100 /dev/zram0
+            sysctl -q -w vm.swappiness=100 vm.page-cluster=0
+            log_message "zram swap enabled ($(( mem_kb / 2048 )) MB)"
+        else
+            log_message "zram device not available"
+        fi
+        ;;
+    none)
+        # No swap and a small page cache footprint
+        swapoff -a
+        sysctl -q -w vm.swappiness=0 vm.vfs_cache_pressure=200
+        log_message "Swap disabled"
+        ;;
+    *)
+        log_message "Keeping default memory settings"
+        ;;
+esac
+
+exit 0
@@ -1,7 +1,11 @@
 #!/bin/bash
 
 # Network setup script for VM interfaces
-# This script brings up network interfaces created by QEMU bridges
+# This script brings up network interfaces created by QEMU bridges.
+# Interfaces listed on the kernel cmdline as
+#   virtk.ip=<mac>,<address>/<bits>[,<gateway>]
+# get a static address, all others request DHCP. The resolvers of a static
+# default route come from virtk.dns=<ip>[,<ip>...], if given.
 
 LOG_FILE="/var/log/network-setup.log"
 
@@ -12,37 +16,77 @@ log_message() {
 
 log_message "Starting network interface setup..."
 
-# Wait a bit for interfaces to be detected
-sleep 2
+# Static addresses keyed by MAC address
+declare -A static_address static_gateway
+nameservers=()
+for param in $(cat /proc/cmdline); do
+    case "$param" in
+        virtk.ip=*)
+            IFS=, read -r mac address gateway <<< "${param#virtk.ip=}"
+            mac="${mac,,}"
+            static_address[$mac]="$address"
+            static_gateway[$mac]="$gateway"
+            ;;
+        virtk.dns=*)
+            IFS=, read -r -a nameservers <<< "${param#virtk.dns=}"
+            ;;
+    esac
+done
+
+# Wait (briefly) until every interface with a static address is present
+for attempt in $(seq 1 100); do
+    missing=0
+    for mac in "${!static_address[@]}"; do
+        if ! grep -qix "$mac" /sys/class/net/*/address 2>/dev/null; then
+            missing=1
+        fi
+    done
+    [ "$missing" -eq 0 ] && break
+    sleep 0.05
+done
 
 # List all available interfaces for debugging
 log_message "Available interfaces: $(ls /sys/class/net/)"
 
-# Bring up all ethernet interfaces except loopback and request DHCP
-for interface in /sys/class/net/enp0s*; do
-    if [ -d "$interface" ]; then
-        iface=$(basename "$interface")
-        
-        # Skip if it's the loopback
-        if [[ "$iface" == "lo" ]]; then
-            continue
-        fi
+for interface in /sys/class/net/*; do
+    iface=$(basename "$interface")
 
-        log_message "Processing interface: $iface"
-        
-        # Bring up the interface
-        ip link set dev "$iface" up
-        log_message "Interface $iface brought up"
-        
-        # Request DHCP lease with timeout and in background
-        log_message "Requesting DHCP for $iface (timeout: 10s)"
-        timeout 10 dhclient -1 -v "$iface" > /dev/null 2>&1 &
-        
-        # Don't wait - let it run in background
+    # Skip loopback and virtual devices
+    if [[ "$iface" == "lo" ]] || [ ! -e "$interface/device" ]; then
+        continue
     fi
+
+    log_message "Processing interface: $iface"
+
+    # Bring up the interface
+    ip link set dev "$iface" up
+    log_message "Interface $iface brought up"
+
+    mac=$(cat "$interface/address")
+    mac="${mac,,}"
+    if [ -n "${static_address[$mac]}" ]; then
+        ip addr replace "${static_address[$mac]}" dev "$iface"
+        log_message "Static address ${static_address[$mac]} set on $iface"
+
+        if [ -n "${static_gateway[$mac]}" ]; then
+            ip route replace default via "${static_gateway[$mac]}" dev "$iface"
+            log_message "Default route via ${static_gateway[$mac]} on $iface"
+            if [ ${#nameservers[@]} -gt 0 ]; then
+                printf 'nameserver %s\n' "${nameservers[@]}" > /etc/resolv.conf
+                log_message "Resolvers: ${nameservers[*]}"
+            fi
+        fi
+        continue
+    fi
+
+    # Request DHCP lease with timeout and in background
+    log_message "Requesting DHCP for $iface (timeout: 10s)"
+    timeout 10 dhclient -1 -v "$iface" > /dev/null 2>&1 &
+
+    # Don't wait - let it run in background
 done
 
-log_message "Network interface setup completed - DHCP requested for all interfaces (background)"
+log_message "Network interface setup completed"
 
 # Exit immediately, don't wait for dhclient processes
 exit 0
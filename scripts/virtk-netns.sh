@@ -0,0 +1,39 @@
+#!/bin/bash
+
+# Namespace endpoints inside a VirtK VM (see libs/netns.sh)
+# Usage: virtk-netns up | down | status | exec <endpoint> <command...>
+
+VIRTK_LIB="/usr/local/lib/virtk"
+CONFIG_FILE="${VIRTK_NETNS_CONFIG:-/etc/virtk/netns.yaml}"
+MAIN_DIR="$VIRTK_LIB"
+VM_DIR="/run/virtk"
+VM_NAME=$(hostname)
+
+source "$VIRTK_LIB/libs/utils.sh"
+source "$VIRTK_LIB/libs/network.sh"
+source "$VIRTK_LIB/libs/link.sh"
+source "$VIRTK_LIB/libs/netns.sh"
+
+# The guest usually runs this as root without sudo installed
+if ! command -v sudo &> /dev/null; then
+    sudo() {
+        [ "$1" = "-v" ] && return 0
+        "$@"
+    }
+fi
+
+if [ ! -f "$CONFIG_FILE" ]; then
+    log_error "Config not found: $CONFIG_FILE"
+    exit 1
+fi
+
+case "${1:-}" in
+    up)     netns_setup ;;
+    down)   netns_teardown ;;
+    status) netns_status ;;
+    exec)   shift; netns_exec "$@" ;;
+    *)
+        echo "Usage: $0 up | down | status | exec <endpoint> <command...>"
+        exit 1
+        ;;
+esac
@@ -0,0 +1,129 @@
+#!/bin/bash
+
+# MPTCP scheduler tracing inside a VirtK VM (see libs/schedtrace.sh)
+# Usage: virtk-sched [-o FILE] [-f FUNCTION]... [-- COMMAND...]
+#
+# Attaches kprobes to the scheduler entry points and aggregates in the
+# kernel (bpftrace maps), per traced function:
+#
+#   @lat_ns[fn]     log2 histogram of the time spent in the call
+#   @lat[fn]        count/average/total of the same
+#   @empty[fn]      calls that did not schedule any subflow (non-zero
+#                   return, NULL for the mptcp_subflow_get_* pickers)
+#   @path[addr]     subflows picked (mptcp_subflow_set_scheduled), by local
+#                   address, i.e. by path
+#   @elapsed_ns     tracing time, for the call rates
+#
+# Traced: mptcp_sched_get_send, mptcp_sched_get_retrans, the in-kernel
+# default pickers (mptcp_subflow_get_send/get_retrans) and, when present,
+# the get_subflow ops of the schedulers (*_get_subflow in kallsyms) plus
+# every -f FUNCTION; functions the compiler inlined are skipped. The maps
+# are printed as JSON lines (bpftrace -f json) to FILE when COMMAND exits,
+# or on SIGINT/SIGTERM without a COMMAND.
+#
+# The mptcp_subflow_context and sock casts need the kernel BTF
+# (CONFIG_DEBUG_INFO_BTF, see schedtrace_kernel_options).
+
+OUT="/dev/stdout"
+FUNCS=(mptcp_sched_get_send mptcp_sched_get_retrans mptcp_subflow_get_send mptcp_subflow_get_retrans)
+
+while getopts "o:f:h" opt; do
+    case "$opt" in
+        o) OUT="$OPTARG" ;;
+        f) FUNCS+=("$OPTARG") ;;
+        *) echo "Usage: $0 [-o FILE] [-f FUNCTION]... [-- COMMAND...]"; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+if ! command -v bpftrace &> /dev/null; then
+    echo "bpftrace not installed" >&2
+    exit 1
+fi
+if [ ! -e /sys/kernel/btf/vmlinux ]; then
+    echo "Kernel without BTF (CONFIG_DEBUG_INFO_BTF), cannot trace the scheduler" >&2
+    exit 1
+fi
+
+# Scheduler ops (default, BPF and out-of-tree schedulers)
+while read -r fn; do
+    FUNCS+=("$fn")
+done < <(awk '$3 ~ /^[a-z0-9_]*get_subflow$/ && $2 ~ /^[tT]$/ { print $3 }' /proc/kallsyms | sort -u)
+
+program="BEGIN { @start = nsecs; }
+"
+clear_maps="clear(@start);"
+i=0
+for fn in "${FUNCS[@]}"; do
+    if ! grep -qw "$fn" /proc/kallsyms; then
+        echo "Skipping $fn (not in this kernel)" >&2
+        continue
+    fi
+    empty="(int32)retval != 0"
+    [[ "$fn" == mptcp_subflow_get_* ]] && empty="retval == 0"
+    program+="
+kprobe:$fn { @ts$i[tid] = nsecs; }
+kretprobe:$fn /@ts$i[tid]/ {
+    \$ns = nsecs - @ts$i[tid];
+    @lat_ns[\"$fn\"] = hist(\$ns);
+    @lat[\"$fn\"] = stats(\$ns);
+    if ($empty) { @empty[\"$fn\"] = count(); }
+    delete(@ts$i[tid]);
+}
+"
+    clear_maps+=" clear(@ts$i);"
+    i=$((i + 1))
+done
+
+if [ $i -eq 0 ]; then
+    echo "No MPTCP scheduler function found in /proc/kallsyms" >&2
+    exit 1
+fi
+
+if grep -qw mptcp_subflow_set_scheduled /proc/kallsyms; then
+    program+="
+kprobe:mptcp_subflow_set_scheduled /arg1/ {
+    \$ssk = (struct sock *)((struct mptcp_subflow_context *)arg0)->tcp_sock;
+    @path[ntop(\$ssk->__sk_common.skc_rcv_saddr)] = count();
+}
+"
+fi
+
+program+="
+END {
+    @elapsed_ns = nsecs - @start;
+    $clear_maps
+}
+"
+
+[ "$OUT" != "/dev/stdout" ] && : > "$OUT"
+bpftrace -f json -o "$OUT" -e "$program" &
+pid=$!
+
+# The first line is {"type": "attached_probes", ...} once the probes are in
+if [ "$OUT" = "/dev/stdout" ]; then
+    sleep 2
+else
+    for _ in $(seq 100); do
+        [ -s "$OUT" ] && break
+        kill -0 $pid 2>/dev/null || break
+        sleep 0.1
+    done
+fi
+if ! kill -0 $pid 2>/dev/null; then
+    wait $pid
+    exit 1
+fi
+
+trap 'kill -INT $pid 2>/dev/null' INT TERM
+if [ $# -gt 0 ]; then
+    "$@"
+    status=$?
+    kill -INT $pid
+    wait $pid
+    exit $status
+fi
+# The first wait returns when the trap fires, the second one collects
+# bpftrace once it printed the maps
+wait $pid
+wait $pid
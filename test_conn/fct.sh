@@ -0,0 +1,90 @@
+#!/bin/bash
+
+# Short-flow suite: flow completion times of every scheduler under the same
+# request/response and short-flow workloads (vkload -m rr / -m fct), against
+# a vkload server (./load.sh -s on the server VM)
+
+usage() {
+    echo "Usage: $0 SERVER_IP [SCHEDULER...]"
+    echo "  Default schedulers: default minrtt blest xlayer"
+    echo "Environment:"
+    echo "  DURATION=S       seconds per run (default 30)"
+    echo "  WORKLOADS=LIST   subset of: rr short http web (default all)"
+    echo "  OUT=DIR          results directory (default ./fct-results)"
+    echo "Results: OUT/<workload>/load_client-<scheduler>.json with a meta.env"
+    echo "(ingest with tools/vkstore/vkstore ingest) and OUT/summary.csv"
+}
+
+# name -> vkload arguments
+declare -A WORKLOAD_ARGS=(
+    [rr]="-m rr -P 8 -l 300 -r 16384"           # HTTP-like request/response, closed loop
+    [short]="-m fct -a 50 -S 10K:9,100K:1"      # Poisson arrivals of single short flows
+    [http]="-m fct -a 20 -S http"               # Poisson arrivals, HTTP-like object sizes
+    [web]="-m fct -a 5 -B 20 -K 6 -S http"      # pages of 20 objects, 6 in parallel
+)
+
+# scheduler,workload,completed,failed,p50_ms,p99_ms,p999_ms (rr: latency)
+summary_line() {
+    local scheduler="$1"
+    local workload="$2"
+    local json="$3"
+
+    awk -v s="$scheduler" -v w="$workload" '
+        function num(key) {
+            if (!match($0, "\"" key "\": [0-9.e+-]+"))
+                return ""
+            return substr($0, RSTART + length(key) + 4, RLENGTH - length(key) - 4)
+        }
+        /^  "rr"/          { n = num("transactions"); p50 = num("p50") / 1000; p99 = num("p99") / 1000; p999 = num("p999") / 1000 }
+        /^    "completed"/ { n = num("completed") }
+        /^    "failed"/    { failed = num("failed") }
+        /^    "fct_ms"/    { p50 = num("p50"); p99 = num("p99"); p999 = num("p999") }
+        END { print s "," w "," n "," failed + 0 "," p50 "," p99 "," p999 }' "$json"
+}
+
+IP_SERVER="$1"
+if [ -z "$IP_SERVER" ] || [ "$IP_SERVER" = "-h" ]; then
+    usage
+    exit 1
+fi
+shift
+SCHEDULERS="${*:-default minrtt blest xlayer}"
+OUT="${OUT:-$PWD/fct-results}"
+
+if ! command -v vkload > /dev/null; then
+    echo "vkload not installed (rebuild the rootfs, see tools/vkload)"
+    exit 1
+fi
+
+mkdir -p "$OUT"
+echo "scheduler,workload,completed,failed,p50_ms,p99_ms,p999_ms" > "$OUT/summary.csv"
+
+for workload in ${WORKLOADS:-rr short http web}; do
+    if [ -z "${WORKLOAD_ARGS[$workload]}" ]; then
+        echo "Unknown workload $workload"
+        exit 1
+    fi
+    mkdir -p "$OUT/$workload"
+    {
+        echo "workload=$workload"
+        echo "vkload_args=-t ${DURATION:-30} ${WORKLOAD_ARGS[$workload]}"
+    } > "$OUT/$workload/meta.env"
+
+    for scheduler in $SCHEDULERS; do
+        json="$OUT/$workload/load_client-$scheduler.json"
+        echo "== $workload, $scheduler"
+        if ! sysctl -qw net.mptcp.scheduler="$scheduler"; then
+            echo "Scheduler $scheduler not available, skipped"
+            continue
+        fi
+        # shellcheck disable=SC2086
+        if ! vkload -c "$IP_SERVER" -t "${DURATION:-30}" -J ${WORKLOAD_ARGS[$workload]} > "$json"; then
+            echo "vkload failed"
+            mv "$json" "$json.failed"
+            continue
+        fi
+        summary_line "$scheduler" "$workload" "$json" | tee -a "$OUT/summary.csv"
+    done
+done
+
+echo "Results saved in: $OUT"
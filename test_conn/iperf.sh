@@ -6,6 +6,11 @@ usage() {
     echo "  -s , for server mode"
     echo "  -c SERVER_IP [SCHEDULER], for client mode, specify server IP and optionally scheduler"
     echo "  Available schedulers: default, minrtt, blest, xlayer"
+    echo "Environment:"
+    echo "  GUEST_CAPTURE=1, also capture inside the guest with tshark (off by default,"
+    echo "                   capture on the host with: script.sh <config.yaml> --capture start)"
+    echo "  TELEMETRY_US=N,  poll the subflows with vkdiag every N us, saved after the run"
+    echo "                   to iperf_diag-SCHEDULER.bin (decode: tools/vkdiag/vkdiag -r)"
 }
 
 mptcp_scheduler(){
@@ -22,7 +27,7 @@ mptcp_scheduler(){
 
 iperf_client(){
 
-    local IP_SERVER="${1:-"10.0.0.229"}"
+    local IP_SERVER="${1:-"10.0.0.20"}"
     local MPTCP_SCHEDULER="${2:-default}"
     
     echo "Starting iperf3 client..."
@@ -31,26 +36,47 @@ iperf_client(){
 
     mptcp_scheduler "$MPTCP_SCHEDULER"
 
-    # Create log and pcap files in the current directory
-    echo "Logs and captures will be saved in: $PWD"
+    # Create log files in the current directory
+    echo "Logs will be saved in: $PWD"
     touch "$PWD/iperf_client-$MPTCP_SCHEDULER.json"
-    touch "$PWD/iperf_capture-$MPTCP_SCHEDULER.pcap"
-
     chmod 777 "$PWD/iperf_client-$MPTCP_SCHEDULER.json"
-    chmod 777 "$PWD/iperf_capture-$MPTCP_SCHEDULER.pcap"
 
-    # Start capturing packets with tshark
-    tshark -i any -w "$PWD/iperf_capture-$MPTCP_SCHEDULER.pcap" &
-    TSHARK_PID=$!
+    # In-guest capture costs guest CPU and 9p I/O during the measurement,
+    # the host capture (--capture) is the default
+    local TSHARK_PID=""
+    if [ "${GUEST_CAPTURE:-0}" = "1" ]; then
+        touch "$PWD/iperf_capture-$MPTCP_SCHEDULER.pcap"
+        chmod 777 "$PWD/iperf_capture-$MPTCP_SCHEDULER.pcap"
+
+        # Headers only, the payload is not needed for the analysis
+        tshark -i any -s 160 -w "$PWD/iperf_capture-$MPTCP_SCHEDULER.pcap" &
+        TSHARK_PID=$!
 
-    sleep 2 # Give tshark a moment to start
+        sleep 2 # Give tshark a moment to start
+
+        echo "tshark started with PID $TSHARK_PID, capturing packets..."
+    fi
 
-    echo "tshark started with PID $TSHARK_PID, capturing packets..."
+    # vkdiag keeps the samples in memory and writes them on SIGINT, so the
+    # 9p share is not touched during the run
+    local DIAG_PID=""
+    if [ -n "${TELEMETRY_US:-}" ] && command -v vkdiag > /dev/null; then
+        vkdiag -i "$TELEMETRY_US" -o "$PWD/iperf_diag-$MPTCP_SCHEDULER.bin" &
+        DIAG_PID=$!
+    fi
 
     mptcpize run iperf3 -c "$IP_SERVER" -t 10 --json > "$PWD/iperf_client-$MPTCP_SCHEDULER.json"
 
-    # Stop tshark
-    kill -9 $TSHARK_PID
+    if [ -n "$DIAG_PID" ]; then
+        kill -INT $DIAG_PID
+        wait $DIAG_PID
+    fi
+
+    # Stop tshark (SIGINT so the pcap is flushed)
+    if [ -n "$TSHARK_PID" ]; then
+        kill -INT $TSHARK_PID
+        wait $TSHARK_PID
+    fi
 
 }
 
@@ -81,7 +107,7 @@ if [ "$MODE" = "-c" ]; then
         usage
         exit 1
     fi
-    SERVER_IP="${2:-"10.0.0.229"}"
+    SERVER_IP="${2:-"10.0.0.20"}"
     SCHEDULER="$3"
     iperf_client "$SERVER_IP" "$SCHEDULER"
     exit 0
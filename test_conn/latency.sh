@@ -0,0 +1,187 @@
+#!/bin/bash
+
+# Latency under load: how much queueing a scheduler adds on each path while
+# a bulk MPTCP transfer runs. Paced vkload request/response probes (-g) run
+# over every path (plain TCP bound to that path's address) and over MPTCP,
+# first idle, then next to the bulk transfer. The inflation is the loaded
+# latency minus the idle median of the same probe.
+
+usage() {
+    echo "Usage: $0 [OPTIONS]"
+    echo "Options:"
+    echo "  -s , for server mode (vkload server, also serves load.sh and fct.sh)"
+    echo "  -c SERVER_IP [SCHEDULER], for client mode, specify server IP and optionally scheduler"
+    echo "  Available schedulers: default, minrtt, blest, xlayer"
+    echo "Environment (client):"
+    echo "  PATHS=\"IP...\"     server address of every path (default: 10.0.0.20 11.0.0.20, br0/br1)"
+    echo "  BASELINE=S       idle seconds (default 5)"
+    echo "  DURATION=S       loaded seconds (default 20)"
+    echo "  GAP_US=N         probe period per probe (default 10000)"
+    echo "  INTERVAL=S       time series step (default 0.5)"
+    echo "  DIRECTION=D      upload | download bulk transfer (default upload)"
+    echo "  BULK_CONNS=N     bulk MPTCP connections (default 1)"
+    echo "Results: latency-SCHEDULER/{summary,timeseries}.csv and the vkload JSONs"
+}
+
+mptcp_scheduler(){
+    local scheduler="$1"
+    if [ -z "$scheduler" ]; then
+        echo "No scheduler specified, using default (default)"
+        return 0
+    fi
+
+    if ! sysctl -a | grep -q "net.mptcp.scheduler = $scheduler"; then
+        sysctl -w net.mptcp.scheduler="$scheduler"
+    fi
+}
+
+# Local address the kernel picks towards an address
+path_source() {
+    ip -4 route get "$1" | awk '{ for (i = 1; i < NF; i++) if ($i == "src") { print $(i + 1); exit } }'
+}
+
+# Starts every probe for SECONDS in the background, into OUT/PHASE-NAME.json
+start_probes() {
+    local phase="$1"
+    local seconds="$2"
+    local probe
+
+    for probe in "${PROBES[@]}"; do
+        # name:protocol:server[:source]
+        IFS=: read -r name proto server src <<< "$probe"
+        local args=(-c "$server" -m rr -l 64 -r 64 -g "${GAP_US:-10000}" -t "$seconds" -i "${INTERVAL:-0.5}" -J)
+        [ "$proto" = "tcp" ] && args+=(-N -b "$src")
+        vkload "${args[@]}" > "$OUT/$phase-$name.json" &
+    done
+}
+
+# phase,t,probe,p50_ms,p99_ms,inflation_p50_ms,inflation_p99_ms
+timeseries() {
+    local phase="$1"
+    local name="$2"
+    local offset="$3"
+    local base="$4"
+
+    awk -v ph="$phase" -v n="$name" -v off="$offset" -v base="$base" '
+        function num(key) {
+            if (!match($0, "\"" key "\": [0-9.e+-]+"))
+                return ""
+            return substr($0, RSTART + length(key) + 4, RLENGTH - length(key) - 4)
+        }
+        /"latency_p50_us"/ {
+            p50 = num("latency_p50_us") / 1000; p99 = num("latency_p99_us") / 1000
+            if (p50 == 0)
+                next
+            printf "%s,%.3f,%s,%.3f,%.3f,%.3f,%.3f\n", ph, off + num("end"), n, p50, p99, p50 - base, p99 - base
+        }' "$OUT/$phase-$name.json"
+}
+
+# "p50 p90 p99 p999" in ms of a probe run
+percentiles() {
+    awk 'function num(key) {
+             if (!match($0, "\"" key "\": [0-9.e+-]+"))
+                 return ""
+             return substr($0, RSTART + length(key) + 4, RLENGTH - length(key) - 4)
+         }
+         /^  "rr"/ { printf "%.3f %.3f %.3f %.3f\n", num("p50") / 1000, num("p90") / 1000, num("p99") / 1000, num("p999") / 1000 }' "$1"
+}
+
+latency_client(){
+    local IP_SERVER="${1:-"10.0.0.20"}"
+    local MPTCP_SCHEDULER="${2:-default}"
+    local baseline="${BASELINE:-5}"
+    local duration="${DURATION:-20}"
+    local addr src i=0 bulk_args bulk_bps
+
+    OUT="$PWD/latency-$MPTCP_SCHEDULER"
+    mkdir -p "$OUT"
+    chmod 777 "$OUT"
+
+    PROBES=("mptcp:mptcp:$IP_SERVER")
+    for addr in ${PATHS:-10.0.0.20 11.0.0.20}; do
+        src=$(path_source "$addr")
+        if [ -z "$src" ]; then
+            echo "No route to $addr, path skipped"
+            continue
+        fi
+        PROBES+=("path$i-$addr:tcp:$addr:$src")
+        i=$((i + 1))
+    done
+
+    echo "Starting latency under load..."
+    echo "Server IP: $IP_SERVER"
+    echo "MPTCP Scheduler: $MPTCP_SCHEDULER"
+    echo "Probes: ${PROBES[*]}"
+    mptcp_scheduler "$MPTCP_SCHEDULER"
+
+    echo "Idle for ${baseline}s..."
+    start_probes idle "$baseline"
+    wait
+
+    echo "Bulk ${DIRECTION:-upload} for ${duration}s..."
+    bulk_args=(-c "$IP_SERVER" -m bulk -P "${BULK_CONNS:-1}" -t "$duration" -J)
+    [ "${DIRECTION:-upload}" = "download" ] && bulk_args+=(-R)
+    start_probes load "$duration"
+    vkload "${bulk_args[@]}" > "$OUT/bulk.json"
+    wait
+    bulk_bps=$(awk -F'"bits_per_second": ' '/^  "receiver"/ { split($2, v, /[,}]/); print v[1] }' "$OUT/bulk.json")
+
+    echo "phase,t,probe,p50_ms,p99_ms,inflation_p50_ms,inflation_p99_ms" > "$OUT/timeseries.csv"
+    echo "scheduler,probe,idle_p50_ms,load_p50_ms,load_p90_ms,load_p99_ms,load_p999_ms,inflation_p50_ms,inflation_p99_ms,bulk_bits_per_second" > "$OUT/summary.csv"
+    local probe name idle load
+    for probe in "${PROBES[@]}"; do
+        name=${probe%%:*}
+        read -r idle _ <<< "$(percentiles "$OUT/idle-$name.json")"
+        read -r -a load <<< "$(percentiles "$OUT/load-$name.json")"
+        if [ -z "$idle" ] || [ ${#load[@]} -ne 4 ]; then
+            echo "No results for probe $name"
+            continue
+        fi
+        timeseries idle "$name" 0 "$idle" >> "$OUT/timeseries.csv"
+        timeseries load "$name" "$baseline" "$idle" >> "$OUT/timeseries.csv"
+        awk -v s="$MPTCP_SCHEDULER" -v n="$name" -v i="$idle" -v p50="${load[0]}" -v p90="${load[1]}" \
+            -v p99="${load[2]}" -v p999="${load[3]}" -v bps="$bulk_bps" \
+            'BEGIN { printf "%s,%s,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%s\n", s, n, i, p50, p90, p99, p999, p50 - i, p99 - i, bps }' \
+            >> "$OUT/summary.csv"
+    done
+
+    column -s, -t < "$OUT/summary.csv" 2>/dev/null || cat "$OUT/summary.csv"
+    echo "Results saved in: $OUT"
+}
+
+latency_server(){
+    echo "Starting vkload server..."
+    vkload -s -T "${THREADS:-$(nproc)}"
+}
+
+
+MODE="$1"
+if [ "$MODE" != "-s" ] && [ "$MODE" != "-c" ]; then
+    usage
+    exit 1
+fi
+
+if ! command -v vkload > /dev/null; then
+    echo "vkload not installed (rebuild the rootfs, see tools/vkload)"
+    exit 1
+fi
+
+if [ "$MODE" = "-s" ]; then
+    echo "Machine IP addresses:"
+    ip addr show | grep 'inet ' | awk '{print $2}'
+    echo "Starting in server mode..."
+    latency_server
+    exit 0
+fi
+
+if [ "$MODE" = "-c" ]; then
+    if [ -z "$2" ]; then
+        echo "Error: SERVER_IP is required in client mode."
+        usage
+        exit 1
+    fi
+    latency_client "$2" "$3"
+    exit 0
+fi
+
+exit 0
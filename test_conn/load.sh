@@ -0,0 +1,109 @@
+#!/bin/bash
+
+# Native MPTCP load with vkload (tools/vkload, installed in the guest as
+# /usr/local/bin/vkload): many IPPROTO_MPTCP connections over several
+# threads, instead of one mptcpize'd iperf3 stream (iperf.sh)
+
+usage() {
+    echo "Usage: $0 [OPTIONS]"
+    echo "Options:"
+    echo "  -s , for server mode"
+    echo "  -c SERVER_IP [SCHEDULER], for client mode, specify server IP and optionally scheduler"
+    echo "  Available schedulers: default, minrtt, blest, xlayer"
+    echo "Environment (client):"
+    echo "  CONNS=N          connections (default 8)"
+    echo "  THREADS=N        worker threads (default: number of CPUs)"
+    echo "  DURATION=S       seconds (default 10)"
+    echo "  PATTERN=P        bulk | download | rr (default bulk)"
+    echo "  SEND_MODE=M      copy | zerocopy | splice (default copy)"
+    echo "  REQ=N RESP=N     rr request/response sizes (default 1/1)"
+    echo "  TELEMETRY_US=N,  poll the subflows with vkdiag every N us, saved after the run"
+    echo "                   to load_diag-SCHEDULER.bin (decode: tools/vkdiag/vkdiag -r)"
+}
+
+mptcp_scheduler(){
+    local scheduler="$1"
+    if [ -z "$scheduler" ]; then
+        echo "No scheduler specified, using default (default)"
+        return 0
+    fi
+
+    if ! sysctl -a | grep -q "net.mptcp.scheduler = $scheduler"; then
+        sysctl -w net.mptcp.scheduler="$scheduler"
+    fi
+}
+
+load_client(){
+
+    local IP_SERVER="${1:-"10.0.0.20"}"
+    local MPTCP_SCHEDULER="${2:-default}"
+    local args=(-c "$IP_SERVER" -P "${CONNS:-8}" -T "${THREADS:-$(nproc)}" -t "${DURATION:-10}" -z "${SEND_MODE:-copy}" -J)
+
+    case "${PATTERN:-bulk}" in
+        bulk)     args+=(-m bulk) ;;
+        download) args+=(-m bulk -R) ;;
+        rr)       args+=(-m rr -l "${REQ:-1}" -r "${RESP:-1}") ;;
+        *)        echo "Unknown PATTERN ${PATTERN}"; usage; exit 1 ;;
+    esac
+
+    echo "Starting vkload client..."
+    echo "Server IP: $IP_SERVER"
+    echo "MPTCP Scheduler: $MPTCP_SCHEDULER"
+
+    mptcp_scheduler "$MPTCP_SCHEDULER"
+
+    echo "Logs will be saved in: $PWD"
+    touch "$PWD/load_client-$MPTCP_SCHEDULER.json"
+    chmod 777 "$PWD/load_client-$MPTCP_SCHEDULER.json"
+
+    # The 9p share is only written after the run (see iperf.sh)
+    local DIAG_PID=""
+    if [ -n "${TELEMETRY_US:-}" ] && command -v vkdiag > /dev/null; then
+        vkdiag -i "$TELEMETRY_US" -p 5301 -o "$PWD/load_diag-$MPTCP_SCHEDULER.bin" &
+        DIAG_PID=$!
+    fi
+
+    vkload "${args[@]}" > "$PWD/load_client-$MPTCP_SCHEDULER.json"
+
+    if [ -n "$DIAG_PID" ]; then
+        kill -INT $DIAG_PID
+        wait $DIAG_PID
+    fi
+}
+
+load_server(){
+    echo "Starting vkload server..."
+    vkload -s -T "${THREADS:-$(nproc)}"
+}
+
+
+MODE="$1"
+if [ "$MODE" != "-s" ] && [ "$MODE" != "-c" ]; then
+    usage
+    exit 1
+fi
+
+if ! command -v vkload > /dev/null; then
+    echo "vkload not installed (rebuild the rootfs, see tools/vkload)"
+    exit 1
+fi
+
+if [ "$MODE" = "-s" ]; then
+    echo "Machine IP addresses:"
+    ip addr show | grep 'inet ' | awk '{print $2}'
+    echo "Starting in server mode..."
+    load_server
+    exit 0
+fi
+
+if [ "$MODE" = "-c" ]; then
+    if [ -z "$2" ]; then
+        echo "Error: SERVER_IP is required in client mode."
+        usage
+        exit 1
+    fi
+    load_client "$2" "$3"
+    exit 0
+fi
+
+exit 0
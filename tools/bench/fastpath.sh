@@ -0,0 +1,95 @@
+#!/bin/bash
+
+# Bridged throughput with and without the bridge fast path.
+#
+# Two network namespaces are attached through veth pairs to a scratch
+# bridge and iperf3 runs between them twice: once with br_netfilter
+# filtering the bridge (conntrack included, as on a default host) and once
+# with the bridge kept out of netfilter as "fast_path: true" does.
+#
+# Usage: sudo tools/bench/fastpath.sh [seconds] [parallel streams]
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+source "$SCRIPT_DIR/libs/utils.sh"
+
+DURATION="${1:-10}"
+STREAMS="${2:-1}"
+BRIDGE="vkbench0"
+NS_A="vkbench-a"
+NS_B="vkbench-b"
+
+if [ "$(id -u)" -ne 0 ]; then
+    log_error "Run as root"
+    exit 1
+fi
+for cmd in iperf3 ip sysctl; do
+    if ! command -v "$cmd" &> /dev/null; then
+        log_error "$cmd not found"
+        exit 1
+    fi
+done
+
+modprobe br_netfilter
+SAVED_SYSCTL=$(sysctl -n net.bridge.bridge-nf-call-iptables)
+
+cleanup() {
+    ip netns del "$NS_A" 2>/dev/null || true
+    ip netns del "$NS_B" 2>/dev/null || true
+    ip link del "$BRIDGE" 2>/dev/null || true
+    nft delete table inet vkbench 2>/dev/null || true
+    sysctl -q -w "net.bridge.bridge-nf-call-iptables=$SAVED_SYSCTL"
+}
+trap cleanup EXIT
+
+ip link add "$BRIDGE" type bridge
+ip link set "$BRIDGE" up
+
+addr=1
+for ns in "$NS_A" "$NS_B"; do
+    ip netns add "$ns"
+    ip link add "$ns" type veth peer name eth0 netns "$ns"
+    ip link set "$ns" master "$BRIDGE" up
+    ip -n "$ns" addr add "192.168.250.$addr/24" dev eth0
+    ip -n "$ns" link set eth0 up
+    ip -n "$ns" link set lo up
+    addr=$((addr + 1))
+done
+
+# Make sure conntrack sees the bridged flows in the filtered run
+if command -v nft &> /dev/null; then
+    nft -f - << 'NFT'
+table inet vkbench
+delete table inet vkbench
+table inet vkbench {
+    chain forward {
+        type filter hook forward priority filter; policy accept;
+        ct state established,related accept
+    }
+}
+NFT
+fi
+
+run_iperf() {
+    ip netns exec "$NS_B" iperf3 -s -1 -D -p 5299
+    wait_for 2 ip netns exec "$NS_B" sh -c "ss -ltn | grep -q ':5299 '"
+    ip netns exec "$NS_A" iperf3 -c 192.168.250.2 -p 5299 -t "$DURATION" -P "$STREAMS" -f m \
+        | awk '/receiver/ { rate = $(NF-2) } END { print rate }'
+}
+
+log_info "Filtered: bridge-nf-call-iptables=1 ($DURATION s, $STREAMS stream(s))"
+sysctl -q -w net.bridge.bridge-nf-call-iptables=1
+ip link set dev "$BRIDGE" type bridge nf_call_iptables 1
+filtered=$(run_iperf)
+
+log_info "Fast path: bridge kept out of netfilter"
+sysctl -q -w net.bridge.bridge-nf-call-iptables=0
+ip link set dev "$BRIDGE" type bridge nf_call_iptables 0
+fast=$(run_iperf)
+
+log_success "Filtered:  ${filtered:-?} Mbit/s"
+log_success "Fast path: ${fast:-?} Mbit/s"
+if [ -n "$filtered" ] && [ -n "$fast" ]; then
+    awk -v f="$filtered" -v p="$fast" 'BEGIN { if (f > 0) printf "Speedup: %.2fx\n", p / f }'
+fi
@@ -0,0 +1,223 @@
+/*
+ * vkacct.bpf.c - per-flow accounting on VirtK tap ports (tc clsact)
+ *
+ * Attached to the ingress (VM -> bridge, "up") and egress (bridge -> VM,
+ * "down") hooks of every tap port. Counts packets and bytes per interface,
+ * direction and 5-tuple into a pinned per-CPU LRU hash, and records the
+ * MPTCP handshake material of each TCP flow:
+ *
+ *   MP_CAPABLE  the keys (SYN-ACK: server key, third ACK: both keys); the
+ *               connection token is the top 32 bits of SHA-256(key) and is
+ *               computed by the reader
+ *   MP_JOIN     the receiver token carried in the SYN
+ *
+ * so the reader can group subflows by connection and path. Programs return
+ * TC_ACT_UNSPEC and never change the packet; the next filter (e.g. the IFB
+ * redirect of libs/link.sh) still runs.
+ *
+ * Self-contained (no libbpf headers): build with
+ *   clang -O2 -g -target bpf -c vkacct.bpf.c -o vkacct.bpf.o
+ */
+
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/in.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/pkt_cls.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+
+#include "vkacct.h"
+
+#define SEC(name) __attribute__((section(name), used))
+#define __always_inline inline __attribute__((always_inline))
+#define __uint(name, val) int (*name)[val]
+#define __type(name, val) typeof(val) *name
+#define LIBBPF_PIN_BY_NAME 1
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define bpf_htons(x) __builtin_bswap16(x)
+#else
+#define bpf_htons(x) (x)
+#endif
+
+#define TCPOPT_MPTCP        30
+#define MPTCPOPT_MP_CAPABLE 0
+#define MPTCPOPT_MP_JOIN    1
+
+static void *(*bpf_map_lookup_elem)(void *map, const void *key) = (void *)BPF_FUNC_map_lookup_elem;
+static long (*bpf_map_update_elem)(void *map, const void *key, const void *value,
+                                   __u64 flags) = (void *)BPF_FUNC_map_update_elem;
+static long (*bpf_skb_load_bytes)(const void *skb, __u32 offset, void *to,
+                                  __u32 len) = (void *)BPF_FUNC_skb_load_bytes;
+static __u64 (*bpf_ktime_get_ns)(void) = (void *)BPF_FUNC_ktime_get_ns;
+
+/* Pinned by tc at /sys/fs/bpf/tc/globals/vk_flows, shared by all ports */
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_PERCPU_HASH);
+    __uint(max_entries, VKACCT_MAX_FLOWS);
+    __type(key, struct vkacct_key);
+    __type(value, struct vkacct_val);
+    __uint(pinning, LIBBPF_PIN_BY_NAME);
+} vk_flows SEC(".maps");
+
+static __always_inline __u64 load_be64(const __u8 *opts, __u32 off)
+{
+    __u64 v = 0;
+    int i;
+
+#pragma unroll
+    for (i = 0; i < 8; i++)
+        v = (v << 8) | opts[(off + i) & 63];
+    return v;
+}
+
+static __always_inline void parse_mptcp(struct __sk_buff *skb, __u32 off, __u32 optlen,
+                                        __u8 syn, __u8 ack, struct vkacct_val *val)
+{
+    __u8 opts[64] = {};
+    __u32 i = 0;
+    int n;
+
+    if (optlen == 0 || optlen > 40)
+        return;
+    if (bpf_skb_load_bytes(skb, off, opts, optlen))
+        return;
+
+#pragma unroll
+    for (n = 0; n < 12; n++) {
+        __u8 kind, len, subtype;
+
+        if (i >= optlen)
+            break;
+        kind = opts[i & 63];
+        if (kind == 0)
+            break;
+        if (kind == 1) {
+            i++;
+            continue;
+        }
+        if (i + 1 >= optlen)
+            break;
+        len = opts[(i + 1) & 63];
+        if (len < 2)
+            break;
+
+        if (kind == TCPOPT_MPTCP && len >= 4) {
+            subtype = opts[(i + 2) & 63] >> 4;
+            if (subtype == MPTCPOPT_MP_CAPABLE && len >= 12) {
+                if (syn && ack) {
+                    val->server_key = load_be64(opts, i + 4);
+                } else if (syn) {
+                    val->client_key = load_be64(opts, i + 4);       /* v0 SYN */
+                } else {
+                    val->client_key = load_be64(opts, i + 4);
+                    if (len >= 20)
+                        val->server_key = load_be64(opts, i + 12);
+                }
+                val->flags |= VKACCT_F_MP_CAPABLE;
+            } else if (subtype == MPTCPOPT_MP_JOIN && syn && !ack && len >= 12) {
+                val->join_token = ((__u32)opts[(i + 4) & 63] << 24) | ((__u32)opts[(i + 5) & 63] << 16) |
+                                  ((__u32)opts[(i + 6) & 63] << 8) | opts[(i + 7) & 63];
+                val->flags |= VKACCT_F_MP_JOIN;
+            }
+        }
+        i += len;
+    }
+}
+
+static __always_inline int account(struct __sk_buff *skb, __u8 dir)
+{
+    struct vkacct_key key = {};
+    struct vkacct_val *val;
+    __u32 off = ETH_HLEN, tcp_optlen = 0;
+    __u8 syn = 0, ack = 0;
+    __u16 proto;
+    __u64 now = bpf_ktime_get_ns();
+
+    if (bpf_skb_load_bytes(skb, 12, &proto, sizeof(proto)))
+        return TC_ACT_UNSPEC;
+
+    if (proto == bpf_htons(ETH_P_IP)) {
+        struct iphdr iph;
+
+        if (bpf_skb_load_bytes(skb, off, &iph, sizeof(iph)))
+            return TC_ACT_UNSPEC;
+        key.family = 4;
+        key.proto = iph.protocol;
+        key.saddr[0] = iph.saddr;
+        key.daddr[0] = iph.daddr;
+        off += iph.ihl * 4;
+        /* Only the first fragment has the ports */
+        if (iph.frag_off & bpf_htons(0x1fff))
+            key.proto = 0;
+    } else if (proto == bpf_htons(ETH_P_IPV6)) {
+        struct ipv6hdr ip6h;
+
+        if (bpf_skb_load_bytes(skb, off, &ip6h, sizeof(ip6h)))
+            return TC_ACT_UNSPEC;
+        key.family = 6;
+        key.proto = ip6h.nexthdr;
+        __builtin_memcpy(key.saddr, &ip6h.saddr, 16);
+        __builtin_memcpy(key.daddr, &ip6h.daddr, 16);
+        off += sizeof(ip6h);
+    }
+
+    if (key.proto == IPPROTO_TCP) {
+        struct tcphdr th;
+
+        if (bpf_skb_load_bytes(skb, off, &th, sizeof(th)))
+            return TC_ACT_UNSPEC;
+        key.sport = th.source;
+        key.dport = th.dest;
+        syn = th.syn;
+        ack = th.ack;
+        tcp_optlen = th.doff * 4 > sizeof(th) ? th.doff * 4 - sizeof(th) : 0;
+        off += sizeof(th);
+    } else if (key.proto == IPPROTO_UDP) {
+        struct udphdr uh;
+
+        if (bpf_skb_load_bytes(skb, off, &uh, sizeof(uh)))
+            return TC_ACT_UNSPEC;
+        key.sport = uh.source;
+        key.dport = uh.dest;
+    }
+
+    key.ifindex = skb->ifindex;
+    key.dir = dir;
+
+    val = bpf_map_lookup_elem(&vk_flows, &key);
+    if (!val) {
+        struct vkacct_val init = { .first_ns = now };
+
+        bpf_map_update_elem(&vk_flows, &key, &init, BPF_NOEXIST);
+        val = bpf_map_lookup_elem(&vk_flows, &key);
+        if (!val)
+            return TC_ACT_UNSPEC;
+    }
+
+    val->packets += skb->gso_segs ? skb->gso_segs : 1;
+    val->bytes += skb->len;
+    val->last_ns = now;
+
+    /* MPTCP keys/tokens only travel in the handshake */
+    if (tcp_optlen && (syn || val->packets <= VKACCT_HANDSHAKE_PKTS))
+        parse_mptcp(skb, off, tcp_optlen, syn, ack, val);
+
+    return TC_ACT_UNSPEC;
+}
+
+SEC("tc_ingress")
+int vk_acct_ingress(struct __sk_buff *skb)
+{
+    return account(skb, VKACCT_DIR_UP);
+}
+
+SEC("tc_egress")
+int vk_acct_egress(struct __sk_buff *skb)
+{
+    return account(skb, VKACCT_DIR_DOWN);
+}
+
+char _license[] SEC("license") = "GPL";
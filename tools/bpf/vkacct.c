@@ -0,0 +1,509 @@
+/*
+ * vkacct - read the pinned vk_flows map and export per-path time series
+ *
+ * The map (see vkacct.bpf.c) holds cumulative per-CPU counters per
+ * interface, direction and 5-tuple. Every interval the reader walks it with
+ * raw bpf() syscalls, sums the CPUs and prints the difference to the
+ * previous walk as CSV:
+ *
+ *   t_ms,ifname,dir,proto,src,sport,dst,dport,token,packets,bytes
+ *
+ * "token" is the MPTCP connection token (hex) of the subflow: the MP_JOIN
+ * token, or the top 32 bits of SHA-256 of the server key seen in the
+ * MP_CAPABLE handshake. Flows without handshake material take the token of
+ * their reverse flow. With -a the rows are summed per token, interface and
+ * direction, which gives the per-path throughput of each connection.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <inttypes.h>
+#include <net/if.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <linux/bpf.h>
+
+#include "mptcp_token.h"
+#include "vkacct.h"
+
+#define DEFAULT_INTERVAL_MS 100
+
+struct flow {
+    struct vkacct_key key;
+    struct vkacct_val val;      /* summed over CPUs */
+    uint64_t prev_packets;
+    uint64_t prev_bytes;
+    uint32_t token;
+    int used;
+    int seen;
+};
+
+static struct flow *flows;
+static size_t flow_slots, flows_used;
+static int num_cpus;
+static volatile sig_atomic_t stop_requested;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s [OPTIONS]\n"
+        "Options:\n"
+        "  -m PATH         pinned map (default %s)\n"
+        "  -i MS           interval (default %d ms)\n"
+        "  -d S            stop after S seconds (default: until SIGINT)\n"
+        "  -o FILE         write the CSV to FILE (default: stdout)\n"
+        "  -a              aggregate per token, interface and direction\n"
+        "  -t              print the totals once and exit\n"
+        "  -c              clear the map and exit\n",
+        prog, VKACCT_MAP_PATH, DEFAULT_INTERVAL_MS);
+}
+
+/* =========================================================================
+ * bpf() syscalls
+ * ========================================================================= */
+
+static int sys_bpf(int cmd, union bpf_attr *attr)
+{
+    return (int)syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+static int map_open(const char *path)
+{
+    union bpf_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.pathname = (uint64_t)(uintptr_t)path;
+    return sys_bpf(BPF_OBJ_GET, &attr);
+}
+
+static int map_check(int fd)
+{
+    struct bpf_map_info info;
+    union bpf_attr attr;
+
+    memset(&info, 0, sizeof(info));
+    memset(&attr, 0, sizeof(attr));
+    attr.info.bpf_fd = (uint32_t)fd;
+    attr.info.info_len = sizeof(info);
+    attr.info.info = (uint64_t)(uintptr_t)&info;
+    if (sys_bpf(BPF_OBJ_GET_INFO_BY_FD, &attr) < 0)
+        return -1;
+    if (info.key_size != sizeof(struct vkacct_key) || info.value_size != sizeof(struct vkacct_val)) {
+        fprintf(stderr, "vkacct: map layout mismatch (key %u, value %u)\n", info.key_size, info.value_size);
+        return -1;
+    }
+    return 0;
+}
+
+static int map_next_key(int fd, const void *key, void *next)
+{
+    union bpf_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = (uint32_t)fd;
+    attr.key = (uint64_t)(uintptr_t)key;
+    attr.next_key = (uint64_t)(uintptr_t)next;
+    return sys_bpf(BPF_MAP_GET_NEXT_KEY, &attr);
+}
+
+static int map_lookup(int fd, const void *key, void *value)
+{
+    union bpf_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = (uint32_t)fd;
+    attr.key = (uint64_t)(uintptr_t)key;
+    attr.value = (uint64_t)(uintptr_t)value;
+    return sys_bpf(BPF_MAP_LOOKUP_ELEM, &attr);
+}
+
+static int map_delete(int fd, const void *key)
+{
+    union bpf_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = (uint32_t)fd;
+    attr.key = (uint64_t)(uintptr_t)key;
+    return sys_bpf(BPF_MAP_DELETE_ELEM, &attr);
+}
+
+/* Per-CPU maps return one value per possible CPU */
+static int possible_cpus(void)
+{
+    FILE *fp = fopen("/sys/devices/system/cpu/possible", "r");
+    int first = 0, last = 0, n;
+
+    if (!fp)
+        return (int)sysconf(_SC_NPROCESSORS_CONF);
+    n = fscanf(fp, "%d-%d", &first, &last);
+    fclose(fp);
+    return n == 2 ? last + 1 : first + 1;
+}
+
+/* =========================================================================
+ * Flow table (open addressing, keyed by the map key)
+ * ========================================================================= */
+
+static uint64_t key_hash(const struct vkacct_key *key)
+{
+    const uint8_t *p = (const uint8_t *)key;
+    uint64_t h = 0xcbf29ce484222325ull;
+    size_t i;
+
+    for (i = 0; i < sizeof(*key); i++)
+        h = (h ^ p[i]) * 0x100000001b3ull;
+    return h;
+}
+
+static struct flow *flow_get(const struct vkacct_key *key, int create)
+{
+    size_t i = key_hash(key) & (flow_slots - 1);
+
+    for (;;) {
+        struct flow *f = &flows[i];
+
+        if (!f->used) {
+            if (!create)
+                return NULL;
+            f->used = 1;
+            f->key = *key;
+            flows_used++;
+            return f;
+        }
+        if (!memcmp(&f->key, key, sizeof(*key)))
+            return f;
+        i = (i + 1) & (flow_slots - 1);
+    }
+}
+
+static void reverse_key(const struct vkacct_key *key, struct vkacct_key *rev)
+{
+    *rev = *key;
+    memcpy(rev->saddr, key->daddr, sizeof(rev->saddr));
+    memcpy(rev->daddr, key->saddr, sizeof(rev->daddr));
+    rev->sport = key->dport;
+    rev->dport = key->sport;
+    rev->dir = key->dir == VKACCT_DIR_UP ? VKACCT_DIR_DOWN : VKACCT_DIR_UP;
+}
+
+static uint32_t flow_token(const struct vkacct_val *val)
+{
+    if (val->join_token)
+        return val->join_token;
+    if (val->server_key)
+        return mptcp_token(val->server_key);
+    return 0;
+}
+
+/* Drop the flows the map no longer has (evicted by the LRU) */
+static int compact(void)
+{
+    struct flow *old = flows;
+    size_t i;
+
+    flows = calloc(flow_slots, sizeof(*flows));
+    if (!flows)
+        return -1;
+    flows_used = 0;
+    for (i = 0; i < flow_slots; i++) {
+        if (old[i].used && old[i].seen)
+            *flow_get(&old[i].key, 1) = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+/* Walk the map and refresh the summed counters of every flow */
+static int snapshot(int fd)
+{
+    size_t stride = (sizeof(struct vkacct_val) + 7) & ~(size_t)7;
+    struct vkacct_key key, next;
+    uint8_t *values = malloc(stride * (size_t)num_cpus);
+    void *prev = NULL;
+    size_t i;
+    int cpu;
+
+    if (!values)
+        return -1;
+    if (flows_used > flow_slots / 2 && compact() < 0)
+        return -1;
+    for (i = 0; i < flow_slots; i++)
+        flows[i].seen = 0;
+
+    while (map_next_key(fd, prev, &next) == 0) {
+        struct vkacct_val sum;
+        struct flow *f;
+
+        key = next;
+        prev = &key;
+        if (map_lookup(fd, &key, values) < 0)
+            continue;
+
+        memset(&sum, 0, sizeof(sum));
+        for (cpu = 0; cpu < num_cpus; cpu++) {
+            const struct vkacct_val *v = (const void *)(values + stride * (size_t)cpu);
+
+            sum.packets += v->packets;
+            sum.bytes += v->bytes;
+            if (v->first_ns && (!sum.first_ns || v->first_ns < sum.first_ns))
+                sum.first_ns = v->first_ns;
+            if (v->last_ns > sum.last_ns)
+                sum.last_ns = v->last_ns;
+            if (v->server_key)
+                sum.server_key = v->server_key;
+            if (v->client_key)
+                sum.client_key = v->client_key;
+            if (v->join_token)
+                sum.join_token = v->join_token;
+            sum.flags |= v->flags;
+        }
+
+        f = flow_get(&key, 1);
+        /* LRU evicted and re-created: start over from zero */
+        if (sum.packets < f->val.packets)
+            f->prev_packets = f->prev_bytes = 0;
+        f->val = sum;
+        f->seen = 1;
+    }
+    free(values);
+
+    for (i = 0; i < flow_slots; i++) {
+        struct flow *f = &flows[i];
+
+        if (!f->used || !f->seen)
+            continue;
+        f->token = flow_token(&f->val);
+        if (!f->token) {
+            struct vkacct_key rev;
+            struct flow *r;
+
+            reverse_key(&f->key, &rev);
+            r = flow_get(&rev, 0);
+            if (r && r->seen)
+                f->token = flow_token(&r->val);
+        }
+    }
+    return 0;
+}
+
+static void format_addr(const struct vkacct_key *key, const uint32_t *addr, char *buf, size_t len)
+{
+    if (key->family == 4)
+        inet_ntop(AF_INET, addr, buf, (socklen_t)len);
+    else if (key->family == 6)
+        inet_ntop(AF_INET6, addr, buf, (socklen_t)len);
+    else
+        snprintf(buf, len, "-");
+}
+
+static const char *ifname_of(uint32_t ifindex, char *buf)
+{
+    if (!if_indextoname(ifindex, buf))
+        snprintf(buf, IF_NAMESIZE, "if%u", ifindex);
+    return buf;
+}
+
+static void print_flows(FILE *out, uint64_t t_ms, int totals)
+{
+    size_t i;
+
+    for (i = 0; i < flow_slots; i++) {
+        struct flow *f = &flows[i];
+        char src[INET6_ADDRSTRLEN], dst[INET6_ADDRSTRLEN], ifname[IF_NAMESIZE];
+        uint64_t packets, bytes;
+
+        if (!f->used || !f->seen)
+            continue;
+        packets = f->val.packets - (totals ? 0 : f->prev_packets);
+        bytes = f->val.bytes - (totals ? 0 : f->prev_bytes);
+        f->prev_packets = f->val.packets;
+        f->prev_bytes = f->val.bytes;
+        if (!packets)
+            continue;
+
+        format_addr(&f->key, f->key.saddr, src, sizeof(src));
+        format_addr(&f->key, f->key.daddr, dst, sizeof(dst));
+        fprintf(out, "%" PRIu64 ",%s,%s,%u,%s,%u,%s,%u,%08x,%" PRIu64 ",%" PRIu64 "\n",
+                t_ms, ifname_of(f->key.ifindex, ifname), f->key.dir == VKACCT_DIR_UP ? "up" : "down",
+                f->key.proto, src, ntohs(f->key.sport), dst, ntohs(f->key.dport),
+                f->token, packets, bytes);
+    }
+}
+
+/* Sum the deltas per (token, interface, direction) */
+static void print_aggregate(FILE *out, uint64_t t_ms, int totals)
+{
+    struct agg { uint32_t token, ifindex; uint8_t dir; uint64_t packets, bytes; } *aggs;
+    size_t i, j, n = 0;
+
+    aggs = calloc(flow_slots, sizeof(*aggs));
+    if (!aggs)
+        return;
+    for (i = 0; i < flow_slots; i++) {
+        struct flow *f = &flows[i];
+        uint64_t packets, bytes;
+
+        if (!f->used || !f->seen)
+            continue;
+        packets = f->val.packets - (totals ? 0 : f->prev_packets);
+        bytes = f->val.bytes - (totals ? 0 : f->prev_bytes);
+        f->prev_packets = f->val.packets;
+        f->prev_bytes = f->val.bytes;
+        if (!packets)
+            continue;
+
+        for (j = 0; j < n; j++) {
+            if (aggs[j].token == f->token && aggs[j].ifindex == f->key.ifindex && aggs[j].dir == f->key.dir)
+                break;
+        }
+        if (j == n) {
+            aggs[n].token = f->token;
+            aggs[n].ifindex = f->key.ifindex;
+            aggs[n].dir = f->key.dir;
+            n++;
+        }
+        aggs[j].packets += packets;
+        aggs[j].bytes += bytes;
+    }
+
+    for (j = 0; j < n; j++) {
+        char ifname[IF_NAMESIZE];
+
+        fprintf(out, "%" PRIu64 ",%s,%s,%08x,%" PRIu64 ",%" PRIu64 "\n", t_ms,
+                ifname_of(aggs[j].ifindex, ifname), aggs[j].dir == VKACCT_DIR_UP ? "up" : "down",
+                aggs[j].token, aggs[j].packets, aggs[j].bytes);
+    }
+    free(aggs);
+}
+
+/* The first walk is the baseline for the deltas */
+static void set_baseline(void)
+{
+    size_t i;
+
+    for (i = 0; i < flow_slots; i++) {
+        flows[i].prev_packets = flows[i].val.packets;
+        flows[i].prev_bytes = flows[i].val.bytes;
+    }
+}
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int sleep_until_ms(uint64_t deadline_ms)
+{
+    struct timespec ts = {
+        .tv_sec = deadline_ms / 1000,
+        .tv_nsec = (deadline_ms % 1000) * 1000000,
+    };
+    int ret;
+
+    do {
+        ret = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    } while (ret == EINTR && !stop_requested);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    const char *map_path = VKACCT_MAP_PATH, *out_path = NULL;
+    uint64_t interval_ms = DEFAULT_INTERVAL_MS, duration_ms = 0, start, tick;
+    int aggregate = 0, totals = 0, clear = 0, opt, fd;
+    FILE *out = stdout;
+
+    while ((opt = getopt(argc, argv, "m:i:d:o:atch")) != -1) {
+        switch (opt) {
+        case 'm': map_path = optarg; break;
+        case 'i': interval_ms = strtoull(optarg, NULL, 10); break;
+        case 'd': duration_ms = strtoull(optarg, NULL, 10) * 1000; break;
+        case 'o': out_path = optarg; break;
+        case 'a': aggregate = 1; break;
+        case 't': totals = 1; break;
+        case 'c': clear = 1; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (!interval_ms) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    fd = map_open(map_path);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", map_path, strerror(errno));
+        return 1;
+    }
+    if (map_check(fd) < 0)
+        return 1;
+
+    if (clear) {
+        struct vkacct_key key;
+
+        while (map_next_key(fd, NULL, &key) == 0)
+            map_delete(fd, &key);
+        return 0;
+    }
+
+    num_cpus = possible_cpus();
+    flow_slots = 4 * VKACCT_MAX_FLOWS;
+    flows = calloc(flow_slots, sizeof(*flows));
+    if (!flows || num_cpus <= 0)
+        return 1;
+    if (out_path && !(out = fopen(out_path, "w"))) {
+        fprintf(stderr, "%s: %s\n", out_path, strerror(errno));
+        return 1;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    if (aggregate)
+        fprintf(out, "t_ms,ifname,dir,token,packets,bytes\n");
+    else
+        fprintf(out, "t_ms,ifname,dir,proto,src,sport,dst,dport,token,packets,bytes\n");
+
+    start = tick = now_ms();
+    if (!totals) {
+        if (snapshot(fd) < 0)
+            return 1;
+        set_baseline();
+    }
+
+    do {
+        if (!totals) {
+            tick += interval_ms;
+            if (sleep_until_ms(tick) != 0)
+                break;
+        }
+        if (snapshot(fd) < 0)
+            break;
+        if (aggregate)
+            print_aggregate(out, tick - start, totals);
+        else
+            print_flows(out, tick - start, totals);
+        fflush(out);
+    } while (!totals && !stop_requested && (!duration_ms || tick - start < duration_ms));
+
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
@@ -0,0 +1,43 @@
+/*
+ * vkacct.h - map layout shared by vkacct.bpf.c and the vkacct reader
+ */
+
+#ifndef VKACCT_H
+#define VKACCT_H
+
+#include <linux/types.h>
+
+#define VKACCT_MAX_FLOWS        65536
+#define VKACCT_HANDSHAKE_PKTS   4
+#define VKACCT_MAP_PATH         "/sys/fs/bpf/tc/globals/vk_flows"
+
+#define VKACCT_DIR_UP           0       /* tap ingress: VM -> bridge */
+#define VKACCT_DIR_DOWN         1       /* tap egress: bridge -> VM */
+
+#define VKACCT_F_MP_CAPABLE     0x1
+#define VKACCT_F_MP_JOIN        0x2
+
+struct vkacct_key {
+    __u32 ifindex;
+    __u8 dir;
+    __u8 proto;
+    __u8 family;                /* 4, 6 or 0 (not IP) */
+    __u8 pad;
+    __u32 saddr[4];             /* network order, IPv4 uses [0] */
+    __u32 daddr[4];
+    __u16 sport;                /* network order */
+    __u16 dport;
+};
+
+struct vkacct_val {
+    __u64 packets;              /* GSO frames count as their segments */
+    __u64 bytes;
+    __u64 first_ns;
+    __u64 last_ns;
+    __u64 server_key;           /* MP_CAPABLE key of the SYN-ACK sender */
+    __u64 client_key;           /* MP_CAPABLE key of the SYN/ACK sender */
+    __u32 join_token;           /* MP_JOIN receiver token */
+    __u32 flags;
+};
+
+#endif
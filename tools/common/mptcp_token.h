@@ -0,0 +1,16 @@
+/*
+ * mptcp_token - MPTCP connection token of a key (RFC 8684)
+ *
+ * Shared by vkpcap (host captures) and vkacct (tc accounting) so both name
+ * a connection the same way.
+ */
+
+#ifndef MPTCP_TOKEN_H
+#define MPTCP_TOKEN_H
+
+#include <stdint.h>
+
+/* Top 32 bits of SHA-256 of the 64-bit key */
+uint32_t mptcp_token(uint64_t key);
+
+#endif
@@ -0,0 +1,914 @@
+/*
+ * linkem - userspace link emulator between a VM tap port and its bridge
+ *
+ * QEMU keeps its tap device (the VM port); linkem takes its place on the
+ * bridge with a tap device of its own and moves frames between the two:
+ *
+ *   VM -> tap (AF_PACKET) -> [up emulation]   -> linkem port -> bridge
+ *   VM <- tap (AF_PACKET) <- [down emulation] <- linkem port <- bridge
+ *
+ * Each direction has a rate (serialization at the given bit rate), a delay
+ * line with uniform jitter, Bernoulli or Gilbert-Elliott loss, reordering
+ * (a fraction of the packets skip the delay line, as in netem) and a queue
+ * limit. Frames keep their virtio-net header on both sides, so GSO frames
+ * from the VM are not segmented; they count as their segments for loss.
+ *
+ * All I/O goes through one io_uring (raw syscalls, no liburing): reads are
+ * kept posted on both devices, and due frames are written in batches. Due
+ * times live in a hashed timer wheel with ~1us ticks; the loop waits with
+ * io_uring_enter's timeout up to the next due frame and spins for the last
+ * few microseconds.
+ *
+ * Per-direction counters are written as one JSON line per interval.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <net/if.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/if_tun.h>
+#include <linux/io_uring.h>
+#include <linux/sockios.h>
+#include <linux/virtio_net.h>
+
+#define BUF_SIZE        (65536 + 256)
+#define DEFAULT_BUFFERS 4096
+#define READ_DEPTH      64
+#define RING_ENTRIES    1024
+#define TICK_SHIFT      10              /* 1.024 us per tick */
+#define WHEEL_BITS      16              /* 65536 slots, ~67 ms horizon */
+#define WHEEL_SLOTS     (1u << WHEEL_BITS)
+#define WHEEL_MASK      (WHEEL_SLOTS - 1)
+#define DEFAULT_SPIN_NS 20000
+#define PPM             1000000u
+
+enum { DIR_UP, DIR_DOWN, NUM_DIRS };
+enum { OP_READ = 1, OP_WRITE = 2 };
+
+struct profile {
+    uint64_t rate_bps;          /* 0 = unlimited */
+    uint64_t delay_ns;
+    uint64_t jitter_ns;
+    uint32_t loss_ppm;          /* Bernoulli loss */
+    int gilbert;                /* Gilbert-Elliott instead of Bernoulli */
+    uint32_t ge_p_ppm;          /* good -> bad */
+    uint32_t ge_r_ppm;          /* bad -> good */
+    uint32_t ge_loss_bad_ppm;
+    uint32_t ge_loss_good_ppm;
+    uint32_t reorder_ppm;
+    uint32_t limit;             /* packets queued in the direction */
+};
+
+struct counters {
+    uint64_t rx_pkts, rx_bytes, rx_segs;
+    uint64_t tx_pkts, tx_bytes;
+    uint64_t drop_loss, drop_loss_segs, drop_queue, tx_errors;
+    uint64_t reordered;
+};
+
+struct direction {
+    const char *name;
+    int in_fd;
+    int out_fd;
+    struct profile prof;
+    int ge_bad;
+    uint64_t link_free_ns;      /* end of serialization of the last frame */
+    uint64_t last_due_ns;       /* keeps the delay line FIFO */
+    unsigned reads_posted;
+    unsigned queued;
+    struct counters c;
+};
+
+struct pkt {
+    uint64_t due_ns;
+    uint32_t next;              /* index in the wheel slot list, or NIL */
+    uint32_t len;
+    uint8_t dir;
+};
+
+#define NIL UINT32_MAX
+
+struct wheel {
+    uint32_t head[WHEEL_SLOTS];
+    uint32_t tail[WHEEL_SLOTS];
+    uint64_t min_due[WHEEL_SLOTS];
+    uint64_t bitmap[WHEEL_SLOTS / 64];
+    uint64_t cur_tick;
+    unsigned count;
+};
+
+struct ring {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned sq_entries, sq_local_tail, sq_submitted;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+};
+
+static struct ring ring;
+static struct wheel wheel;
+static struct direction dirs[NUM_DIRS];
+static struct pkt *pkts;
+static uint8_t *buffers;
+static uint32_t *free_list;
+static unsigned num_buffers = DEFAULT_BUFFERS, num_free;
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+static volatile sig_atomic_t stop_requested, dump_requested;
+
+static void on_signal(int sig)
+{
+    if (sig == SIGUSR1)
+        dump_requested = 1;
+    else
+        stop_requested = 1;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s -i TAP -p PORT -b BRIDGE [OPTIONS]\n"
+        "Options:\n"
+        "  -i TAP          VM tap port (opened with AF_PACKET, must not be on the bridge)\n"
+        "  -p PORT         name of the tap device linkem attaches to the bridge\n"
+        "  -b BRIDGE       bridge to attach PORT to\n"
+        "  -u SPEC         VM -> bridge profile\n"
+        "  -d SPEC         bridge -> VM profile\n"
+        "  -N NAME         path name used in the counters (default: BRIDGE)\n"
+        "  -o FILE         append counters as JSON lines to FILE (default: stdout)\n"
+        "  -I MS           counters interval (default 1000, 0 = only on SIGUSR1/exit)\n"
+        "  -S SEED         PRNG seed (loss, jitter and reordering)\n"
+        "  -B N            packet buffers (default %u)\n"
+        "  -P US           spin for the last US microseconds before a due frame (default %u)\n"
+        "SPEC: comma separated rate=100mbit delay=10ms jitter=1ms loss=0.1%%\n"
+        "      ge=P%%:R%%[:LOSS_BAD%%[:LOSS_GOOD%%]] reorder=1%% limit=1000\n",
+        prog, DEFAULT_BUFFERS, DEFAULT_SPIN_NS / 1000);
+}
+
+/* =========================================================================
+ * Helpers
+ * ========================================================================= */
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* xorshift64* */
+static uint64_t rng_next(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545f4914f6cdd1dull;
+}
+
+static int chance_ppm(uint32_t ppm)
+{
+    return ppm && (uint32_t)(rng_next() % PPM) < ppm;
+}
+
+static int parse_rate(const char *s, uint64_t *bps)
+{
+    char *end;
+    double v = strtod(s, &end);
+
+    if (end == s || v < 0)
+        return -1;
+    if (!strcasecmp(end, "gbit"))
+        v *= 1e9;
+    else if (!strcasecmp(end, "mbit"))
+        v *= 1e6;
+    else if (!strcasecmp(end, "kbit"))
+        v *= 1e3;
+    else if (*end && strcasecmp(end, "bit"))
+        return -1;
+    *bps = (uint64_t)v;
+    return 0;
+}
+
+static int parse_time(const char *s, uint64_t *ns)
+{
+    char *end;
+    double v = strtod(s, &end);
+
+    if (end == s || v < 0)
+        return -1;
+    if (!strcmp(end, "s"))
+        v *= 1e9;
+    else if (!strcmp(end, "ms") || !*end)
+        v *= 1e6;
+    else if (!strcmp(end, "us"))
+        v *= 1e3;
+    else if (strcmp(end, "ns"))
+        return -1;
+    *ns = (uint64_t)v;
+    return 0;
+}
+
+static int parse_pct(const char *s, uint32_t *ppm, char **rest)
+{
+    char *end;
+    double v = strtod(s, &end);
+
+    if (end == s || v < 0 || v > 100)
+        return -1;
+    if (*end == '%')
+        end++;
+    if (rest)
+        *rest = end;
+    else if (*end)
+        return -1;
+    *ppm = (uint32_t)(v * 10000);
+    return 0;
+}
+
+/* ge=P%:R%[:LOSS_BAD%[:LOSS_GOOD%]] */
+static int parse_gilbert(const char *s, struct profile *prof)
+{
+    uint32_t *fields[] = { &prof->ge_p_ppm, &prof->ge_r_ppm, &prof->ge_loss_bad_ppm, &prof->ge_loss_good_ppm };
+    char *rest = (char *)s;
+    unsigned i;
+
+    prof->gilbert = 1;
+    prof->ge_loss_bad_ppm = PPM;
+    prof->ge_loss_good_ppm = 0;
+    for (i = 0; i < 4 && *rest; i++) {
+        if (parse_pct(rest, fields[i], &rest) < 0)
+            return -1;
+        if (*rest == ':')
+            rest++;
+        else if (*rest)
+            return -1;
+    }
+    return i >= 2 ? 0 : -1;
+}
+
+static int parse_profile(const char *spec, struct profile *prof)
+{
+    char buf[256];
+    char *opt, *save = NULL;
+
+    snprintf(buf, sizeof(buf), "%s", spec);
+    for (opt = strtok_r(buf, ",", &save); opt; opt = strtok_r(NULL, ",", &save)) {
+        char *value = strchr(opt, '=');
+        int ret;
+
+        if (!value)
+            return -1;
+        *value++ = '\0';
+        if (!strcmp(opt, "rate"))
+            ret = parse_rate(value, &prof->rate_bps);
+        else if (!strcmp(opt, "delay"))
+            ret = parse_time(value, &prof->delay_ns);
+        else if (!strcmp(opt, "jitter"))
+            ret = parse_time(value, &prof->jitter_ns);
+        else if (!strcmp(opt, "loss"))
+            ret = parse_pct(value, &prof->loss_ppm, NULL);
+        else if (!strcmp(opt, "ge"))
+            ret = parse_gilbert(value, prof);
+        else if (!strcmp(opt, "reorder"))
+            ret = parse_pct(value, &prof->reorder_ppm, NULL);
+        else if (!strcmp(opt, "limit"))
+            ret = (prof->limit = (uint32_t)strtoul(value, NULL, 10)) ? 0 : -1;
+        else
+            ret = -1;
+        if (ret < 0) {
+            fprintf(stderr, "Invalid value for %s: %s\n", opt, value);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* =========================================================================
+ * io_uring (raw syscalls)
+ * ========================================================================= */
+
+static int ring_init(unsigned entries)
+{
+    struct io_uring_params p;
+    size_t sq_size, cq_size;
+    uint8_t *sq_ptr, *cq_ptr;
+
+    memset(&p, 0, sizeof(p));
+    ring.fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (ring.fd < 0) {
+        perror("io_uring_setup");
+        return -1;
+    }
+    if (!(p.features & IORING_FEAT_EXT_ARG)) {
+        fprintf(stderr, "linkem: io_uring without IORING_FEAT_EXT_ARG (kernel >= 5.11 needed)\n");
+        return -1;
+    }
+
+    sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        sq_size = cq_size = sq_size > cq_size ? sq_size : cq_size;
+
+    sq_ptr = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED)
+        return -1;
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        cq_ptr = sq_ptr;
+    } else {
+        cq_ptr = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+        if (cq_ptr == MAP_FAILED)
+            return -1;
+    }
+    ring.sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+    if (ring.sqes == MAP_FAILED)
+        return -1;
+
+    ring.sq_head = (unsigned *)(sq_ptr + p.sq_off.head);
+    ring.sq_tail = (unsigned *)(sq_ptr + p.sq_off.tail);
+    ring.sq_mask = (unsigned *)(sq_ptr + p.sq_off.ring_mask);
+    ring.sq_array = (unsigned *)(sq_ptr + p.sq_off.array);
+    ring.sq_entries = p.sq_entries;
+    ring.sq_local_tail = ring.sq_submitted = *ring.sq_tail;
+    ring.cq_head = (unsigned *)(cq_ptr + p.cq_off.head);
+    ring.cq_tail = (unsigned *)(cq_ptr + p.cq_off.tail);
+    ring.cq_mask = (unsigned *)(cq_ptr + p.cq_off.ring_mask);
+    ring.cqes = (struct io_uring_cqe *)(cq_ptr + p.cq_off.cqes);
+    return 0;
+}
+
+/* Submit queued SQEs and optionally wait for one completion or the timeout */
+static int ring_enter(int wait, uint64_t timeout_ns)
+{
+    struct __kernel_timespec ts = {
+        .tv_sec = (long long)(timeout_ns / 1000000000ull),
+        .tv_nsec = (long long)(timeout_ns % 1000000000ull),
+    };
+    struct io_uring_getevents_arg arg = { .ts = (uint64_t)(uintptr_t)&ts };
+    unsigned to_submit, flags = 0;
+    int ret;
+
+    __atomic_store_n(ring.sq_tail, ring.sq_local_tail, __ATOMIC_RELEASE);
+    to_submit = ring.sq_local_tail - ring.sq_submitted;
+    if (wait)
+        flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    if (!to_submit && !wait)
+        return 0;
+
+    ret = (int)syscall(__NR_io_uring_enter, ring.fd, to_submit, wait ? 1 : 0, flags,
+                       wait ? &arg : NULL, wait ? sizeof(arg) : 0);
+    if (ret >= 0) {
+        ring.sq_submitted += (unsigned)ret;
+        return 0;
+    }
+    if (errno == ETIME || errno == EINTR || errno == EBUSY || errno == EAGAIN)
+        return 0;
+    perror("io_uring_enter");
+    return -1;
+}
+
+static struct io_uring_sqe *ring_get_sqe(void)
+{
+    struct io_uring_sqe *sqe;
+    unsigned idx;
+
+    while (ring.sq_local_tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE) >= ring.sq_entries) {
+        if (ring_enter(0, 0) < 0)
+            return NULL;
+    }
+    idx = ring.sq_local_tail & *ring.sq_mask;
+    sqe = &ring.sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    ring.sq_array[idx] = idx;
+    ring.sq_local_tail++;
+    return sqe;
+}
+
+static uint64_t user_data(int op, uint32_t buf)
+{
+    return ((uint64_t)op << 32) | buf;
+}
+
+static int queue_io(int op, int fd, uint32_t buf, uint32_t len)
+{
+    struct io_uring_sqe *sqe = ring_get_sqe();
+
+    if (!sqe)
+        return -1;
+    sqe->opcode = op == OP_READ ? IORING_OP_READ : IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)(buffers + (size_t)buf * BUF_SIZE);
+    sqe->len = len;
+    sqe->off = (uint64_t)-1;
+    sqe->user_data = user_data(op, buf);
+    return 0;
+}
+
+/* =========================================================================
+ * Buffers and timer wheel
+ * ========================================================================= */
+
+static int buffers_init(void)
+{
+    unsigned i;
+
+    buffers = mmap(NULL, (size_t)num_buffers * BUF_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    pkts = calloc(num_buffers, sizeof(*pkts));
+    free_list = calloc(num_buffers, sizeof(*free_list));
+    if (buffers == MAP_FAILED || !pkts || !free_list)
+        return -1;
+    for (i = 0; i < num_buffers; i++)
+        free_list[i] = num_buffers - 1 - i;
+    num_free = num_buffers;
+    return 0;
+}
+
+static uint32_t buf_alloc(void)
+{
+    return num_free ? free_list[--num_free] : NIL;
+}
+
+static void buf_free(uint32_t buf)
+{
+    free_list[num_free++] = buf;
+}
+
+static void wheel_init(uint64_t now)
+{
+    unsigned i;
+
+    for (i = 0; i < WHEEL_SLOTS; i++)
+        wheel.head[i] = wheel.tail[i] = NIL;
+    wheel.cur_tick = now >> TICK_SHIFT;
+}
+
+static void wheel_insert(uint32_t buf)
+{
+    unsigned slot = (unsigned)(pkts[buf].due_ns >> TICK_SHIFT) & WHEEL_MASK;
+
+    pkts[buf].next = NIL;
+    if (wheel.head[slot] == NIL) {
+        wheel.head[slot] = buf;
+        wheel.min_due[slot] = pkts[buf].due_ns;
+        wheel.bitmap[slot / 64] |= 1ull << (slot % 64);
+    } else {
+        pkts[wheel.tail[slot]].next = buf;
+        if (pkts[buf].due_ns < wheel.min_due[slot])
+            wheel.min_due[slot] = pkts[buf].due_ns;
+    }
+    wheel.tail[slot] = buf;
+    wheel.count++;
+}
+
+/* Distance in slots from "from" to the next non-empty slot, or -1 */
+static long wheel_find(unsigned from)
+{
+    unsigned word = from / 64, i;
+    uint64_t bits = wheel.bitmap[word] & (~0ull << (from % 64));
+
+    for (i = 0; i <= WHEEL_SLOTS / 64; i++) {
+        if (bits) {
+            unsigned slot = word * 64 + (unsigned)__builtin_ctzll(bits);
+            return (long)((slot - from) & WHEEL_MASK);
+        }
+        word = (word + 1) % (WHEEL_SLOTS / 64);
+        bits = wheel.bitmap[word];
+    }
+    return -1;
+}
+
+/* Earliest instant at which a frame may become due (UINT64_MAX if none) */
+static uint64_t wheel_next_due(void)
+{
+    unsigned cur = (unsigned)wheel.cur_tick & WHEEL_MASK;
+    uint64_t due = UINT64_MAX;
+    long dist;
+
+    if (!wheel.count)
+        return UINT64_MAX;
+    /* The current slot may only hold frames of later wheel rounds */
+    if (wheel.head[cur] != NIL)
+        due = wheel.min_due[cur];
+    dist = wheel_find((cur + 1) & WHEEL_MASK);
+    if (dist >= 0) {
+        uint64_t t = (wheel.cur_tick + 1 + (uint64_t)dist) << TICK_SHIFT;
+        if (t < due)
+            due = t;
+    }
+    return due;
+}
+
+static void send_frame(uint32_t buf);
+
+/* Release every frame due at "now", slot by slot in time order */
+static void wheel_expire(uint64_t now)
+{
+    uint64_t now_tick = now >> TICK_SHIFT, tick = wheel.cur_tick;
+
+    if (now_tick - tick >= WHEEL_SLOTS)
+        tick = now_tick - WHEEL_SLOTS + 1;
+
+    for (; tick <= now_tick && wheel.count; tick++) {
+        unsigned slot = (unsigned)tick & WHEEL_MASK;
+        uint32_t buf, prev = NIL, next;
+        uint64_t min_due = UINT64_MAX;
+
+        if (wheel.head[slot] == NIL)
+            continue;
+        for (buf = wheel.head[slot]; buf != NIL; buf = next) {
+            next = pkts[buf].next;
+            if (pkts[buf].due_ns > now) {
+                if (pkts[buf].due_ns < min_due)
+                    min_due = pkts[buf].due_ns;
+                prev = buf;
+                continue;
+            }
+            if (prev == NIL)
+                wheel.head[slot] = next;
+            else
+                pkts[prev].next = next;
+            if (wheel.tail[slot] == buf)
+                wheel.tail[slot] = prev;
+            wheel.count--;
+            send_frame(buf);
+        }
+        wheel.min_due[slot] = min_due;
+        if (wheel.head[slot] == NIL)
+            wheel.bitmap[slot / 64] &= ~(1ull << (slot % 64));
+    }
+    wheel.cur_tick = now_tick;
+}
+
+/* =========================================================================
+ * Emulation
+ * ========================================================================= */
+
+static void post_reads(void)
+{
+    int d;
+
+    for (d = 0; d < NUM_DIRS; d++) {
+        while (dirs[d].reads_posted < READ_DEPTH) {
+            uint32_t buf = buf_alloc();
+
+            if (buf == NIL)
+                return;
+            pkts[buf].dir = (uint8_t)d;
+            if (queue_io(OP_READ, dirs[d].in_fd, buf, BUF_SIZE) < 0) {
+                buf_free(buf);
+                return;
+            }
+            dirs[d].reads_posted++;
+        }
+    }
+}
+
+static void send_frame(uint32_t buf)
+{
+    struct direction *dir = &dirs[pkts[buf].dir];
+
+    dir->queued--;
+    if (queue_io(OP_WRITE, dir->out_fd, buf, pkts[buf].len) < 0) {
+        dir->c.tx_errors++;
+        buf_free(buf);
+    }
+}
+
+static int segment_lost(struct direction *dir)
+{
+    const struct profile *prof = &dir->prof;
+
+    if (!prof->gilbert)
+        return chance_ppm(prof->loss_ppm);
+
+    /* State transition first, then the loss of the new state */
+    if (dir->ge_bad) {
+        if (chance_ppm(prof->ge_r_ppm))
+            dir->ge_bad = 0;
+    } else if (chance_ppm(prof->ge_p_ppm)) {
+        dir->ge_bad = 1;
+    }
+    return chance_ppm(dir->ge_bad ? prof->ge_loss_bad_ppm : prof->ge_loss_good_ppm);
+}
+
+/* Decide the fate of a received frame: drop it, send it now or schedule it */
+static void emulate(uint32_t buf, uint64_t now)
+{
+    struct pkt *pkt = &pkts[buf];
+    struct direction *dir = &dirs[pkt->dir];
+    const struct profile *prof = &dir->prof;
+    const struct virtio_net_hdr *vh = (const void *)(buffers + (size_t)buf * BUF_SIZE);
+    uint32_t wire_len = pkt->len > sizeof(*vh) ? pkt->len - (uint32_t)sizeof(*vh) : 0;
+    uint32_t segs = 1, i;
+    uint64_t due = now;
+    int lost = 0;
+
+    if (vh->gso_type != VIRTIO_NET_HDR_GSO_NONE && vh->gso_size && wire_len > vh->hdr_len)
+        segs = (wire_len - vh->hdr_len + vh->gso_size - 1) / vh->gso_size;
+
+    dir->c.rx_pkts++;
+    dir->c.rx_segs += segs;
+    dir->c.rx_bytes += wire_len;
+
+    for (i = 0; i < segs; i++) {
+        if (segment_lost(dir)) {
+            lost = 1;
+            dir->c.drop_loss_segs++;
+        }
+    }
+    if (lost) {
+        dir->c.drop_loss++;
+        goto drop;
+    }
+    if (prof->limit && dir->queued >= prof->limit) {
+        dir->c.drop_queue++;
+        goto drop;
+    }
+
+    /* Serialization at the link rate */
+    if (prof->rate_bps) {
+        uint64_t start = dir->link_free_ns > now ? dir->link_free_ns : now;
+
+        dir->link_free_ns = start + (uint64_t)wire_len * 8 * 1000000000ull / prof->rate_bps;
+        due = dir->link_free_ns;
+    }
+
+    /* Delay line: reordered frames skip it, the others stay in order */
+    if (chance_ppm(prof->reorder_ppm)) {
+        dir->c.reordered++;
+    } else {
+        int64_t delay = (int64_t)prof->delay_ns;
+
+        if (prof->jitter_ns)
+            delay += (int64_t)(rng_next() % (2 * prof->jitter_ns + 1)) - (int64_t)prof->jitter_ns;
+        if (delay > 0)
+            due += (uint64_t)delay;
+        if (due < dir->last_due_ns)
+            due = dir->last_due_ns;
+        dir->last_due_ns = due;
+    }
+
+    dir->queued++;
+    pkt->due_ns = due;
+    if (due <= now)
+        send_frame(buf);
+    else
+        wheel_insert(buf);
+    return;
+
+drop:
+    buf_free(buf);
+}
+
+static int handle_completions(uint64_t *now)
+{
+    unsigned head = *ring.cq_head;
+    unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+    int seen = 0;
+
+    if (head != tail)
+        *now = now_ns();
+    for (; head != tail; head++) {
+        const struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+        uint32_t buf = (uint32_t)cqe->user_data;
+        int op = (int)(cqe->user_data >> 32);
+        struct direction *dir = &dirs[pkts[buf].dir];
+
+        seen++;
+        if (op == OP_READ) {
+            dir->reads_posted--;
+            if (cqe->res <= 0) {
+                if (cqe->res < 0 && cqe->res != -EAGAIN && cqe->res != -EINTR && cqe->res != -ENETDOWN)
+                    fprintf(stderr, "linkem: %s read: %s\n", dir->name, strerror(-cqe->res));
+                buf_free(buf);
+                continue;
+            }
+            pkts[buf].len = (uint32_t)cqe->res;
+            emulate(buf, *now);
+        } else {
+            if (cqe->res < 0) {
+                dir->c.tx_errors++;
+            } else {
+                dir->c.tx_pkts++;
+                dir->c.tx_bytes += (uint64_t)cqe->res > sizeof(struct virtio_net_hdr) ?
+                                   (uint64_t)cqe->res - sizeof(struct virtio_net_hdr) : 0;
+            }
+            buf_free(buf);
+        }
+    }
+    __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    return seen;
+}
+
+static void dump_counters(FILE *out, const char *name, uint64_t elapsed_ns)
+{
+    int d;
+
+    fprintf(out, "{\"t_ms\":%" PRIu64 ",\"path\":\"%s\"", elapsed_ns / 1000000, name);
+    for (d = 0; d < NUM_DIRS; d++) {
+        const struct direction *dir = &dirs[d];
+        const struct counters *c = &dir->c;
+
+        fprintf(out, ",\"%s\":{\"rx_pkts\":%" PRIu64 ",\"rx_segs\":%" PRIu64 ",\"rx_bytes\":%" PRIu64
+                ",\"tx_pkts\":%" PRIu64 ",\"tx_bytes\":%" PRIu64 ",\"drop_loss\":%" PRIu64
+                ",\"drop_loss_segs\":%" PRIu64 ",\"drop_queue\":%" PRIu64 ",\"tx_errors\":%" PRIu64 ",\"reordered\":%" PRIu64 ",\"queued\":%u}",
+                dir->name, c->rx_pkts, c->rx_segs, c->rx_bytes, c->tx_pkts, c->tx_bytes,
+                c->drop_loss, c->drop_loss_segs, c->drop_queue,
+                c->tx_errors, c->reordered, dir->queued);
+    }
+    fprintf(out, "}\n");
+    fflush(out);
+}
+
+/* =========================================================================
+ * Devices
+ * ========================================================================= */
+
+static int open_vm_tap(const char *ifname)
+{
+    struct sockaddr_ll sll = { .sll_family = AF_PACKET, .sll_protocol = htons(ETH_P_ALL) };
+    int fd, one = 1, bufsize = 8 << 20;
+
+    sll.sll_ifindex = (int)if_nametoindex(ifname);
+    if (!sll.sll_ifindex) {
+        fprintf(stderr, "%s: %s\n", ifname, strerror(errno));
+        return -1;
+    }
+    fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    if (fd < 0) {
+        perror("socket(AF_PACKET)");
+        return -1;
+    }
+    /* Keep the virtio-net header (GSO/csum offload) and skip our own sends */
+    if (setsockopt(fd, SOL_PACKET, PACKET_VNET_HDR, &one, sizeof(one)) < 0 ||
+        setsockopt(fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one)) < 0) {
+        perror("setsockopt(SOL_PACKET)");
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &bufsize, sizeof(bufsize));
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUFFORCE, &bufsize, sizeof(bufsize));
+    if (bind(fd, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
+        perror("bind(AF_PACKET)");
+        return -1;
+    }
+    return fd;
+}
+
+static int open_port(const char *ifname, const char *bridge)
+{
+    struct ifreq ifr;
+    int fd, sock;
+
+    fd = open("/dev/net/tun", O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        perror("/dev/net/tun");
+        return -1;
+    }
+    memset(&ifr, 0, sizeof(ifr));
+    snprintf(ifr.ifr_name, IFNAMSIZ, "%s", ifname);
+    ifr.ifr_flags = IFF_TAP | IFF_NO_PI | IFF_VNET_HDR;
+    if (ioctl(fd, TUNSETIFF, &ifr) < 0) {
+        fprintf(stderr, "%s: TUNSETIFF: %s\n", ifname, strerror(errno));
+        return -1;
+    }
+    /* Accept GSO frames from the bridge, like the VM tap does */
+    if (ioctl(fd, TUNSETOFFLOAD, TUN_F_CSUM | TUN_F_TSO4 | TUN_F_TSO6) < 0)
+        fprintf(stderr, "%s: TUNSETOFFLOAD: %s\n", ifname, strerror(errno));
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0)
+        return -1;
+    if (ioctl(sock, SIOCGIFFLAGS, &ifr) == 0) {
+        ifr.ifr_flags |= IFF_UP;
+        ioctl(sock, SIOCSIFFLAGS, &ifr);
+    }
+
+    memset(&ifr, 0, sizeof(ifr));
+    snprintf(ifr.ifr_name, IFNAMSIZ, "%s", bridge);
+    ifr.ifr_ifindex = (int)if_nametoindex(ifname);
+    if (ioctl(sock, SIOCBRADDIF, &ifr) < 0 && errno != EBUSY) {
+        fprintf(stderr, "%s: adding %s: %s\n", bridge, ifname, strerror(errno));
+        close(sock);
+        return -1;
+    }
+    close(sock);
+    return fd;
+}
+
+int main(int argc, char **argv)
+{
+    const char *vm_tap = NULL, *port = NULL, *bridge = NULL, *name = NULL, *out_path = NULL;
+    uint64_t interval_ns = 1000000000ull, spin_ns = DEFAULT_SPIN_NS, start, now, next_dump;
+    FILE *out = stdout;
+    int opt;
+
+    dirs[DIR_UP].name = "up";
+    dirs[DIR_DOWN].name = "down";
+
+    while ((opt = getopt(argc, argv, "i:p:b:u:d:N:o:I:S:B:P:h")) != -1) {
+        switch (opt) {
+        case 'i': vm_tap = optarg; break;
+        case 'p': port = optarg; break;
+        case 'b': bridge = optarg; break;
+        case 'u':
+            if (parse_profile(optarg, &dirs[DIR_UP].prof) < 0)
+                return 1;
+            break;
+        case 'd':
+            if (parse_profile(optarg, &dirs[DIR_DOWN].prof) < 0)
+                return 1;
+            break;
+        case 'N': name = optarg; break;
+        case 'o': out_path = optarg; break;
+        case 'I': interval_ns = strtoull(optarg, NULL, 10) * 1000000ull; break;
+        case 'S': rng_state = strtoull(optarg, NULL, 10) | 1; break;
+        case 'B': num_buffers = (unsigned)strtoul(optarg, NULL, 10); break;
+        case 'P': spin_ns = strtoull(optarg, NULL, 10) * 1000ull; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (!vm_tap || !port || !bridge || num_buffers < 2 * READ_DEPTH) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (!name)
+        name = bridge;
+    if (out_path && !(out = fopen(out_path, "a"))) {
+        fprintf(stderr, "%s: %s\n", out_path, strerror(errno));
+        return 1;
+    }
+
+    dirs[DIR_UP].in_fd = dirs[DIR_DOWN].out_fd = open_vm_tap(vm_tap);
+    if (dirs[DIR_UP].in_fd < 0)
+        return 1;
+    dirs[DIR_DOWN].in_fd = dirs[DIR_UP].out_fd = open_port(port, bridge);
+    if (dirs[DIR_DOWN].in_fd < 0)
+        return 1;
+    if (ring_init(RING_ENTRIES) < 0 || buffers_init() < 0)
+        return 1;
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGUSR1, on_signal);
+
+    start = now = now_ns();
+    next_dump = interval_ns ? start + interval_ns : UINT64_MAX;
+    wheel_init(now);
+    fprintf(stderr, "linkem: %s <-> %s on %s, %u buffers\n", vm_tap, port, bridge, num_buffers);
+
+    while (!stop_requested) {
+        uint64_t due;
+
+        post_reads();
+        wheel_expire(now);
+
+        due = wheel_next_due();
+        if (due != UINT64_MAX && due <= now + spin_ns) {
+            /* Close to the next departure: submit and poll without sleeping */
+            if (ring_enter(0, 0) < 0)
+                break;
+        } else {
+            uint64_t wake = due == UINT64_MAX ? next_dump : due - spin_ns;
+
+            if (wake > next_dump)
+                wake = next_dump;
+            if (ring_enter(1, wake > now ? wake - now : 0) < 0)
+                break;
+        }
+
+        if (!handle_completions(&now))
+            now = now_ns();
+
+        if (now >= next_dump || dump_requested) {
+            dump_counters(out, name, now - start);
+            dump_requested = 0;
+            if (interval_ns)
+                while (next_dump <= now)
+                    next_dump += interval_ns;
+        }
+    }
+
+    dump_counters(out, name, now_ns() - start);
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
@@ -0,0 +1,452 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * mptcp_sched_bench - synthetic microbenchmark of the MPTCP scheduler ops
+ *
+ * Built into the guest kernel (net/mptcp) by kernel_setup() with
+ * vm.schedbench: true, see libs/schedbench.sh. Driven from debugfs:
+ *
+ *   echo "subflows=1,2,4,8 iters=200000 sched=default,xlayer" \
+ *       > /sys/kernel/debug/mptcp_sched_bench/run
+ *   cat /sys/kernel/debug/mptcp_sched_bench/run
+ *
+ * For every scheduler and subflow count, an unconnected MPTCP socket is
+ * given N fake subflows (kernel TCP sockets with the mptcp ULP, forced to
+ * ESTABLISHED) with pseudo-random but reproducible (seed=) state:
+ *
+ *   srtt      1..100 ms
+ *   cwnd      10..200 segments, pacing rate cwnd * mss / srtt
+ *   backlog   1/4 idle, 1/2 partly queued, 1/4 full (sk_wmem_queued at
+ *             sk_sndbuf, i.e. not writable)
+ *
+ * and mptcp_sched_get_send() is called iters times under the msk lock,
+ * clearing the scheduled flag after each decision. The same loop without
+ * the call is timed as a baseline and subtracted, so the result is the
+ * cost of the decision itself. Output is CSV:
+ *
+ *   scheduler,subflows,iters,ns_per_decision,cache_misses_per_decision,empty
+ *
+ * cache misses come from a PERF_COUNT_HW_CACHE_MISSES counter on the
+ * benchmarking task (-1 when the guest has no PMU, e.g. KVM without
+ * -cpu host); empty counts the decisions that scheduled no subflow.
+ *
+ * Without sched=, every registered scheduler is measured: the static
+ * mptcp_sched_list is found through kallsyms (CONFIG_KALLSYMS_ALL),
+ * otherwise only "default".
+ */
+
+#include <linux/debugfs.h>
+#include <linux/kallsyms.h>
+#include <linux/ktime.h>
+#include <linux/perf_event.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <net/tcp.h>
+
+#include "protocol.h"
+
+#define BENCH_MAX_SUBFLOWS	64
+#define BENCH_MAX_SCHEDS	8
+#define BENCH_MAX_COUNTS	16
+#define BENCH_BUF_SIZE		(16 * 1024)
+
+struct bench_params {
+	char scheds[BENCH_MAX_SCHEDS][MPTCP_SCHED_NAME_MAX];
+	int nr_scheds;
+	int subflows[BENCH_MAX_COUNTS];
+	int nr_subflows;
+	u32 iters;
+	u32 seed;
+};
+
+struct bench_result {
+	u64 ns;
+	s64 misses;
+	u32 empty;
+};
+
+static DEFINE_MUTEX(bench_lock);
+static char *bench_buf;
+static size_t bench_len;
+
+static u32 bench_rand(u32 *state)
+{
+	*state = *state * 1103515245 + 12345;
+	return *state >> 8;
+}
+
+static int bench_add_subflow(struct sock *sk, u32 *rnd)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	struct mptcp_subflow_context *subflow;
+	struct socket *sf;
+	struct tcp_sock *tp;
+	struct sock *ssk;
+	u32 rtt_us, cwnd;
+	int err;
+
+	err = mptcp_subflow_create_socket(sk, AF_INET, &sf);
+	if (err)
+		return err;
+
+	ssk = sf->sk;
+	tp = tcp_sk(ssk);
+	subflow = mptcp_subflow_ctx(ssk);
+
+	rtt_us = 1000 + bench_rand(rnd) % 99000;
+	cwnd = 10 + bench_rand(rnd) % 191;
+	tp->mss_cache = 1448;
+	tp->srtt_us = rtt_us << 3;
+	tcp_snd_cwnd_set(tp, cwnd);
+	WRITE_ONCE(ssk->sk_pacing_rate,
+		   div_u64((u64)tp->mss_cache * cwnd * USEC_PER_SEC, rtt_us));
+
+	switch (bench_rand(rnd) % 4) {
+	case 0:
+		break;
+	case 3:
+		WRITE_ONCE(ssk->sk_wmem_queued, READ_ONCE(ssk->sk_sndbuf));
+		break;
+	default:
+		WRITE_ONCE(ssk->sk_wmem_queued,
+			   bench_rand(rnd) % READ_ONCE(ssk->sk_sndbuf));
+		break;
+	}
+	inet_sk_state_store(ssk, TCP_ESTABLISHED);
+
+	/* as __mptcp_subflow_connect(), minus the connect */
+	sock_hold(ssk);
+	list_add_tail(&subflow->node, &msk->conn_list);
+	mptcp_sock_graft(ssk, sk->sk_socket);
+	iput(SOCK_INODE(sf));
+	return 0;
+}
+
+/* Undo the fake state, so that the normal close path releases the subflows */
+static void bench_reset_subflows(struct mptcp_sock *msk)
+{
+	struct mptcp_subflow_context *subflow;
+
+	mptcp_for_each_subflow(msk, subflow) {
+		struct sock *ssk = mptcp_subflow_tcp_sock(subflow);
+
+		mptcp_subflow_set_scheduled(subflow, false);
+		WRITE_ONCE(ssk->sk_wmem_queued, 0);
+		inet_sk_state_store(ssk, TCP_CLOSE);
+	}
+}
+
+/* Clears the decision of the last call, returns false if there was none */
+static bool bench_clear_scheduled(struct mptcp_sock *msk)
+{
+	struct mptcp_subflow_context *subflow;
+	bool scheduled = false;
+
+	mptcp_for_each_subflow(msk, subflow) {
+		if (READ_ONCE(subflow->scheduled)) {
+			mptcp_subflow_set_scheduled(subflow, false);
+			scheduled = true;
+		}
+	}
+	return scheduled;
+}
+
+static u64 bench_loop(struct mptcp_sock *msk, u32 iters, bool call, u32 *empty)
+{
+	u64 start;
+	u32 i;
+
+	*empty = 0;
+	start = ktime_get_ns();
+	for (i = 0; i < iters; i++) {
+		if (call)
+			mptcp_sched_get_send(msk);
+		if (!bench_clear_scheduled(msk))
+			(*empty)++;
+		if (unlikely((i & 4095) == 4095))
+			cond_resched();
+	}
+	return ktime_get_ns() - start;
+}
+
+#ifdef CONFIG_PERF_EVENTS
+static struct perf_event *bench_counter_create(void)
+{
+	struct perf_event_attr attr = {
+		.type		= PERF_TYPE_HARDWARE,
+		.config		= PERF_COUNT_HW_CACHE_MISSES,
+		.size		= sizeof(attr),
+		.disabled	= 1,
+	};
+	struct perf_event *event;
+
+	event = perf_event_create_kernel_counter(&attr, -1, current, NULL, NULL);
+	return IS_ERR(event) ? NULL : event;
+}
+
+static u64 bench_counter_read(struct perf_event *event)
+{
+	u64 enabled, running;
+
+	return perf_event_read_value(event, &enabled, &running);
+}
+
+static void bench_counter_release(struct perf_event *event)
+{
+	perf_event_release_kernel(event);
+}
+#else
+static struct perf_event *bench_counter_create(void) { return NULL; }
+static u64 bench_counter_read(struct perf_event *event) { return 0; }
+static void bench_counter_release(struct perf_event *event) { }
+#endif
+
+static int bench_one(struct mptcp_sched_ops *sched, int nr_subflows,
+		     const struct bench_params *p, struct bench_result *res)
+{
+	struct perf_event *counter;
+	struct mptcp_sock *msk;
+	u64 base_ns, sched_ns;
+	s64 base_misses = 0;
+	struct socket *sock;
+	u32 rnd = p->seed;
+	struct sock *sk;
+	u64 misses;
+	u32 empty;
+	int i, err;
+
+	err = sock_create_kern(&init_net, AF_INET, SOCK_STREAM, IPPROTO_MPTCP, &sock);
+	if (err)
+		return err;
+
+	sk = sock->sk;
+	msk = mptcp_sk(sk);
+	lock_sock(sk);
+
+	mptcp_release_sched(msk);
+	err = mptcp_init_sched(msk, sched);
+	if (err)
+		goto out;
+
+	for (i = 0; i < nr_subflows; i++) {
+		err = bench_add_subflow(sk, &rnd);
+		if (err)
+			goto out;
+	}
+	/* room in the MPTCP send window, so the burst accounting runs too */
+	WRITE_ONCE(msk->wnd_end, msk->snd_nxt + 65535);
+
+	counter = bench_counter_create();
+
+	/* warm up the caches and the schedulers' own state */
+	bench_loop(msk, min_t(u32, p->iters / 10 + 1, 10000), true, &empty);
+
+	if (counter)
+		perf_event_enable(counter);
+
+	misses = counter ? bench_counter_read(counter) : 0;
+	base_ns = bench_loop(msk, p->iters, false, &empty);
+	if (counter)
+		base_misses = bench_counter_read(counter) - misses;
+
+	misses = counter ? bench_counter_read(counter) : 0;
+	sched_ns = bench_loop(msk, p->iters, true, &res->empty);
+	if (counter) {
+		res->misses = max_t(s64, (s64)(bench_counter_read(counter) - misses) -
+				    base_misses, 0);
+		bench_counter_release(counter);
+	} else {
+		res->misses = -1;
+	}
+	res->ns = sched_ns > base_ns ? sched_ns - base_ns : 0;
+
+out:
+	bench_reset_subflows(msk);
+	release_sock(sk);
+	sock_release(sock);
+	return err;
+}
+
+/* Registered schedulers, when the static list is reachable */
+static void bench_find_schedulers(struct bench_params *p)
+{
+	struct mptcp_sched_ops *sched;
+	struct list_head *list;
+
+	list = (struct list_head *)kallsyms_lookup_name("mptcp_sched_list");
+	if (!list) {
+		strscpy(p->scheds[0], "default", MPTCP_SCHED_NAME_MAX);
+		p->nr_scheds = 1;
+		return;
+	}
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(sched, list, list) {
+		if (p->nr_scheds == BENCH_MAX_SCHEDS)
+			break;
+		strscpy(p->scheds[p->nr_scheds++], sched->name, MPTCP_SCHED_NAME_MAX);
+	}
+	rcu_read_unlock();
+}
+
+static int bench_parse(char *buf, struct bench_params *p)
+{
+	char *opt, *val, *item;
+	int n;
+
+	memset(p, 0, sizeof(*p));
+	p->iters = 100000;
+	p->seed = 1;
+
+	while ((opt = strsep(&buf, " \t\n")) != NULL) {
+		if (!*opt)
+			continue;
+		val = strchr(opt, '=');
+		if (!val)
+			return -EINVAL;
+		*val++ = '\0';
+
+		if (!strcmp(opt, "iters")) {
+			if (kstrtou32(val, 0, &p->iters) || !p->iters)
+				return -EINVAL;
+		} else if (!strcmp(opt, "seed")) {
+			if (kstrtou32(val, 0, &p->seed))
+				return -EINVAL;
+		} else if (!strcmp(opt, "subflows")) {
+			while ((item = strsep(&val, ",")) != NULL) {
+				if (p->nr_subflows == BENCH_MAX_COUNTS ||
+				    kstrtoint(item, 0, &n) || n < 1 ||
+				    n > BENCH_MAX_SUBFLOWS)
+					return -EINVAL;
+				p->subflows[p->nr_subflows++] = n;
+			}
+		} else if (!strcmp(opt, "sched")) {
+			while ((item = strsep(&val, ",")) != NULL) {
+				if (p->nr_scheds == BENCH_MAX_SCHEDS ||
+				    strscpy(p->scheds[p->nr_scheds++], item,
+					    MPTCP_SCHED_NAME_MAX) < 0)
+					return -EINVAL;
+			}
+		} else {
+			return -EINVAL;
+		}
+	}
+
+	if (!p->nr_subflows) {
+		for (n = 1; n <= 32; n *= 2)
+			p->subflows[p->nr_subflows++] = n;
+	}
+	if (!p->nr_scheds)
+		bench_find_schedulers(p);
+	return 0;
+}
+
+static int bench_run(const struct bench_params *p)
+{
+	struct bench_result res;
+	struct mptcp_sched_ops *sched;
+	int s, i, err;
+
+	bench_len = scnprintf(bench_buf, BENCH_BUF_SIZE,
+			      "scheduler,subflows,iters,ns_per_decision,cache_misses_per_decision,empty\n");
+
+	for (s = 0; s < p->nr_scheds; s++) {
+		rcu_read_lock();
+		sched = mptcp_sched_find(p->scheds[s]);
+		rcu_read_unlock();
+		if (!sched) {
+			pr_warn("mptcp_sched_bench: unknown scheduler %s\n", p->scheds[s]);
+			continue;
+		}
+
+		for (i = 0; i < p->nr_subflows; i++) {
+			memset(&res, 0, sizeof(res));
+			err = bench_one(sched, p->subflows[i], p, &res);
+			if (err) {
+				pr_warn("mptcp_sched_bench: %s with %d subflows failed: %d\n",
+					p->scheds[s], p->subflows[i], err);
+				return err;
+			}
+
+			bench_len += scnprintf(bench_buf + bench_len, BENCH_BUF_SIZE - bench_len,
+					       "%s,%d,%u,%llu.%01llu,", p->scheds[s],
+					       p->subflows[i], p->iters,
+					       div_u64(res.ns, p->iters),
+					       div_u64(res.ns * 10, p->iters) % 10);
+			if (res.misses < 0)
+				bench_len += scnprintf(bench_buf + bench_len,
+						       BENCH_BUF_SIZE - bench_len, "-1,");
+			else
+				bench_len += scnprintf(bench_buf + bench_len,
+						       BENCH_BUF_SIZE - bench_len, "%llu.%02llu,",
+						       div_u64(res.misses, p->iters),
+						       div_u64(res.misses * 100, p->iters) % 100);
+			bench_len += scnprintf(bench_buf + bench_len, BENCH_BUF_SIZE - bench_len,
+					       "%u\n", res.empty);
+		}
+	}
+	return 0;
+}
+
+static ssize_t bench_write(struct file *file, const char __user *ubuf,
+			   size_t count, loff_t *ppos)
+{
+	struct bench_params *p;
+	char *buf;
+	int err;
+
+	if (count >= PAGE_SIZE)
+		return -EINVAL;
+
+	buf = memdup_user_nul(ubuf, count);
+	if (IS_ERR(buf))
+		return PTR_ERR(buf);
+
+	p = kmalloc(sizeof(*p), GFP_KERNEL);
+	if (!p) {
+		kfree(buf);
+		return -ENOMEM;
+	}
+
+	err = bench_parse(buf, p);
+	if (!err) {
+		mutex_lock(&bench_lock);
+		err = bench_run(p);
+		mutex_unlock(&bench_lock);
+	}
+
+	kfree(p);
+	kfree(buf);
+	return err ? err : count;
+}
+
+static ssize_t bench_read(struct file *file, char __user *ubuf,
+			  size_t count, loff_t *ppos)
+{
+	ssize_t ret;
+
+	mutex_lock(&bench_lock);
+	ret = simple_read_from_buffer(ubuf, count, ppos, bench_buf, bench_len);
+	mutex_unlock(&bench_lock);
+	return ret;
+}
+
+static const struct file_operations bench_fops = {
+	.owner	= THIS_MODULE,
+	.read	= bench_read,
+	.write	= bench_write,
+	.llseek	= default_llseek,
+};
+
+static int __init mptcp_sched_bench_init(void)
+{
+	struct dentry *dir;
+
+	bench_buf = kzalloc(BENCH_BUF_SIZE, GFP_KERNEL);
+	if (!bench_buf)
+		return -ENOMEM;
+
+	dir = debugfs_create_dir("mptcp_sched_bench", NULL);
+	debugfs_create_file("run", 0600, dir, NULL, &bench_fops);
+	return 0;
+}
+late_initcall(mptcp_sched_bench_init);
@@ -0,0 +1,501 @@
+/*
+ * traceplay - replay time-varying link traces on VirtK bridge ports
+ *
+ * Each path is a network device (tap port or its IFB) and a trace file.
+ * The player builds an HTB + netem tree on the device and then changes the
+ * rate, delay, jitter and loss at the instants given by the trace, relative
+ * to a common start time. Changes are written to a single "tc -batch"
+ * process, so no process is forked per step.
+ *
+ * Trace formats:
+ *   text      "t_ms rate_kbit delay_ms [loss_pct [jitter_ms]]" per line,
+ *             '#' starts a comment. rate 0 blackholes the path.
+ *   mahimahi  one delivery opportunity (1500 bytes) per line, given as a
+ *             millisecond timestamp; converted to a rate per bin.
+ *   binary    "VKTR" header followed by fixed size records (see
+ *             struct trace_record), produced with --compile.
+ *
+ * Timing is absolute (clock_nanosleep on CLOCK_REALTIME with TIMER_ABSTIME),
+ * so the same trace produces the same schedule on every repetition and
+ * errors do not accumulate.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_PATHS       32
+#define MAHIMAHI_MTU    1500
+#define DEFAULT_BIN_MS  100
+#define DEFAULT_LIMIT   1000
+#define TRACE_MAGIC     "VKTR"
+#define TRACE_VERSION   1
+
+struct trace_record {
+    uint32_t t_ms;
+    uint32_t rate_kbit;     /* 0 = blackhole */
+    uint32_t delay_us;
+    uint32_t jitter_us;
+    uint32_t loss_ppm;      /* parts per million */
+};
+
+struct trace_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t count;
+    uint32_t duration_ms;
+};
+
+struct path {
+    char dev[32];
+    char file[256];
+    int mahimahi;
+    uint32_t bin_ms;
+    uint32_t limit;
+
+    struct trace_record *records;
+    size_t count;
+    uint32_t duration_ms;
+
+    size_t next;            /* next record to apply */
+    uint64_t loop_base_ms;  /* offset of the current loop iteration */
+    struct trace_record applied;
+    int has_applied;
+};
+
+static struct path paths[MAX_PATHS];
+static int num_paths;
+static volatile sig_atomic_t stop_requested;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s [OPTIONS] -p DEV=TRACE[,mahimahi][,bin=MS][,limit=N] ...\n"
+        "Options:\n"
+        "  -p SPEC         path to drive (repeatable)\n"
+        "  -s START        start time: epoch ms, or +MS relative to now (default +0)\n"
+        "  -f FIFO         wait for a line on FIFO before starting (start sync)\n"
+        "  -d MS           stop after MS milliseconds (default: end of trace)\n"
+        "  -l              loop traces until stopped\n"
+        "  -S SEED         pass a fixed netem PRNG seed (deterministic loss)\n"
+        "  -L LOG          log applied changes with their actual timestamps\n"
+        "  -n              dry run: print tc commands instead of running them\n"
+        "  -c OUT          compile the trace of the first path to binary and exit\n",
+        prog);
+}
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int sleep_until_ms(uint64_t deadline_ms)
+{
+    struct timespec ts = {
+        .tv_sec = deadline_ms / 1000,
+        .tv_nsec = (deadline_ms % 1000) * 1000000,
+    };
+    int ret;
+
+    do {
+        ret = clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &ts, NULL);
+    } while (ret == EINTR && !stop_requested);
+    return ret;
+}
+
+static int append_record(struct path *p, size_t *capacity, const struct trace_record *rec)
+{
+    if (p->count == *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : 256;
+        struct trace_record *records = realloc(p->records, new_capacity * sizeof(*records));
+
+        if (!records)
+            return -1;
+        p->records = records;
+        *capacity = new_capacity;
+    }
+    p->records[p->count++] = *rec;
+    return 0;
+}
+
+static int load_text(struct path *p, FILE *fp)
+{
+    char line[256];
+    size_t capacity = 0;
+    unsigned lineno = 0;
+
+    while (fgets(line, sizeof(line), fp)) {
+        struct trace_record rec = { 0 };
+        double t_ms, rate_kbit, delay_ms, loss_pct = 0, jitter_ms = 0;
+        char *hash = strchr(line, '#');
+        int fields;
+
+        lineno++;
+        if (hash)
+            *hash = '\0';
+        fields = sscanf(line, "%lf %lf %lf %lf %lf", &t_ms, &rate_kbit, &delay_ms, &loss_pct, &jitter_ms);
+        if (fields <= 0)
+            continue;
+        if (fields < 3) {
+            fprintf(stderr, "%s:%u: expected 't_ms rate_kbit delay_ms [loss_pct [jitter_ms]]'\n", p->file, lineno);
+            return -1;
+        }
+        if (p->count && t_ms < p->records[p->count - 1].t_ms) {
+            fprintf(stderr, "%s:%u: timestamps must not decrease\n", p->file, lineno);
+            return -1;
+        }
+
+        rec.t_ms = (uint32_t)t_ms;
+        rec.rate_kbit = (uint32_t)rate_kbit;
+        rec.delay_us = (uint32_t)(delay_ms * 1000);
+        rec.jitter_us = (uint32_t)(jitter_ms * 1000);
+        rec.loss_ppm = (uint32_t)(loss_pct * 10000);
+        if (append_record(p, &capacity, &rec) < 0)
+            return -1;
+    }
+
+    if (p->count)
+        p->duration_ms = p->records[p->count - 1].t_ms + 1;
+    return 0;
+}
+
+/* Mahimahi: each line is a ms timestamp of one MTU-sized delivery opportunity */
+static int load_mahimahi(struct path *p, FILE *fp)
+{
+    char line[64];
+    size_t capacity = 0;
+    uint64_t bin_start = 0, opportunities = 0, last_ms = 0;
+
+    while (fgets(line, sizeof(line), fp)) {
+        char *end;
+        uint64_t t_ms = strtoull(line, &end, 10);
+
+        if (end == line)
+            continue;
+        if (t_ms < last_ms) {
+            fprintf(stderr, "%s: timestamps must not decrease\n", p->file);
+            return -1;
+        }
+        last_ms = t_ms;
+
+        while (t_ms >= bin_start + p->bin_ms) {
+            struct trace_record rec = {
+                .t_ms = (uint32_t)bin_start,
+                .rate_kbit = (uint32_t)(opportunities * MAHIMAHI_MTU * 8 / p->bin_ms),
+            };
+
+            if (append_record(p, &capacity, &rec) < 0)
+                return -1;
+            bin_start += p->bin_ms;
+            opportunities = 0;
+        }
+        opportunities++;
+    }
+
+    if (opportunities) {
+        struct trace_record rec = {
+            .t_ms = (uint32_t)bin_start,
+            .rate_kbit = (uint32_t)(opportunities * MAHIMAHI_MTU * 8 / p->bin_ms),
+        };
+
+        if (append_record(p, &capacity, &rec) < 0)
+            return -1;
+        bin_start += p->bin_ms;
+    }
+    p->duration_ms = (uint32_t)bin_start;
+    return 0;
+}
+
+static int load_binary(struct path *p, FILE *fp)
+{
+    struct trace_header hdr;
+
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || hdr.version != TRACE_VERSION) {
+        fprintf(stderr, "%s: unsupported binary trace\n", p->file);
+        return -1;
+    }
+    p->records = calloc(hdr.count ? hdr.count : 1, sizeof(*p->records));
+    if (!p->records)
+        return -1;
+    if (fread(p->records, sizeof(*p->records), hdr.count, fp) != hdr.count) {
+        fprintf(stderr, "%s: truncated binary trace\n", p->file);
+        return -1;
+    }
+    p->count = hdr.count;
+    p->duration_ms = hdr.duration_ms;
+    return 0;
+}
+
+static int load_trace(struct path *p)
+{
+    char magic[4] = { 0 };
+    FILE *fp = fopen(p->file, "rb");
+    int ret;
+
+    if (!fp) {
+        fprintf(stderr, "%s: %s\n", p->file, strerror(errno));
+        return -1;
+    }
+
+    if (fread(magic, 1, sizeof(magic), fp) == sizeof(magic) && !memcmp(magic, TRACE_MAGIC, 4)) {
+        rewind(fp);
+        ret = load_binary(p, fp);
+    } else {
+        rewind(fp);
+        ret = p->mahimahi ? load_mahimahi(p, fp) : load_text(p, fp);
+    }
+    fclose(fp);
+
+    if (ret == 0 && p->count == 0) {
+        fprintf(stderr, "%s: empty trace\n", p->file);
+        ret = -1;
+    }
+    return ret;
+}
+
+static int compile_trace(const struct path *p, const char *out)
+{
+    struct trace_header hdr = {
+        .magic = { 'V', 'K', 'T', 'R' },
+        .version = TRACE_VERSION,
+        .count = (uint32_t)p->count,
+        .duration_ms = p->duration_ms,
+    };
+    FILE *fp = fopen(out, "wb");
+
+    if (!fp) {
+        fprintf(stderr, "%s: %s\n", out, strerror(errno));
+        return -1;
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        fwrite(p->records, sizeof(*p->records), p->count, fp) != p->count) {
+        fclose(fp);
+        return -1;
+    }
+    return fclose(fp);
+}
+
+/* DEV=TRACE[,mahimahi][,bin=MS][,limit=N] */
+static int parse_path_spec(const char *spec, struct path *p)
+{
+    char buf[512];
+    char *eq, *opt, *save = NULL;
+
+    snprintf(buf, sizeof(buf), "%s", spec);
+    eq = strchr(buf, '=');
+    if (!eq)
+        return -1;
+    *eq = '\0';
+
+    memset(p, 0, sizeof(*p));
+    p->bin_ms = DEFAULT_BIN_MS;
+    p->limit = DEFAULT_LIMIT;
+    snprintf(p->dev, sizeof(p->dev), "%.31s", buf);
+
+    opt = strtok_r(eq + 1, ",", &save);
+    if (!opt)
+        return -1;
+    snprintf(p->file, sizeof(p->file), "%s", opt);
+
+    while ((opt = strtok_r(NULL, ",", &save))) {
+        if (!strcmp(opt, "mahimahi"))
+            p->mahimahi = 1;
+        else if (!strncmp(opt, "bin=", 4))
+            p->bin_ms = (uint32_t)atoi(opt + 4);
+        else if (!strncmp(opt, "limit=", 6))
+            p->limit = (uint32_t)atoi(opt + 6);
+        else
+            return -1;
+    }
+    return p->bin_ms ? 0 : -1;
+}
+
+static void emit_setup(FILE *tc, const struct path *p)
+{
+    fprintf(tc, "qdisc del dev %s root\n", p->dev);
+    fprintf(tc, "qdisc add dev %s root handle 1: htb default 1\n", p->dev);
+    fprintf(tc, "class add dev %s parent 1: classid 1:1 htb rate 10gbit ceil 10gbit\n", p->dev);
+    fprintf(tc, "qdisc add dev %s parent 1:1 handle 10: netem limit %u\n", p->dev, p->limit);
+}
+
+static void emit_record(FILE *tc, struct path *p, const struct trace_record *rec, long seed)
+{
+    const struct trace_record *prev = p->has_applied ? &p->applied : NULL;
+    uint32_t loss_ppm = rec->rate_kbit ? rec->loss_ppm : 1000000;
+
+    if (rec->rate_kbit && (!prev || prev->rate_kbit != rec->rate_kbit))
+        fprintf(tc, "class change dev %s parent 1: classid 1:1 htb rate %ukbit ceil %ukbit\n",
+                p->dev, rec->rate_kbit, rec->rate_kbit);
+
+    if (!prev || prev->delay_us != rec->delay_us || prev->jitter_us != rec->jitter_us ||
+        (prev->rate_kbit ? prev->loss_ppm : 1000000) != loss_ppm) {
+        fprintf(tc, "qdisc change dev %s parent 1:1 handle 10: netem limit %u delay %uus %uus loss %u.%04u%%",
+                p->dev, p->limit, rec->delay_us, rec->jitter_us, loss_ppm / 10000, loss_ppm % 10000);
+        if (seed >= 0)
+            fprintf(tc, " seed %ld", seed);
+        fputc('\n', tc);
+    }
+
+    p->applied = *rec;
+    p->has_applied = 1;
+}
+
+/* Absolute time (ms since start) of the next record of a path, or UINT64_MAX */
+static uint64_t next_event_ms(struct path *p, int loop)
+{
+    if (p->next >= p->count) {
+        if (!loop)
+            return UINT64_MAX;
+        p->next = 0;
+        p->loop_base_ms += p->duration_ms;
+    }
+    return p->loop_base_ms + p->records[p->next].t_ms;
+}
+
+int main(int argc, char **argv)
+{
+    const char *start_spec = "+0", *fifo = NULL, *log_path = NULL, *compile_out = NULL;
+    uint64_t duration_ms = 0, start_ms;
+    long seed = -1;
+    int loop = 0, dry_run = 0, opt, i;
+    FILE *tc, *log = NULL;
+
+    while ((opt = getopt(argc, argv, "p:s:f:d:lS:L:nc:h")) != -1) {
+        switch (opt) {
+        case 'p':
+            if (num_paths == MAX_PATHS || parse_path_spec(optarg, &paths[num_paths]) < 0) {
+                fprintf(stderr, "Invalid path spec: %s\n", optarg);
+                return 1;
+            }
+            num_paths++;
+            break;
+        case 's': start_spec = optarg; break;
+        case 'f': fifo = optarg; break;
+        case 'd': duration_ms = strtoull(optarg, NULL, 10); break;
+        case 'l': loop = 1; break;
+        case 'S': seed = strtol(optarg, NULL, 10); break;
+        case 'L': log_path = optarg; break;
+        case 'n': dry_run = 1; break;
+        case 'c': compile_out = optarg; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (num_paths == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    for (i = 0; i < num_paths; i++) {
+        if (load_trace(&paths[i]) < 0)
+            return 1;
+    }
+
+    if (compile_out)
+        return compile_trace(&paths[0], compile_out) < 0 ? 1 : 0;
+
+    if (loop && !duration_ms)
+        fprintf(stderr, "traceplay: looping until SIGINT/SIGTERM\n");
+
+    tc = dry_run ? stdout : popen("tc -force -batch -", "w");
+    if (!tc) {
+        perror("tc");
+        return 1;
+    }
+    if (log_path && !(log = fopen(log_path, "w"))) {
+        fprintf(stderr, "%s: %s\n", log_path, strerror(errno));
+        return 1;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    /* Build the qdisc trees before the start so the first change is cheap */
+    for (i = 0; i < num_paths; i++)
+        emit_setup(tc, &paths[i]);
+    fflush(tc);
+
+    if (fifo) {
+        char line[64];
+        FILE *fp = fopen(fifo, "r");
+
+        if (!fp) {
+            fprintf(stderr, "%s: %s\n", fifo, strerror(errno));
+            return 1;
+        }
+        if (!fgets(line, sizeof(line), fp))
+            line[0] = '\0';
+        fclose(fp);
+        /* The writer may pass the agreed start time, otherwise start now */
+        start_ms = strtoull(line, NULL, 10);
+        if (!start_ms)
+            start_ms = now_ms();
+    } else if (start_spec[0] == '+') {
+        start_ms = now_ms() + strtoull(start_spec + 1, NULL, 10);
+    } else {
+        start_ms = strtoull(start_spec, NULL, 10);
+    }
+
+    fprintf(stderr, "traceplay: start at %" PRIu64 " ms (epoch), %d path(s)\n", start_ms, num_paths);
+    if (log)
+        fprintf(log, "# start_ms %" PRIu64 "\n# offset_ms actual_ms dev rate_kbit delay_us jitter_us loss_ppm\n", start_ms);
+
+    while (!stop_requested) {
+        uint64_t event_ms = UINT64_MAX;
+        int batch = 0;
+
+        for (i = 0; i < num_paths; i++) {
+            uint64_t t = next_event_ms(&paths[i], loop);
+
+            if (t < event_ms)
+                event_ms = t;
+        }
+        if (event_ms == UINT64_MAX || (duration_ms && event_ms >= duration_ms))
+            break;
+
+        if (!dry_run && sleep_until_ms(start_ms + event_ms) != 0)
+            break;
+
+        /* Apply every record due at this instant, on all paths */
+        for (i = 0; i < num_paths; i++) {
+            struct path *p = &paths[i];
+
+            while (p->next < p->count && p->loop_base_ms + p->records[p->next].t_ms == event_ms) {
+                const struct trace_record *rec = &p->records[p->next++];
+
+                emit_record(tc, p, rec, seed);
+                batch++;
+                if (log)
+                    fprintf(log, "%" PRIu64 " %" PRId64 " %s %u %u %u %u\n", event_ms,
+                            (int64_t)(now_ms() - start_ms), p->dev, rec->rate_kbit,
+                            rec->delay_us, rec->jitter_us, rec->loss_ppm);
+            }
+        }
+        if (batch)
+            fflush(tc);
+    }
+
+    if (log)
+        fclose(log);
+    if (!dry_run)
+        return pclose(tc) == 0 ? 0 : 1;
+    return 0;
+}
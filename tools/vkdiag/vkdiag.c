@@ -0,0 +1,560 @@
+/*
+ * vkdiag - high-frequency MPTCP subflow telemetry from sock_diag
+ *
+ *   vkdiag [-i US] [-p PORT] [-n SAMPLES] [-d SECONDS] -o FILE   collect
+ *   vkdiag -r FILE                                              decode to CSV
+ *
+ * Runs in the guest (installed as /usr/local/bin/vkdiag by rootfs_config).
+ * Every interval it dumps, over one NETLINK_SOCK_DIAG socket:
+ *
+ *   TCP sockets    with INET_DIAG_INFO (struct tcp_info) and the MPTCP
+ *                  subflow ULP info (tokens, address ids), so subflows and
+ *                  plain TCP sockets are told apart
+ *   MPTCP sockets  with INET_DIAG_INFO (struct mptcp_info of the msk)
+ *
+ * restricted in the kernel (inet_diag bytecode) to the sockets with PORT as
+ * source or destination port, i.e. the test connection.
+ *
+ * Samples go into a preallocated ring (-n, the oldest are overwritten when
+ * it is full, nothing is written during the run) which is flushed to FILE
+ * when the duration elapses or on SIGINT/SIGTERM:
+ *
+ *   struct vkdiag_header
+ *   struct vkdiag_flow    [header.flows]    one per socket, index = sample.flow
+ *   struct vkdiag_sample  [header.samples]  oldest first
+ *
+ * All integers in host byte order (decode on a host of the same endianness).
+ */
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <linux/inet_diag.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/sock_diag.h>
+#include <linux/tcp.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef IPPROTO_MPTCP
+#define IPPROTO_MPTCP 262
+#endif
+
+/* uapi/linux/mptcp.h, not in every libc header set */
+#define VK_ULP_INFO_MPTCP           3   /* INET_ULP_INFO_MPTCP */
+#define VK_SUBFLOW_ATTR_TOKEN_REM   1
+#define VK_SUBFLOW_ATTR_TOKEN_LOC   2
+#define VK_SUBFLOW_ATTR_ID_REM      9
+#define VK_SUBFLOW_ATTR_ID_LOC      10
+#define VK_DIAG_REQ_PROTOCOL        3   /* INET_DIAG_REQ_PROTOCOL */
+
+#define VKDIAG_MAGIC        "VKD1"
+#define VKDIAG_VERSION      1
+#define DEFAULT_INTERVAL_US 5000
+#define DEFAULT_PORT        5201
+#define DEFAULT_SAMPLES     (1 << 18)
+#define MAX_FLOWS           4096
+#define RECV_BUF            (256 * 1024)
+
+enum { KIND_TCP = 1, KIND_SUBFLOW = 2, KIND_MSK = 3 };
+
+struct vkdiag_header {
+    char magic[4];
+    uint16_t version;
+    uint16_t sample_size;
+    uint32_t interval_us;
+    uint32_t flows;
+    uint64_t samples;
+    uint64_t overwritten;       /* samples lost to the ring wrapping */
+    uint64_t polls;
+    uint64_t late_polls;        /* polls that took longer than the interval */
+};
+
+struct vkdiag_flow {
+    uint64_t cookie;
+    uint8_t kind;
+    uint8_t family;
+    uint8_t id_loc, id_rem;     /* MPTCP address ids (subflows) */
+    uint16_t sport, dport;
+    uint32_t token_loc;         /* msk token, shared by its subflows */
+    uint32_t token_rem;
+    uint8_t saddr[16], daddr[16];
+};
+
+/* Subflow and plain TCP rows come from tcp_info; msk rows from mptcp_info
+ * (retrans: mptcpi_retransmits, bytes_*: data level, subflows) */
+struct vkdiag_sample {
+    uint64_t ts_ns;             /* CLOCK_REALTIME */
+    uint16_t flow;
+    uint8_t state, ca_state;
+    uint8_t subflows;
+    uint8_t pad[3];
+    uint32_t rtt_us, rttvar_us, min_rtt_us;
+    uint32_t snd_cwnd, snd_ssthresh;
+    uint32_t unacked, lost, retrans, total_retrans;
+    uint32_t notsent;
+    uint64_t bytes_sent, bytes_acked, bytes_retrans;
+    uint64_t delivery_rate, pacing_rate;    /* bytes/s */
+};
+
+/* struct mptcp_info as of Linux 6.6, older kernels fill a prefix */
+struct vk_mptcp_info {
+    uint8_t mptcpi_subflows;
+    uint8_t mptcpi_add_addr_signal;
+    uint8_t mptcpi_add_addr_accepted;
+    uint8_t mptcpi_subflows_max;
+    uint8_t mptcpi_add_addr_signal_max;
+    uint8_t mptcpi_add_addr_accepted_max;
+    uint32_t mptcpi_flags;
+    uint32_t mptcpi_token;
+    uint64_t mptcpi_write_seq;
+    uint64_t mptcpi_snd_una;
+    uint64_t mptcpi_rcv_nxt;
+    uint8_t mptcpi_local_addr_used;
+    uint8_t mptcpi_local_addr_max;
+    uint8_t mptcpi_csum_enabled;
+    uint32_t mptcpi_retransmits;
+    uint64_t mptcpi_bytes_retrans;
+    uint64_t mptcpi_bytes_sent;
+    uint64_t mptcpi_bytes_received;
+    uint64_t mptcpi_bytes_acked;
+};
+
+static struct vkdiag_header header;
+static struct vkdiag_flow flows[MAX_FLOWS];
+static struct vkdiag_sample *ring;
+static uint64_t ring_size, ring_head;
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+/* =========================================================================
+ * Collection
+ * ========================================================================= */
+
+static int flow_index(const struct inet_diag_msg *msg, int kind)
+{
+    uint64_t cookie = (uint64_t)msg->id.idiag_cookie[1] << 32 | msg->id.idiag_cookie[0];
+    uint32_t i;
+
+    /* Few sockets per run: linear, newest first */
+    for (i = header.flows; i-- > 0;)
+        if (flows[i].cookie == cookie && flows[i].kind == kind)
+            return i;
+    if (header.flows == MAX_FLOWS)
+        return -1;
+
+    i = header.flows++;
+    flows[i].cookie = cookie;
+    flows[i].kind = kind;
+    flows[i].family = msg->idiag_family;
+    flows[i].sport = ntohs(msg->id.idiag_sport);
+    flows[i].dport = ntohs(msg->id.idiag_dport);
+    memcpy(flows[i].saddr, msg->id.idiag_src, 16);
+    memcpy(flows[i].daddr, msg->id.idiag_dst, 16);
+    return i;
+}
+
+static struct vkdiag_sample *ring_next(void)
+{
+    struct vkdiag_sample *s = &ring[ring_head % ring_size];
+
+    if (ring_head >= ring_size)
+        header.overwritten++;
+    ring_head++;
+    memset(s, 0, sizeof(*s));
+    return s;
+}
+
+/* MPTCP subflow ULP info: tokens and address ids */
+static int parse_ulp(struct rtattr *ulp, struct vkdiag_flow *f)
+{
+    int len = RTA_PAYLOAD(ulp), found = 0;
+    struct rtattr *a;
+
+    for (a = RTA_DATA(ulp); RTA_OK(a, len); a = RTA_NEXT(a, len)) {
+        struct rtattr *m;
+        int mlen;
+
+        if (a->rta_type != VK_ULP_INFO_MPTCP)
+            continue;
+        found = 1;
+        mlen = RTA_PAYLOAD(a);
+        for (m = RTA_DATA(a); RTA_OK(m, mlen); m = RTA_NEXT(m, mlen)) {
+            switch (m->rta_type) {
+            case VK_SUBFLOW_ATTR_TOKEN_LOC: memcpy(&f->token_loc, RTA_DATA(m), 4); break;
+            case VK_SUBFLOW_ATTR_TOKEN_REM: memcpy(&f->token_rem, RTA_DATA(m), 4); break;
+            case VK_SUBFLOW_ATTR_ID_LOC:    f->id_loc = *(uint8_t *)RTA_DATA(m); break;
+            case VK_SUBFLOW_ATTR_ID_REM:    f->id_rem = *(uint8_t *)RTA_DATA(m); break;
+            }
+        }
+    }
+    return found;
+}
+
+static void handle_msg(const struct inet_diag_msg *msg, int len, int proto, uint64_t ts)
+{
+    struct rtattr *a, *info = NULL, *ulp = NULL;
+    struct vkdiag_sample *s;
+    int idx, alen = len - NLMSG_ALIGN(sizeof(*msg));
+
+    for (a = (struct rtattr *)(msg + 1); RTA_OK(a, alen); a = RTA_NEXT(a, alen)) {
+        if (a->rta_type == INET_DIAG_INFO)
+            info = a;
+        else if (a->rta_type == INET_DIAG_ULP_INFO)
+            ulp = a;
+    }
+    if (!info)
+        return;
+
+    if (proto == IPPROTO_MPTCP) {
+        struct vk_mptcp_info mi;
+
+        memset(&mi, 0, sizeof(mi));
+        memcpy(&mi, RTA_DATA(info), (size_t)RTA_PAYLOAD(info) < sizeof(mi) ? (size_t)RTA_PAYLOAD(info) : sizeof(mi));
+        if ((idx = flow_index(msg, KIND_MSK)) < 0)
+            return;
+        flows[idx].token_loc = mi.mptcpi_token;
+
+        s = ring_next();
+        s->subflows = mi.mptcpi_subflows;
+        s->retrans = mi.mptcpi_retransmits;
+        s->bytes_sent = mi.mptcpi_bytes_sent;
+        s->bytes_acked = mi.mptcpi_bytes_acked;
+        s->bytes_retrans = mi.mptcpi_bytes_retrans;
+    } else {
+        struct tcp_info ti;
+        struct vkdiag_flow tmp = { 0 };
+        int kind = ulp && parse_ulp(ulp, &tmp) ? KIND_SUBFLOW : KIND_TCP;
+
+        memset(&ti, 0, sizeof(ti));
+        memcpy(&ti, RTA_DATA(info), (size_t)RTA_PAYLOAD(info) < sizeof(ti) ? (size_t)RTA_PAYLOAD(info) : sizeof(ti));
+        if ((idx = flow_index(msg, kind)) < 0)
+            return;
+        if (kind == KIND_SUBFLOW) {
+            /* Tokens are only known once the handshake completed */
+            flows[idx].token_loc = tmp.token_loc;
+            flows[idx].token_rem = tmp.token_rem;
+            flows[idx].id_loc = tmp.id_loc;
+            flows[idx].id_rem = tmp.id_rem;
+        }
+
+        s = ring_next();
+        s->ca_state = ti.tcpi_ca_state;
+        s->rtt_us = ti.tcpi_rtt;
+        s->rttvar_us = ti.tcpi_rttvar;
+        s->min_rtt_us = ti.tcpi_min_rtt;
+        s->snd_cwnd = ti.tcpi_snd_cwnd;
+        s->snd_ssthresh = ti.tcpi_snd_ssthresh;
+        s->unacked = ti.tcpi_unacked;
+        s->lost = ti.tcpi_lost;
+        s->retrans = ti.tcpi_retrans;
+        s->total_retrans = ti.tcpi_total_retrans;
+        s->notsent = ti.tcpi_notsent_bytes;
+        s->bytes_sent = ti.tcpi_bytes_sent;
+        s->bytes_acked = ti.tcpi_bytes_acked;
+        s->bytes_retrans = ti.tcpi_bytes_retrans;
+        s->delivery_rate = ti.tcpi_delivery_rate;
+        s->pacing_rate = ti.tcpi_pacing_rate;
+    }
+    s->ts_ns = ts;
+    s->flow = idx;
+    s->state = msg->idiag_state;
+}
+
+struct diag_req {
+    struct nlmsghdr nlh;
+    struct inet_diag_req_v2 r;
+    struct rtattr bc_attr;
+    struct inet_diag_bc_op bc[5];
+    struct rtattr proto_attr;
+    uint32_t proto;
+};
+
+/* sport == PORT || dport == PORT (iproute2 ss bytecode layout) */
+static void build_req(struct diag_req *req, int family, int proto, uint16_t port)
+{
+    memset(req, 0, sizeof(*req));
+    req->nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    req->nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req->r.sdiag_family = family;
+    req->r.sdiag_protocol = proto == IPPROTO_MPTCP ? 0 : proto;
+    req->r.idiag_ext = 1 << (INET_DIAG_INFO - 1);
+    /* Every state but LISTEN, TIME_WAIT and CLOSE */
+    req->r.idiag_states = 0xfff & ~(1 << 10 | 1 << 6 | 1 << 7);
+
+    req->bc_attr.rta_type = INET_DIAG_REQ_BYTECODE;
+    req->bc_attr.rta_len = RTA_LENGTH(sizeof(req->bc));
+    req->bc[0] = (struct inet_diag_bc_op){ INET_DIAG_BC_S_EQ, 8, 12 };
+    req->bc[1] = (struct inet_diag_bc_op){ 0, 0, port };
+    req->bc[2] = (struct inet_diag_bc_op){ INET_DIAG_BC_JMP, 4, 12 };
+    req->bc[3] = (struct inet_diag_bc_op){ INET_DIAG_BC_D_EQ, 8, 12 };
+    req->bc[4] = (struct inet_diag_bc_op){ 0, 0, port };
+    req->nlh.nlmsg_len = offsetof(struct diag_req, proto_attr);
+
+    if (proto == IPPROTO_MPTCP) {
+        req->proto_attr.rta_type = VK_DIAG_REQ_PROTOCOL;
+        req->proto_attr.rta_len = RTA_LENGTH(sizeof(req->proto));
+        req->proto = IPPROTO_MPTCP;
+        req->nlh.nlmsg_len = sizeof(*req);
+    }
+}
+
+static int dump(int fd, struct diag_req *req, int proto, uint64_t ts, char *buf)
+{
+    ssize_t n;
+
+    if (send(fd, req, req->nlh.nlmsg_len, 0) < 0)
+        return -1;
+    for (;;) {
+        struct nlmsghdr *h;
+
+        n = recv(fd, buf, RECV_BUF, 0);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        for (h = (struct nlmsghdr *)buf; NLMSG_OK(h, n); h = NLMSG_NEXT(h, n)) {
+            if (h->nlmsg_type == NLMSG_DONE)
+                return 0;
+            if (h->nlmsg_type == NLMSG_ERROR)
+                return -1;
+            handle_msg(NLMSG_DATA(h), h->nlmsg_len - NLMSG_HDRLEN, proto, ts);
+        }
+    }
+}
+
+static uint64_t now_ns(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int flush(const char *path)
+{
+    uint64_t first = ring_head > ring_size ? ring_head - ring_size : 0, i;
+    FILE *f = fopen(path, "wb");
+
+    if (!f) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    header.samples = ring_head - first;
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(flows, sizeof(flows[0]), header.flows, f);
+    for (i = first; i < ring_head; i++)
+        fwrite(&ring[i % ring_size], sizeof(*ring), 1, f);
+    if (fclose(f) != 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static int collect(const char *path, uint32_t interval_us, uint16_t port, double duration)
+{
+    static const int families[] = { AF_INET, AF_INET6 };
+    static const int protos[] = { IPPROTO_TCP, IPPROTO_MPTCP };
+    struct diag_req reqs[4];
+    struct timespec next;
+    uint64_t end = 0;
+    int fd, i, nreq = 0, mptcp_ok = 1;
+    char *buf = malloc(RECV_BUF);
+    struct sigaction sa = { .sa_handler = on_signal };
+
+    fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+    if (fd < 0 || !buf) {
+        fprintf(stderr, "sock_diag: %s\n", strerror(errno));
+        return 1;
+    }
+
+    /* Prefaulted so the polling loop never takes a page fault */
+    ring = mmap(NULL, ring_size * sizeof(*ring), PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (ring == MAP_FAILED) {
+        fprintf(stderr, "Cannot allocate %" PRIu64 " samples\n", ring_size);
+        return 1;
+    }
+    mlock(ring, ring_size * sizeof(*ring));
+
+    for (i = 0; i < 4; i++)
+        build_req(&reqs[nreq++], families[i % 2], protos[i / 2], port);
+
+    memcpy(header.magic, VKDIAG_MAGIC, 4);
+    header.version = VKDIAG_VERSION;
+    header.sample_size = sizeof(struct vkdiag_sample);
+    header.interval_us = interval_us;
+
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    if (duration > 0)
+        end = now_ns(CLOCK_MONOTONIC) + (uint64_t)(duration * 1e9);
+
+    while (!stop && (!end || now_ns(CLOCK_MONOTONIC) < end)) {
+        uint64_t ts = now_ns(CLOCK_REALTIME);
+
+        for (i = 0; i < nreq; i++) {
+            int proto = protos[i / 2];
+
+            if (proto == IPPROTO_MPTCP && !mptcp_ok)
+                continue;
+            if (dump(fd, &reqs[i], proto, ts, buf) < 0 && proto == IPPROTO_MPTCP) {
+                /* Kernel without MPTCP diag: subflows only */
+                fprintf(stderr, "MPTCP sock_diag not available, collecting subflows only\n");
+                mptcp_ok = 0;
+            }
+        }
+        header.polls++;
+
+        next.tv_nsec += interval_us * 1000L;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        if (now_ns(CLOCK_MONOTONIC) > next.tv_sec * 1000000000ull + next.tv_nsec) {
+            /* Overran: skip ahead instead of bursting to catch up */
+            header.late_polls++;
+            clock_gettime(CLOCK_MONOTONIC, &next);
+            continue;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+
+    close(fd);
+    if (flush(path) < 0)
+        return 1;
+    fprintf(stderr, "vkdiag: %" PRIu64 " polls (%" PRIu64 " late), %" PRIu64 " samples, %" PRIu64
+            " overwritten, %u sockets -> %s\n", header.polls, header.late_polls,
+            header.samples, header.overwritten, header.flows, path);
+    return 0;
+}
+
+/* =========================================================================
+ * Decoding
+ * ========================================================================= */
+
+static const char *kind_name(int kind)
+{
+    switch (kind) {
+    case KIND_SUBFLOW: return "subflow";
+    case KIND_MSK:     return "msk";
+    default:           return "tcp";
+    }
+}
+
+static int decode(const char *path)
+{
+    struct vkdiag_flow *fl;
+    struct vkdiag_sample s;
+    FILE *f = fopen(path, "rb");
+    uint64_t i;
+
+    if (!f) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, VKDIAG_MAGIC, 4) ||
+        header.sample_size != sizeof(s) || header.flows > MAX_FLOWS) {
+        fprintf(stderr, "%s: not a vkdiag v%d file\n", path, VKDIAG_VERSION);
+        fclose(f);
+        return 1;
+    }
+    fl = flows;
+    if (fread(fl, sizeof(*fl), header.flows, f) != header.flows) {
+        fprintf(stderr, "%s: truncated\n", path);
+        fclose(f);
+        return 1;
+    }
+    if (header.overwritten)
+        fprintf(stderr, "%s: %" PRIu64 " oldest samples were overwritten (ring too small)\n",
+                path, header.overwritten);
+
+    printf("t_s,kind,token,id_loc,id_rem,src,sport,dst,dport,state,ca_state,rtt_ms,rttvar_ms,min_rtt_ms,"
+           "cwnd,ssthresh,unacked,lost,retrans,total_retrans,notsent,bytes_sent,bytes_acked,bytes_retrans,"
+           "delivery_mbps,pacing_mbps,subflows\n");
+    for (i = 0; i < header.samples && fread(&s, sizeof(s), 1, f) == 1; i++) {
+        const struct vkdiag_flow *x;
+        char src[INET6_ADDRSTRLEN], dst[INET6_ADDRSTRLEN];
+
+        if (s.flow >= header.flows)
+            continue;
+        x = &fl[s.flow];
+        inet_ntop(x->family, x->saddr, src, sizeof(src));
+        inet_ntop(x->family, x->daddr, dst, sizeof(dst));
+        printf("%.6f,%s,%08x,%u,%u,%s,%u,%s,%u,%u,%u,%.3f,%.3f,%.3f,%u,%u,%u,%u,%u,%u,%u,"
+               "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.3f,%.3f,%u\n",
+               s.ts_ns / 1e9, kind_name(x->kind), x->token_loc, x->id_loc, x->id_rem,
+               src, x->sport, dst, x->dport, s.state, s.ca_state,
+               s.rtt_us / 1e3, s.rttvar_us / 1e3, s.min_rtt_us / 1e3,
+               s.snd_cwnd, s.snd_ssthresh, s.unacked, s.lost, s.retrans, s.total_retrans, s.notsent,
+               s.bytes_sent, s.bytes_acked, s.bytes_retrans,
+               s.delivery_rate * 8 / 1e6, s.pacing_rate * 8 / 1e6, s.subflows);
+    }
+    fclose(f);
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s [OPTIONS] -o FILE    collect until SIGINT/SIGTERM or -d\n"
+        "       %s -r FILE              decode FILE to CSV\n"
+        "Options:\n"
+        "  -i US           poll interval (default %d us)\n"
+        "  -p PORT         sockets with this source or destination port (default %d)\n"
+        "  -n SAMPLES      ring size (default %d, %zu bytes each)\n"
+        "  -d SECONDS      stop after SECONDS\n",
+        prog, prog, DEFAULT_INTERVAL_US, DEFAULT_PORT, DEFAULT_SAMPLES, sizeof(struct vkdiag_sample));
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t interval_us = DEFAULT_INTERVAL_US;
+    uint16_t port = DEFAULT_PORT;
+    double duration = 0;
+    const char *out = NULL, *in = NULL;
+    int opt;
+
+    ring_size = DEFAULT_SAMPLES;
+    while ((opt = getopt(argc, argv, "i:p:n:d:o:r:h")) != -1) {
+        switch (opt) {
+        case 'i': interval_us = strtoul(optarg, NULL, 10); break;
+        case 'p': port = strtoul(optarg, NULL, 10); break;
+        case 'n': ring_size = strtoull(optarg, NULL, 10); break;
+        case 'd': duration = atof(optarg); break;
+        case 'o': out = optarg; break;
+        case 'r': in = optarg; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (in)
+        return decode(in);
+    if (!out || interval_us == 0 || ring_size == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    return collect(out, interval_us, port, duration);
+}
@@ -0,0 +1,1687 @@
+/*
+ * vkload - native MPTCP load generator
+ *
+ *   vkload -s [-p PORT] [-T THREADS] [-N]                              server
+ *   vkload -c HOST [-p PORT] [-P CONNS] [-T THREADS] [-t SECONDS]      client
+ *          [-i SECONDS] [-m bulk|rr|fct] [-R] [-z copy|zerocopy|splice]
+ *          [-l LEN] [-r LEN] [-w BYTES] [-N] [-J]
+ *          [-a RATE] [-S SIZES] [-B OBJECTS] [-K PARALLEL]            (-m fct)
+ *          [-g USEC] [-b ADDR]
+ *
+ * Runs in the guest (installed as /usr/local/bin/vkload by rootfs_config,
+ * driven by test_conn/load.sh). Opens IPPROTO_MPTCP sockets directly, no
+ * mptcpize/LD_PRELOAD (-N: plain TCP, for comparisons), and spreads CONNS
+ * non-blocking connections over THREADS workers, each with its own epoll
+ * loop (edge-triggered).
+ *
+ * Patterns (-m):
+ *   bulk   the client sends as fast as the sockets accept (-R: the server
+ *          sends, the client receives); -l is the size of each send
+ *   rr     request/response: -l bytes to the server, -r bytes back, the
+ *          next request once the response is complete (one outstanding
+ *          transaction per connection); latency percentiles per
+ *          transaction. With -g the requests of a connection start at
+ *          most every USEC (paced probes, e.g. of the queueing behind a
+ *          bulk transfer, test_conn/latency.sh); the JSON intervals then
+ *          also carry their own latency percentiles
+ *   fct    short flows, open loop: pages arrive as a Poisson process at -a
+ *          per second, each of -B objects (1: single flows) fetched over new
+ *          connections, at most -K at a time per page and -P in total (the
+ *          rest waits, "deferred"). An object is a -l byte request and a
+ *          response of a size drawn from -S: "http" (HTTP-like mix, the
+ *          default) or SIZE[:WEIGHT],... with K/M suffixes. Flow completion
+ *          time runs from connect() to the last response byte, percentiles
+ *          overall and per size; page completion time from the arrival to
+ *          the last object. Arrivals and sizes use a fixed seed, so every
+ *          scheduler sees the same sequence
+ *
+ * Send modes (-z, passed to the server in the hello), all from one
+ * constant buffer:
+ *   copy      send()
+ *   zerocopy  send(MSG_ZEROCOPY) with SO_ZEROCOPY, completions reaped from
+ *             the error queue; falls back to copy (reported) where the
+ *             socket does not support it (MPTCP up to at least Linux 6.6)
+ *   splice    vmsplice() of the buffer into a per-connection pipe, then
+ *             splice() to the socket
+ *
+ * Each connection starts with a 16 byte hello carrying the pattern, so the
+ * server needs no options. For the bulk upload the client half-closes at
+ * the end and the server answers with the bytes it received and the time
+ * it took, i.e. the receiver goodput (sender bytes only count what the
+ * socket buffers accepted).
+ *
+ * Interval lines on stdout, -J prints one JSON object at the end instead.
+ * cpu_percent (process user+system over wall time) shows how close the
+ * generator itself is to being the bottleneck.
+ */
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <linux/errqueue.h>
+#include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef IPPROTO_MPTCP
+#define IPPROTO_MPTCP 262
+#endif
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+
+#define VKLOAD_MAGIC        0x564b4c31      /* "VKL1" */
+#define DEFAULT_PORT        5301
+#define DEFAULT_BULK_LEN    (128 * 1024)
+#define RECV_BUF            (256 * 1024)
+#define PIPE_SIZE           (1024 * 1024)
+#define MAX_EVENTS          256
+#define MAX_INTERVALS       3600
+#define REPORT_TIMEOUT_MS   5000
+#define MAX_SIZES           16
+#define DEFAULT_FCT_REQ     300             /* bytes, a typical GET */
+#define DEFAULT_FCT_FLOWS   256
+#define HTTP_SIZES          "1K:25,4K:20,16K:20,64K:15,256K:12,1M:6,4M:2"
+
+/* log-linear latency histogram: 32 sub-buckets per power of two (~3%) */
+#define HIST_SUB_BITS       5
+#define HIST_SUB            (1 << HIST_SUB_BITS)
+#define HIST_SIZE           ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+enum { MODE_BULK, MODE_RR, MODE_FCT };
+enum { SEND_COPY, SEND_ZEROCOPY, SEND_SPLICE };
+enum { ST_CONNECTING, ST_HELLO, ST_RUN, ST_REPORT, ST_DONE };
+
+static const char *mode_names[] = { "bulk", "rr", "fct" };
+static const char *send_names[] = { "copy", "zerocopy", "splice" };
+
+/* On the wire, integers in network byte order */
+struct vkload_hello {
+    uint32_t magic;
+    uint8_t mode;
+    uint8_t reverse;
+    uint8_t send_mode;
+    uint8_t pad;
+    uint32_t req_len;
+    uint32_t resp_len;
+};
+
+struct vkload_report {
+    uint64_t bytes;
+    uint64_t duration_ns;
+};
+
+/* -m fct: objects fetched together, complete when the last one is */
+struct page {
+    uint64_t arrival_ns;
+    int to_start;               /* objects not started yet */
+    int active;
+    int failed;
+    int queued;                 /* waiting for a free flow slot */
+    struct page *next;
+};
+
+struct conn {
+    int fd;
+    int pipe[2];                /* splice mode */
+    size_t pipe_len;            /* bytes waiting in the pipe */
+    int state;
+    int send_mode;
+    int zerocopy;               /* SO_ZEROCOPY accepted */
+    uint8_t mode, reverse;
+    uint32_t req_len, resp_len;
+    uint64_t to_send;           /* rr: left in the current message */
+    uint64_t to_recv;
+    uint64_t start_ns;          /* rr: request start; report: first byte */
+    uint64_t last_ns;
+    uint64_t rx_bytes;
+    union {
+        struct vkload_hello hello;
+        struct vkload_report report;
+        uint8_t raw[16];
+    } msg;
+    size_t msg_len;
+    struct page *page;          /* -m fct */
+    int size_class;
+    int slot;
+    uint64_t next_ns;           /* -g: next request not before */
+    int waiting;
+};
+
+struct worker {
+    pthread_t thread;
+    int id;
+    int epfd;
+    int listen_fd;              /* server */
+    struct conn *conns;         /* client */
+    int nconns;
+    uint64_t tx_bytes;          /* updated by the worker, read by main */
+    uint64_t rx_bytes;
+    uint64_t transactions;
+    uint64_t zc_completions, zc_copied;
+    uint64_t report_bytes, report_ns;
+    int reports;
+    int errors;
+    int zerocopy_fallback;
+    uint64_t hist[HIST_SIZE];
+    uint64_t lat_max;
+
+    /* -m fct, -g */
+    int timerfd;
+    uint64_t timer_ns;          /* -g: armed for, 0 if not */
+    uint64_t next_arrival;
+    uint64_t rng;
+    struct conn **flows;        /* in flight */
+    int nflows, max_flows;
+    struct page *blocked, *blocked_tail;
+    uint64_t *fct_hist;         /* HIST_SIZE per size class, then the pages */
+    uint64_t fct_count[MAX_SIZES];
+    uint64_t fct_max_ns[MAX_SIZES + 1]; /* per size class, then the pages */
+    uint64_t fct_sum_ns;
+    uint64_t flows_started, flows_failed, flows_unfinished;
+    uint64_t pages, pages_completed, pages_failed, pages_deferred;
+} __attribute__((aligned(64)));
+
+static struct {
+    int server;
+    const char *host;
+    uint16_t port;
+    int conns, threads;
+    double duration, interval;
+    int mode, reverse, send_mode;
+    uint32_t len, resp_len;
+    int bufsize;
+    int protocol;
+    int json;
+    double rate;
+    uint32_t sizes[MAX_SIZES];
+    double weights[MAX_SIZES], weight_total;
+    int nsizes;
+    int bundle, parallel;
+    uint64_t gap_ns;
+    struct sockaddr_storage bind_addr;
+    socklen_t bind_len;
+} opt = {
+    .port = DEFAULT_PORT, .conns = 1, .threads = 1, .duration = 10,
+    .interval = 1, .mode = MODE_BULK, .send_mode = SEND_COPY,
+    .protocol = IPPROTO_MPTCP, .rate = 10, .bundle = 1, .parallel = 6,
+};
+
+static struct addrinfo *target;
+static char *send_buf;
+static size_t send_buf_len;
+static volatile int stop;
+static int sndbuf_actual, rcvbuf_actual;
+static uint64_t start_epoch_ns;     /* wall clock at the start of the intervals */
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+static void counter_add(uint64_t *counter, uint64_t n)
+{
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+static uint64_t counter_get(uint64_t *counter)
+{
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static unsigned int hist_index(uint64_t v)
+{
+    unsigned int msb;
+
+    if (v < HIST_SUB)
+        return v;
+    msb = 63 - __builtin_clzll(v);
+    return (msb - HIST_SUB_BITS + 1) * HIST_SUB + ((v >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+/* Midpoint of the bucket */
+static uint64_t hist_value(unsigned int i)
+{
+    unsigned int shift;
+
+    if (i < HIST_SUB)
+        return i;
+    shift = i / HIST_SUB - 1;
+    return ((uint64_t)(HIST_SUB + i % HIST_SUB) << shift) + ((1ull << shift) >> 1);
+}
+
+/* Bucket midpoints can exceed the largest value recorded: clamped to max */
+static uint64_t hist_percentile(const uint64_t *hist, uint64_t total, double p, uint64_t max)
+{
+    uint64_t acc = 0, rank = (uint64_t)(p * total);
+    unsigned int i;
+
+    for (i = 0; i < HIST_SIZE; i++) {
+        acc += hist[i];
+        if (acc > rank)
+            return hist_value(i) < max ? hist_value(i) : max;
+    }
+    return 0;
+}
+
+/* ---------------------------------------------------------------------------
+ * Sockets
+ * ------------------------------------------------------------------------- */
+
+static void set_nonblock(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+static void conn_setup(struct conn *c)
+{
+    set_nonblock(c->fd);
+    if (opt.bufsize) {
+        setsockopt(c->fd, SOL_SOCKET, SO_SNDBUF, &opt.bufsize, sizeof(opt.bufsize));
+        setsockopt(c->fd, SOL_SOCKET, SO_RCVBUF, &opt.bufsize, sizeof(opt.bufsize));
+    }
+    c->pipe[0] = c->pipe[1] = -1;
+}
+
+/* The server takes the send mode of the client from the hello */
+static void conn_set_send_mode(struct worker *w, struct conn *c, int send_mode)
+{
+    int one = 1;
+
+    /* best effort, older MPTCP kernels reject it */
+    if (c->mode == MODE_RR)
+        setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    c->send_mode = send_mode;
+    if (send_mode == SEND_ZEROCOPY) {
+        c->zerocopy = setsockopt(c->fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+        if (!c->zerocopy)
+            w->zerocopy_fallback = 1;
+    } else if (send_mode == SEND_SPLICE) {
+        if (pipe2(c->pipe, O_NONBLOCK) < 0) {
+            perror("pipe2");
+            exit(1);
+        }
+        fcntl(c->pipe[1], F_SETPIPE_SZ, PIPE_SIZE);
+    }
+}
+
+static void conn_close(struct conn *c)
+{
+    if (c->fd >= 0)
+        close(c->fd);
+    if (c->pipe[0] >= 0) {
+        close(c->pipe[0]);
+        close(c->pipe[1]);
+    }
+    c->fd = c->pipe[0] = c->pipe[1] = -1;
+    c->state = ST_DONE;
+}
+
+/* Completions of MSG_ZEROCOPY sends, the buffer is constant so they are only
+ * counted (and reaped, or the socket runs out of optmem) */
+static void reap_zerocopy(struct worker *w, struct conn *c)
+{
+    char control[128];
+    struct msghdr msg;
+    struct cmsghdr *cm;
+    struct sock_extended_err *serr;
+
+    for (;;) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(c->fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+            return;
+        for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            serr = (struct sock_extended_err *)CMSG_DATA(cm);
+            if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                continue;
+            /* ee_info..ee_data is the range of completed sends */
+            w->zc_completions += serr->ee_data - serr->ee_info + 1;
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+                w->zc_copied += serr->ee_data - serr->ee_info + 1;
+        }
+    }
+}
+
+/* One send of up to len bytes in the configured mode; >0 bytes handed to the
+ * socket, 0 would block, -1 error */
+static ssize_t conn_send(struct worker *w, struct conn *c, size_t len)
+{
+    struct iovec iov;
+    ssize_t n;
+
+    if (len > send_buf_len)
+        len = send_buf_len;
+
+    if (c->send_mode == SEND_SPLICE) {
+        if (c->pipe_len == 0) {
+            iov.iov_base = send_buf;
+            iov.iov_len = len;
+            n = vmsplice(c->pipe[1], &iov, 1, 0);
+            if (n < 0)
+                return errno == EAGAIN ? 0 : -1;
+            c->pipe_len = n;
+        }
+        n = splice(c->pipe[0], NULL, c->fd, NULL, c->pipe_len,
+                   SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE);
+        if (n > 0)
+            c->pipe_len -= n;
+    } else {
+        n = send(c->fd, send_buf, len, MSG_NOSIGNAL | MSG_DONTWAIT |
+                 (c->zerocopy ? MSG_ZEROCOPY : 0));
+        /* optmem full of pending notifications */
+        if (n < 0 && errno == ENOBUFS && c->zerocopy) {
+            reap_zerocopy(w, c);
+            return 0;
+        }
+    }
+
+    if (n < 0)
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    counter_add(&w->tx_bytes, n);
+    return n;
+}
+
+/* Bytes in the splice pipe belong to the message being sent */
+static size_t conn_unsent(struct conn *c)
+{
+    return c->pipe_len;
+}
+
+/* ---------------------------------------------------------------------------
+ * Client
+ * ------------------------------------------------------------------------- */
+
+static void rr_start(struct conn *c)
+{
+    c->to_send = c->req_len;
+    c->to_recv = 0;
+    c->start_ns = now_ns();
+}
+
+static void timer_arm(struct worker *w, uint64_t ns)
+{
+    struct itimerspec its = { 0 };
+
+    its.it_value.tv_sec = ns / 1000000000ull;
+    its.it_value.tv_nsec = ns % 1000000000ull;
+    timerfd_settime(w->timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/* -g: the next request of the connection waits for the worker timer */
+static void rr_wait(struct worker *w, struct conn *c, uint64_t when)
+{
+    c->next_ns = when;
+    c->waiting = 1;
+    if (!w->timer_ns || when < w->timer_ns) {
+        w->timer_ns = when;
+        timer_arm(w, when);
+    }
+}
+
+/* Sends what the connection currently has to send, until EAGAIN */
+static int client_send(struct worker *w, struct conn *c)
+{
+    ssize_t n;
+
+    if (c->state == ST_HELLO) {
+        n = send(c->fd, c->msg.raw + c->msg_len, sizeof(c->msg.hello) - c->msg_len, MSG_NOSIGNAL);
+        if (n < 0)
+            return errno == EAGAIN ? 0 : -1;
+        c->msg_len += n;
+        if (c->msg_len < sizeof(c->msg.hello))
+            return 0;
+        c->state = ST_RUN;
+        c->msg_len = 0;
+        if (opt.mode == MODE_RR)
+            rr_start(c);
+        else if (opt.mode == MODE_FCT)
+            c->to_send = c->req_len;
+    }
+    if (c->state != ST_RUN)
+        return 0;
+
+    if (opt.mode == MODE_BULK) {
+        if (opt.reverse)
+            return 0;
+        while (!stop) {
+            n = conn_send(w, c, opt.len);
+            if (n <= 0)
+                return n;
+        }
+        return 0;
+    }
+
+    while (c->to_send > 0) {
+        n = conn_send(w, c, c->to_send);
+        if (n <= 0)
+            return n;
+        c->to_send -= n;
+    }
+    if (c->to_send == 0 && c->to_recv == 0 && !conn_unsent(c))
+        c->to_recv = c->resp_len;
+    return 0;
+}
+
+static void flow_end(struct worker *w, struct conn *c, int ok);
+
+/* <0 error, 1 the connection was a finished flow and is gone */
+static int client_recv(struct worker *w, struct conn *c, char *buf)
+{
+    uint64_t lat;
+    ssize_t n;
+
+    for (;;) {
+        if (c->state == ST_REPORT) {
+            n = recv(c->fd, c->msg.raw + c->msg_len, sizeof(c->msg.report) - c->msg_len, 0);
+            if (n <= 0)
+                return n == 0 || errno != EAGAIN ? -1 : 0;
+            c->msg_len += n;
+            if (c->msg_len == sizeof(c->msg.report)) {
+                w->report_bytes += be64toh(c->msg.report.bytes);
+                if (be64toh(c->msg.report.duration_ns) > w->report_ns)
+                    w->report_ns = be64toh(c->msg.report.duration_ns);
+                w->reports++;
+                conn_close(c);
+                return 0;
+            }
+            continue;
+        }
+
+        n = recv(c->fd, buf, RECV_BUF, 0);
+        if (n == 0)
+            return -1;
+        if (n < 0)
+            return errno == EAGAIN ? 0 : -1;
+        counter_add(&w->rx_bytes, n);
+
+        if (opt.mode == MODE_BULK || c->to_recv == 0)
+            continue;
+        c->to_recv = (uint64_t)n >= c->to_recv ? 0 : c->to_recv - n;
+        if (c->to_recv > 0)
+            continue;
+
+        if (opt.mode == MODE_FCT) {
+            flow_end(w, c, 1);
+            return 1;
+        }
+        lat = now_ns() - c->start_ns;
+        w->hist[hist_index(lat)]++;
+        if (lat > w->lat_max)
+            w->lat_max = lat;
+        counter_add(&w->transactions, 1);
+        if (stop)
+            return 0;
+        if (opt.gap_ns > lat) {
+            rr_wait(w, c, c->start_ns + opt.gap_ns);
+            continue;
+        }
+        rr_start(c);
+        if (client_send(w, c) < 0)
+            return -1;
+    }
+}
+
+static void client_event(struct worker *w, struct conn *c, uint32_t events, char *buf)
+{
+    int err = 0;
+    socklen_t len = sizeof(err);
+
+    if (c->state == ST_CONNECTING) {
+        if (!(events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+            return;
+        getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err && opt.mode == MODE_FCT) {
+            flow_end(w, c, 0);
+            return;
+        }
+        if (err) {
+            fprintf(stderr, "connect: %s\n", strerror(err));
+            w->errors++;
+            conn_close(c);
+            return;
+        }
+        c->state = ST_HELLO;
+        if (w->id == 0 && !sndbuf_actual) {
+            len = sizeof(sndbuf_actual);
+            getsockopt(c->fd, SOL_SOCKET, SO_SNDBUF, &sndbuf_actual, &len);
+            len = sizeof(rcvbuf_actual);
+            getsockopt(c->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf_actual, &len);
+        }
+        events |= EPOLLOUT;
+    }
+
+    if ((events & EPOLLERR) && c->zerocopy)
+        reap_zerocopy(w, c);
+    if (events & EPOLLIN) {
+        err = client_recv(w, c, buf);
+        if (err < 0)
+            goto fail;
+        if (err > 0)
+            return;
+    }
+    if (c->state != ST_DONE && (events & EPOLLOUT) && client_send(w, c) < 0)
+        goto fail;
+    return;
+
+fail:
+    if (opt.mode == MODE_FCT) {
+        flow_end(w, c, 0);
+        return;
+    }
+    if (!stop || c->state == ST_REPORT) {
+        w->errors++;
+        fprintf(stderr, "connection %d.%d: %s\n", w->id, (int)(c - w->conns),
+                errno ? strerror(errno) : "closed by the server");
+    }
+    conn_close(c);
+}
+
+static int client_connect(struct worker *w, struct conn *c)
+{
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT | EPOLLET, .data.ptr = c };
+
+    c->fd = socket(target->ai_family, SOCK_STREAM, opt.protocol);
+    if (c->fd < 0) {
+        perror(opt.protocol == IPPROTO_MPTCP ? "socket(IPPROTO_MPTCP)" : "socket");
+        return -1;
+    }
+    conn_setup(c);
+
+    /* a short flow is one request/response transaction for the server */
+    c->mode = opt.mode == MODE_FCT ? MODE_RR : opt.mode;
+    if (opt.mode != MODE_FCT) {
+        c->req_len = opt.len;
+        c->resp_len = opt.resp_len;
+    }
+    /* nothing to send in a download */
+    conn_set_send_mode(w, c, opt.mode == MODE_BULK && opt.reverse ? SEND_COPY : opt.send_mode);
+    c->msg.hello.magic = htonl(VKLOAD_MAGIC);
+    c->msg.hello.mode = c->mode;
+    c->msg.hello.reverse = opt.reverse;
+    c->msg.hello.send_mode = opt.send_mode;
+    c->msg.hello.req_len = htonl(c->req_len);
+    c->msg.hello.resp_len = htonl(c->resp_len);
+    c->msg_len = 0;
+    c->state = ST_CONNECTING;
+
+    if (opt.bind_len && bind(c->fd, (struct sockaddr *)&opt.bind_addr, opt.bind_len) < 0) {
+        perror("bind");
+        return -1;
+    }
+    if (connect(c->fd, target->ai_addr, target->ai_addrlen) < 0 && errno != EINPROGRESS) {
+        perror("connect");
+        return -1;
+    }
+    return epoll_ctl(w->epfd, EPOLL_CTL_ADD, c->fd, &ev);
+}
+
+/* ---------------------------------------------------------------------------
+ * Short flows (-m fct)
+ * ------------------------------------------------------------------------- */
+
+/* xorshift64, seeded per worker */
+static double rng_uniform(struct worker *w)
+{
+    w->rng ^= w->rng << 13;
+    w->rng ^= w->rng >> 7;
+    w->rng ^= w->rng << 17;
+    return ((w->rng >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+static int rng_size_class(struct worker *w)
+{
+    double u = rng_uniform(w) * opt.weight_total;
+    int i;
+
+    for (i = 0; i < opt.nsizes - 1; i++) {
+        u -= opt.weights[i];
+        if (u <= 0)
+            break;
+    }
+    return i;
+}
+
+static int flow_start(struct worker *w, struct page *pg)
+{
+    struct conn *c = calloc(1, sizeof(*c));
+
+    if (!c)
+        return -1;
+    c->page = pg;
+    c->size_class = rng_size_class(w);
+    c->req_len = opt.len;
+    c->resp_len = opt.sizes[c->size_class];
+    c->start_ns = now_ns();
+    w->flows_started++;
+    if (client_connect(w, c) < 0) {
+        conn_close(c);
+        free(c);
+        return -1;
+    }
+    c->slot = w->nflows;
+    w->flows[w->nflows++] = c;
+    return 0;
+}
+
+static void page_free(struct worker *w, struct page *pg)
+{
+    uint64_t pct = now_ns() - pg->arrival_ns;
+
+    if (pg->failed) {
+        w->pages_failed++;
+    } else {
+        w->pages_completed++;
+        w->fct_hist[opt.nsizes * HIST_SIZE + hist_index(pct)]++;
+        if (pct > w->fct_max_ns[opt.nsizes])
+            w->fct_max_ns[opt.nsizes] = pct;
+    }
+    free(pg);
+}
+
+/* Starts the objects of a page that the page and flow limits allow; frees
+ * the page once all its objects are done */
+static void page_pump(struct worker *w, struct page *pg)
+{
+    while (pg->to_start > 0 && pg->active < opt.parallel && w->nflows < w->max_flows) {
+        pg->to_start--;
+        if (flow_start(w, pg) < 0) {
+            w->flows_failed++;
+            pg->failed++;
+            continue;
+        }
+        pg->active++;
+    }
+
+    if (pg->to_start > 0 && pg->active < opt.parallel && !pg->queued) {
+        /* out of flow slots, resumed by flow_end() */
+        pg->queued = 1;
+        pg->next = NULL;
+        if (w->blocked_tail)
+            w->blocked_tail->next = pg;
+        else
+            w->blocked = pg;
+        w->blocked_tail = pg;
+    }
+    if (pg->to_start == 0 && pg->active == 0)
+        page_free(w, pg);
+}
+
+static void flow_end(struct worker *w, struct conn *c, int ok)
+{
+    struct page *pg = c->page;
+    uint64_t fct;
+
+    if (ok) {
+        fct = now_ns() - c->start_ns;
+        w->fct_hist[c->size_class * HIST_SIZE + hist_index(fct)]++;
+        w->fct_count[c->size_class]++;
+        w->fct_sum_ns += fct;
+        if (fct > w->fct_max_ns[c->size_class])
+            w->fct_max_ns[c->size_class] = fct;
+        counter_add(&w->transactions, 1);
+    } else {
+        w->flows_failed++;
+        pg->failed++;
+    }
+
+    w->flows[c->slot] = w->flows[--w->nflows];
+    w->flows[c->slot]->slot = c->slot;
+    conn_close(c);
+    free(c);
+
+    pg->active--;
+    if (!pg->queued)
+        page_pump(w, pg);
+    while (w->blocked && w->nflows < w->max_flows) {
+        pg = w->blocked;
+        w->blocked = pg->next;
+        if (!w->blocked)
+            w->blocked_tail = NULL;
+        pg->queued = 0;
+        page_pump(w, pg);
+    }
+}
+
+/* Poisson arrivals, the rate split evenly over the workers */
+static void fct_arrivals(struct worker *w)
+{
+    double rate = opt.rate / opt.threads;
+    uint64_t expirations, t = now_ns();
+    struct page *pg;
+
+    if (read(w->timerfd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+        return;
+
+    while (w->next_arrival <= t && !stop) {
+        pg = calloc(1, sizeof(*pg));
+        if (!pg)
+            break;
+        pg->arrival_ns = w->next_arrival;
+        pg->to_start = opt.bundle;
+        w->pages++;
+        if (w->nflows >= w->max_flows)
+            w->pages_deferred++;
+        page_pump(w, pg);
+        w->next_arrival += (uint64_t)(-log(rng_uniform(w)) / rate * 1e9);
+    }
+    timer_arm(w, w->next_arrival);
+}
+
+static int fct_init(struct worker *w)
+{
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    double rate = opt.rate / opt.threads;
+
+    w->max_flows = opt.conns / opt.threads + (w->id < opt.conns % opt.threads);
+    if (w->max_flows < 1)
+        w->max_flows = 1;
+    w->flows = calloc(w->max_flows, sizeof(*w->flows));
+    w->fct_hist = calloc((opt.nsizes + 1) * HIST_SIZE, sizeof(uint64_t));
+    w->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (!w->flows || !w->fct_hist || w->timerfd < 0) {
+        perror("fct setup");
+        return -1;
+    }
+    w->rng = 0x9e3779b97f4a7c15ull * (w->id + 1);
+    w->next_arrival = now_ns() + (uint64_t)(-log(rng_uniform(w)) / rate * 1e9);
+    timer_arm(w, w->next_arrival);
+    return epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->timerfd, &ev);
+}
+
+/* Flows still running at the end are counted, not measured */
+static void fct_finish(struct worker *w)
+{
+    struct page *pg, *next;
+
+    while (w->nflows > 0) {
+        struct conn *c = w->flows[--w->nflows];
+
+        pg = c->page;
+        pg->to_start = 0;
+        if (--pg->active == 0 && !pg->queued)
+            free(pg);
+        conn_close(c);
+        free(c);
+        w->flows_unfinished++;
+    }
+    for (pg = w->blocked; pg; pg = next) {
+        next = pg->next;
+        free(pg);
+    }
+    close(w->timerfd);
+}
+
+/* Bulk upload: half-close and collect the receiver reports */
+static void client_finish(struct worker *w, char *buf)
+{
+    struct epoll_event events[MAX_EVENTS];
+    uint64_t deadline;
+    int i, n, pending = 0;
+
+    if (opt.mode == MODE_FCT) {
+        fct_finish(w);
+        return;
+    }
+
+    for (i = 0; i < w->nconns; i++) {
+        struct conn *c = &w->conns[i];
+
+        if (c->state == ST_DONE)
+            continue;
+        if (opt.mode != MODE_BULK || opt.reverse || c->state != ST_RUN) {
+            conn_close(c);
+            continue;
+        }
+        shutdown(c->fd, SHUT_WR);
+        c->state = ST_REPORT;
+        c->msg_len = 0;
+        pending++;
+    }
+
+    deadline = now_ns() + REPORT_TIMEOUT_MS * 1000000ull;
+    while (pending > 0 && now_ns() < deadline) {
+        n = epoll_wait(w->epfd, events, MAX_EVENTS, 100);
+        for (i = 0; i < n; i++) {
+            struct conn *c = events[i].data.ptr;
+
+            if (c->state != ST_REPORT)
+                continue;
+            if (client_recv(w, c, buf) < 0) {
+                w->errors++;
+                conn_close(c);
+            }
+            if (c->state == ST_DONE)
+                pending--;
+        }
+    }
+
+    for (i = 0; i < w->nconns; i++) {
+        if (w->conns[i].state != ST_DONE) {
+            w->errors++;
+            conn_close(&w->conns[i]);
+        }
+    }
+}
+
+/* -g: starts the requests that are due, re-arms for the next one */
+static void rr_paced(struct worker *w)
+{
+    uint64_t expirations, next = 0, t = now_ns();
+    int i;
+
+    if (read(w->timerfd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+        return;
+
+    for (i = 0; i < w->nconns; i++) {
+        struct conn *c = &w->conns[i];
+
+        if (!c->waiting || c->fd < 0)
+            continue;
+        if (c->next_ns > t) {
+            if (!next || c->next_ns < next)
+                next = c->next_ns;
+            continue;
+        }
+        c->waiting = 0;
+        rr_start(c);
+        if (client_send(w, c) < 0) {
+            w->errors++;
+            fprintf(stderr, "connection %d.%d: %s\n", w->id, i, strerror(errno));
+            conn_close(c);
+        }
+    }
+    w->timer_ns = next;
+    if (next)
+        timer_arm(w, next);
+}
+
+static int rr_paced_init(struct worker *w)
+{
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+
+    w->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (w->timerfd < 0) {
+        perror("timerfd_create");
+        return -1;
+    }
+    return epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->timerfd, &ev);
+}
+
+static void *client_worker(void *arg)
+{
+    struct worker *w = arg;
+    struct epoll_event events[MAX_EVENTS];
+    char *buf = malloc(RECV_BUF);
+    int i, n;
+
+    for (i = 0; i < w->nconns; i++) {
+        if (client_connect(w, &w->conns[i]) < 0) {
+            w->errors++;
+            conn_close(&w->conns[i]);
+        }
+    }
+    if ((opt.mode == MODE_FCT && fct_init(w) < 0) ||
+        (opt.mode == MODE_RR && opt.gap_ns && rr_paced_init(w) < 0)) {
+        w->errors++;
+        stop = 1;
+    }
+
+    while (!stop) {
+        n = epoll_wait(w->epfd, events, MAX_EVENTS, 100);
+        for (i = 0; i < n && !stop; i++) {
+            if (!events[i].data.ptr && opt.mode == MODE_FCT)
+                fct_arrivals(w);
+            else if (!events[i].data.ptr)
+                rr_paced(w);
+            else
+                client_event(w, events[i].data.ptr, events[i].events, buf);
+        }
+    }
+
+    client_finish(w, buf);
+    if (opt.mode == MODE_RR && opt.gap_ns)
+        close(w->timerfd);
+    free(buf);
+    return NULL;
+}
+
+/* ---------------------------------------------------------------------------
+ * Server
+ * ------------------------------------------------------------------------- */
+
+static int server_send(struct worker *w, struct conn *c)
+{
+    ssize_t n;
+
+    if (c->mode == MODE_BULK) {
+        if (!c->reverse)
+            return 0;
+        for (;;) {
+            n = conn_send(w, c, DEFAULT_BULK_LEN);
+            if (n <= 0)
+                return n;
+        }
+    }
+
+    while (c->to_send > 0) {
+        n = conn_send(w, c, c->to_send);
+        if (n <= 0)
+            return n;
+        c->to_send -= n;
+    }
+    return 0;
+}
+
+static int server_recv(struct worker *w, struct conn *c, char *buf)
+{
+    ssize_t n;
+
+    while (c->state == ST_HELLO) {
+        n = recv(c->fd, c->msg.raw + c->msg_len, sizeof(c->msg.hello) - c->msg_len, 0);
+        if (n <= 0)
+            return n == 0 || errno != EAGAIN ? -1 : 0;
+        c->msg_len += n;
+        if (c->msg_len < sizeof(c->msg.hello))
+            continue;
+        if (ntohl(c->msg.hello.magic) != VKLOAD_MAGIC || c->msg.hello.mode > MODE_RR ||
+            c->msg.hello.send_mode > SEND_SPLICE) {
+            fprintf(stderr, "Bad hello, not a vkload client\n");
+            return -1;
+        }
+        c->mode = c->msg.hello.mode;
+        c->reverse = c->msg.hello.reverse;
+        c->req_len = ntohl(c->msg.hello.req_len);
+        c->resp_len = ntohl(c->msg.hello.resp_len);
+        c->to_recv = c->req_len;
+        c->state = ST_RUN;
+        /* nothing to send in an upload */
+        conn_set_send_mode(w, c, c->mode == MODE_BULK && !c->reverse ? SEND_COPY : c->msg.hello.send_mode);
+        if (c->reverse && server_send(w, c) < 0)
+            return -1;
+    }
+
+    for (;;) {
+        n = recv(c->fd, buf, RECV_BUF, 0);
+        if (n < 0)
+            return errno == EAGAIN ? 0 : -1;
+        if (n == 0) {
+            if (c->mode != MODE_BULK || c->reverse)
+                return -1;
+            /* end of the upload, tell the client what arrived */
+            c->msg.report.bytes = htobe64(c->rx_bytes);
+            c->msg.report.duration_ns = htobe64(c->rx_bytes ? c->last_ns - c->start_ns : 0);
+            send(c->fd, &c->msg.report, sizeof(c->msg.report), MSG_NOSIGNAL);
+            return -1;
+        }
+        counter_add(&w->rx_bytes, n);
+        if (c->mode == MODE_BULK) {
+            c->last_ns = now_ns();
+            if (!c->rx_bytes)
+                c->start_ns = c->last_ns;
+            c->rx_bytes += n;
+            continue;
+        }
+
+        /* rr: one request at a time */
+        c->to_recv = (uint64_t)n >= c->to_recv ? 0 : c->to_recv - n;
+        if (c->to_recv > 0)
+            continue;
+        c->to_recv = c->req_len;
+        c->to_send = c->resp_len;
+        counter_add(&w->transactions, 1);
+        if (server_send(w, c) < 0)
+            return -1;
+    }
+}
+
+static void server_accept(struct worker *w)
+{
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT | EPOLLET };
+    struct conn *c;
+    int fd;
+
+    while ((fd = accept4(w->listen_fd, NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+        c = calloc(1, sizeof(*c));
+        if (!c) {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->state = ST_HELLO;
+        conn_setup(c);
+        ev.data.ptr = c;
+        if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            conn_close(c);
+            free(c);
+        }
+    }
+}
+
+static void *server_worker(void *arg)
+{
+    struct worker *w = arg;
+    struct epoll_event events[MAX_EVENTS];
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = NULL };
+    char *buf = malloc(RECV_BUF);
+    int i, n;
+
+    if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->listen_fd, &ev) < 0) {
+        perror("epoll_ctl");
+        exit(1);
+    }
+
+    while (!stop) {
+        n = epoll_wait(w->epfd, events, MAX_EVENTS, 500);
+        for (i = 0; i < n; i++) {
+            struct conn *c = events[i].data.ptr;
+
+            if (!c) {
+                server_accept(w);
+                continue;
+            }
+            if ((events[i].events & EPOLLERR) && c->zerocopy)
+                reap_zerocopy(w, c);
+            if ((events[i].events & EPOLLIN) && server_recv(w, c, buf) < 0)
+                goto close;
+            if (c->state == ST_RUN && (events[i].events & EPOLLOUT) && server_send(w, c) < 0)
+                goto close;
+            continue;
+close:
+            conn_close(c);
+            free(c);
+        }
+    }
+    free(buf);
+    return NULL;
+}
+
+static int run_server(struct worker *workers)
+{
+    struct sockaddr_in6 addr = { .sin6_family = AF_INET6, .sin6_addr = IN6ADDR_ANY_INIT };
+    int fd, i, zero = 0, one = 1;
+
+    fd = socket(AF_INET6, SOCK_STREAM, opt.protocol);
+    if (fd < 0) {
+        perror(opt.protocol == IPPROTO_MPTCP ? "socket(IPPROTO_MPTCP)" : "socket");
+        return 1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+    addr.sin6_port = htons(opt.port);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 4096) < 0) {
+        perror("bind/listen");
+        return 1;
+    }
+    set_nonblock(fd);
+
+    printf("vkload server on port %u (%s, %d threads)\n", opt.port,
+           opt.protocol == IPPROTO_MPTCP ? "mptcp" : "tcp", opt.threads);
+    fflush(stdout);
+
+    for (i = 0; i < opt.threads; i++) {
+        workers[i].listen_fd = fd;
+        pthread_create(&workers[i].thread, NULL, server_worker, &workers[i]);
+    }
+    for (i = 0; i < opt.threads; i++)
+        pthread_join(workers[i].thread, NULL);
+    close(fd);
+    return 0;
+}
+
+/* ---------------------------------------------------------------------------
+ * Client run and report
+ * ------------------------------------------------------------------------- */
+
+struct interval {
+    double end;
+    double bps;
+    double tps;
+    double p50_us, p99_us;      /* rr: of the transactions in the interval */
+};
+
+/* Latency percentiles of the transactions since the last call */
+static void interval_latency(struct worker *workers, struct interval *iv)
+{
+    static uint64_t last[HIST_SIZE], diff[HIST_SIZE];
+    uint64_t total = 0, cur, max = 0;
+    int i, j;
+
+    /* the largest latency so far bounds the interval's too */
+    for (i = 0; i < opt.threads; i++) {
+        cur = __atomic_load_n(&workers[i].lat_max, __ATOMIC_RELAXED);
+        if (cur > max)
+            max = cur;
+    }
+    for (j = 0; j < HIST_SIZE; j++) {
+        cur = 0;
+        for (i = 0; i < opt.threads; i++)
+            cur += __atomic_load_n(&workers[i].hist[j], __ATOMIC_RELAXED);
+        diff[j] = cur - last[j];
+        last[j] = cur;
+        total += diff[j];
+    }
+    iv->p50_us = hist_percentile(diff, total, 0.5, max) / 1e3;
+    iv->p99_us = hist_percentile(diff, total, 0.99, max) / 1e3;
+}
+
+static double cpu_seconds(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+           ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static void sum_counters(struct worker *workers, uint64_t *bytes, uint64_t *trans)
+{
+    int i;
+
+    *bytes = *trans = 0;
+    for (i = 0; i < opt.threads; i++) {
+        *bytes += opt.reverse || opt.mode == MODE_FCT ? counter_get(&workers[i].rx_bytes)
+                                                      : counter_get(&workers[i].tx_bytes);
+        *trans += counter_get(&workers[i].transactions);
+    }
+}
+
+struct fct_summary {
+    uint64_t hist[HIST_SIZE];   /* all sizes */
+    uint64_t page_hist[HIST_SIZE];
+    uint64_t completed, sum_ns, max_ns, page_max_ns;
+    uint64_t started, failed, unfinished, pages, pages_completed, pages_failed, deferred;
+};
+
+static void fct_summarize(struct worker *workers, struct fct_summary *f)
+{
+    int i, k, j;
+
+    memset(f, 0, sizeof(*f));
+    for (i = 0; i < opt.threads; i++) {
+        struct worker *w = &workers[i];
+
+        for (k = 0; k <= opt.nsizes; k++)
+            for (j = 0; j < HIST_SIZE; j++)
+                (k < opt.nsizes ? f->hist : f->page_hist)[j] += w->fct_hist[k * HIST_SIZE + j];
+        for (k = 0; k < opt.nsizes; k++) {
+            f->completed += w->fct_count[k];
+            if (w->fct_max_ns[k] > f->max_ns)
+                f->max_ns = w->fct_max_ns[k];
+        }
+        if (w->fct_max_ns[opt.nsizes] > f->page_max_ns)
+            f->page_max_ns = w->fct_max_ns[opt.nsizes];
+        f->sum_ns += w->fct_sum_ns;
+        f->started += w->flows_started;
+        f->failed += w->flows_failed;
+        f->unfinished += w->flows_unfinished;
+        f->pages += w->pages;
+        f->pages_completed += w->pages_completed;
+        f->pages_failed += w->pages_failed;
+        f->deferred += w->pages_deferred;
+    }
+}
+
+static void print_fct_json(struct worker *workers)
+{
+    static struct fct_summary f;
+    static uint64_t hist[HIST_SIZE];
+    uint64_t n, max;
+    int i, k, j;
+
+    fct_summarize(workers, &f);
+    printf("  \"fct\": {\n");
+    printf("    \"rate\": %.3f,\n", opt.rate);
+    printf("    \"objects_per_page\": %d,\n", opt.bundle);
+    printf("    \"parallel\": %d,\n", opt.parallel);
+    printf("    \"request_len\": %u,\n", opt.len);
+    printf("    \"flows\": %" PRIu64 ",\n", f.started);
+    printf("    \"completed\": %" PRIu64 ",\n", f.completed);
+    printf("    \"failed\": %" PRIu64 ",\n", f.failed);
+    printf("    \"unfinished\": %" PRIu64 ",\n", f.unfinished);
+    printf("    \"deferred\": %" PRIu64 ",\n", f.deferred);
+    printf("    \"fct_ms\": {\"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"p999\": %.3f, \"max\": %.3f},\n",
+           f.completed ? f.sum_ns / 1e6 / f.completed : 0,
+           hist_percentile(f.hist, f.completed, 0.5, f.max_ns) / 1e6,
+           hist_percentile(f.hist, f.completed, 0.9, f.max_ns) / 1e6,
+           hist_percentile(f.hist, f.completed, 0.99, f.max_ns) / 1e6,
+           hist_percentile(f.hist, f.completed, 0.999, f.max_ns) / 1e6,
+           f.max_ns / 1e6);
+    printf("    \"by_size\": [");
+    for (k = 0; k < opt.nsizes; k++) {
+        memset(hist, 0, sizeof(hist));
+        n = max = 0;
+        for (i = 0; i < opt.threads; i++) {
+            for (j = 0; j < HIST_SIZE; j++)
+                hist[j] += workers[i].fct_hist[k * HIST_SIZE + j];
+            n += workers[i].fct_count[k];
+            if (workers[i].fct_max_ns[k] > max)
+                max = workers[i].fct_max_ns[k];
+        }
+        printf("%s\n      {\"bytes\": %u, \"completed\": %" PRIu64 ", \"p50_ms\": %.3f, \"p99_ms\": %.3f, \"p999_ms\": %.3f}",
+               k ? "," : "", opt.sizes[k], n, hist_percentile(hist, n, 0.5, max) / 1e6,
+               hist_percentile(hist, n, 0.99, max) / 1e6, hist_percentile(hist, n, 0.999, max) / 1e6);
+    }
+    printf("\n    ],\n");
+    printf("    \"pages\": {\"arrived\": %" PRIu64 ", \"completed\": %" PRIu64 ", \"failed\": %" PRIu64 ", "
+           "\"pct_ms\": {\"p50\": %.3f, \"p99\": %.3f, \"p999\": %.3f}}\n",
+           f.pages, f.pages_completed, f.pages_failed,
+           hist_percentile(f.page_hist, f.pages_completed, 0.5, f.page_max_ns) / 1e6,
+           hist_percentile(f.page_hist, f.pages_completed, 0.99, f.page_max_ns) / 1e6,
+           hist_percentile(f.page_hist, f.pages_completed, 0.999, f.page_max_ns) / 1e6);
+    printf("  }\n");
+}
+
+static void print_json(struct worker *workers, struct interval *iv, int niv,
+                       double elapsed, double cpu)
+{
+    static uint64_t hist[HIST_SIZE];
+    uint64_t tx = 0, rx = 0, trans = 0, zc = 0, zc_copied = 0, lat_max = 0;
+    uint64_t report_bytes = 0, report_ns = 0;
+    int i, j, errors = 0, reports = 0, fallback = 0;
+
+    for (i = 0; i < opt.threads; i++) {
+        struct worker *w = &workers[i];
+
+        tx += w->tx_bytes;
+        rx += w->rx_bytes;
+        trans += w->transactions;
+        zc += w->zc_completions;
+        zc_copied += w->zc_copied;
+        errors += w->errors;
+        reports += w->reports;
+        report_bytes += w->report_bytes;
+        if (w->report_ns > report_ns)
+            report_ns = w->report_ns;
+        fallback |= w->zerocopy_fallback;
+        if (w->lat_max > lat_max)
+            lat_max = w->lat_max;
+        for (j = 0; j < HIST_SIZE; j++)
+            hist[j] += w->hist[j];
+    }
+
+    printf("{\n");
+    printf("  \"protocol\": \"%s\",\n", opt.protocol == IPPROTO_MPTCP ? "mptcp" : "tcp");
+    printf("  \"mode\": \"%s\",\n", mode_names[opt.mode]);
+    printf("  \"reverse\": %s,\n", opt.reverse ? "true" : "false");
+    printf("  \"send_mode\": \"%s\",\n", fallback ? "copy" : send_names[opt.send_mode]);
+    printf("  \"connections\": %d,\n", opt.conns);
+    printf("  \"threads\": %d,\n", opt.threads);
+    printf("  \"len\": %u,\n", opt.len);
+    printf("  \"resp_len\": %u,\n", opt.resp_len);
+    printf("  \"sndbuf_actual\": %d,\n", sndbuf_actual);
+    printf("  \"rcvbuf_actual\": %d,\n", rcvbuf_actual);
+    printf("  \"start_epoch_ns\": %" PRIu64 ",\n", start_epoch_ns);
+    printf("  \"duration_s\": %.3f,\n", elapsed);
+    printf("  \"cpu_percent\": %.1f,\n", elapsed > 0 ? 100 * cpu / elapsed : 0);
+    printf("  \"errors\": %d,\n", errors);
+    printf("  \"intervals\": [");
+    for (i = 0; i < niv; i++) {
+        printf("%s\n    {\"end\": %.3f, \"bits_per_second\": %.0f, \"transactions_per_second\": %.1f",
+               i ? "," : "", iv[i].end, iv[i].bps, iv[i].tps);
+        if (opt.mode == MODE_RR)
+            printf(", \"latency_p50_us\": %.1f, \"latency_p99_us\": %.1f", iv[i].p50_us, iv[i].p99_us);
+        printf("}");
+    }
+    printf("\n  ],\n");
+    printf("  \"sender\": {\"bytes\": %" PRIu64 ", \"bits_per_second\": %.0f},\n",
+           opt.reverse ? 0 : tx, opt.reverse || elapsed <= 0 ? 0 : tx * 8 / elapsed);
+    if (opt.mode == MODE_BULK && !opt.reverse)
+        printf("  \"receiver\": {\"bytes\": %" PRIu64 ", \"bits_per_second\": %.0f, \"reports\": %d},\n",
+               report_bytes, report_ns ? report_bytes * 8e9 / report_ns : 0, reports);
+    else
+        printf("  \"receiver\": {\"bytes\": %" PRIu64 ", \"bits_per_second\": %.0f},\n",
+               rx, elapsed > 0 ? rx * 8 / elapsed : 0);
+    if (opt.send_mode == SEND_ZEROCOPY && !(opt.mode == MODE_BULK && opt.reverse))
+        printf("  \"zerocopy\": {\"supported\": %s, \"completions\": %" PRIu64 ", \"copied\": %" PRIu64 "},\n",
+               fallback ? "false" : "true", zc, zc_copied);
+    printf("  \"rr\": {\"transactions\": %" PRIu64 ", \"transactions_per_second\": %.1f, "
+           "\"latency_us\": {\"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f}}%s\n",
+           trans, elapsed > 0 ? trans / elapsed : 0,
+           hist_percentile(hist, trans, 0.5, lat_max) / 1e3, hist_percentile(hist, trans, 0.9, lat_max) / 1e3,
+           hist_percentile(hist, trans, 0.99, lat_max) / 1e3, hist_percentile(hist, trans, 0.999, lat_max) / 1e3,
+           lat_max / 1e3, opt.mode == MODE_FCT ? "," : "");
+    if (opt.mode == MODE_FCT)
+        print_fct_json(workers);
+    printf("}\n");
+}
+
+static int run_client(struct worker *workers)
+{
+    static struct interval iv[MAX_INTERVALS];
+    uint64_t start, last, t, bytes, trans, last_bytes = 0, last_trans = 0;
+    double cpu0, elapsed, dt;
+    int i, niv = 0, assigned = 0;
+
+    for (i = 0; i < opt.threads && opt.mode != MODE_FCT; i++) {
+        int n = opt.conns / opt.threads + (i < opt.conns % opt.threads);
+
+        workers[i].conns = calloc(n, sizeof(struct conn));
+        workers[i].nconns = n;
+        assigned += n;
+    }
+
+    cpu0 = cpu_seconds();
+    start = last = now_ns();
+    {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_REALTIME, &ts);
+        start_epoch_ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    }
+    for (i = 0; i < opt.threads; i++)
+        pthread_create(&workers[i].thread, NULL, client_worker, &workers[i]);
+
+    if (!opt.json && opt.mode == MODE_FCT)
+        printf("vkload fct, %.1f pages/s of %d objects, up to %d flows on %d threads to %s:%u (%s)\n",
+               opt.rate, opt.bundle, opt.conns, opt.threads, opt.host, opt.port,
+               opt.protocol == IPPROTO_MPTCP ? "mptcp" : "tcp");
+    else if (!opt.json)
+        printf("vkload %s, %d connections on %d threads to %s:%u (%s)\n",
+               opt.mode == MODE_RR ? "rr" : opt.reverse ? "bulk download" : "bulk upload", assigned,
+               opt.threads, opt.host, opt.port, opt.protocol == IPPROTO_MPTCP ? "mptcp" : "tcp");
+
+    while (!stop) {
+        int done;
+
+        t = now_ns();
+        done = t - start >= opt.duration * 1e9;
+        if (!done && t - last < opt.interval * 1e9) {
+            usleep(10000);
+            continue;
+        }
+        sum_counters(workers, &bytes, &trans);
+        dt = (t - last) / 1e9;
+        if (niv < MAX_INTERVALS) {
+            iv[niv].end = (t - start) / 1e9;
+            iv[niv].bps = (bytes - last_bytes) * 8 / dt;
+            iv[niv].tps = (trans - last_trans) / dt;
+            if (opt.mode == MODE_RR)
+                interval_latency(workers, &iv[niv]);
+            if (!opt.json && opt.mode == MODE_RR)
+                printf("[%7.2fs] %10.2f Mbit/s %12.1f trans/s, p50 %.1f p99 %.1f us\n", iv[niv].end,
+                       iv[niv].bps / 1e6, iv[niv].tps, iv[niv].p50_us, iv[niv].p99_us);
+            else if (!opt.json)
+                printf("[%7.2fs] %10.2f Mbit/s %12.1f %s/s\n", iv[niv].end, iv[niv].bps / 1e6,
+                       iv[niv].tps, opt.mode == MODE_FCT ? "flows" : "trans");
+            niv++;
+        }
+        fflush(stdout);
+        last = t;
+        last_bytes = bytes;
+        last_trans = trans;
+        if (done)
+            break;
+    }
+    elapsed = (now_ns() - start) / 1e9;
+    stop = 1;
+
+    for (i = 0; i < opt.threads; i++)
+        pthread_join(workers[i].thread, NULL);
+
+    if (opt.json) {
+        print_json(workers, iv, niv, elapsed, cpu_seconds() - cpu0);
+    } else {
+        uint64_t rbytes = 0, rns = 0;
+        int errors = 0, fallback = 0;
+
+        sum_counters(workers, &bytes, &trans);
+        for (i = 0; i < opt.threads; i++) {
+            rbytes += workers[i].report_bytes;
+            if (workers[i].report_ns > rns)
+                rns = workers[i].report_ns;
+            errors += workers[i].errors;
+            fallback |= workers[i].zerocopy_fallback;
+        }
+        printf("total %.2fs: %.2f Mbit/s %s", elapsed, bytes * 8 / elapsed / 1e6,
+               opt.reverse || opt.mode == MODE_FCT ? "received" : "sent");
+        if (opt.mode == MODE_FCT) {
+            static struct fct_summary f;
+
+            fct_summarize(workers, &f);
+            printf(", %" PRIu64 "/%" PRIu64 " flows (%" PRIu64 " failed), fct p50 %.2f p99 %.2f p999 %.2f ms",
+                   f.completed, f.started, f.failed,
+                   hist_percentile(f.hist, f.completed, 0.5, f.max_ns) / 1e6,
+                   hist_percentile(f.hist, f.completed, 0.99, f.max_ns) / 1e6,
+                   hist_percentile(f.hist, f.completed, 0.999, f.max_ns) / 1e6);
+            if (opt.bundle > 1)
+                printf(", page p50 %.2f p99 %.2f ms",
+                       hist_percentile(f.page_hist, f.pages_completed, 0.5, f.page_max_ns) / 1e6,
+                       hist_percentile(f.page_hist, f.pages_completed, 0.99, f.page_max_ns) / 1e6);
+        }
+        if (rns)
+            printf(", %.2f Mbit/s received by the server", rbytes * 8e9 / rns / 1e6);
+        if (opt.mode == MODE_RR)
+            printf(", %.1f trans/s", trans / elapsed);
+        printf(", sndbuf %d, cpu %.1f%%, %d errors\n", sndbuf_actual,
+               100 * (cpu_seconds() - cpu0) / elapsed, errors);
+        if (fallback)
+            printf("MSG_ZEROCOPY not supported on these sockets, sent with copies\n");
+    }
+
+    for (i = 0; i < opt.threads; i++)
+        if (workers[i].errors)
+            return 1;
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s -s [-p PORT] [-T THREADS] [-N]\n"
+            "       %s -c HOST [-p PORT] [-P CONNS] [-T THREADS] [-t SECONDS] [-i SECONDS]\n"
+            "          [-m bulk|rr|fct] [-R] [-z copy|zerocopy|splice] [-l LEN] [-r LEN]\n"
+            "          [-w BYTES] [-N] [-J]\n"
+            "          [-a RATE] [-S SIZES] [-B OBJECTS] [-K PARALLEL]     (-m fct)\n"
+            "          [-g USEC] [-b ADDR]\n"
+            "  -P  connections (1)           -T  worker threads (1)\n"
+            "  -t  duration (10 s)           -i  report interval (1 s)\n"
+            "  -m  bulk, rr or fct (bulk)    -R  bulk: server sends\n"
+            "  -z  send mode (copy)          -l  send size (bulk 128K) / request size (rr 1, fct 300)\n"
+            "  -r  rr response size (1)      -w  SO_SNDBUF/SO_RCVBUF\n"
+            "  -a  fct: pages per second (10)          -B  fct: objects per page (1)\n"
+            "  -S  fct: http or SIZE[:WEIGHT],... (http) -K  fct: parallel objects per page (6)\n"
+            "      -P is the flow limit in fct mode (256)\n"
+            "  -g  rr: at most one request per USEC per connection\n"
+            "  -b  local address to bind (e.g. of one path)\n"
+            "  -N  plain TCP instead of MPTCP\n"
+            "  -J  JSON output\n", prog, prog);
+}
+
+/* SIZE[:WEIGHT],... with K/M/G suffixes (1024 based) */
+static int parse_sizes(const char *spec)
+{
+    char *copy = strdup(spec), *tok, *save = NULL, *end;
+    double size;
+
+    opt.nsizes = 0;
+    opt.weight_total = 0;
+    for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        if (opt.nsizes == MAX_SIZES)
+            goto bad;
+        size = strtod(tok, &end);
+        switch (*end) {
+        case 'k': case 'K': size *= 1024; end++; break;
+        case 'm': case 'M': size *= 1024 * 1024; end++; break;
+        case 'g': case 'G': size *= 1024 * 1024 * 1024; end++; break;
+        }
+        opt.weights[opt.nsizes] = 1;
+        if (*end == ':')
+            opt.weights[opt.nsizes] = strtod(end + 1, &end);
+        if (*end || size < 1 || size > UINT32_MAX || opt.weights[opt.nsizes] <= 0)
+            goto bad;
+        opt.sizes[opt.nsizes] = size;
+        opt.weight_total += opt.weights[opt.nsizes++];
+    }
+    free(copy);
+    return opt.nsizes ? 0 : -1;
+
+bad:
+    fprintf(stderr, "Bad size list: %s\n", spec);
+    free(copy);
+    return -1;
+}
+
+static int lookup(const char *word, const char **names, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        if (!strcmp(word, names[i]))
+            return i;
+    return -1;
+}
+
+int main(int argc, char **argv)
+{
+    struct addrinfo hints = { .ai_socktype = SOCK_STREAM };
+    struct worker *workers;
+    char port[8];
+    const char *sizes = HTTP_SIZES, *bind_host = NULL;
+    int c, i, len_set = 0, conns_set = 0, err;
+
+    while ((c = getopt(argc, argv, "sc:p:P:T:t:i:m:Rz:l:r:w:NJa:S:B:K:g:b:h")) != -1) {
+        switch (c) {
+        case 's': opt.server = 1; break;
+        case 'c': opt.host = optarg; break;
+        case 'p': opt.port = strtoul(optarg, NULL, 10); break;
+        case 'P': opt.conns = atoi(optarg); conns_set = 1; break;
+        case 'T': opt.threads = atoi(optarg); break;
+        case 't': opt.duration = atof(optarg); break;
+        case 'i': opt.interval = atof(optarg); break;
+        case 'm': opt.mode = lookup(optarg, mode_names, 3); break;
+        case 'R': opt.reverse = 1; break;
+        case 'z': opt.send_mode = lookup(optarg, send_names, 3); break;
+        case 'l': opt.len = strtoul(optarg, NULL, 0); len_set = 1; break;
+        case 'r': opt.resp_len = strtoul(optarg, NULL, 0); break;
+        case 'w': opt.bufsize = atoi(optarg); break;
+        case 'N': opt.protocol = IPPROTO_TCP; break;
+        case 'J': opt.json = 1; break;
+        case 'a': opt.rate = atof(optarg); break;
+        case 'S': sizes = strcmp(optarg, "http") ? optarg : HTTP_SIZES; break;
+        case 'B': opt.bundle = atoi(optarg); break;
+        case 'K': opt.parallel = atoi(optarg); break;
+        case 'g': opt.gap_ns = strtoull(optarg, NULL, 10) * 1000; break;
+        case 'b': bind_host = optarg; break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (opt.server == !!opt.host || opt.mode < 0 || opt.send_mode < 0 ||
+        opt.conns < 1 || opt.threads < 1 || opt.duration <= 0 || opt.interval <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (!len_set)
+        opt.len = opt.mode == MODE_RR ? 1 : opt.mode == MODE_FCT ? DEFAULT_FCT_REQ : DEFAULT_BULK_LEN;
+    if (opt.mode == MODE_RR && !opt.resp_len)
+        opt.resp_len = 1;
+    if (opt.mode == MODE_RR && (opt.len == 0 || opt.reverse)) {
+        fprintf(stderr, "rr needs -l > 0 and no -R\n");
+        return 1;
+    }
+    if (opt.mode == MODE_FCT) {
+        if (parse_sizes(sizes) < 0 || opt.rate <= 0 || opt.bundle < 1 || opt.parallel < 1 || opt.reverse) {
+            fprintf(stderr, "fct needs -a > 0, -B/-K >= 1, valid -S and no -R\n");
+            return 1;
+        }
+        if (!len_set)
+            opt.len = DEFAULT_FCT_REQ;
+        if (!conns_set)
+            opt.conns = DEFAULT_FCT_FLOWS;
+        for (i = 0; i < opt.nsizes; i++)
+            if (opt.sizes[i] > opt.resp_len)
+                opt.resp_len = opt.sizes[i];
+    }
+    if (!opt.server && opt.threads > opt.conns)
+        opt.threads = opt.conns;
+
+    /* the server sends bulk data and responses of any size from it too */
+    send_buf_len = opt.len > DEFAULT_BULK_LEN ? opt.len : DEFAULT_BULK_LEN;
+    if (opt.resp_len > send_buf_len)
+        send_buf_len = opt.resp_len;
+    send_buf = aligned_alloc(4096, (send_buf_len + 4095) & ~4095ul);
+    if (!send_buf) {
+        perror("malloc");
+        return 1;
+    }
+    for (i = 0; i < (int)send_buf_len; i++)
+        send_buf[i] = 'a' + i % 26;
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    workers = aligned_alloc(64, sizeof(*workers) * opt.threads);
+    if (!workers) {
+        perror("malloc");
+        return 1;
+    }
+    memset(workers, 0, sizeof(*workers) * opt.threads);
+    for (i = 0; i < opt.threads; i++) {
+        workers[i].id = i;
+        workers[i].epfd = epoll_create1(0);
+    }
+
+    if (opt.server)
+        return run_server(workers);
+
+    snprintf(port, sizeof(port), "%u", opt.port);
+    err = getaddrinfo(opt.host, port, &hints, &target);
+    if (err) {
+        fprintf(stderr, "%s: %s\n", opt.host, gai_strerror(err));
+        return 1;
+    }
+    if (bind_host) {
+        struct addrinfo *local;
+
+        hints.ai_family = target->ai_family;
+        err = getaddrinfo(bind_host, NULL, &hints, &local);
+        if (err) {
+            fprintf(stderr, "%s: %s\n", bind_host, gai_strerror(err));
+            return 1;
+        }
+        memcpy(&opt.bind_addr, local->ai_addr, local->ai_addrlen);
+        opt.bind_len = local->ai_addrlen;
+        freeaddrinfo(local);
+    }
+    return run_client(workers);
+}
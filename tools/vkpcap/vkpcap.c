@@ -0,0 +1,1368 @@
+/*
+ * vkpcap - per-subflow MPTCP time series from pcap/pcapng captures
+ *
+ *   vkpcap [-b MS] [-j THREADS] [-o FILE] [-s] [-S FILE] [-m] [-t TOKEN] CAPTURE...
+ *
+ * The capture is mmap'ed and parsed in place (Ethernet, Linux cooked v1/v2
+ * and raw IP link types; IPv4/IPv6; TCP with MPTCP options), nothing is
+ * copied per packet. Gzipped captures and the rotated files of one port
+ * (libs/capture.sh) are read into memory first and analysed as one, in the
+ * order of their first packet: tcpdump -W reuses its file names.
+ *
+ * Three passes over the capture:
+ *   index      walks the record headers only and cuts the capture into one
+ *              chunk per thread (and collects the file headers and pcapng
+ *              interfaces)
+ *   handshake  (threads) SYN/SYN-ACK MPTCP options: MP_CAPABLE server key,
+ *              whose SHA-256 gives the connection token, and MP_JOIN tokens.
+ *              Subflows are numbered by SYN time within their connection.
+ *   analysis   (threads) per flow and direction, binned: payload bytes,
+ *              RTT samples (data segment to the ACK covering it, Karn's
+ *              rule), retransmissions and reordering; per connection: DSS
+ *              mappings below the highest data sequence already mapped
+ *              (reinjections and cross-subflow reordering)
+ *
+ * Chunks are analysed independently and merged, so the RTT and reordering
+ * state restarts at each chunk boundary: a few samples per thread are lost,
+ * the byte counts are exact. A segment below the highest sequence seen is a
+ * retransmission if that range was already seen or if it arrives later than
+ * the minimum RTT (3 ms before the first sample) after the highest one,
+ * otherwise it was reordered before the capture point.
+ *
+ * Output (CSV, one row per bin, flow and data direction with payload):
+ *   t_s,token,subflow,src,sport,dst,dport,mbps,packets,rtt_ms,retrans,reordered
+ * token is "-" for plain TCP flows and flows whose handshake was not
+ * captured. -s prints a per-subflow summary instead, -S FILE writes it to
+ * FILE in the same run.
+ */
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "mptcp_token.h"
+
+#define DEFAULT_BIN_MS      100
+#define RTT_RING            1024
+#define REORDER_DEFAULT_NS  3000000ull
+#define MAX_IFACES          64
+
+#define LINKTYPE_NULL       0
+#define LINKTYPE_EN10MB     1
+#define LINKTYPE_RAW        101
+#define LINKTYPE_LINUX_SLL  113
+#define LINKTYPE_IPV4       228
+#define LINKTYPE_IPV6       229
+#define LINKTYPE_LINUX_SLL2 276
+
+#define TCPOPT_MPTCP        30
+#define MPTCP_MP_CAPABLE    0
+#define MPTCP_MP_JOIN       1
+#define MPTCP_DSS           2
+
+#define TH_FIN  0x01
+#define TH_SYN  0x02
+#define TH_ACK  0x10
+
+/* =========================================================================
+ * Capture file
+ * ========================================================================= */
+
+enum { FMT_PCAP, FMT_PCAPNG };
+
+struct iface {
+    uint16_t linktype;
+    uint64_t ts_div;        /* ticks -> ns: multiply or divide */
+    uint64_t ts_mul;
+};
+
+/* A classic pcap file or a pcapng section: byte order and interfaces */
+struct section {
+    uint64_t offset;        /* of the file header or SHB */
+    int format;
+    int swap;
+    int iface_base;
+};
+
+struct chunk {
+    uint64_t start, end;
+    int section;            /* section at start */
+};
+
+static const uint8_t *cap;
+static uint64_t cap_len;
+static uint64_t *file_offsets;  /* start of each file in cap */
+static int num_files;
+static struct iface ifaces[MAX_IFACES];
+static int num_ifaces;
+static struct section *sections;
+static int num_sections;
+static struct chunk *chunks;
+static int num_chunks;
+
+static uint16_t rd16(const uint8_t *p, int swap)
+{
+    uint16_t v;
+    memcpy(&v, p, 2);
+    return swap ? __builtin_bswap16(v) : v;
+}
+
+static uint32_t rd32(const uint8_t *p, int swap)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return swap ? __builtin_bswap32(v) : v;
+}
+
+static uint16_t be16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t be32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static uint64_t be64(const uint8_t *p)
+{
+    return (uint64_t)be32(p) << 32 | be32(p + 4);
+}
+
+/* Appends a (possibly gzipped) file to the in-memory capture */
+static int cap_load(const char *path, uint64_t *size)
+{
+    uint8_t *buf = (uint8_t *)cap;
+    gzFile gz = gzopen(path, "rb");
+    int n;
+
+    if (!gz) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    gzbuffer(gz, 1 << 20);
+    for (;;) {
+        uint64_t room;
+
+        if (cap_len == *size) {
+            *size = *size ? *size * 2 : 1 << 24;
+            buf = realloc(buf, *size);
+            if (!buf) {
+                fprintf(stderr, "Out of memory\n");
+                return -1;
+            }
+            cap = buf;
+        }
+        room = *size - cap_len;
+        n = gzread(gz, buf + cap_len, room > (1u << 30) ? (1u << 30) : (unsigned)room);
+        if (n <= 0)
+            break;
+        cap_len += n;
+    }
+    gzclose(gz);
+    return n < 0 ? -1 : 0;
+}
+
+/*
+ * Timestamp of the first packet of a (possibly gzipped) file, in the units
+ * of the file, which the rotated files of one port share; UINT64_MAX if it
+ * has none
+ */
+static uint64_t first_packet_ts(const char *path)
+{
+    static uint8_t buf[1 << 16];
+    gzFile gz = gzopen(path, "rb");
+    uint64_t off = 0, len;
+    uint32_t magic;
+    int n, swap;
+
+    if (!gz)
+        return UINT64_MAX;
+    n = gzread(gz, buf, sizeof(buf));
+    gzclose(gz);
+    if (n < 24)
+        return UINT64_MAX;
+
+    magic = rd32(buf, 0);
+    if (magic == 0x0a0d0d0a) {
+        swap = rd32(buf + 8, 0) == 0x4d3c2b1a;
+        while (off + 20 <= (uint64_t)n) {
+            len = rd32(buf + off + 4, swap);
+            if (len < 12 || len % 4)
+                break;
+            /* enhanced packet block: timestamp high and low words */
+            if (rd32(buf + off, swap) == 6)
+                return (uint64_t)rd32(buf + off + 12, swap) << 32 | rd32(buf + off + 16, swap);
+            off += len;
+        }
+        return UINT64_MAX;
+    }
+    if (magic != 0xa1b2c3d4 && magic != 0xa1b23c4d && magic != 0xd4c3b2a1 && magic != 0x4d3cb2a1)
+        return UINT64_MAX;
+    if (n < 24 + 16)
+        return UINT64_MAX;
+    swap = magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1;
+    return rd32(buf + 24, swap) * 1000000000ull +
+           rd32(buf + 28, swap) * ((magic == 0xa1b23c4d || magic == 0x4d3cb2a1) ? 1ull : 1000ull);
+}
+
+struct cap_file {
+    char *path;
+    uint64_t first_ts;
+    int idx;
+};
+
+static int cmp_cap_file(const void *a, const void *b)
+{
+    const struct cap_file *x = a, *y = b;
+
+    if (x->first_ts != y->first_ts)
+        return x->first_ts < y->first_ts ? -1 : 1;
+    return x->idx - y->idx;
+}
+
+/* Puts the files of one port in the order of their first packet */
+static void sort_captures(char **paths, int npaths)
+{
+    struct cap_file *files = calloc(npaths, sizeof(*files));
+    int i;
+
+    for (i = 0; i < npaths; i++)
+        files[i] = (struct cap_file){ paths[i], first_packet_ts(paths[i]), i };
+    qsort(files, npaths, sizeof(*files), cmp_cap_file);
+    for (i = 0; i < npaths; i++)
+        paths[i] = files[i].path;
+    free(files);
+}
+
+static int cap_open(char **paths, int npaths)
+{
+    struct stat sb;
+    uint8_t magic[2] = { 0 };
+    uint64_t size = 0;
+    int fd, i;
+
+    file_offsets = calloc(npaths, sizeof(*file_offsets));
+    num_files = npaths;
+
+    /* A single uncompressed file is mapped, everything else is read */
+    if (npaths == 1) {
+        fd = open(paths[0], O_RDONLY);
+        if (fd < 0 || fstat(fd, &sb) < 0) {
+            fprintf(stderr, "%s: %s\n", paths[0], strerror(errno));
+            return -1;
+        }
+        if (read(fd, magic, 2) == 2 && !(magic[0] == 0x1f && magic[1] == 0x8b)) {
+            cap_len = sb.st_size;
+            cap = mmap(NULL, cap_len, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+            close(fd);
+            if (cap == MAP_FAILED) {
+                fprintf(stderr, "%s: mmap: %s\n", paths[0], strerror(errno));
+                return -1;
+            }
+            madvise((void *)cap, cap_len, MADV_SEQUENTIAL);
+            return 0;
+        }
+        close(fd);
+    }
+
+    sort_captures(paths, npaths);
+    for (i = 0; i < npaths; i++) {
+        file_offsets[i] = cap_len;
+        if (cap_load(paths[i], &size) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static void set_iface_tsresol(struct iface *ifc, uint8_t resol)
+{
+    uint64_t ticks = 1;
+    int i;
+
+    /* Base 10 or 2 exponent; ns are the unit here */
+    if (resol & 0x80) {
+        ticks = 1ull << (resol & 0x7f);
+    } else {
+        for (i = 0; i < resol && i < 19; i++)
+            ticks *= 10;
+    }
+    if (ticks <= 1000000000ull) {
+        ifc->ts_mul = 1000000000ull / ticks;
+        ifc->ts_div = 1;
+    } else {
+        ifc->ts_mul = 1;
+        ifc->ts_div = ticks / 1000000000ull;
+    }
+}
+
+static int add_section(uint64_t off, int format, int swap)
+{
+    sections = realloc(sections, (num_sections + 1) * sizeof(*sections));
+    sections[num_sections] = (struct section){ off, format, swap, num_ifaces };
+    return num_sections++;
+}
+
+/* Classic pcap file header at off: one section with one interface */
+static int pcap_header(uint64_t off)
+{
+    uint32_t magic;
+    int swap, sec;
+
+    if (off + 24 > cap_len || num_ifaces == MAX_IFACES)
+        return -1;
+    magic = rd32(cap + off, 0);
+    if (magic != 0xa1b2c3d4 && magic != 0xa1b23c4d && magic != 0xd4c3b2a1 && magic != 0x4d3cb2a1)
+        return -1;
+    swap = magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1;
+    sec = add_section(off, FMT_PCAP, swap);
+    ifaces[num_ifaces].linktype = rd32(cap + off + 20, swap) & 0xffff;
+    set_iface_tsresol(&ifaces[num_ifaces], (magic == 0xa1b23c4d || magic == 0x4d3cb2a1) ? 9 : 6);
+    num_ifaces++;
+    return sec;
+}
+
+/* pcapng interface description block: linktype and if_tsresol */
+static void pcapng_idb(uint64_t off, uint32_t len, int swap)
+{
+    struct iface *ifc;
+    uint64_t o = off + 16;
+
+    if (num_ifaces == MAX_IFACES)
+        return;
+    ifc = &ifaces[num_ifaces++];
+    ifc->linktype = rd16(cap + off + 8, swap);
+    set_iface_tsresol(ifc, 6);
+    while (o + 4 <= off + len - 4) {
+        uint16_t code = rd16(cap + o, swap), olen = rd16(cap + o + 2, swap);
+
+        if (code == 0)
+            break;
+        if (code == 9 && olen >= 1)
+            set_iface_tsresol(ifc, cap[o + 4]);
+        o += 4 + ((olen + 3) & ~3u);
+    }
+}
+
+/* Length of the record at off, 0 at the end of the data */
+static uint64_t record_len(uint64_t off, uint64_t end, const struct section *s)
+{
+    uint64_t len;
+
+    if (s->format == FMT_PCAP) {
+        if (off + 16 > end)
+            return 0;
+        len = 16 + (uint64_t)rd32(cap + off + 8, s->swap);
+    } else {
+        if (off + 12 > end)
+            return 0;
+        len = rd32(cap + off + 4, s->swap);
+        if (len < 12 || len % 4)
+            return 0;
+    }
+    return off + len <= end ? len : 0;
+}
+
+/*
+ * Walk the record headers once: sections, interfaces and the chunk cuts.
+ * Truncated files (a capture still being written) end at the last whole
+ * record.
+ */
+static int cap_index(int nchunks)
+{
+    uint64_t off, end, len, step, next_cut = 0;
+    int f, sec;
+
+    chunks = calloc(nchunks, sizeof(*chunks));
+    step = cap_len / nchunks + 1;
+
+    for (f = 0; f < num_files; f++) {
+        off = file_offsets[f];
+        end = f + 1 < num_files ? file_offsets[f + 1] : cap_len;
+
+        if (off + 4 <= end && rd32(cap + off, 0) == 0x0a0d0d0a) {
+            sec = -1;
+        } else if ((sec = pcap_header(off)) >= 0) {
+            off += 24;
+        } else {
+            fprintf(stderr, "Not a pcap or pcapng capture (file %d)\n", f + 1);
+            return -1;
+        }
+
+        while (off < end) {
+            if (sec < 0 || (sections[sec].format == FMT_PCAPNG && rd32(cap + off, 0) == 0x0a0d0d0a)) {
+                if (off + 12 > end)
+                    break;
+                sec = add_section(off, FMT_PCAPNG, rd32(cap + off + 8, 0) == 0x4d3c2b1a);
+            }
+            if (off >= next_cut && num_chunks < nchunks) {
+                if (num_chunks)
+                    chunks[num_chunks - 1].end = off;
+                chunks[num_chunks++] = (struct chunk){ off, 0, sec };
+                next_cut = off + step;
+            }
+
+            len = record_len(off, end, &sections[sec]);
+            if (!len)
+                break;
+            if (sections[sec].format == FMT_PCAPNG && rd32(cap + off, sections[sec].swap) == 1)
+                pcapng_idb(off, len, sections[sec].swap);
+            off += len;
+        }
+        if (off < end)
+            fprintf(stderr, "Warning: file %d truncated, %" PRIu64 " bytes ignored\n", f + 1, end - off);
+
+        /* Whatever follows is skipped by the walk: next section or file */
+        if (num_chunks)
+            chunks[num_chunks - 1].end = off;
+    }
+    return num_chunks ? 0 : -1;
+}
+
+/* =========================================================================
+ * Packet decoding
+ * ========================================================================= */
+
+/* Flow key with the two endpoints in canonical order */
+struct flow_key {
+    uint32_t addr[2][4];
+    uint16_t port[2];
+    uint8_t family;
+    uint8_t pad[3];
+};
+
+struct pkt {
+    uint64_t ts;            /* ns */
+    struct flow_key key;
+    int dir;                /* 0: endpoint 0 -> 1 */
+    uint32_t seq, ack;
+    uint32_t payload;
+    uint8_t flags;
+    const uint8_t *opts;
+    uint32_t optlen;        /* options present in the capture */
+};
+
+static int decode_ip(struct pkt *p, const uint8_t *d, uint32_t caplen)
+{
+    uint32_t src[4] = { 0 }, dst[4] = { 0 }, ip_payload, hl, doff;
+    uint16_t sport, dport;
+    const uint8_t *th;
+    int cmp;
+
+    if (caplen < 1)
+        return -1;
+    if ((d[0] >> 4) == 4) {
+        if (caplen < 20 || d[9] != IPPROTO_TCP || (be16(d + 6) & 0x1fff))
+            return -1;
+        hl = (d[0] & 0x0f) * 4;
+        if (hl < 20 || be16(d + 2) < hl)
+            return -1;
+        ip_payload = be16(d + 2) - hl;
+        memcpy(&src[0], d + 12, 4);
+        memcpy(&dst[0], d + 16, 4);
+        p->key.family = 4;
+    } else if ((d[0] >> 4) == 6) {
+        if (caplen < 40 || d[6] != IPPROTO_TCP)
+            return -1;
+        hl = 40;
+        ip_payload = be16(d + 4);
+        memcpy(src, d + 8, 16);
+        memcpy(dst, d + 24, 16);
+        p->key.family = 6;
+    } else {
+        return -1;
+    }
+
+    if (caplen < hl + 20)
+        return -1;
+    th = d + hl;
+    sport = be16(th);
+    dport = be16(th + 2);
+    p->seq = be32(th + 4);
+    p->ack = be32(th + 8);
+    doff = (th[12] >> 4) * 4;
+    p->flags = th[13];
+    if (doff < 20)
+        return -1;
+    p->payload = ip_payload > doff ? ip_payload - doff : 0;
+    p->opts = th + 20;
+    p->optlen = doff - 20;
+    if (hl + doff > caplen)
+        p->optlen = caplen > hl + 20 ? caplen - hl - 20 : 0;
+
+    cmp = memcmp(src, dst, sizeof(src));
+    if (cmp == 0)
+        cmp = (int)sport - (int)dport;
+    p->dir = cmp > 0;
+    memcpy(p->key.addr[p->dir], src, sizeof(src));
+    memcpy(p->key.addr[!p->dir], dst, sizeof(dst));
+    p->key.port[p->dir] = sport;
+    p->key.port[!p->dir] = dport;
+    return 0;
+}
+
+static int decode(struct pkt *p, uint16_t linktype, const uint8_t *d, uint32_t caplen)
+{
+    uint16_t proto;
+    uint32_t off;
+
+    memset(&p->key, 0, sizeof(p->key));
+    switch (linktype) {
+    case LINKTYPE_EN10MB:
+        if (caplen < 14)
+            return -1;
+        off = 12;
+        proto = be16(d + off);
+        while ((proto == 0x8100 || proto == 0x88a8) && off + 6 <= caplen) {
+            off += 4;
+            proto = be16(d + off);
+        }
+        off += 2;
+        break;
+    case LINKTYPE_LINUX_SLL:
+        if (caplen < 16)
+            return -1;
+        proto = be16(d + 14);
+        off = 16;
+        break;
+    case LINKTYPE_LINUX_SLL2:
+        if (caplen < 20)
+            return -1;
+        proto = be16(d);
+        off = 20;
+        break;
+    case LINKTYPE_RAW:
+    case LINKTYPE_IPV4:
+    case LINKTYPE_IPV6:
+        proto = 0x0800;
+        off = 0;
+        break;
+    default:
+        return -1;
+    }
+    if (proto != 0x0800 && proto != 0x86dd)
+        return -1;
+    if (off >= caplen)
+        return -1;
+    return decode_ip(p, d + off, caplen - off);
+}
+
+typedef void (*pkt_fn)(void *ctx, struct pkt *p);
+
+static void walk_chunk(const struct chunk *c, pkt_fn fn, void *ctx)
+{
+    uint64_t off = c->start, sec_end, len;
+    int sec = c->section;
+    struct pkt p;
+
+    sec_end = sec + 1 < num_sections ? sections[sec + 1].offset : cap_len;
+    while (off < c->end) {
+        const struct section *s = &sections[sec];
+        const uint8_t *rec = cap + off;
+        const struct iface *ifc;
+        const uint8_t *data;
+        uint32_t caplen, ifid;
+        uint64_t ticks;
+
+        len = record_len(off, sec_end, s);
+        if (!len) {
+            /* End of the file or section (or a truncated record) */
+            if (++sec >= num_sections)
+                break;
+            off = sections[sec].offset + (sections[sec].format == FMT_PCAP ? 24 : 0);
+            sec_end = sec + 1 < num_sections ? sections[sec + 1].offset : cap_len;
+            continue;
+        }
+
+        if (s->format == FMT_PCAP) {
+            ifc = &ifaces[s->iface_base];
+            caplen = rd32(rec + 8, s->swap);
+            p.ts = rd32(rec, s->swap) * 1000000000ull + rd32(rec + 4, s->swap) * ifc->ts_mul;
+            data = rec + 16;
+        } else {
+            /* Enhanced packet blocks only */
+            if (rd32(rec, s->swap) != 6) {
+                off += len;
+                continue;
+            }
+            ifid = s->iface_base + rd32(rec + 8, s->swap);
+            caplen = rd32(rec + 20, s->swap);
+            if (ifid >= (uint32_t)num_ifaces || 32 + (uint64_t)caplen > len) {
+                off += len;
+                continue;
+            }
+            ifc = &ifaces[ifid];
+            ticks = (uint64_t)rd32(rec + 12, s->swap) << 32 | rd32(rec + 16, s->swap);
+            p.ts = ticks * ifc->ts_mul / ifc->ts_div;
+            data = rec + 28;
+        }
+
+        if (decode(&p, ifc->linktype, data, caplen) == 0)
+            fn(ctx, &p);
+        off += len;
+    }
+}
+
+/* =========================================================================
+ * MPTCP
+ * ========================================================================= */
+
+struct mptcp_opts {
+    int has_token;
+    uint32_t token;         /* connection token (server key hash or join token) */
+    int has_map;
+    uint64_t dsn;           /* DSS mapping */
+    uint16_t data_len;
+    int dsn64;
+};
+
+static void parse_mptcp(const struct pkt *p, struct mptcp_opts *m)
+{
+    uint32_t i = 0;
+
+    memset(m, 0, sizeof(*m));
+    while (i < p->optlen) {
+        const uint8_t *o = p->opts + i;
+        uint8_t kind = o[0], len;
+
+        if (kind == 0)
+            break;
+        if (kind == 1) {
+            i++;
+            continue;
+        }
+        if (i + 1 >= p->optlen)
+            break;
+        len = o[1];
+        if (len < 2 || i + len > p->optlen)
+            break;
+
+        if (kind == TCPOPT_MPTCP && len >= 4) {
+            uint8_t subtype = o[2] >> 4;
+
+            if (subtype == MPTCP_MP_CAPABLE && (p->flags & TH_SYN) && (p->flags & TH_ACK) && len >= 12) {
+                /* SYN-ACK: key of the server */
+                m->has_token = 1;
+                m->token = mptcp_token(be64(o + 4));
+            } else if (subtype == MPTCP_MP_CAPABLE && !(p->flags & TH_SYN) && len >= 20) {
+                /* Third ACK: client key then server key */
+                m->has_token = 1;
+                m->token = mptcp_token(be64(o + 12));
+            } else if (subtype == MPTCP_MP_JOIN && (p->flags & TH_SYN) && !(p->flags & TH_ACK) && len >= 12) {
+                m->has_token = 1;
+                m->token = be32(o + 4);
+            } else if (subtype == MPTCP_DSS) {
+                uint8_t fl = o[3];
+                uint32_t j = 4;
+
+                if (fl & 0x01)
+                    j += (fl & 0x02) ? 8 : 4;
+                if ((fl & 0x04) && j + ((fl & 0x08) ? 8 : 4) + 6 <= len) {
+                    m->dsn64 = !!(fl & 0x08);
+                    m->dsn = m->dsn64 ? be64(o + j) : be32(o + j);
+                    j += m->dsn64 ? 8 : 4;
+                    m->data_len = be16(o + j + 4);
+                    m->has_map = 1;
+                }
+            }
+        }
+        i += len;
+    }
+}
+
+/* =========================================================================
+ * Flow tables
+ * ========================================================================= */
+
+struct bin {
+    uint64_t bytes;
+    uint64_t rtt_sum;       /* ns */
+    uint32_t packets;
+    uint32_t rtt_n;
+    uint32_t retrans;
+    uint32_t reordered;
+};
+
+struct series {
+    int64_t first;          /* bin index of b[0] */
+    uint32_t n, cap;
+    struct bin *b;
+};
+
+struct rtt_ent {
+    uint32_t end;
+    uint8_t retx;
+    uint64_t ts;
+};
+
+struct dir_state {
+    struct series s;
+    int started;
+    uint32_t max_end;       /* highest sequence seen */
+    uint64_t max_ts;
+    uint32_t una;           /* highest ACK from the peer */
+    uint64_t rtt_min;
+    struct rtt_ent ring[RTT_RING];
+    uint32_t head, count;
+    /* Totals */
+    uint64_t bytes, packets, retrans, reordered, rtt_n, rtt_sum, rtt_max;
+    uint64_t first_ts, last_ts;
+    /* Connection-level (DSS) state of this direction, see conn_state */
+    uint64_t dsn_ooo;
+};
+
+struct flow {
+    struct flow_key key;
+    int used;
+    /* From the handshake pass */
+    int has_token;
+    uint32_t token;
+    int subflow;
+    int client;             /* endpoint index of the SYN sender, -1 unknown */
+    uint64_t syn_ts;
+    struct dir_state *d[2]; /* analysis */
+};
+
+struct table {
+    struct flow *slots;
+    size_t size, used;
+};
+
+/* Connection data-level state (per thread, keyed by token and direction) */
+struct conn_state {
+    uint32_t token;
+    int used;
+    int started[2];
+    uint64_t max_end[2];
+    uint64_t ooo[2];
+};
+
+struct conn_table {
+    struct conn_state *slots;
+    size_t size, used;
+};
+
+static uint64_t hash_bytes(const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    uint64_t h = 0xcbf29ce484222325ull;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        h = (h ^ p[i]) * 0x100000001b3ull;
+    return h ^ (h >> 29);
+}
+
+static struct flow *table_get(struct table *t, const struct flow_key *key, int create);
+
+static void table_grow(struct table *t)
+{
+    struct table n = { .size = t->size ? t->size * 2 : 1024 };
+    size_t i;
+
+    n.slots = calloc(n.size, sizeof(*n.slots));
+    for (i = 0; i < t->size; i++) {
+        if (t->slots[i].used) {
+            struct flow *f = table_get(&n, &t->slots[i].key, 1);
+            *f = t->slots[i];
+        }
+    }
+    free(t->slots);
+    *t = n;
+}
+
+static struct flow *table_get(struct table *t, const struct flow_key *key, int create)
+{
+    size_t i;
+
+    if (create && (t->used + 1) * 2 > t->size)
+        table_grow(t);
+    if (!t->size)
+        return NULL;
+    i = hash_bytes(key, sizeof(*key)) & (t->size - 1);
+    while (t->slots[i].used) {
+        if (!memcmp(&t->slots[i].key, key, sizeof(*key)))
+            return &t->slots[i];
+        i = (i + 1) & (t->size - 1);
+    }
+    if (!create)
+        return NULL;
+    memset(&t->slots[i], 0, sizeof(t->slots[i]));
+    t->slots[i].used = 1;
+    t->slots[i].key = *key;
+    t->slots[i].client = -1;
+    t->used++;
+    return &t->slots[i];
+}
+
+static struct conn_state *conn_get(struct conn_table *t, uint32_t token)
+{
+    size_t i;
+
+    if ((t->used + 1) * 2 > t->size) {
+        struct conn_table n = { .size = t->size ? t->size * 2 : 64 };
+
+        n.slots = calloc(n.size, sizeof(*n.slots));
+        for (i = 0; i < t->size; i++)
+            if (t->slots[i].used)
+                *conn_get(&n, t->slots[i].token) = t->slots[i];
+        free(t->slots);
+        *t = n;
+    }
+    i = (token * 2654435761u) & (t->size - 1);
+    while (t->slots[i].used && t->slots[i].token != token)
+        i = (i + 1) & (t->size - 1);
+    if (!t->slots[i].used) {
+        memset(&t->slots[i], 0, sizeof(t->slots[i]));
+        t->slots[i].used = 1;
+        t->slots[i].token = token;
+        t->used++;
+    }
+    return &t->slots[i];
+}
+
+static struct bin *series_bin(struct series *s, int64_t idx)
+{
+    if (s->n == 0) {
+        s->first = idx;
+    } else if (idx < s->first) {
+        uint32_t shift = (uint32_t)(s->first - idx);
+
+        if (s->n + shift > s->cap) {
+            s->cap = (s->n + shift) * 2;
+            s->b = realloc(s->b, s->cap * sizeof(*s->b));
+        }
+        memmove(s->b + shift, s->b, s->n * sizeof(*s->b));
+        memset(s->b, 0, shift * sizeof(*s->b));
+        s->n += shift;
+        s->first = idx;
+    }
+    if (idx - s->first >= s->n) {
+        uint32_t n = (uint32_t)(idx - s->first + 1);
+
+        if (n > s->cap) {
+            s->cap = n * 2 > 64 ? n * 2 : 64;
+            s->b = realloc(s->b, s->cap * sizeof(*s->b));
+        }
+        memset(s->b + s->n, 0, (n - s->n) * sizeof(*s->b));
+        s->n = n;
+    }
+    return &s->b[idx - s->first];
+}
+
+/* =========================================================================
+ * Pass 1: handshakes
+ * ========================================================================= */
+
+struct hs_ctx {
+    struct table flows;
+    uint64_t first_ts;
+};
+
+static void hs_packet(void *arg, struct pkt *p)
+{
+    struct hs_ctx *ctx = arg;
+    struct mptcp_opts m;
+    struct flow *f;
+
+    if (!ctx->first_ts || p->ts < ctx->first_ts)
+        ctx->first_ts = p->ts;
+    if (!(p->flags & TH_SYN))
+        return;
+    f = table_get(&ctx->flows, &p->key, 1);
+    if (!(p->flags & TH_ACK) && (f->client < 0 || p->ts < f->syn_ts)) {
+        f->client = p->dir;
+        f->syn_ts = p->ts;
+    }
+    parse_mptcp(p, &m);
+    if (m.has_token) {
+        f->has_token = 1;
+        f->token = m.token;
+    }
+}
+
+/* =========================================================================
+ * Pass 2: analysis
+ * ========================================================================= */
+
+static uint64_t t0;             /* first packet of the capture */
+static uint64_t bin_ns = DEFAULT_BIN_MS * 1000000ull;
+static struct table flows;      /* global: handshake info, then merged state */
+
+struct an_ctx {
+    struct table flows;
+    struct conn_table conns;
+};
+
+static int seq_before(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) < 0;
+}
+
+static struct dir_state *dir_state(struct flow *f, int dir)
+{
+    if (!f->d[dir])
+        f->d[dir] = calloc(1, sizeof(*f->d[dir]));
+    return f->d[dir];
+}
+
+static void rtt_sample(struct dir_state *ds, uint64_t ts, uint64_t rtt)
+{
+    struct bin *b = series_bin(&ds->s, (int64_t)(ts - t0) / (int64_t)bin_ns);
+
+    b->rtt_sum += rtt;
+    b->rtt_n++;
+    ds->rtt_sum += rtt;
+    ds->rtt_n++;
+    if (!ds->rtt_min || rtt < ds->rtt_min)
+        ds->rtt_min = rtt;
+    if (rtt > ds->rtt_max)
+        ds->rtt_max = rtt;
+}
+
+static void an_ack(struct dir_state *ds, uint32_t ack, uint64_t ts)
+{
+    struct rtt_ent *last = NULL;
+
+    if (!ds->started)
+        return;
+    if (seq_before(ds->una, ack) || !ds->una)
+        ds->una = ack;
+    while (ds->count) {
+        struct rtt_ent *e = &ds->ring[ds->head];
+
+        if (seq_before(ack, e->end))
+            break;
+        last = e;
+        ds->head = (ds->head + 1) % RTT_RING;
+        ds->count--;
+    }
+    /* Karn: no sample from a retransmitted segment */
+    if (last && !last->retx && ts >= last->ts)
+        rtt_sample(ds, ts, ts - last->ts);
+}
+
+static void an_data(struct dir_state *ds, struct pkt *p)
+{
+    struct bin *b = series_bin(&ds->s, (int64_t)(p->ts - t0) / (int64_t)bin_ns);
+    uint32_t end = p->seq + p->payload;
+
+    b->bytes += p->payload;
+    b->packets++;
+    ds->bytes += p->payload;
+    ds->packets++;
+    if (!ds->first_ts)
+        ds->first_ts = p->ts;
+    ds->last_ts = p->ts;
+
+    if (!ds->started || seq_before(ds->max_end, end)) {
+        ds->started = 1;
+        ds->max_end = end;
+        ds->max_ts = p->ts;
+        if (ds->count == RTT_RING) {
+            ds->head = (ds->head + 1) % RTT_RING;
+            ds->count--;
+        }
+        ds->ring[(ds->head + ds->count) % RTT_RING] = (struct rtt_ent){ .end = end, .ts = p->ts };
+        ds->count++;
+        return;
+    }
+
+    /* Below the highest sequence: retransmitted or reordered */
+    {
+        uint64_t window = ds->rtt_min ? ds->rtt_min : REORDER_DEFAULT_NS;
+        int seen = seq_before(p->seq, ds->una) && ds->una;
+        uint32_t i;
+
+        for (i = 0; i < ds->count && !seen; i++) {
+            struct rtt_ent *e = &ds->ring[(ds->head + i) % RTT_RING];
+            if (e->end == end) {
+                e->retx = 1;
+                seen = 1;
+            }
+        }
+        if (seen || p->ts - ds->max_ts > window) {
+            b->retrans++;
+            ds->retrans++;
+        } else {
+            b->reordered++;
+            ds->reordered++;
+        }
+    }
+}
+
+static void an_packet(void *arg, struct pkt *p)
+{
+    struct an_ctx *ctx = arg;
+    struct flow *f = table_get(&ctx->flows, &p->key, 1);
+    struct dir_state *ds;
+
+    if (!f->has_token && !f->d[0] && !f->d[1]) {
+        const struct flow *g = table_get(&flows, &p->key, 0);
+        if (g) {
+            f->has_token = g->has_token;
+            f->token = g->token;
+            f->client = g->client;
+        }
+    }
+
+    if (p->flags & TH_ACK)
+        an_ack(dir_state(f, !p->dir), p->ack, p->ts);
+    if (p->payload == 0 || (p->flags & TH_SYN))
+        return;
+
+    ds = dir_state(f, p->dir);
+    an_data(ds, p);
+
+    if (f->has_token) {
+        struct mptcp_opts m;
+
+        parse_mptcp(p, &m);
+        if (m.has_map && m.data_len) {
+            /* Data direction of the connection: 0 client -> server */
+            struct conn_state *c = conn_get(&ctx->conns, f->token);
+            int cd = f->client < 0 ? p->dir : p->dir != f->client;
+            uint64_t end = m.dsn + m.data_len;
+            int before = m.dsn64 ? (int64_t)(m.dsn - c->max_end[cd]) < 0
+                                 : (int32_t)((uint32_t)m.dsn - (uint32_t)c->max_end[cd]) < 0;
+
+            if (!c->started[cd]) {
+                c->started[cd] = 1;
+                c->max_end[cd] = end;
+            } else if (before) {
+                c->ooo[cd]++;
+                ds->dsn_ooo++;
+            } else {
+                c->max_end[cd] = end;
+            }
+        }
+    }
+}
+
+/* =========================================================================
+ * Threads and merge
+ * ========================================================================= */
+
+struct job {
+    const struct chunk *chunk;
+    pkt_fn fn;
+    void *ctx;
+};
+
+static void *job_run(void *arg)
+{
+    struct job *j = arg;
+
+    walk_chunk(j->chunk, j->fn, j->ctx);
+    return NULL;
+}
+
+static void run_jobs(pkt_fn fn, void *ctxs, size_t ctx_size)
+{
+    pthread_t *threads = calloc(num_chunks, sizeof(*threads));
+    struct job *jobs = calloc(num_chunks, sizeof(*jobs));
+    int i;
+
+    for (i = 0; i < num_chunks; i++) {
+        jobs[i] = (struct job){ &chunks[i], fn, (char *)ctxs + i * ctx_size };
+        pthread_create(&threads[i], NULL, job_run, &jobs[i]);
+    }
+    for (i = 0; i < num_chunks; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+    free(jobs);
+}
+
+static void merge_dir(struct dir_state **dst, struct dir_state *src)
+{
+    struct dir_state *d;
+    uint32_t i;
+
+    if (!src)
+        return;
+    if (!*dst) {
+        *dst = src;
+        return;
+    }
+    d = *dst;
+    for (i = 0; i < src->s.n; i++) {
+        struct bin *from = &src->s.b[i], *to;
+
+        if (!from->packets && !from->rtt_n)
+            continue;
+        to = series_bin(&d->s, src->s.first + i);
+        to->bytes += from->bytes;
+        to->packets += from->packets;
+        to->rtt_sum += from->rtt_sum;
+        to->rtt_n += from->rtt_n;
+        to->retrans += from->retrans;
+        to->reordered += from->reordered;
+    }
+    d->bytes += src->bytes;
+    d->packets += src->packets;
+    d->retrans += src->retrans;
+    d->reordered += src->reordered;
+    d->rtt_n += src->rtt_n;
+    d->rtt_sum += src->rtt_sum;
+    d->dsn_ooo += src->dsn_ooo;
+    if (src->rtt_min && (!d->rtt_min || src->rtt_min < d->rtt_min))
+        d->rtt_min = src->rtt_min;
+    if (src->rtt_max > d->rtt_max)
+        d->rtt_max = src->rtt_max;
+    if (src->first_ts && (!d->first_ts || src->first_ts < d->first_ts))
+        d->first_ts = src->first_ts;
+    if (src->last_ts > d->last_ts)
+        d->last_ts = src->last_ts;
+    free(src->s.b);
+    free(src);
+}
+
+/* Subflow numbers: order of the SYN within each connection */
+static int cmp_flow_syn(const void *a, const void *b)
+{
+    const struct flow *x = *(const struct flow *const *)a, *y = *(const struct flow *const *)b;
+
+    if (x->token != y->token)
+        return x->token < y->token ? -1 : 1;
+    return (x->syn_ts > y->syn_ts) - (x->syn_ts < y->syn_ts);
+}
+
+static void number_subflows(void)
+{
+    struct flow **list = calloc(flows.used + 1, sizeof(*list));
+    size_t i, n = 0;
+    int sub = 0;
+
+    for (i = 0; i < flows.size; i++)
+        if (flows.slots[i].used && flows.slots[i].has_token)
+            list[n++] = &flows.slots[i];
+    qsort(list, n, sizeof(*list), cmp_flow_syn);
+    for (i = 0; i < n; i++) {
+        sub = (i && list[i]->token == list[i - 1]->token) ? sub + 1 : 0;
+        list[i]->subflow = sub;
+    }
+    free(list);
+}
+
+/* =========================================================================
+ * Output
+ * ========================================================================= */
+
+static void endpoint(const struct flow *f, int idx, char *buf, size_t size)
+{
+    inet_ntop(f->key.family == 4 ? AF_INET : AF_INET6, f->key.addr[idx], buf, size);
+}
+
+static int flow_selected(const struct flow *f, int mptcp_only, int has_filter, uint32_t filter)
+{
+    if (mptcp_only && !f->has_token)
+        return 0;
+    if (has_filter && (!f->has_token || f->token != filter))
+        return 0;
+    return 1;
+}
+
+static int cmp_flow_out(const void *a, const void *b)
+{
+    const struct flow *x = *(const struct flow *const *)a, *y = *(const struct flow *const *)b;
+
+    if (x->has_token != y->has_token)
+        return y->has_token - x->has_token;
+    if (x->token != y->token)
+        return x->token < y->token ? -1 : 1;
+    return x->subflow - y->subflow;
+}
+
+static void print_output(FILE *out, int summary, int mptcp_only, int has_filter, uint32_t filter)
+{
+    struct flow **list = calloc(flows.used + 1, sizeof(*list));
+    size_t i, n = 0;
+    int dir;
+
+    for (i = 0; i < flows.size; i++)
+        if (flows.slots[i].used && flow_selected(&flows.slots[i], mptcp_only, has_filter, filter))
+            list[n++] = &flows.slots[i];
+    qsort(list, n, sizeof(*list), cmp_flow_out);
+
+    if (summary)
+        fprintf(out, "token,subflow,src,sport,dst,dport,bytes,packets,mbps,rtt_min_ms,rtt_avg_ms,rtt_max_ms,"
+                     "retrans,reordered,dsn_ooo\n");
+    else
+        fprintf(out, "t_s,token,subflow,src,sport,dst,dport,mbps,packets,rtt_ms,retrans,reordered\n");
+
+    for (i = 0; i < n; i++) {
+        struct flow *f = list[i];
+        char token[16] = "-", sub[16] = "-";
+
+        if (f->has_token) {
+            snprintf(token, sizeof(token), "%08x", f->token);
+            snprintf(sub, sizeof(sub), "%d", f->subflow);
+        }
+        for (dir = 0; dir < 2; dir++) {
+            struct dir_state *ds = f->d[dir];
+            char src[INET6_ADDRSTRLEN], dst[INET6_ADDRSTRLEN];
+            uint32_t b;
+
+            if (!ds || !ds->bytes)
+                continue;
+            endpoint(f, dir, src, sizeof(src));
+            endpoint(f, !dir, dst, sizeof(dst));
+
+            if (summary) {
+                double secs = (ds->last_ts - ds->first_ts) / 1e9;
+
+                fprintf(out, "%s,%s,%s,%u,%s,%u,%" PRIu64 ",%" PRIu64 ",%.3f,%.3f,%.3f,%.3f,%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+                        token, sub, src, f->key.port[dir], dst, f->key.port[!dir], ds->bytes, ds->packets,
+                        secs > 0 ? ds->bytes * 8 / secs / 1e6 : 0.0,
+                        ds->rtt_min / 1e6, ds->rtt_n ? ds->rtt_sum / (double)ds->rtt_n / 1e6 : 0.0,
+                        ds->rtt_max / 1e6, ds->retrans, ds->reordered, ds->dsn_ooo);
+                continue;
+            }
+            for (b = 0; b < ds->s.n; b++) {
+                struct bin *bin = &ds->s.b[b];
+
+                if (!bin->packets && !bin->rtt_n)
+                    continue;
+                fprintf(out, "%.3f,%s,%s,%s,%u,%s,%u,%.3f,%u,", (ds->s.first + b) * (bin_ns / 1e9),
+                        token, sub, src, f->key.port[dir], dst, f->key.port[!dir],
+                        bin->bytes * 8 / (bin_ns / 1e9) / 1e6, bin->packets);
+                if (bin->rtt_n)
+                    fprintf(out, "%.3f", bin->rtt_sum / (double)bin->rtt_n / 1e6);
+                fprintf(out, ",%u,%u\n", bin->retrans, bin->reordered);
+            }
+        }
+    }
+    free(list);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s [OPTIONS] CAPTURE...\n"
+        "Several files (rotated captures of one port) are analysed as one, in the\n"
+        "order of their first packet.\n"
+        "Options:\n"
+        "  -b MS           bin width (default %d ms)\n"
+        "  -j N            threads (default: online CPUs)\n"
+        "  -o FILE         write the CSV to FILE (default: stdout)\n"
+        "  -s              per-subflow summary instead of the time series\n"
+        "  -S FILE         also write the per-subflow summary to FILE\n"
+        "  -m              MPTCP subflows only\n"
+        "  -t TOKEN        only the subflows of one connection (hex)\n",
+        prog, DEFAULT_BIN_MS);
+}
+
+int main(int argc, char **argv)
+{
+    long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    int summary = 0, mptcp_only = 0, has_filter = 0, opt, i;
+    uint32_t filter = 0;
+    const char *out_path = NULL, *summary_path = NULL;
+    struct hs_ctx *hs;
+    struct an_ctx *an;
+    FILE *out = stdout, *summary_out;
+
+    while ((opt = getopt(argc, argv, "b:j:o:sS:mt:h")) != -1) {
+        switch (opt) {
+        case 'b': bin_ns = strtoull(optarg, NULL, 10) * 1000000ull; break;
+        case 'j': nthreads = atol(optarg); break;
+        case 'o': out_path = optarg; break;
+        case 's': summary = 1; break;
+        case 'S': summary_path = optarg; break;
+        case 'm': mptcp_only = 1; break;
+        case 't': filter = strtoul(optarg, NULL, 16); has_filter = 1; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind >= argc || bin_ns == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (nthreads < 1)
+        nthreads = 1;
+
+    if (cap_open(argv + optind, argc - optind) < 0 || cap_index(nthreads) < 0)
+        return 1;
+
+    hs = calloc(num_chunks, sizeof(*hs));
+    run_jobs(hs_packet, hs, sizeof(*hs));
+    for (i = 0; i < num_chunks; i++) {
+        size_t s;
+
+        /* Time origin of the bins: first packet of the capture */
+        if (hs[i].first_ts && (!t0 || hs[i].first_ts < t0))
+            t0 = hs[i].first_ts;
+        for (s = 0; s < hs[i].flows.size; s++) {
+            struct flow *src = &hs[i].flows.slots[s], *dst;
+
+            if (!src->used)
+                continue;
+            dst = table_get(&flows, &src->key, 1);
+            if (src->has_token) {
+                dst->has_token = 1;
+                dst->token = src->token;
+            }
+            if (src->client >= 0 && (dst->client < 0 || src->syn_ts < dst->syn_ts)) {
+                dst->client = src->client;
+                dst->syn_ts = src->syn_ts;
+            }
+        }
+        free(hs[i].flows.slots);
+    }
+    free(hs);
+    number_subflows();
+
+    an = calloc(num_chunks, sizeof(*an));
+    run_jobs(an_packet, an, sizeof(*an));
+    for (i = 0; i < num_chunks; i++) {
+        size_t s;
+
+        for (s = 0; s < an[i].flows.size; s++) {
+            struct flow *src = &an[i].flows.slots[s], *dst;
+
+            if (!src->used)
+                continue;
+            dst = table_get(&flows, &src->key, 1);
+            merge_dir(&dst->d[0], src->d[0]);
+            merge_dir(&dst->d[1], src->d[1]);
+        }
+        free(an[i].flows.slots);
+        free(an[i].conns.slots);
+    }
+    free(an);
+
+    if (out_path) {
+        out = fopen(out_path, "w");
+        if (!out) {
+            fprintf(stderr, "%s: %s\n", out_path, strerror(errno));
+            return 1;
+        }
+    }
+    print_output(out, summary, mptcp_only, has_filter, filter);
+    if (out != stdout)
+        fclose(out);
+
+    if (summary_path) {
+        summary_out = fopen(summary_path, "w");
+        if (!summary_out) {
+            fprintf(stderr, "%s: %s\n", summary_path, strerror(errno));
+            return 1;
+        }
+        print_output(summary_out, 1, mptcp_only, has_filter, filter);
+        fclose(summary_out);
+    }
+    return 0;
+}
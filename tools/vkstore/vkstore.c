@@ -0,0 +1,1417 @@
+/*
+ * vkstore - columnar store and aggregator for iperf3 and vkload JSON results
+ *
+ *   vkstore ingest STORE [-j THREADS] [-l key=value]... PATH...
+ *   vkstore query  STORE [-m METRIC] [-g KEY[,KEY...]] [-w key=value]... [-i] [-c]
+ *   vkstore dump   STORE [-r]
+ *   vkstore info   STORE
+ *
+ * ingest parses iperf3 -J (and vkload -J) outputs in one pass with a streaming parser: no
+ * document tree is built, every value is matched against the path it
+ * appears under and the interval rows are emitted as their objects close.
+ * A PATH may be a file or a directory searched recursively for *.json.
+ * Files are parsed by a pool of threads and merged in path order.
+ *
+ * Labels of a run come from, by increasing precedence: the scheduler in
+ * "iperf_client-<scheduler>.json" and "load_client-<scheduler>.json" file
+ * names, the meta.env next to the
+ * file (written by libs/matrix.sh) and -l. Runs that ended with an iperf3
+ * "error" (interrupted, refused, ...) are skipped, and a source already in
+ * the store is not ingested twice, so a results directory can be ingested
+ * again as it grows.
+ *
+ * Two tables are stored, one value array per column:
+ *   runs  labels, source, end throughput/retransmits, duration, streams,
+ *         flow completion time percentiles (vkload -m fct)
+ *   rows  one row per interval and stream (stream 0xffff: the interval sum)
+ *         with throughput, bytes, retransmits, cwnd, rtt and flags
+ * Each column is zlib-compressed on its own ("VKS1" header, then a
+ * descriptor and the compressed bytes per column); unknown columns are
+ * skipped when reading.
+ *
+ * query groups runs by labels and prints n, mean, stddev, p50/p95/p99 and
+ * the 95% confidence interval of the mean (Student t). By default there is
+ * one value per run: the intervals of a run are autocorrelated, a CI over
+ * them would be too narrow. -i uses every (non-omitted) interval instead.
+ * The fct_* metrics are per run only, over the runs that measured them.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#define STORE_MAGIC     "VKS1"
+#define STORE_VERSION   1
+#define MAX_DEPTH       16
+#define MAX_LABELS      32
+#define MAX_FILTERS     16
+#define MAX_GROUP_KEYS  8
+#define SUM_STREAM      0xffff
+
+#define ROW_F_OMITTED   0x1
+#define ROW_F_SENDER    0x2
+
+enum { TABLE_RUNS, TABLE_ROWS };
+
+struct store_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t nruns;
+    uint32_t ncolumns;
+    uint64_t nrows;
+};
+
+struct column_header {
+    char name[24];
+    uint32_t table;
+    uint32_t size;          /* element size, 0 for strings */
+    uint64_t raw_len;
+    uint64_t comp_len;
+};
+
+/* One run (file) as parsed, before it is merged into the store */
+struct row {
+    uint16_t stream;
+    uint16_t interval;
+    float start;
+    float seconds;
+    double bps;
+    uint64_t bytes;
+    uint32_t retrans;
+    uint32_t cwnd;
+    uint32_t rtt;           /* us */
+    uint8_t flags;
+};
+
+struct parsed {
+    const char *path;
+    char *labels;
+    int error;              /* iperf3 reported an error, or bad JSON */
+    double bps;             /* end.sum_received */
+    uint32_t retrans;       /* end.sum_sent */
+    float duration;
+    uint16_t streams;
+    float fct_p50, fct_p99, fct_p999;   /* ms */
+    float last_end;         /* vkload intervals only carry their end */
+    int vkload_row;         /* cur is a vkload interval */
+    struct row *rows;
+    size_t nrows, cap;
+    struct row cur;         /* stream or sum object being parsed */
+};
+
+/* Column arrays of the whole store */
+struct store {
+    uint32_t nruns;
+    uint64_t nrows;
+    uint32_t runs_cap;
+    uint64_t rows_cap;
+
+    char **run_labels;
+    char **run_source;
+    double *run_bps;
+    uint32_t *run_retrans;
+    float *run_duration;
+    uint16_t *run_streams;
+    float *run_fct_p50;
+    float *run_fct_p99;
+    float *run_fct_p999;
+
+    uint32_t *row_run;
+    uint16_t *row_stream;
+    uint16_t *row_interval;
+    float *row_start;
+    float *row_seconds;
+    double *row_bps;
+    uint64_t *row_bytes;
+    uint32_t *row_retrans;
+    uint32_t *row_cwnd;
+    uint32_t *row_rtt;
+    uint8_t *row_flags;
+};
+
+static struct store st;
+
+struct column {
+    const char *name;
+    int table;
+    size_t size;            /* 0: array of strings */
+    void **data;
+};
+
+static struct column columns[] = {
+    { "run.labels",    TABLE_RUNS, 0,                 (void **)&st.run_labels },
+    { "run.source",    TABLE_RUNS, 0,                 (void **)&st.run_source },
+    { "run.bps",       TABLE_RUNS, sizeof(double),    (void **)&st.run_bps },
+    { "run.retrans",   TABLE_RUNS, sizeof(uint32_t),  (void **)&st.run_retrans },
+    { "run.duration",  TABLE_RUNS, sizeof(float),     (void **)&st.run_duration },
+    { "run.streams",   TABLE_RUNS, sizeof(uint16_t),  (void **)&st.run_streams },
+    { "run.fct_p50",   TABLE_RUNS, sizeof(float),     (void **)&st.run_fct_p50 },
+    { "run.fct_p99",   TABLE_RUNS, sizeof(float),     (void **)&st.run_fct_p99 },
+    { "run.fct_p999",  TABLE_RUNS, sizeof(float),     (void **)&st.run_fct_p999 },
+    { "row.run",       TABLE_ROWS, sizeof(uint32_t),  (void **)&st.row_run },
+    { "row.stream",    TABLE_ROWS, sizeof(uint16_t),  (void **)&st.row_stream },
+    { "row.interval",  TABLE_ROWS, sizeof(uint16_t),  (void **)&st.row_interval },
+    { "row.start",     TABLE_ROWS, sizeof(float),     (void **)&st.row_start },
+    { "row.seconds",   TABLE_ROWS, sizeof(float),     (void **)&st.row_seconds },
+    { "row.bps",       TABLE_ROWS, sizeof(double),    (void **)&st.row_bps },
+    { "row.bytes",     TABLE_ROWS, sizeof(uint64_t),  (void **)&st.row_bytes },
+    { "row.retrans",   TABLE_ROWS, sizeof(uint32_t),  (void **)&st.row_retrans },
+    { "row.cwnd",      TABLE_ROWS, sizeof(uint32_t),  (void **)&st.row_cwnd },
+    { "row.rtt",       TABLE_ROWS, sizeof(uint32_t),  (void **)&st.row_rtt },
+    { "row.flags",     TABLE_ROWS, sizeof(uint8_t),   (void **)&st.row_flags },
+};
+
+#define NUM_COLUMNS (sizeof(columns) / sizeof(columns[0]))
+
+/* =========================================================================
+ * Helpers
+ * ========================================================================= */
+
+static void *xrealloc(void *p, size_t size)
+{
+    p = realloc(p, size ? size : 1);
+    if (!p) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+static char *read_file(const char *path, size_t *len)
+{
+    struct stat sb;
+    char *buf;
+    ssize_t n;
+    size_t off = 0;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &sb) < 0) {
+        close(fd);
+        return NULL;
+    }
+    buf = xrealloc(NULL, sb.st_size + 1);
+    while (off < (size_t)sb.st_size && (n = read(fd, buf + off, sb.st_size - off)) > 0)
+        off += n;
+    close(fd);
+    buf[off] = '\0';
+    *len = off;
+    return buf;
+}
+
+/* Label sets are "key=value" entries separated by tabs */
+struct labels {
+    char *key[MAX_LABELS];
+    char *value[MAX_LABELS];
+    int count;
+};
+
+static void labels_set(struct labels *l, const char *key, size_t klen, const char *value, size_t vlen)
+{
+    int i;
+
+    for (i = 0; i < l->count; i++) {
+        if (strlen(l->key[i]) == klen && !memcmp(l->key[i], key, klen)) {
+            free(l->value[i]);
+            l->value[i] = strndup(value, vlen);
+            return;
+        }
+    }
+    if (l->count == MAX_LABELS)
+        return;
+    l->key[l->count] = strndup(key, klen);
+    l->value[l->count] = strndup(value, vlen);
+    l->count++;
+}
+
+static char *labels_join(struct labels *l)
+{
+    size_t len = 1;
+    char *out, *p;
+    int i;
+
+    for (i = 0; i < l->count; i++)
+        len += strlen(l->key[i]) + strlen(l->value[i]) + 2;
+    out = p = xrealloc(NULL, len);
+    *p = '\0';
+    for (i = 0; i < l->count; i++) {
+        p += sprintf(p, "%s%s=%s", i ? "\t" : "", l->key[i], l->value[i]);
+        free(l->key[i]);
+        free(l->value[i]);
+    }
+    l->count = 0;
+    return out;
+}
+
+/* Value of a label in a joined label string (into buf), NULL if absent */
+static const char *label_get(const char *labels, const char *key, char *buf, size_t size)
+{
+    size_t klen = strlen(key);
+    const char *p = labels;
+
+    while (*p) {
+        const char *end = strchr(p, '\t');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+
+        if (len > klen && p[klen] == '=' && !memcmp(p, key, klen)) {
+            size_t vlen = len - klen - 1;
+
+            if (vlen >= size)
+                vlen = size - 1;
+            memcpy(buf, p + klen + 1, vlen);
+            buf[vlen] = '\0';
+            return buf;
+        }
+        if (!end)
+            break;
+        p = end + 1;
+    }
+    return NULL;
+}
+
+/* =========================================================================
+ * Streaming iperf3 JSON parser
+ * ========================================================================= */
+
+struct jpath {
+    const char *key;        /* NULL for array elements */
+    size_t klen;
+    int index;
+};
+
+struct jparser {
+    const char *p;
+    const char *end;
+    struct jpath path[MAX_DEPTH];
+    int depth;
+    struct parsed *out;
+};
+
+static int key_is(const struct jpath *jp, const char *s)
+{
+    return jp->key && jp->klen == strlen(s) && !memcmp(jp->key, s, jp->klen);
+}
+
+static void skip_ws(struct jparser *jp)
+{
+    while (jp->p < jp->end && (*jp->p == ' ' || *jp->p == '\t' || *jp->p == '\n' || *jp->p == '\r'))
+        jp->p++;
+}
+
+/* Returns the string contents (escapes left as they are) */
+static int parse_string(struct jparser *jp, const char **s, size_t *len)
+{
+    const char *start;
+
+    if (*jp->p != '"')
+        return -1;
+    start = ++jp->p;
+    while (jp->p < jp->end && *jp->p != '"') {
+        if (*jp->p == '\\')
+            jp->p++;
+        jp->p++;
+    }
+    if (jp->p >= jp->end)
+        return -1;
+    *s = start;
+    *len = jp->p - start;
+    jp->p++;
+    return 0;
+}
+
+static void add_row(struct parsed *out, uint16_t stream, uint16_t interval)
+{
+    if (out->nrows == out->cap) {
+        out->cap = out->cap ? out->cap * 2 : 64;
+        out->rows = xrealloc(out->rows, out->cap * sizeof(*out->rows));
+    }
+    out->cur.stream = stream;
+    out->cur.interval = interval;
+    out->rows[out->nrows++] = out->cur;
+}
+
+static void set_row_field(struct row *r, const struct jpath *jp, double v)
+{
+    if (key_is(jp, "socket"))           r->stream = (uint16_t)v;
+    else if (key_is(jp, "start"))       r->start = v;
+    else if (key_is(jp, "seconds"))     r->seconds = v;
+    else if (key_is(jp, "bytes"))       r->bytes = v;
+    else if (key_is(jp, "bits_per_second")) r->bps = v;
+    else if (key_is(jp, "retransmits")) r->retrans = v;
+    else if (key_is(jp, "snd_cwnd"))    r->cwnd = v;
+    else if (key_is(jp, "rtt"))         r->rtt = v;
+    else if (key_is(jp, "omitted"))     r->flags = v ? (r->flags | ROW_F_OMITTED) : r->flags;
+    else if (key_is(jp, "sender"))      r->flags = v ? (r->flags | ROW_F_SENDER) : r->flags;
+}
+
+/* vkload -J: one interval sum per "intervals" element, an "fct" summary */
+static void on_vkload_scalar(struct jparser *jp, double v)
+{
+    struct jpath *p = jp->path;
+    struct parsed *out = jp->out;
+    int n = jp->depth;
+
+    if (n == 1 && key_is(&p[0], "duration_s"))
+        out->duration = v;
+    else if (n == 1 && key_is(&p[0], "connections"))
+        out->streams = v;
+    else if (n == 2 && key_is(&p[0], "receiver") && key_is(&p[1], "bits_per_second"))
+        out->bps = v;
+    else if (n == 3 && key_is(&p[0], "intervals") && key_is(&p[2], "end")) {
+        out->cur.start = v;
+        out->vkload_row = 1;
+    }
+    else if (n == 3 && key_is(&p[0], "intervals") && key_is(&p[2], "bits_per_second"))
+        out->cur.bps = v;
+    else if (n == 3 && key_is(&p[0], "fct") && key_is(&p[1], "fct_ms")) {
+        if (key_is(&p[2], "p50"))
+            out->fct_p50 = v;
+        else if (key_is(&p[2], "p99"))
+            out->fct_p99 = v;
+        else if (key_is(&p[2], "p999"))
+            out->fct_p999 = v;
+    }
+}
+
+/* A scalar (number, or boolean as 0/1) at the current path */
+static void on_scalar(struct jparser *jp, double v)
+{
+    struct jpath *p = jp->path;
+    struct parsed *out = jp->out;
+    int n = jp->depth;
+
+    on_vkload_scalar(jp, v);
+    if (n == 5 && key_is(&p[0], "intervals") && key_is(&p[2], "streams"))
+        set_row_field(&out->cur, &p[4], v);
+    else if (n == 4 && key_is(&p[0], "intervals") && key_is(&p[2], "sum"))
+        set_row_field(&out->cur, &p[3], v);
+    else if (n == 3 && key_is(&p[0], "end")) {
+        if (key_is(&p[1], "sum_received") && key_is(&p[2], "bits_per_second"))
+            out->bps = v;
+        else if (key_is(&p[1], "sum_sent") && key_is(&p[2], "retransmits"))
+            out->retrans = v;
+    } else if (n == 3 && key_is(&p[0], "start") && key_is(&p[1], "test_start")) {
+        if (key_is(&p[2], "duration"))
+            out->duration = v;
+        else if (key_is(&p[2], "num_streams"))
+            out->streams = v;
+    }
+}
+
+static void on_object_start(struct jparser *jp)
+{
+    struct jpath *p = jp->path;
+    int n = jp->depth;
+
+    if ((n == 4 && key_is(&p[0], "intervals") && key_is(&p[2], "streams")) ||
+        (n == 3 && key_is(&p[0], "intervals") && key_is(&p[2], "sum")) ||
+        (n == 2 && key_is(&p[0], "intervals")))
+        memset(&jp->out->cur, 0, sizeof(jp->out->cur));
+}
+
+static void on_object_end(struct jparser *jp)
+{
+    struct jpath *p = jp->path;
+    int n = jp->depth;
+
+    if (n == 4 && key_is(&p[0], "intervals") && key_is(&p[2], "streams"))
+        add_row(jp->out, jp->out->cur.stream, p[1].index);
+    else if (n == 3 && key_is(&p[0], "intervals") && key_is(&p[2], "sum"))
+        add_row(jp->out, SUM_STREAM, p[1].index);
+    else if (n == 2 && key_is(&p[0], "intervals") && jp->out->vkload_row) {
+        struct row *r = &jp->out->cur;
+        float end = r->start;
+
+        jp->out->vkload_row = 0;
+        r->start = jp->out->last_end;
+        r->seconds = end - r->start;
+        r->bytes = r->bps * r->seconds / 8;
+        jp->out->last_end = end;
+        add_row(jp->out, SUM_STREAM, p[1].index);
+    }
+}
+
+static int parse_value(struct jparser *jp);
+
+static int parse_object(struct jparser *jp)
+{
+    jp->p++;
+    on_object_start(jp);
+    skip_ws(jp);
+    if (jp->p < jp->end && *jp->p == '}') {
+        jp->p++;
+        on_object_end(jp);
+        return 0;
+    }
+    if (jp->depth == MAX_DEPTH)
+        return -1;
+
+    for (;;) {
+        struct jpath *slot = &jp->path[jp->depth];
+
+        skip_ws(jp);
+        if (jp->p >= jp->end || parse_string(jp, &slot->key, &slot->klen) < 0)
+            return -1;
+        skip_ws(jp);
+        if (jp->p >= jp->end || *jp->p++ != ':')
+            return -1;
+
+        /* A top-level "error" means the run did not complete */
+        if (jp->depth == 0 && key_is(slot, "error"))
+            jp->out->error = 1;
+
+        jp->depth++;
+        if (parse_value(jp) < 0)
+            return -1;
+        jp->depth--;
+
+        skip_ws(jp);
+        if (jp->p >= jp->end)
+            return -1;
+        if (*jp->p == ',') {
+            jp->p++;
+            continue;
+        }
+        if (*jp->p++ != '}')
+            return -1;
+        on_object_end(jp);
+        return 0;
+    }
+}
+
+static int parse_array(struct jparser *jp)
+{
+    struct jpath *slot;
+
+    jp->p++;
+    skip_ws(jp);
+    if (jp->p < jp->end && *jp->p == ']') {
+        jp->p++;
+        return 0;
+    }
+    if (jp->depth == MAX_DEPTH)
+        return -1;
+
+    slot = &jp->path[jp->depth];
+    slot->key = NULL;
+    slot->index = 0;
+    for (;;) {
+        jp->depth++;
+        if (parse_value(jp) < 0)
+            return -1;
+        jp->depth--;
+
+        skip_ws(jp);
+        if (jp->p >= jp->end)
+            return -1;
+        if (*jp->p == ',') {
+            jp->p++;
+            slot->index++;
+            continue;
+        }
+        return *jp->p++ == ']' ? 0 : -1;
+    }
+}
+
+static int parse_value(struct jparser *jp)
+{
+    const char *s;
+    size_t len;
+    char *num_end;
+    double v;
+
+    skip_ws(jp);
+    if (jp->p >= jp->end)
+        return -1;
+
+    switch (*jp->p) {
+    case '{':
+        return parse_object(jp);
+    case '[':
+        return parse_array(jp);
+    case '"':
+        return parse_string(jp, &s, &len);
+    case 't':
+        if (jp->end - jp->p < 4 || memcmp(jp->p, "true", 4))
+            return -1;
+        jp->p += 4;
+        on_scalar(jp, 1);
+        return 0;
+    case 'f':
+        if (jp->end - jp->p < 5 || memcmp(jp->p, "false", 5))
+            return -1;
+        jp->p += 5;
+        on_scalar(jp, 0);
+        return 0;
+    case 'n':
+        if (jp->end - jp->p < 4 || memcmp(jp->p, "null", 4))
+            return -1;
+        jp->p += 4;
+        return 0;
+    default:
+        /* The buffer is NUL-terminated, strtod cannot run past it */
+        v = strtod(jp->p, &num_end);
+        if (num_end == jp->p)
+            return -1;
+        jp->p = num_end;
+        on_scalar(jp, v);
+        return 0;
+    }
+}
+
+/* =========================================================================
+ * Ingest
+ * ========================================================================= */
+
+static struct labels cli_labels;
+static char **files;
+static size_t num_files, files_cap;
+
+static void load_meta_env(struct labels *l, const char *json_path)
+{
+    char meta[4096], line[1024];
+    const char *slash = strrchr(json_path, '/');
+    FILE *f;
+
+    snprintf(meta, sizeof(meta), "%.*smeta.env",
+             slash ? (int)(slash - json_path + 1) : 0, json_path);
+    f = fopen(meta, "r");
+    if (!f)
+        return;
+    while (fgets(line, sizeof(line), f)) {
+        char *eq = strchr(line, '=');
+        size_t len = strcspn(line, "\n");
+
+        if (!eq || eq - line >= (ptrdiff_t)len)
+            continue;
+        labels_set(l, line, eq - line, eq + 1, len - (eq - line) - 1);
+    }
+    fclose(f);
+}
+
+static void parse_file(struct parsed *out)
+{
+    struct labels l = { .count = 0 };
+    struct jparser jp = { 0 };
+    const char *base;
+    size_t len;
+    char *buf;
+    int i;
+
+    buf = read_file(out->path, &len);
+    if (!buf) {
+        out->error = 1;
+        return;
+    }
+    jp.p = buf;
+    jp.end = buf + len;
+    jp.out = out;
+    if (parse_value(&jp) < 0)
+        out->error = 1;
+    free(buf);
+
+    base = strrchr(out->path, '/');
+    base = base ? base + 1 : out->path;
+    for (i = 0; i < 2; i++) {
+        const char *prefix = i ? "load_client-" : "iperf_client-";
+        size_t plen = strlen(prefix);
+        const char *dot = strrchr(base, '.');
+
+        if (!strncmp(base, prefix, plen) && dot && dot > base + plen)
+            labels_set(&l, "scheduler", 9, base + plen, dot - base - plen);
+    }
+    load_meta_env(&l, out->path);
+    for (i = 0; i < cli_labels.count; i++)
+        labels_set(&l, cli_labels.key[i], strlen(cli_labels.key[i]),
+                   cli_labels.value[i], strlen(cli_labels.value[i]));
+    out->labels = labels_join(&l);
+}
+
+struct pool {
+    struct parsed *results;
+    size_t next;
+    pthread_mutex_t lock;
+};
+
+static void *parse_worker(void *arg)
+{
+    struct pool *pool = arg;
+
+    for (;;) {
+        size_t i;
+
+        pthread_mutex_lock(&pool->lock);
+        i = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        if (i >= num_files)
+            return NULL;
+        parse_file(&pool->results[i]);
+    }
+}
+
+static int collect_file(const char *path, const struct stat *sb, int type, struct FTW *ftw)
+{
+    size_t len = strlen(path);
+
+    (void)sb;
+    (void)ftw;
+    if (type != FTW_F || len < 5 || strcmp(path + len - 5, ".json"))
+        return 0;
+    if (num_files == files_cap) {
+        files_cap = files_cap ? files_cap * 2 : 256;
+        files = xrealloc(files, files_cap * sizeof(*files));
+    }
+    files[num_files++] = realpath(path, NULL);
+    if (!files[num_files - 1])
+        num_files--;
+    return 0;
+}
+
+static int cmp_str(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* Sources already in the store (open addressing on FNV-1a) */
+static char **seen;
+static size_t seen_size;
+
+static uint64_t fnv1a(const char *s)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    while (*s)
+        h = (h ^ (uint8_t)*s++) * 0x100000001b3ULL;
+    return h;
+}
+
+/* Returns 1 if the source was already present */
+static int seen_add(char *source)
+{
+    size_t i = fnv1a(source) & (seen_size - 1);
+
+    while (seen[i]) {
+        if (!strcmp(seen[i], source))
+            return 1;
+        i = (i + 1) & (seen_size - 1);
+    }
+    seen[i] = source;
+    return 0;
+}
+
+static void store_reserve(uint32_t runs, uint64_t rows)
+{
+    size_t i;
+
+    if (runs > st.runs_cap) {
+        st.runs_cap = runs * 2;
+        for (i = 0; i < NUM_COLUMNS; i++)
+            if (columns[i].table == TABLE_RUNS)
+                *columns[i].data = xrealloc(*columns[i].data,
+                    st.runs_cap * (columns[i].size ? columns[i].size : sizeof(char *)));
+    }
+    if (rows > st.rows_cap) {
+        st.rows_cap = rows * 2;
+        for (i = 0; i < NUM_COLUMNS; i++)
+            if (columns[i].table == TABLE_ROWS)
+                *columns[i].data = xrealloc(*columns[i].data, st.rows_cap * columns[i].size);
+    }
+}
+
+static void store_append(struct parsed *p)
+{
+    uint32_t run = st.nruns;
+    size_t i;
+
+    store_reserve(st.nruns + 1, st.nrows + p->nrows);
+    st.run_labels[run] = p->labels;
+    st.run_source[run] = (char *)p->path;
+    st.run_bps[run] = p->bps;
+    st.run_retrans[run] = p->retrans;
+    st.run_duration[run] = p->duration;
+    st.run_streams[run] = p->streams;
+    st.run_fct_p50[run] = p->fct_p50;
+    st.run_fct_p99[run] = p->fct_p99;
+    st.run_fct_p999[run] = p->fct_p999;
+    st.nruns++;
+
+    for (i = 0; i < p->nrows; i++) {
+        struct row *r = &p->rows[i];
+        uint64_t n = st.nrows++;
+
+        st.row_run[n] = run;
+        st.row_stream[n] = r->stream;
+        st.row_interval[n] = r->interval;
+        st.row_start[n] = r->start;
+        st.row_seconds[n] = r->seconds;
+        st.row_bps[n] = r->bps;
+        st.row_bytes[n] = r->bytes;
+        st.row_retrans[n] = r->retrans;
+        st.row_cwnd[n] = r->cwnd;
+        st.row_rtt[n] = r->rtt;
+        st.row_flags[n] = r->flags;
+    }
+}
+
+/* =========================================================================
+ * Store I/O
+ * ========================================================================= */
+
+static size_t column_count(const struct column *c)
+{
+    return c->table == TABLE_RUNS ? st.nruns : st.nrows;
+}
+
+static int store_load(const char *path)
+{
+    struct store_header h;
+    struct column_header ch;
+    FILE *f = fopen(path, "rb");
+    int loaded[NUM_COLUMNS] = { 0 };
+    uint32_t c;
+
+    if (!f)
+        return errno == ENOENT ? 0 : -1;
+    if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, STORE_MAGIC, 4) || h.version != STORE_VERSION) {
+        fprintf(stderr, "%s: not a vkstore file\n", path);
+        fclose(f);
+        return -1;
+    }
+    store_reserve(h.nruns, h.nrows);
+    st.nruns = h.nruns;
+    st.nrows = h.nrows;
+
+    for (c = 0; c < h.ncolumns; c++) {
+        struct column *col = NULL;
+        unsigned char *comp, *raw;
+        uLongf raw_len;
+        size_t i;
+
+        if (fread(&ch, sizeof(ch), 1, f) != 1)
+            goto bad;
+        ch.name[sizeof(ch.name) - 1] = '\0';
+        for (i = 0; i < NUM_COLUMNS; i++)
+            if (!strcmp(columns[i].name, ch.name))
+                col = &columns[i];
+        if (col && col->size == ch.size)
+            loaded[col - columns] = 1;
+
+        comp = xrealloc(NULL, ch.comp_len);
+        if (fread(comp, 1, ch.comp_len, f) != ch.comp_len) {
+            free(comp);
+            goto bad;
+        }
+        if (!col || col->size != ch.size) {
+            free(comp);
+            continue;
+        }
+
+        raw_len = ch.raw_len;
+        raw = xrealloc(NULL, raw_len);
+        if (uncompress(raw, &raw_len, comp, ch.comp_len) != Z_OK || raw_len != ch.raw_len) {
+            free(comp);
+            free(raw);
+            goto bad;
+        }
+        free(comp);
+
+        if (col->size) {
+            if (raw_len != column_count(col) * col->size) {
+                free(raw);
+                goto bad;
+            }
+            memcpy(*col->data, raw, raw_len);
+            free(raw);
+        } else {
+            /* NUL-separated strings, kept in the decompressed buffer */
+            char **strs = *col->data;
+            char *s = (char *)raw;
+
+            for (i = 0; i < column_count(col); i++) {
+                if (s >= (char *)raw + raw_len)
+                    goto bad;
+                strs[i] = s;
+                s += strlen(s) + 1;
+            }
+        }
+    }
+    fclose(f);
+
+    /* Columns added after the store was written read as 0 */
+    for (c = 0; c < NUM_COLUMNS; c++)
+        if (!loaded[c] && columns[c].size)
+            memset(*columns[c].data, 0, column_count(&columns[c]) * columns[c].size);
+    return 0;
+
+bad:
+    fprintf(stderr, "%s: truncated or corrupt\n", path);
+    fclose(f);
+    return -1;
+}
+
+static int write_column(FILE *f, const struct column *col)
+{
+    struct column_header ch = { 0 };
+    size_t count = column_count(col), i;
+    unsigned char *raw, *comp;
+    uLongf comp_len;
+    size_t raw_len = 0;
+    int ret = 0;
+
+    if (col->size) {
+        raw = *col->data;
+        raw_len = count * col->size;
+    } else {
+        char **strs = *col->data;
+        size_t off = 0;
+
+        for (i = 0; i < count; i++)
+            raw_len += strlen(strs[i]) + 1;
+        raw = xrealloc(NULL, raw_len);
+        for (i = 0; i < count; i++) {
+            size_t len = strlen(strs[i]) + 1;
+            memcpy(raw + off, strs[i], len);
+            off += len;
+        }
+    }
+
+    comp_len = compressBound(raw_len);
+    comp = xrealloc(NULL, comp_len);
+    if (compress2(comp, &comp_len, raw, raw_len, 6) != Z_OK) {
+        ret = -1;
+        goto out;
+    }
+
+    snprintf(ch.name, sizeof(ch.name), "%s", col->name);
+    ch.table = col->table;
+    ch.size = col->size;
+    ch.raw_len = raw_len;
+    ch.comp_len = comp_len;
+    if (fwrite(&ch, sizeof(ch), 1, f) != 1 || fwrite(comp, 1, comp_len, f) != comp_len)
+        ret = -1;
+out:
+    free(comp);
+    if (!col->size)
+        free(raw);
+    return ret;
+}
+
+static int store_save(const char *path)
+{
+    struct store_header h = { .version = STORE_VERSION };
+    char tmp[4096];
+    size_t i;
+    FILE *f;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    f = fopen(tmp, "wb");
+    if (!f) {
+        fprintf(stderr, "%s: %s\n", tmp, strerror(errno));
+        return -1;
+    }
+    memcpy(h.magic, STORE_MAGIC, 4);
+    h.nruns = st.nruns;
+    h.nrows = st.nrows;
+    h.ncolumns = NUM_COLUMNS;
+    if (fwrite(&h, sizeof(h), 1, f) != 1)
+        goto bad;
+    for (i = 0; i < NUM_COLUMNS; i++)
+        if (write_column(f, &columns[i]) < 0)
+            goto bad;
+    if (fclose(f) != 0) {
+        f = NULL;
+        goto bad;
+    }
+    return rename(tmp, path);
+
+bad:
+    fprintf(stderr, "%s: write failed\n", tmp);
+    if (f)
+        fclose(f);
+    unlink(tmp);
+    return -1;
+}
+
+static int cmd_ingest(const char *store_path, int argc, char **argv)
+{
+    struct parsed *results;
+    struct pool pool = { .next = 0 };
+    pthread_t *threads;
+    long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t i, added = 0, skipped_error = 0, skipped_dup = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "j:l:")) != -1) {
+        switch (opt) {
+        case 'j':
+            nthreads = atol(optarg);
+            break;
+        case 'l': {
+            char *eq = strchr(optarg, '=');
+            if (!eq) {
+                fprintf(stderr, "Invalid label: %s (key=value)\n", optarg);
+                return 1;
+            }
+            labels_set(&cli_labels, optarg, eq - optarg, eq + 1, strlen(eq + 1));
+            break;
+        }
+        default:
+            return 1;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "No input given\n");
+        return 1;
+    }
+    if (nthreads < 1)
+        nthreads = 1;
+
+    if (store_load(store_path) < 0)
+        return 1;
+
+    for (i = optind; i < (size_t)argc; i++) {
+        struct stat sb;
+
+        if (stat(argv[i], &sb) < 0) {
+            fprintf(stderr, "%s: %s\n", argv[i], strerror(errno));
+            return 1;
+        }
+        if (S_ISDIR(sb.st_mode))
+            nftw(argv[i], collect_file, 32, FTW_PHYS);
+        else
+            collect_file(argv[i], &sb, FTW_F, NULL);
+    }
+    qsort(files, num_files, sizeof(*files), cmp_str);
+
+    results = calloc(num_files ? num_files : 1, sizeof(*results));
+    for (i = 0; i < num_files; i++)
+        results[i].path = files[i];
+    if ((size_t)nthreads > num_files)
+        nthreads = num_files ? num_files : 1;
+
+    pool.results = results;
+    pthread_mutex_init(&pool.lock, NULL);
+    threads = calloc(nthreads, sizeof(*threads));
+    for (i = 0; i < (size_t)nthreads; i++)
+        pthread_create(&threads[i], NULL, parse_worker, &pool);
+    for (i = 0; i < (size_t)nthreads; i++)
+        pthread_join(threads[i], NULL);
+
+    for (seen_size = 1024; seen_size < 2 * (st.nruns + num_files); seen_size *= 2)
+        ;
+    seen = calloc(seen_size, sizeof(*seen));
+    for (i = 0; i < st.nruns; i++)
+        seen_add(st.run_source[i]);
+
+    for (i = 0; i < num_files; i++) {
+        struct parsed *p = &results[i];
+
+        if (p->error) {
+            skipped_error++;
+            continue;
+        }
+        if (seen_add((char *)p->path)) {
+            skipped_dup++;
+            continue;
+        }
+        store_append(p);
+        free(p->rows);
+        added++;
+    }
+
+    if (store_save(store_path) < 0)
+        return 1;
+    printf("%zu runs added (%zu with errors, %zu already stored), %u runs and %" PRIu64 " rows in %s\n",
+           added, skipped_error, skipped_dup, st.nruns, st.nrows, store_path);
+    return 0;
+}
+
+/* =========================================================================
+ * Query
+ * ========================================================================= */
+
+enum metric { M_THROUGHPUT, M_RETRANS, M_RTT, M_CWND, M_FCT_P50, M_FCT_P99, M_FCT_P999 };
+
+static const struct {
+    const char *name;
+    const char *unit;
+} metrics[] = {
+    [M_THROUGHPUT] = { "throughput", "Mbit/s" },
+    [M_RETRANS]    = { "retrans", "segments" },
+    [M_RTT]        = { "rtt", "ms" },
+    [M_CWND]       = { "cwnd", "KB" },
+    [M_FCT_P50]    = { "fct_p50", "ms" },
+    [M_FCT_P99]    = { "fct_p99", "ms" },
+    [M_FCT_P999]   = { "fct_p999", "ms" },
+};
+
+struct values {
+    double *v;
+    size_t n, cap;
+};
+
+static void values_add(struct values *vals, double v)
+{
+    if (vals->n == vals->cap) {
+        vals->cap = vals->cap ? vals->cap * 2 : 256;
+        vals->v = xrealloc(vals->v, vals->cap * sizeof(double));
+    }
+    vals->v[vals->n++] = v;
+}
+
+/* Value of a row for a metric; returns 0 if the row does not carry it */
+static int row_value(uint64_t i, enum metric m, double *v)
+{
+    if (st.row_flags[i] & ROW_F_OMITTED)
+        return 0;
+    switch (m) {
+    case M_THROUGHPUT:
+        if (st.row_stream[i] != SUM_STREAM)
+            return 0;
+        *v = st.row_bps[i] / 1e6;
+        return 1;
+    case M_RETRANS:
+        if (st.row_stream[i] != SUM_STREAM)
+            return 0;
+        *v = st.row_retrans[i];
+        return 1;
+    case M_RTT:
+    case M_CWND:
+        /* Only the sending side reports rtt and cwnd */
+        if (st.row_stream[i] == SUM_STREAM || !(st.row_flags[i] & ROW_F_SENDER))
+            return 0;
+        *v = m == M_RTT ? st.row_rtt[i] / 1e3 : st.row_cwnd[i] / 1024.0;
+        return 1;
+    default:
+        /* per run only */
+        return 0;
+    }
+    return 0;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, size_t n, double q)
+{
+    double pos = q * (n - 1);
+    size_t lo = (size_t)pos;
+
+    if (lo + 1 >= n)
+        return sorted[n - 1];
+    return sorted[lo] + (pos - lo) * (sorted[lo + 1] - sorted[lo]);
+}
+
+/* Two-sided 95% Student t quantile */
+static double t95(size_t df)
+{
+    static const double table[] = {
+        0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+    };
+
+    if (df == 0)
+        return NAN;
+    if (df <= 30)
+        return table[df];
+    return 1.960 + 2.5 / df;
+}
+
+struct group {
+    char *key;
+    struct values vals;
+};
+
+static int cmp_group(const void *a, const void *b)
+{
+    return strcmp(((const struct group *)a)->key, ((const struct group *)b)->key);
+}
+
+static int cmd_query(const char *store_path, int argc, char **argv)
+{
+    char *group_keys[MAX_GROUP_KEYS], *filters[MAX_FILTERS];
+    int num_group_keys = 0, num_filters = 0, per_interval = 0, csv = 0, opt, k;
+    enum metric metric = M_THROUGHPUT;
+    struct group *groups = NULL;
+    size_t num_groups = 0, groups_cap = 0, i;
+    uint64_t *row_first, r;
+    char buf[256];
+
+    group_keys[num_group_keys++] = "scheduler";
+    while ((opt = getopt(argc, argv, "m:g:w:ic")) != -1) {
+        switch (opt) {
+        case 'm':
+            for (k = 0; k < (int)(sizeof(metrics) / sizeof(metrics[0])); k++)
+                if (!strcmp(optarg, metrics[k].name))
+                    break;
+            if (k == (int)(sizeof(metrics) / sizeof(metrics[0]))) {
+                fprintf(stderr, "Unknown metric: %s (throughput, retrans, rtt, cwnd, fct_p50, fct_p99, fct_p999)\n", optarg);
+                return 1;
+            }
+            metric = k;
+            break;
+        case 'g': {
+            char *tok, *save = NULL;
+            num_group_keys = 0;
+            for (tok = strtok_r(optarg, ",", &save); tok && num_group_keys < MAX_GROUP_KEYS;
+                 tok = strtok_r(NULL, ",", &save))
+                group_keys[num_group_keys++] = tok;
+            break;
+        }
+        case 'w':
+            if (!strchr(optarg, '=') || num_filters == MAX_FILTERS) {
+                fprintf(stderr, "Invalid filter: %s (key=value)\n", optarg);
+                return 1;
+            }
+            filters[num_filters++] = optarg;
+            break;
+        case 'i':
+            per_interval = 1;
+            break;
+        case 'c':
+            csv = 1;
+            break;
+        default:
+            return 1;
+        }
+    }
+
+    if (store_load(store_path) < 0)
+        return 1;
+    if (st.nruns == 0) {
+        fprintf(stderr, "%s: empty or missing store\n", store_path);
+        return 1;
+    }
+
+    /* Rows are stored run by run: first row of each run */
+    row_first = xrealloc(NULL, (st.nruns + 1) * sizeof(*row_first));
+    for (i = 0, r = 0; i <= st.nruns; i++) {
+        while (r < st.nrows && st.row_run[r] < i)
+            r++;
+        row_first[i] = r;
+    }
+
+    for (i = 0; i < st.nruns; i++) {
+        const char *labels = st.run_labels[i];
+        char key[1024] = "";
+        size_t len = 0, g;
+        int f, pass = 1;
+        double sum = 0, v;
+        size_t count = 0;
+
+        for (f = 0; f < num_filters && pass; f++) {
+            char *eq = strchr(filters[f], '=');
+            const char *val;
+
+            *eq = '\0';
+            val = label_get(labels, filters[f], buf, sizeof(buf));
+            pass = val && !strcmp(val, eq + 1);
+            *eq = '=';
+        }
+        if (!pass)
+            continue;
+
+        for (k = 0; k < num_group_keys; k++) {
+            const char *val = label_get(labels, group_keys[k], buf, sizeof(buf));
+            len += snprintf(key + len, sizeof(key) - len, "%s%s", k ? "\t" : "", val ? val : "-");
+            if (len >= sizeof(key))
+                len = sizeof(key) - 1;
+        }
+
+        for (g = 0; g < num_groups; g++)
+            if (!strcmp(groups[g].key, key))
+                break;
+        if (g == num_groups) {
+            if (num_groups == groups_cap) {
+                groups_cap = groups_cap ? groups_cap * 2 : 16;
+                groups = xrealloc(groups, groups_cap * sizeof(*groups));
+            }
+            groups[g].key = strdup(key);
+            memset(&groups[g].vals, 0, sizeof(groups[g].vals));
+            num_groups++;
+        }
+
+        if (!per_interval && metric == M_THROUGHPUT) {
+            values_add(&groups[g].vals, st.run_bps[i] / 1e6);
+            continue;
+        }
+        if (!per_interval && metric == M_RETRANS) {
+            values_add(&groups[g].vals, st.run_retrans[i]);
+            continue;
+        }
+        if (metric >= M_FCT_P50) {
+            float *fct = metric == M_FCT_P50 ? st.run_fct_p50 :
+                         metric == M_FCT_P99 ? st.run_fct_p99 : st.run_fct_p999;
+
+            if (fct[i] > 0)
+                values_add(&groups[g].vals, fct[i]);
+            continue;
+        }
+        for (r = row_first[i]; r < row_first[i + 1]; r++) {
+            if (!row_value(r, metric, &v))
+                continue;
+            if (per_interval)
+                values_add(&groups[g].vals, v);
+            sum += v;
+            count++;
+        }
+        if (!per_interval && count)
+            values_add(&groups[g].vals, sum / count);
+    }
+    qsort(groups, num_groups, sizeof(*groups), cmp_group);
+
+    for (k = 0; k < num_group_keys; k++)
+        printf(csv ? "%s," : "%-12s ", group_keys[k]);
+    printf(csv ? "n,mean,stddev,p50,p95,p99,ci95\n" : "%6s %12s %10s %12s %12s %12s %10s   (%s %s, per %s)\n",
+           "n", "mean", "stddev", "p50", "p95", "p99", "ci95", metrics[metric].name,
+           metrics[metric].unit, per_interval ? "interval" : "run");
+
+    for (i = 0; i < num_groups; i++) {
+        struct values *vals = &groups[i].vals;
+        double mean = 0, var = 0, sd, ci;
+        char *save = NULL, *tok;
+        size_t j;
+
+        if (vals->n == 0)
+            continue;
+        for (j = 0; j < vals->n; j++)
+            mean += vals->v[j];
+        mean /= vals->n;
+        for (j = 0; j < vals->n; j++)
+            var += (vals->v[j] - mean) * (vals->v[j] - mean);
+        sd = vals->n > 1 ? sqrt(var / (vals->n - 1)) : 0;
+        ci = vals->n > 1 ? t95(vals->n - 1) * sd / sqrt(vals->n) : NAN;
+        qsort(vals->v, vals->n, sizeof(double), cmp_double);
+
+        for (tok = strtok_r(groups[i].key, "\t", &save), k = 0; k < num_group_keys;
+             tok = strtok_r(NULL, "\t", &save), k++)
+            printf(csv ? "%s," : "%-12s ", tok ? tok : "-");
+        printf(csv ? "%zu,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g\n" : "%6zu %12.3f %10.3f %12.3f %12.3f %12.3f %10.3f\n",
+               vals->n, mean, sd, percentile(vals->v, vals->n, 0.50),
+               percentile(vals->v, vals->n, 0.95), percentile(vals->v, vals->n, 0.99), ci);
+    }
+    return 0;
+}
+
+/* =========================================================================
+ * Dump and info
+ * ========================================================================= */
+
+static int cmd_dump(const char *store_path, int argc, char **argv)
+{
+    int runs_only = 0, opt;
+    uint64_t i;
+
+    while ((opt = getopt(argc, argv, "r")) != -1) {
+        if (opt != 'r')
+            return 1;
+        runs_only = 1;
+    }
+    if (store_load(store_path) < 0)
+        return 1;
+
+    if (runs_only) {
+        printf("run,source,bits_per_second,retransmits,duration,streams,fct_p50_ms,fct_p99_ms,fct_p999_ms,labels\n");
+        for (i = 0; i < st.nruns; i++)
+            printf("%" PRIu64 ",%s,%.0f,%u,%g,%u,%g,%g,%g,\"%s\"\n", i, st.run_source[i], st.run_bps[i],
+                   st.run_retrans[i], st.run_duration[i], st.run_streams[i], st.run_fct_p50[i],
+                   st.run_fct_p99[i], st.run_fct_p999[i], st.run_labels[i]);
+        return 0;
+    }
+
+    printf("run,interval,stream,start,seconds,bits_per_second,bytes,retransmits,snd_cwnd,rtt_us,omitted,sender\n");
+    for (i = 0; i < st.nrows; i++) {
+        char stream[8];
+
+        if (st.row_stream[i] == SUM_STREAM)
+            strcpy(stream, "sum");
+        else
+            snprintf(stream, sizeof(stream), "%u", st.row_stream[i]);
+        printf("%u,%u,%s,%.3f,%.3f,%.0f,%" PRIu64 ",%u,%u,%u,%d,%d\n",
+               st.row_run[i], st.row_interval[i], stream, st.row_start[i], st.row_seconds[i],
+               st.row_bps[i], st.row_bytes[i], st.row_retrans[i], st.row_cwnd[i], st.row_rtt[i],
+               !!(st.row_flags[i] & ROW_F_OMITTED), !!(st.row_flags[i] & ROW_F_SENDER));
+    }
+    return 0;
+}
+
+static int cmd_info(const char *store_path)
+{
+    struct store_header h;
+    struct column_header ch;
+    FILE *f = fopen(store_path, "rb");
+    uint64_t raw = 0, comp = 0;
+    uint32_t c;
+
+    if (!f || fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, STORE_MAGIC, 4)) {
+        fprintf(stderr, "%s: not a vkstore file\n", store_path);
+        return 1;
+    }
+    printf("%s: %u runs, %" PRIu64 " rows\n", store_path, h.nruns, h.nrows);
+    for (c = 0; c < h.ncolumns && fread(&ch, sizeof(ch), 1, f) == 1; c++) {
+        ch.name[sizeof(ch.name) - 1] = '\0';
+        printf("  %-14s %10" PRIu64 " -> %10" PRIu64 " bytes\n", ch.name, ch.raw_len, ch.comp_len);
+        raw += ch.raw_len;
+        comp += ch.comp_len;
+        fseek(f, ch.comp_len, SEEK_CUR);
+    }
+    printf("  %-14s %10" PRIu64 " -> %10" PRIu64 " bytes\n", "total", raw, comp);
+    fclose(f);
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s COMMAND STORE [OPTIONS]\n"
+        "Commands:\n"
+        "  ingest STORE [-j N] [-l key=value]... PATH...\n"
+        "                  add iperf3/vkload JSON files (directories are searched for *.json)\n"
+        "  query STORE [-m METRIC] [-g KEY[,KEY...]] [-w key=value]... [-i] [-c]\n"
+        "                  statistics per group (default: -m throughput -g scheduler)\n"
+        "                  METRIC: throughput, retrans, rtt, cwnd, fct_p50, fct_p99, fct_p999\n"
+        "                  -i: one value per interval instead of per run, -c: CSV\n"
+        "  dump STORE [-r] CSV of the interval rows (-r: of the runs)\n"
+        "  info STORE      sizes of the columns\n",
+        prog);
+}
+
+int main(int argc, char **argv)
+{
+    const char *cmd, *store_path;
+
+    if (argc < 3) {
+        usage(argv[0]);
+        return 1;
+    }
+    cmd = argv[1];
+    store_path = argv[2];
+    argv[2] = argv[0];
+
+    if (!strcmp(cmd, "ingest"))
+        return cmd_ingest(store_path, argc - 2, argv + 2);
+    if (!strcmp(cmd, "query"))
+        return cmd_query(store_path, argc - 2, argv + 2);
+    if (!strcmp(cmd, "dump"))
+        return cmd_dump(store_path, argc - 2, argv + 2);
+    if (!strcmp(cmd, "info"))
+        return cmd_info(store_path);
+    usage(argv[0]);
+    return 1;
+}